@@ -440,7 +440,8 @@ int WINAPI WinMain(HINSTANCE hInstance,	HINSTANCE hPrevInstance, LPSTR lpCmdLine
 			}
 		}
 
-		if (wiiuse_poll(wiimotes, MAX_WIIMOTES)) {
+		/* wait a little for the wiimotes instead of spinning, SDL events are checked again after */
+		if (wiiuse_poll_wait(wiimotes, MAX_WIIMOTES, 10)) {
 			/*
 			 *	This happens if something happened on any wiimote.
 			 *	So go through each one and check if anything happened.
@@ -512,9 +512,13 @@ int main(int argc, char** argv) {
 	 *
 	 *	This function will set the event flag for each wiimote
 	 *	when the wiimote has things to report.
+	 *
+	 *	wiiuse_poll_wait() does the same but sleeps until there
+	 *	is something to report (-1 means no time limit), so the
+	 *	loop does not spin while the wiimotes are quiet.
 	 */
 	while (any_wiimote_connected(wiimotes, MAX_WIIMOTES)) {
-		if (wiiuse_poll(wiimotes, MAX_WIIMOTES)) {
+		if (wiiuse_poll_wait(wiimotes, MAX_WIIMOTES, -1)) {
 			/*
 			 *	This happens if something happened on any wiimote.
 			 *	So go through each one and check if anything happened.
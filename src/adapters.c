@@ -0,0 +1,443 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Placement of wiimotes on local Bluetooth adapters.
+ *
+ *	A Bluetooth controller holds at most 7 active links and
+ *	shares its air time between them. With several adapters
+ *	the platform code asks adapter_place() which one a new
+ *	connection should go through. Nothing here talks to the
+ *	Bluetooth stack, so the policy can be tested on its own.
+ *
+ *	The contexts of a poller's shards use the adapter list of
+ *	the context they were cloned from, so a placement sees the
+ *	links of every worker. Each context keeps the links of its
+ *	own wiimotes in own[], and adds the difference to the shared
+ *	list under a spinlock whenever it recounts. The lock is held
+ *	for a few loads and stores, never across a system call.
+ */
+
+#include "adapters.h"
+
+#include <string.h> /* for memcpy, strncpy */
+
+/**
+ *	@brief Pick the adapter for a new connection.
+ *
+ *	@param adapter		The local adapters, with their current links.
+ *	@param count		Number of entries in \a adapter.
+ *	@param placement	The placement policy.
+ *	@param cursor		[in/out] Where round-robin resumes, kept between calls.
+ *
+ *	@return Index into \a adapter, or -1 if every adapter is full.
+ *
+ *	Round-robin takes the next adapter with a free link after the
+ *	one used last. Least-loaded takes the adapter with the fewest
+ *	links, ties going round-robin so equal radios share the load.
+ */
+int adapter_place(const struct wiiuse_adapter_t *adapter, int count, enum wiiuse_placement_t placement, int *cursor)
+{
+    int best = -1;
+    int i, n;
+
+    if (!adapter || (count <= 0))
+    {
+        return -1;
+    }
+
+    for (n = 0; n < count; ++n)
+    {
+        i = (*cursor + n) % count;
+
+        if (adapter[i].links >= WIIUSE_ADAPTER_MAX_LINKS)
+        {
+            continue;
+        }
+
+        if (placement == WIIUSE_PLACE_ROUND_ROBIN)
+        {
+            best = i;
+            break;
+        }
+
+        if ((best < 0) || (adapter[i].links < adapter[best].links))
+        {
+            best = i;
+        }
+    }
+
+    if (best >= 0)
+    {
+        *cursor = (best + 1) % count;
+    }
+
+    return best;
+}
+
+/**
+ *	@brief Count the connected wiimotes bound to each adapter.
+ *
+ *	@param adapter		The local adapters.
+ *	@param count		Number of entries in \a adapter.
+ *	@param wm			An array of pointers to wiimote_t structures.
+ *	@param wiimotes		The number of wiimote_t structures in the \a wm array.
+ */
+void adapter_count_links(struct wiiuse_adapter_t *adapter, int count, struct wiimote_t **wm, int wiimotes)
+{
+    int i, a;
+
+    for (a = 0; a < count; ++a)
+    {
+        adapter[a].links = 0;
+    }
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        if (!WIIMOTE_IS_CONNECTED(wm[i]) || (wm[i]->adapter < 0))
+        {
+            continue;
+        }
+
+        for (a = 0; a < count; ++a)
+        {
+            if (adapter[a].id == wm[i]->adapter)
+            {
+                ++adapter[a].links;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ *	@brief Add a local adapter to the list of a context.
+ *
+ *	@param ctx		The context.
+ *	@param id		Platform id of the adapter (the HCI device id on BlueZ).
+ *	@param addr		Readable address of the adapter.
+ *
+ *	@return 1 if added, 0 if the list is full.
+ */
+int adapter_add(struct wiiuse_context_t *ctx, int id, const char *addr)
+{
+    struct wiiuse_adapter_t *ad;
+
+    if (ctx->adapters >= WIIUSE_MAX_ADAPTERS)
+    {
+        return 0;
+    }
+
+    ad        = &ctx->adapter[ctx->adapters++];
+    ad->id    = id;
+    ad->links = 0;
+    strncpy(ad->addr, addr, sizeof(ad->addr) - 1);
+    ad->addr[sizeof(ad->addr) - 1] = '\0';
+
+    return 1;
+}
+
+/**
+ *	@brief The context whose adapter list \a ctx uses.
+ */
+struct wiiuse_context_t *adapter_table(struct wiiuse_context_t *ctx)
+{
+    return ctx->adapter_owner ? ctx->adapter_owner : ctx;
+}
+
+/**
+ *	@brief Take the lock of an adapter list.
+ *
+ *	@param table	The context from adapter_table().
+ */
+void adapter_lock(struct wiiuse_context_t *table)
+{
+    while (WIIUSE_EXCHANGE_ACQUIRE(&table->adapter_lock, 1))
+    {
+        /* only ever held for a few loads and stores */
+    }
+}
+
+/**
+ *	@brief Release the lock of an adapter list.
+ *
+ *	@param table	The context from adapter_table().
+ */
+void adapter_unlock(struct wiiuse_context_t *table) { WIIUSE_STORE_RELEASE(&table->adapter_lock, 0); }
+
+static struct wiiuse_adapter_t *adapter_by_id(struct wiiuse_adapter_t *adapter, int count, int id)
+{
+    int a;
+
+    for (a = 0; a < count; ++a)
+    {
+        if (adapter[a].id == id)
+        {
+            return &adapter[a];
+        }
+    }
+
+    return NULL;
+}
+
+/* entry of a link count list for an adapter, added if there is room */
+static struct wiiuse_adapter_t *adapter_entry(struct wiiuse_adapter_t *own, int *owns, int id)
+{
+    struct wiiuse_adapter_t *e = adapter_by_id(own, *owns, id);
+
+    if (!e && (*owns < WIIUSE_MAX_ADAPTERS))
+    {
+        e        = &own[(*owns)++];
+        e->id    = id;
+        e->links = 0;
+    }
+
+    return e;
+}
+
+/* one more link of a context on a shared adapter, lock held */
+static void adapter_link(struct wiiuse_context_t *ctx, struct wiiuse_adapter_t *a)
+{
+    struct wiiuse_adapter_t *e = adapter_entry(ctx->own, &ctx->owns, a->id);
+
+    ++a->links;
+    if (e)
+    {
+        ++e->links;
+    }
+}
+
+/* add (sign 1) or take back (sign -1) the links of a context, lock held */
+static void adapter_apply(struct wiiuse_context_t *table, const struct wiiuse_context_t *ctx, int sign)
+{
+    struct wiiuse_adapter_t *a;
+    int i;
+
+    for (i = 0; i < ctx->owns; ++i)
+    {
+        a = adapter_by_id(table->adapter, table->adapters, ctx->own[i].id);
+        if (a)
+        {
+            a->links += sign * ctx->own[i].links;
+        }
+    }
+}
+
+/**
+ *	@brief Replace the adapter list of a context.
+ *
+ *	@param ctx		The context.
+ *	@param found	The adapters that are up now, their links are ignored.
+ *	@param count	Number of entries in \a found.
+ *
+ *	Adapters that were already known keep their links.
+ */
+void adapter_update(struct wiiuse_context_t *ctx, const struct wiiuse_adapter_t *found, int count)
+{
+    struct wiiuse_context_t *table = adapter_table(ctx);
+    struct wiiuse_adapter_t old[WIIUSE_MAX_ADAPTERS];
+    struct wiiuse_adapter_t *was;
+    int olds, a;
+
+    adapter_lock(table);
+
+    olds = table->adapters;
+    memcpy(old, table->adapter, olds * sizeof(struct wiiuse_adapter_t));
+
+    for (a = 0; (a < count) && (a < WIIUSE_MAX_ADAPTERS); ++a)
+    {
+        was                     = adapter_by_id(old, olds, found[a].id);
+        table->adapter[a]       = found[a];
+        table->adapter[a].links = was ? was->links : 0;
+    }
+    table->adapters = a;
+
+    adapter_unlock(table);
+}
+
+/**
+ *	@brief Recount the links of the wiimotes of a context.
+ *
+ *	@param ctx			The context of the wiimotes.
+ *	@param wm			An array of pointers to wiimote_t structures.
+ *	@param wiimotes		The number of wiimote_t structures in the \a wm array.
+ *
+ *	A wiimote holds its link from adapter_claim() or adapter_bind()
+ *	until the platform closes it and sets wm->adapter to -1, even
+ *	once it stopped answering. Only the difference to the last
+ *	count of \a ctx goes into the shared list, the links of other
+ *	contexts stay.
+ */
+void adapter_sync_links(struct wiiuse_context_t *ctx, struct wiimote_t **wm, int wiimotes)
+{
+    struct wiiuse_context_t *table = adapter_table(ctx);
+    struct wiiuse_adapter_t own[WIIUSE_MAX_ADAPTERS];
+    struct wiiuse_adapter_t *e;
+    int owns = 0;
+    int i;
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        e = (wm[i]->adapter >= 0) ? adapter_entry(own, &owns, wm[i]->adapter) : NULL;
+        if (e)
+        {
+            ++e->links;
+        }
+    }
+
+    adapter_lock(table);
+
+    adapter_apply(table, ctx, -1);
+    memcpy(ctx->own, own, owns * sizeof(struct wiiuse_adapter_t));
+    ctx->owns = owns;
+    adapter_apply(table, ctx, 1);
+
+    adapter_unlock(table);
+}
+
+/**
+ *	@brief Pick an adapter for a new connection and count it as used.
+ *
+ *	@param ctx		The context of the wiimote to connect.
+ *	@param out		[out] Copy of the adapter picked.
+ *
+ *	@return 1 if an adapter was picked, 0 if no adapter is known
+ *			and the platform routes the connection, -1 if all
+ *			adapters are full.
+ *
+ *	The link is counted until adapter_release() or the next
+ *	adapter_sync_links() of \a ctx.
+ */
+int adapter_claim(struct wiiuse_context_t *ctx, struct wiiuse_adapter_t *out)
+{
+    struct wiiuse_context_t *table = adapter_table(ctx);
+    int a;
+
+    adapter_lock(table);
+
+    if (!table->adapters)
+    {
+        adapter_unlock(table);
+        return 0;
+    }
+
+    a = adapter_place(table->adapter, table->adapters, table->placement, &table->place_cursor);
+    if (a < 0)
+    {
+        adapter_unlock(table);
+        return -1;
+    }
+
+    adapter_link(ctx, &table->adapter[a]);
+    *out = table->adapter[a];
+
+    adapter_unlock(table);
+    return 1;
+}
+
+/**
+ *	@brief Count a link that came up on a known adapter.
+ *
+ *	@param ctx		The context of the wiimote.
+ *	@param id		Platform id of the adapter.
+ *
+ *	For links the wiimote opened, given back like a claimed one.
+ */
+void adapter_bind(struct wiiuse_context_t *ctx, int id)
+{
+    struct wiiuse_context_t *table = adapter_table(ctx);
+    struct wiiuse_adapter_t *a;
+
+    adapter_lock(table);
+
+    a = adapter_by_id(table->adapter, table->adapters, id);
+    if (a)
+    {
+        adapter_link(ctx, a);
+    }
+
+    adapter_unlock(table);
+}
+
+/**
+ *	@brief Give back a link taken with adapter_claim().
+ *
+ *	@param ctx		The context that claimed it.
+ *	@param id		Platform id of the adapter.
+ */
+void adapter_release(struct wiiuse_context_t *ctx, int id)
+{
+    struct wiiuse_context_t *table = adapter_table(ctx);
+    struct wiiuse_adapter_t *a;
+
+    adapter_lock(table);
+
+    a = adapter_by_id(ctx->own, ctx->owns, id);
+    if (a && (a->links > 0))
+    {
+        --a->links;
+
+        a = adapter_by_id(table->adapter, table->adapters, id);
+        if (a)
+        {
+            --a->links;
+        }
+    }
+
+    adapter_unlock(table);
+}
+
+/**
+ *	@brief Move the link of a wiimote to another context.
+ *
+ *	@param from		The context giving up the wiimote.
+ *	@param to		The context taking it, with the same adapter list.
+ *	@param wm		The wiimote.
+ *
+ *	The shared counts do not change.
+ */
+void adapter_move(struct wiiuse_context_t *from, struct wiiuse_context_t *to, struct wiimote_t *wm)
+{
+    struct wiiuse_context_t *table = adapter_table(to);
+    struct wiiuse_adapter_t *e;
+
+    if (wm->adapter < 0)
+    {
+        return;
+    }
+
+    adapter_lock(table);
+
+    e = adapter_by_id(from->own, from->owns, wm->adapter);
+    if (e && (e->links > 0))
+    {
+        --e->links;
+        e = adapter_entry(to->own, &to->owns, wm->adapter);
+        if (e)
+        {
+            ++e->links;
+        }
+    }
+
+    adapter_unlock(table);
+}
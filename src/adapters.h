@@ -0,0 +1,58 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Placement of wiimotes on local Bluetooth adapters.
+ */
+
+#ifndef ADAPTERS_H_INCLUDED
+#define ADAPTERS_H_INCLUDED
+
+#include "wiiuse_internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @defgroup internal_adapters Internal: Adapter Placement */
+/** @{ */
+int adapter_place(const struct wiiuse_adapter_t *adapter, int count, enum wiiuse_placement_t placement, int *cursor);
+void adapter_count_links(struct wiiuse_adapter_t *adapter, int count, struct wiimote_t **wm, int wiimotes);
+int adapter_add(struct wiiuse_context_t *ctx, int id, const char *addr);
+
+struct wiiuse_context_t *adapter_table(struct wiiuse_context_t *ctx);
+void adapter_lock(struct wiiuse_context_t *table);
+void adapter_unlock(struct wiiuse_context_t *table);
+void adapter_update(struct wiiuse_context_t *ctx, const struct wiiuse_adapter_t *found, int count);
+void adapter_sync_links(struct wiiuse_context_t *ctx, struct wiimote_t **wm, int wiimotes);
+int adapter_claim(struct wiiuse_context_t *ctx, struct wiiuse_adapter_t *out);
+void adapter_bind(struct wiiuse_context_t *ctx, int id);
+void adapter_release(struct wiiuse_context_t *ctx, int id);
+void adapter_move(struct wiiuse_context_t *from, struct wiiuse_context_t *to, struct wiimote_t *wm);
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ADAPTERS_H_INCLUDED */
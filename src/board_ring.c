@@ -0,0 +1,212 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Ring buffer of balance board samples.
+ *
+ *	Every decoded balance board report is pushed with its
+ *	timestamp into a per-board ring, so that a consumer can
+ *	pull complete runs of samples at its own pace. The thread
+ *	calling wiiuse_poll() is the only producer and one other
+ *	thread may be the only consumer; neither takes a lock.
+ */
+
+#include "wiiboard.h"
+
+#include <string.h> /* for memset */
+
+/**
+ *	@brief Single producer, single consumer ring.
+ *
+ *	head and tail count samples written and read since the ring
+ *	was created and only ever grow; the slot of a sample is its
+ *	count masked by the power of two capacity.
+ */
+struct wii_board_ring_t
+{
+    unsigned long head;     /* written by the producer	*/
+    unsigned long seq;      /* reports pushed, including overruns	*/
+    unsigned long overruns; /* reports dropped because the ring was full	*/
+    byte pad[WIIUSE_CACHE_LINE];
+
+    unsigned long tail; /* written by the consumer	*/
+    byte pad2[WIIUSE_CACHE_LINE];
+
+    unsigned long mask;
+    struct wii_board_sample_t *sample;
+};
+
+/**
+ *	@brief Enable, resize or disable the sample ring of a balance board.
+ *
+ *	@param wm			Pointer to a wiimote_t structure.
+ *	@param capacity		Number of samples the ring can hold, rounded up
+ *						to a power of two, or 0 to free the ring.
+ *
+ *	@return 1 on success, 0 if the memory could not be allocated.
+ *
+ *	Once enabled, every report of a connected balance board is
+ *	kept until wiiuse_read_wii_board_ring() fetches it. Samples
+ *	already in the ring are lost when it is resized; do not
+ *	resize while another thread is reading it.
+ */
+int wiiuse_set_wii_board_ring(struct wiimote_t *wm, int capacity)
+{
+    struct wii_board_ring_t *ring;
+    unsigned long size = 1;
+
+    if (!wm)
+    {
+        return 0;
+    }
+
+    if (wm->board_ring)
+    {
+        wiiuse_ctx_free(wm->ctx, wm->board_ring->sample);
+        wiiuse_ctx_free(wm->ctx, wm->board_ring);
+        wm->board_ring = NULL;
+    }
+
+    if (capacity <= 0)
+    {
+        return 1;
+    }
+
+    while (size < (unsigned long)capacity)
+    {
+        size <<= 1;
+    }
+
+    ring = (struct wii_board_ring_t *)wiiuse_ctx_malloc(wm->ctx, sizeof(struct wii_board_ring_t));
+    if (!ring)
+    {
+        return 0;
+    }
+    memset(ring, 0, sizeof(struct wii_board_ring_t));
+
+    ring->sample = (struct wii_board_sample_t *)wiiuse_ctx_malloc(wm->ctx, size * sizeof(struct wii_board_sample_t));
+    if (!ring->sample)
+    {
+        wiiuse_ctx_free(wm->ctx, ring);
+        return 0;
+    }
+    ring->mask = size - 1;
+
+    wm->board_ring = ring;
+
+    WIIUSE_CTX_DEBUG(wm->ctx, "Balance board ring enabled for wiimote id %i (%lu samples).", wm->unid, size);
+    return 1;
+}
+
+/**
+ *	@brief Fetch the oldest samples from the ring of a balance board.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param out		[out] Caller allocated array of \a max samples.
+ *	@param max		Maximum number of samples to fetch.
+ *
+ *	@return Number of samples copied to \a out, oldest first.
+ *
+ *	May be called from a thread other than the one polling the
+ *	board. A gap in wii_board_sample_t::seq between two samples
+ *	means reports were dropped there because the ring was full.
+ */
+int wiiuse_read_wii_board_ring(struct wiimote_t *wm, struct wii_board_sample_t *out, int max)
+{
+    struct wii_board_ring_t *ring;
+    unsigned long head, tail;
+    int n = 0;
+
+    if (!wm || !wm->board_ring || !out || max <= 0)
+    {
+        return 0;
+    }
+    ring = wm->board_ring;
+
+    head = WIIUSE_LOAD_ACQUIRE(&ring->head);
+    tail = ring->tail;
+
+    while (tail != head && n < max)
+    {
+        out[n++] = ring->sample[tail & ring->mask];
+        ++tail;
+    }
+
+    /* hand the slots back to the producer */
+    WIIUSE_STORE_RELEASE(&ring->tail, tail);
+
+    return n;
+}
+
+/**
+ *	@brief Number of balance board reports dropped because the ring was full.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ */
+unsigned long wiiuse_wii_board_ring_overruns(struct wiimote_t *wm)
+{
+    if (!wm || !wm->board_ring)
+    {
+        return 0;
+    }
+
+    return WIIUSE_LOAD_ACQUIRE(&wm->board_ring->overruns);
+}
+
+/**
+ *	@brief Push the current balance board state into its ring.
+ *
+ *	@param ring		The ring of the board.
+ *	@param wb		The board, right after wii_board_event().
+ *	@param ts		Time of the report, in milliseconds.
+ *
+ *	When the ring is full the new sample is dropped, so the
+ *	samples the consumer has not read yet stay intact.
+ */
+void wii_board_ring_push(struct wii_board_ring_t *ring, const struct wii_board_t *wb, unsigned long ts)
+{
+    struct wii_board_sample_t *s;
+    unsigned long head = ring->head;
+    unsigned long seq  = ring->seq++;
+
+    if (head - WIIUSE_LOAD_ACQUIRE(&ring->tail) > ring->mask)
+    {
+        WIIUSE_STORE_RELEASE(&ring->overruns, ring->overruns + 1);
+        return;
+    }
+
+    s            = &ring->sample[head & ring->mask];
+    s->seq       = seq;
+    s->timestamp = ts;
+    s->tl        = wb->tl;
+    s->tr        = wb->tr;
+    s->bl        = wb->bl;
+    s->br        = wb->br;
+    s->rtl       = wb->rtl;
+    s->rtr       = wb->rtr;
+    s->rbl       = wb->rbl;
+    s->rbr       = wb->rbr;
+
+    /* publish the sample */
+    WIIUSE_STORE_RELEASE(&ring->head, head + 1);
+}
@@ -74,9 +74,9 @@ int classic_ctrl_handshake(struct wiimote_t *wm, struct classic_ctrl_t *cc, byte
         if (len < 17 || len < HANDSHAKE_BYTES_USED + 16 || data[16] == 0xFF)
         {
             /* get the calibration data */
-            byte *handshake_buf = (byte *)malloc(EXP_HANDSHAKE_LEN * sizeof(byte));
+            byte *handshake_buf = (byte *)wiiuse_ctx_malloc(wm->ctx, EXP_HANDSHAKE_LEN * sizeof(byte));
 
-            WIIUSE_DEBUG("Classic controller handshake appears invalid, trying again.");
+            WIIUSE_CTX_DEBUG(wm->ctx, "Classic controller handshake appears invalid, trying again.");
             wiiuse_read_data_cb(wm, handshake_expansion, handshake_buf, WM_EXP_MEM_CALIBR, EXP_HANDSHAKE_LEN);
 
             return 0;
@@ -152,6 +152,62 @@ void classic_ctrl_event(struct classic_ctrl_t *cc, byte *msg)
     calc_joystick_state(&cc->rjs, (float)rx, (float)ry);
 }
 
+/**
+ *	@brief Handle classic controller data passed through a Motion Plus.
+ *
+ *	@param cc		A pointer to a classic_ctrl_t structure.
+ *	@param msg		The expansion frame of the event packet.
+ *
+ *	In pass-through mode the lowest bit of both left stick axes is
+ *	replaced by the d-pad up and left buttons, and byte 4 bit 0 flags
+ *	an attached extension. The frame is re-encoded in the regular
+ *	layout and handled by classic_ctrl_event().
+ */
+void classic_ctrl_passthrough_event(struct classic_ctrl_t *cc, byte *msg)
+{
+    byte frame[6];
+
+    frame[0] = msg[0] & 0xFE;
+    frame[1] = msg[1] & 0xFE;
+    frame[2] = msg[2];
+    frame[3] = msg[3];
+    frame[4] = msg[4];
+    frame[5] = (msg[5] & 0xFC) | ((msg[1] & 0x01) << 1) | (msg[0] & 0x01);
+
+    classic_ctrl_event(cc, frame);
+}
+
+/**
+ *	@brief Set nominal joystick calibration for pass-through mode.
+ *
+ *	@param cc		A pointer to a classic_ctrl_t structure.
+ *
+ *	The Motion Plus hides the classic controller calibration data,
+ *	so the full range of each axis is assumed.
+ */
+void classic_ctrl_passthrough_calibration(struct classic_ctrl_t *cc)
+{
+    cc->btns          = 0;
+    cc->btns_held     = 0;
+    cc->btns_released = 0;
+    cc->r_shoulder    = 0;
+    cc->l_shoulder    = 0;
+
+    cc->ljs.max.x    = 63;
+    cc->ljs.min.x    = 0;
+    cc->ljs.center.x = 32;
+    cc->ljs.max.y    = 63;
+    cc->ljs.min.y    = 0;
+    cc->ljs.center.y = 32;
+
+    cc->rjs.max.x    = 31;
+    cc->rjs.min.x    = 0;
+    cc->rjs.center.x = 16;
+    cc->rjs.max.y    = 31;
+    cc->rjs.min.y    = 0;
+    cc->rjs.center.y = 16;
+}
+
 /**
  *	@brief Find what buttons are pressed.
  *
@@ -47,6 +47,10 @@ int classic_ctrl_handshake(struct wiimote_t *wm, struct classic_ctrl_t *cc, byte
 void classic_ctrl_disconnected(struct classic_ctrl_t *cc);
 
 void classic_ctrl_event(struct classic_ctrl_t *cc, byte *msg);
+
+void classic_ctrl_passthrough_event(struct classic_ctrl_t *cc, byte *msg);
+
+void classic_ctrl_passthrough_calibration(struct classic_ctrl_t *cc);
 /** @} */
 
 #ifdef __cplusplus
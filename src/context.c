@@ -0,0 +1,260 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Library contexts.
+ *
+ *	A context owns everything that used to be process wide:
+ *	log targets, the allocator, statistics and the scratch
+ *	data of wiiuse_update(). Wiimote arrays created from
+ *	different contexts share no mutable state, so each can
+ *	be driven from its own thread.
+ *
+ *	The classic API (wiiuse_init(), wiiuse_set_output(), ...)
+ *	works on a built-in default context.
+ */
+
+#include "loop.h"  /* for loop_destroy */
+#include "uring.h" /* for uring_destroy */
+#include "wiiuse_internal.h"
+
+#include <stdio.h>  /* for FILE, printf */
+#include <stdlib.h> /* for malloc, free */
+#include <string.h> /* for memset */
+
+#if defined(_MSC_VER)
+#define WIIUSE_THREAD_LOCAL __declspec(thread)
+#else
+#define WIIUSE_THREAD_LOCAL __thread
+#endif
+
+/* used by the classic API, and by threads that did not pick a context */
+static struct wiiuse_context_t g_default_context;
+
+/* context whose log targets the calling thread writes to */
+static WIIUSE_THREAD_LOCAL struct wiiuse_context_t *g_current_context = NULL;
+
+/**
+ *	@brief The context behind the classic API.
+ */
+struct wiiuse_context_t *wiiuse_default_context() { return &g_default_context; }
+
+/**
+ *	@brief Output FILE stream of a context for a log level.
+ *
+ *	@param ctx		The context, or NULL for the one of the calling thread.
+ *	@param level	A wiiuse_loglevel.
+ *
+ *	Used by the WIIUSE_CTX_ERROR(), WIIUSE_ERROR(), ... macros.
+ */
+FILE *wiiuse_log_target(struct wiiuse_context_t *ctx, int level)
+{
+    if (!ctx)
+    {
+        ctx = g_current_context ? g_current_context : &g_default_context;
+    }
+
+    return ctx->logtarget[level];
+}
+
+/**
+ *	@brief Allocate memory with the allocator of a context.
+ *
+ *	@param ctx		The context, or NULL for the default one.
+ *	@param size		Number of bytes.
+ */
+void *wiiuse_ctx_malloc(struct wiiuse_context_t *ctx, size_t size)
+{
+    if (!ctx)
+    {
+        ctx = &g_default_context;
+    }
+
+    return ctx->malloc_cb ? ctx->malloc_cb(size) : malloc(size);
+}
+
+/**
+ *	@brief Release memory from wiiuse_ctx_malloc().
+ *
+ *	@param ctx		The context the memory was allocated with.
+ *	@param ptr		The memory, may be NULL.
+ */
+void wiiuse_ctx_free(struct wiiuse_context_t *ctx, void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    if (!ctx)
+    {
+        ctx = &g_default_context;
+    }
+
+    if (ctx->free_cb)
+    {
+        ctx->free_cb(ptr);
+    } else
+    {
+        free(ptr);
+    }
+}
+
+/**
+ *	@brief Create a library context.
+ *
+ *	@return The new context, or NULL if out of memory.
+ *
+ *	All log levels of a new context go to stderr.
+ *
+ *	@see wiiuse_context_init()
+ */
+struct wiiuse_context_t *wiiuse_context_create()
+{
+    struct wiiuse_context_t *ctx = (struct wiiuse_context_t *)malloc(sizeof(struct wiiuse_context_t));
+
+    if (!ctx)
+    {
+        return NULL;
+    }
+    memset(ctx, 0, sizeof(struct wiiuse_context_t));
+
+    ctx->logtarget[0] = stderr;
+    ctx->logtarget[1] = stderr;
+    ctx->logtarget[2] = stderr;
+    ctx->logtarget[3] = stderr;
+
+    return ctx;
+}
+
+/**
+ *	@brief Destroy a library context.
+ *
+ *	@param ctx		The context from wiiuse_context_create().
+ *
+ *	The wiimotes of the context must be released with
+ *	wiiuse_cleanup() first.
+ */
+void wiiuse_context_destroy(struct wiiuse_context_t *ctx)
+{
+    if (!ctx || (ctx == &g_default_context))
+    {
+        return;
+    }
+
+    if (g_current_context == ctx)
+    {
+        g_current_context = NULL;
+    }
+
+    wiiuse_set_background_discovery(ctx, 0);
+    wiiuse_set_accept_incoming(ctx, 0);
+    loop_destroy(ctx);
+#ifdef WIIUSE_IO_URING
+    uring_destroy(ctx);
+#endif
+    free(ctx);
+}
+
+/**
+ *	@brief Specify an alternate FILE stream for a log level of a context.
+ *
+ *	@param ctx		The context, or NULL for the default one.
+ *	@param loglevel The loglevel, for which the output should be set.
+ *	@param logfile	A valid, writeable <code>FILE*</code>, or 0, if output should be disabled.
+ */
+void wiiuse_context_set_output(struct wiiuse_context_t *ctx, enum wiiuse_loglevel loglevel, FILE *logfile)
+{
+    if (!ctx)
+    {
+        ctx = &g_default_context;
+    }
+
+    ctx->logtarget[(int)loglevel] = logfile;
+}
+
+/**
+ *	@brief Use a custom allocator for the wiimotes of a context.
+ *
+ *	@param ctx			The context, or NULL for the default one.
+ *	@param malloc_cb	Allocation function, NULL for malloc().
+ *	@param free_cb		Matching release function, NULL for free().
+ *
+ *	Covers the wiimote array, the wiimotes, their pending requests,
+ *	sample stores and rings. Must be set before wiiuse_context_init().
+ */
+void wiiuse_context_set_allocator(struct wiiuse_context_t *ctx, wiiuse_malloc_cb malloc_cb, wiiuse_free_cb free_cb)
+{
+    if (!ctx)
+    {
+        ctx = &g_default_context;
+    }
+
+    ctx->malloc_cb = malloc_cb;
+    ctx->free_cb   = free_cb;
+}
+
+/**
+ *	@brief Choose how new connections are spread over local Bluetooth adapters.
+ *
+ *	@param ctx			The context, or NULL for the default one.
+ *	@param placement	The placement policy, round-robin by default.
+ *
+ *	Only has an effect on platforms that can pick the adapter
+ *	of a connection (BlueZ).
+ */
+void wiiuse_context_set_placement(struct wiiuse_context_t *ctx, enum wiiuse_placement_t placement)
+{
+    if (!ctx)
+    {
+        ctx = &g_default_context;
+    }
+
+    ctx->placement = placement;
+}
+
+/**
+ *	@brief Send the log output of the calling thread to a context.
+ *
+ *	@param ctx		The context, or NULL to go back to the default one.
+ *
+ *	Worker threads that drive the wiimotes of their own context
+ *	should call this once before they start.
+ */
+void wiiuse_context_make_current(struct wiiuse_context_t *ctx) { g_current_context = ctx; }
+
+/**
+ *	@brief Read the statistics of a context.
+ *
+ *	@param ctx		The context, or NULL for the default one.
+ *	@param stats	[out] The statistics.
+ */
+void wiiuse_context_get_stats(struct wiiuse_context_t *ctx, struct wiiuse_stats_t *stats)
+{
+    if (!stats)
+    {
+        return;
+    }
+
+    *stats = ctx ? ctx->stats : g_default_context.stats;
+}
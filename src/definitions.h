@@ -44,62 +44,64 @@
 
 /* #define WITH_WIIUSE_DEBUG */
 
-extern FILE *logtarget[];
+/* defined in context.c, a NULL context is the one of the calling thread */
+struct wiiuse_context_t;
+FILE *wiiuse_log_target(struct wiiuse_context_t *ctx, int level);
 
-#define OUTF_ERROR logtarget[0]
-#define OUTF_WARNING logtarget[1]
-#define OUTF_INFO logtarget[2]
-#define OUTF_DEBUG logtarget[3]
+#define OUTF_ERROR wiiuse_log_target(NULL, 0)
+#define OUTF_WARNING wiiuse_log_target(NULL, 1)
+#define OUTF_INFO wiiuse_log_target(NULL, 2)
+#define OUTF_DEBUG wiiuse_log_target(NULL, 3)
 
-/* Error output macros */
-#define WIIUSE_ERROR(fmt, ...)                                       \
-    do                                                               \
-    {                                                                \
-        if (OUTF_ERROR)                                              \
-            fprintf(OUTF_ERROR, "[ERROR] " fmt "\n", ##__VA_ARGS__); \
+/* Output to the log targets of a context, NULL for the one of the calling thread */
+#define WIIUSE_LOG_CTX(ctx, level, prefix, fmt, ...)                          \
+    do                                                                        \
+    {                                                                         \
+        FILE *___out = wiiuse_log_target((ctx), (level));                     \
+        if (___out)                                                           \
+            fprintf(___out, "[" prefix "] " fmt "\n", ##__VA_ARGS__);         \
     } while (0)
 
+/* Error output macros */
+#define WIIUSE_CTX_ERROR(ctx, fmt, ...) WIIUSE_LOG_CTX(ctx, 0, "ERROR", fmt, ##__VA_ARGS__)
+#define WIIUSE_ERROR(fmt, ...) WIIUSE_CTX_ERROR(NULL, fmt, ##__VA_ARGS__)
+
 /* Warning output macros */
-#define WIIUSE_WARNING(fmt, ...)                                         \
-    do                                                                   \
-    {                                                                    \
-        if (OUTF_WARNING)                                                \
-            fprintf(OUTF_WARNING, "[WARNING] " fmt "\n", ##__VA_ARGS__); \
-    } while (0)
+#define WIIUSE_CTX_WARNING(ctx, fmt, ...) WIIUSE_LOG_CTX(ctx, 1, "WARNING", fmt, ##__VA_ARGS__)
+#define WIIUSE_WARNING(fmt, ...) WIIUSE_CTX_WARNING(NULL, fmt, ##__VA_ARGS__)
 
 /* Information output macros */
-#define WIIUSE_INFO(fmt, ...)                                      \
-    do                                                             \
-    {                                                              \
-        if (OUTF_INFO)                                             \
-            fprintf(OUTF_INFO, "[INFO] " fmt "\n", ##__VA_ARGS__); \
-    } while (0)
+#define WIIUSE_CTX_INFO(ctx, fmt, ...) WIIUSE_LOG_CTX(ctx, 2, "INFO", fmt, ##__VA_ARGS__)
+#define WIIUSE_INFO(fmt, ...) WIIUSE_CTX_INFO(NULL, fmt, ##__VA_ARGS__)
 
 #ifdef WITH_WIIUSE_DEBUG
 #ifdef WIIUSE_WIN32
-#define WIIUSE_DEBUG(fmt, ...)                                                                      \
+#define WIIUSE_CTX_DEBUG(ctx, fmt, ...)                                                             \
     do                                                                                              \
     {                                                                                               \
-        if (OUTF_DEBUG)                                                                             \
+        FILE *___out = wiiuse_log_target((ctx), 3);                                                 \
+        if (___out)                                                                                 \
         {                                                                                           \
             char *___filename = __FILE__;                                                           \
             int ___i      = strlen(___filename) - 1;                                                \
             for (; ___i && (___filename[___i] != '\\'); --___i)                                     \
                 ;                                                                                   \
-            fprintf(OUTF_DEBUG, "[DEBUG] %s:%i: " fmt "\n", ___filename + ___i + 1, __LINE__, ##__VA_ARGS__); \
+            fprintf(___out, "[DEBUG] %s:%i: " fmt "\n", ___filename + ___i + 1, __LINE__, ##__VA_ARGS__); \
         }                                                                                           \
     } while (0)
 #else
-#define WIIUSE_DEBUG(fmt, ...)                                                                  \
+#define WIIUSE_CTX_DEBUG(ctx, fmt, ...)                                                         \
     do                                                                                          \
     {                                                                                           \
-        if (OUTF_DEBUG)                                                                         \
-            fprintf(OUTF_DEBUG, "[DEBUG] " __FILE__ ":%i: " fmt "\n", __LINE__, ##__VA_ARGS__); \
+        FILE *___out = wiiuse_log_target((ctx), 3);                                             \
+        if (___out)                                                                             \
+            fprintf(___out, "[DEBUG] " __FILE__ ":%i: " fmt "\n", __LINE__, ##__VA_ARGS__);     \
     } while (0)
 #endif
 #else
-#define WIIUSE_DEBUG(fmt, ...)
+#define WIIUSE_CTX_DEBUG(ctx, fmt, ...)
 #endif
+#define WIIUSE_DEBUG(fmt, ...) WIIUSE_CTX_DEBUG(NULL, fmt, ##__VA_ARGS__)
 
 /* Convert between radians and degrees */
 #define RAD_TO_DEGREE(r) ((r * 180.0f) / WIIMOTE_PI)
@@ -36,9 +36,97 @@
  */
 
 #include "dynamics.h"
+#include "fixed.h"
 
-#include <math.h>   /* for atan2f, atanf, sqrt */
+#include <math.h>   /* for atan2f, atanf, fabsf, sqrt */
 #include <stdlib.h> /* for abs */
+#include <string.h> /* for memcpy */
+
+/* WIIUSE_NO_SIMD builds the portable batch code, to test it on x86 */
+#if defined(WIIUSE_NO_SIMD)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WIIUSE_DYNAMICS_SSE2
+#endif
+
+/*
+ *	Minimax coefficients for atan(t) on [0, 1].
+ *	Absolute error is about 1e-5 rad.
+ */
+#define ATAN_C1 0.99986601f
+#define ATAN_C3 -0.33029950f
+#define ATAN_C5 0.18014100f
+#define ATAN_C7 -0.08513300f
+#define ATAN_C9 0.02083510f
+
+/*
+ *	Full range of each signal given to the One Euro filter, so that
+ *	beta always means cutoff increase per full range per second.
+ *	The accelerometers of the wiimote and nunchuk measure +-3 g,
+ *	joysticks are normalized to -1..1.
+ */
+#define EURO_RANGE_ANGLE 360.0f
+#define EURO_RANGE_GFORCE 6.0f
+#define EURO_RANGE_JOYSTICK 2.0f
+
+/* with fixed-point orientation the scalar atan2 is only needed by the scalar batch code */
+#if !defined(WIIUSE_FIXED_POINT) || !defined(WIIUSE_DYNAMICS_SSE2)
+
+/**
+ *	@brief Polynomial approximation of atan2f(), in degrees.
+ *
+ *	Uses one division instead of the libm call. The result is
+ *	within 0.001 degrees of RAD_TO_DEGREE(atan2f(y, x)).
+ */
+static float approx_atan2_deg(float y, float x)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float t, t2, a;
+
+    if (ax == 0.0f && ay == 0.0f)
+    {
+        return 0.0f;
+    }
+
+    /* reduce to an angle in [0, 45] degrees */
+    t  = (ay > ax) ? (ax / ay) : (ay / ax);
+    t2 = t * t;
+    a  = RAD_TO_DEGREE(t * (ATAN_C1 + t2 * (ATAN_C3 + t2 * (ATAN_C5 + t2 * (ATAN_C7 + t2 * ATAN_C9)))));
+
+    /* and unfold it back into the right octant */
+    if (ay > ax)
+    {
+        a = 90.0f - a;
+    }
+    if (x < 0.0f)
+    {
+        a = 180.0f - a;
+    }
+    if (y < 0.0f)
+    {
+        a = -a;
+    }
+
+    return a;
+}
+
+#endif
+
+/**
+ *	@brief Cache the reciprocal gains of an accelerometer.
+ *
+ *	@param ac			An accelerometer (accel_t) structure.
+ *
+ *	Must be called whenever cal_g changes so the WIIUSE_FAST_ORIENT
+ *	path can multiply instead of divide.
+ */
+void calculate_accel_gains(struct accel_t *ac)
+{
+    ac->cal_g_inv.x = ac->cal_g.x ? 1.0f / (float)ac->cal_g.x : 0.0f;
+    ac->cal_g_inv.y = ac->cal_g.y ? 1.0f / (float)ac->cal_g.y : 0.0f;
+    ac->cal_g_inv.z = ac->cal_g.z ? 1.0f / (float)ac->cal_g.z : 0.0f;
+}
 
 /**
  *	@brief Calculate the roll, pitch, yaw.
@@ -46,16 +134,18 @@
  *	@param ac			An accelerometer (accel_t) structure.
  *	@param accel		[in] Pointer to a vec3b_t structure that holds the raw acceleration data.
  *	@param orient		[out] Pointer to a orient_t structure that will hold the orientation data.
- *	@param rorient		[out] Pointer to a orient_t structure that will hold the non-smoothed
- *orientation data.
- *	@param smooth		If smoothing should be performed on the angles calculated. 1 to enable, 0 to
- *disable.
+ *	@param flags		Option flags of the device. WIIUSE_SMOOTHING smooths the
+ *						angles, WIIUSE_FAST_ORIENT uses the cached reciprocal gains
+ *						and a polynomial atan2 instead of libm.
  *
  *	Given the raw acceleration data from the accelerometer struct, calculate
  *	the orientation of the device and set it in the \a orient parameter.
  */
-void calculate_orientation(struct accel_t *ac, struct vec3b_t *accel, struct orient_t *orient, int smooth)
+void calculate_orientation(struct accel_t *ac, struct vec3b_t *accel, struct orient_t *orient, int flags)
 {
+#ifdef WIIUSE_FIXED_POINT
+    fixed_orientation(ac, accel, orient);
+#else
     float xg, yg, zg;
     float x, y, z;
 
@@ -68,15 +158,23 @@ void calculate_orientation(struct accel_t *ac, struct vec3b_t *accel, struct ori
     /* yaw - set to 0, IR will take care of it if it's enabled */
     orient->yaw = 0.0f;
 
-    /* find out how much it has to move to be 1g */
-    xg = (float)ac->cal_g.x;
-    yg = (float)ac->cal_g.y;
-    zg = (float)ac->cal_g.z;
-
     /* find out how much it actually moved and normalize to +/- 1g */
-    x = ((float)accel->x - (float)ac->cal_zero.x) / xg;
-    y = ((float)accel->y - (float)ac->cal_zero.y) / yg;
-    z = ((float)accel->z - (float)ac->cal_zero.z) / zg;
+    if (flags & WIIUSE_FAST_ORIENT)
+    {
+        x = ((float)accel->x - (float)ac->cal_zero.x) * ac->cal_g_inv.x;
+        y = ((float)accel->y - (float)ac->cal_zero.y) * ac->cal_g_inv.y;
+        z = ((float)accel->z - (float)ac->cal_zero.z) * ac->cal_g_inv.z;
+    } else
+    {
+        /* find out how much it has to move to be 1g */
+        xg = (float)ac->cal_g.x;
+        yg = (float)ac->cal_g.y;
+        zg = (float)ac->cal_g.z;
+
+        x = ((float)accel->x - (float)ac->cal_zero.x) / xg;
+        y = ((float)accel->y - (float)ac->cal_zero.y) / yg;
+        z = ((float)accel->z - (float)ac->cal_zero.z) / zg;
+    }
 
     /* make sure x,y,z are between -1 and 1 for the tan functions */
     if (x < -1.0f)
@@ -109,7 +207,7 @@ void calculate_orientation(struct accel_t *ac, struct vec3b_t *accel, struct ori
     if (abs(accel->x - ac->cal_zero.x) <= ac->cal_g.x)
     {
         /* roll */
-        float roll = RAD_TO_DEGREE(atan2f(x, z));
+        float roll = (flags & WIIUSE_FAST_ORIENT) ? approx_atan2_deg(x, z) : RAD_TO_DEGREE(atan2f(x, z));
 
         orient->roll   = roll;
         orient->a_roll = roll;
@@ -118,14 +216,16 @@ void calculate_orientation(struct accel_t *ac, struct vec3b_t *accel, struct ori
     if (abs(accel->y - ac->cal_zero.y) <= ac->cal_g.y)
     {
         /* pitch */
-        float pitch = RAD_TO_DEGREE(atan2f(y, sqrtf(x * x + z * z)));
+        float r     = sqrtf(x * x + z * z);
+        float pitch = (flags & WIIUSE_FAST_ORIENT) ? approx_atan2_deg(y, r) : RAD_TO_DEGREE(atan2f(y, r));
 
         orient->pitch   = pitch;
         orient->a_pitch = pitch;
     }
+#endif
 
-    /* smooth the angles if enabled */
-    if (smooth)
+    /* smooth the angles if enabled, the One Euro filter runs later on the whole report */
+    if ((flags & WIIUSE_SMOOTHING) && !(flags & WIIUSE_ONE_EURO))
     {
         apply_smoothing(ac, orient, SMOOTH_ROLL);
         apply_smoothing(ac, orient, SMOOTH_PITCH);
@@ -154,6 +254,7 @@ void calculate_gforce(struct accel_t *ac, struct vec3b_t *accel, struct gforce_t
     gforce->z = ((float)accel->z - (float)ac->cal_zero.z) / zg;
 }
 
+#ifndef WIIUSE_FIXED_POINT
 static float applyCalibration(float inval, float minval, float maxval, float centerval)
 {
     float ret;
@@ -170,6 +271,7 @@ static float applyCalibration(float inval, float minval, float maxval, float cen
     }
     return ret;
 }
+#endif
 
 /**
  *	@brief Calculate the angle and magnitude of a joystick.
@@ -180,6 +282,9 @@ static float applyCalibration(float inval, float minval, float maxval, float cen
  */
 void calc_joystick_state(struct joystick_t *js, float x, float y)
 {
+#ifdef WIIUSE_FIXED_POINT
+    fixed_joystick_state(js, (int)x, (int)y);
+#else
     float rx, ry, ang;
 
     /*
@@ -206,6 +311,7 @@ void calc_joystick_state(struct joystick_t *js, float x, float y)
     ang     = RAD_TO_DEGREE(atan2f(ry, rx));
     js->ang = ang + 180.0f;
     js->mag = sqrtf((rx * rx) + (ry * ry));
+#endif
 }
 
 void apply_smoothing(struct accel_t *ac, struct orient_t *orient, int type)
@@ -256,3 +362,497 @@ void apply_smoothing(struct accel_t *ac, struct orient_t *orient, int type)
     }
     }
 }
+
+/**
+ *	@brief Smoothing factor of a first order low-pass filter.
+ *
+ *	@param cutoff		Cutoff frequency in Hz.
+ *	@param dt			Time since the last sample, in seconds.
+ */
+static float euro_alpha(float cutoff, float dt)
+{
+    float tau = 1.0f / (2.0f * WIIMOTE_PI * cutoff);
+
+    return dt / (dt + tau);
+}
+
+/**
+ *	@brief Run one sample through a One Euro filter.
+ *
+ *	@param f			Filter state.
+ *	@param value		New sample.
+ *	@param min_cutoff	Cutoff frequency at rest, in Hz.
+ *	@param beta			How much the cutoff rises per unit of speed of the filtered value.
+ *	@param dt			Time since the last sample, in seconds.
+ *
+ *	@return The filtered value.
+ *
+ *	The cutoff follows the speed of the signal, so slow motion
+ *	is smoothed heavily and fast motion passes with little lag.
+ */
+float one_euro_filter(struct one_euro_t *f, float value, float min_cutoff, float beta, float dt)
+{
+    float dx;
+
+    if (!f->primed || isnan(f->x) || isinf(f->x))
+    {
+        f->x      = value;
+        f->dx     = 0.0f;
+        f->primed = 1;
+        return value;
+    }
+
+    dx    = (value - f->x) / dt;
+    f->dx = f->dx + euro_alpha(WIIUSE_EURO_D_CUTOFF, dt) * (dx - f->dx);
+    f->x  = f->x + euro_alpha(min_cutoff + beta * fabsf(f->dx), dt) * (value - f->x);
+
+    return f->x;
+}
+
+/**
+ *	@brief One Euro filter for an angle in (-180, 180].
+ *
+ *	Going across +-180 degrees restarts the filter, like
+ *	the sign check in apply_smoothing().
+ */
+static float one_euro_angle(struct one_euro_t *f, float angle, float min_cutoff, float beta, float dt)
+{
+    if (f->primed && fabsf(angle - f->x) > 180.0f)
+    {
+        f->primed = 0;
+    }
+
+    return one_euro_filter(f, angle, min_cutoff, beta / EURO_RANGE_ANGLE, dt);
+}
+
+/**
+ *	@brief Smooth the orientation and gforce of an accelerometer.
+ *
+ *	@param ac			An accelerometer (accel_t) structure, holds the filter state.
+ *	@param orient		[in/out] Orientation, smoothed from the absolute angles.
+ *	@param gforce		[in/out] Gravity forces.
+ *	@param min_cutoff	Cutoff frequency at rest, in Hz.
+ *	@param beta			Cutoff increase per full range per second.
+ *	@param dt			Time since the last report, in seconds.
+ */
+void apply_one_euro(struct accel_t *ac, struct orient_t *orient, struct gforce_t *gforce, float min_cutoff, float beta,
+                    float dt)
+{
+    orient->roll  = one_euro_angle(&ac->euro_roll, orient->a_roll, min_cutoff, beta, dt);
+    orient->pitch = one_euro_angle(&ac->euro_pitch, orient->a_pitch, min_cutoff, beta, dt);
+
+    gforce->x = one_euro_filter(&ac->euro_gforce[0], gforce->x, min_cutoff, beta / EURO_RANGE_GFORCE, dt);
+    gforce->y = one_euro_filter(&ac->euro_gforce[1], gforce->y, min_cutoff, beta / EURO_RANGE_GFORCE, dt);
+    gforce->z = one_euro_filter(&ac->euro_gforce[2], gforce->z, min_cutoff, beta / EURO_RANGE_GFORCE, dt);
+}
+
+/**
+ *	@brief Smooth the position of a joystick.
+ *
+ *	@param js			A joystick_t structure, holds the filter state.
+ *	@param min_cutoff	Cutoff frequency at rest, in Hz.
+ *	@param beta			Cutoff increase per full range per second.
+ *	@param dt			Time since the last report, in seconds.
+ *
+ *	The angle and magnitude are derived again from the smoothed position.
+ */
+void apply_one_euro_joystick(struct joystick_t *js, float min_cutoff, float beta, float dt)
+{
+    js->x   = one_euro_filter(&js->euro_x, js->x, min_cutoff, beta / EURO_RANGE_JOYSTICK, dt);
+    js->y   = one_euro_filter(&js->euro_y, js->y, min_cutoff, beta / EURO_RANGE_JOYSTICK, dt);
+    js->ang = RAD_TO_DEGREE(atan2f(js->y, js->x)) + 180.0f;
+    js->mag = sqrtf((js->x * js->x) + (js->y * js->y));
+}
+
+/**
+ *	@brief Set a quaternion from the direction of gravity.
+ *
+ *	@param q			[out] Orientation quaternion.
+ *	@param gforce		Accelerometer reading in g, or NULL.
+ *
+ *	Picks the smallest rotation that matches the measured roll and
+ *	pitch. Without a usable reading, or upside down, this is identity.
+ */
+void quaternion_from_gravity(struct quat_t *q, const struct gforce_t *gforce)
+{
+    float norm, ax, ay, az, n;
+
+    q->w = 1.0f;
+    q->x = 0.0f;
+    q->y = 0.0f;
+    q->z = 0.0f;
+
+    if (!gforce)
+    {
+        return;
+    }
+
+    norm = sqrtf(gforce->x * gforce->x + gforce->y * gforce->y + gforce->z * gforce->z);
+    if (norm < 0.5f || norm > 1.5f)
+    {
+        return;
+    }
+
+    ax = gforce->x / norm;
+    ay = gforce->y / norm;
+    az = gforce->z / norm;
+    if (az < -0.99f)
+    {
+        return;
+    }
+
+    n    = 1.0f / sqrtf(2.0f * (1.0f + az));
+    q->w = (1.0f + az) * n;
+    q->x = ay * n;
+    q->y = -ax * n;
+}
+
+/**
+ *	@brief Advance an orientation quaternion by one gyroscope sample.
+ *
+ *	@param q			[in,out] Orientation quaternion.
+ *	@param rate			Angular rates in degrees per second.
+ *	@param gforce		Accelerometer reading in g, or NULL if there is none.
+ *	@param beta			Filter gain.
+ *	@param dt			Time since the previous sample, in seconds.
+ *
+ *	This is Madgwick's IMU filter. The rates are integrated and the
+ *	accelerometer pulls the estimate towards gravity, which cancels roll
+ *	and pitch drift. Readings far from 1g are ignored since the device
+ *	is being shaken. Yaw has no reference and is only integrated.
+ *
+ *	Axes follow the accelerometer: pitch turns about x, roll about y
+ *	and yaw about z. Positive rates increase the angles reported by
+ *	quaternion_to_orient().
+ */
+void fuse_orientation(struct quat_t *q, const struct ang3f_t *rate, const struct gforce_t *gforce, float beta,
+                      float dt)
+{
+    float q0 = q->w, q1 = q->x, q2 = q->y, q3 = q->z;
+    float gx = DEGREE_TO_RAD(rate->pitch);
+    float gy = -DEGREE_TO_RAD(rate->roll);
+    float gz = DEGREE_TO_RAD(rate->yaw);
+    float qd0, qd1, qd2, qd3;
+    float ax, ay, az, norm;
+    float s0, s1, s2, s3;
+
+    /* rate of change from the gyroscopes */
+    qd0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    qd1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    qd2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    qd3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    if (gforce && beta > 0.0f)
+    {
+        norm = sqrtf(gforce->x * gforce->x + gforce->y * gforce->y + gforce->z * gforce->z);
+
+        if (norm > 0.5f && norm < 1.5f)
+        {
+            ax = gforce->x / norm;
+            ay = gforce->y / norm;
+            az = gforce->z / norm;
+
+            /* gradient step towards the measured gravity */
+            s0 = 4.0f * q0 * q2 * q2 + 2.0f * q2 * ax + 4.0f * q0 * q1 * q1 - 2.0f * q1 * ay;
+            s1 = 4.0f * q1 * q3 * q3 - 2.0f * q3 * ax + 4.0f * q0 * q0 * q1 - 2.0f * q0 * ay - 4.0f * q1
+                 + 8.0f * q1 * q1 * q1 + 8.0f * q1 * q2 * q2 + 4.0f * q1 * az;
+            s2 = 4.0f * q0 * q0 * q2 + 2.0f * q0 * ax + 4.0f * q2 * q3 * q3 - 2.0f * q3 * ay - 4.0f * q2
+                 + 8.0f * q2 * q1 * q1 + 8.0f * q2 * q2 * q2 + 4.0f * q2 * az;
+            s3 = 4.0f * q1 * q1 * q3 - 2.0f * q1 * ax + 4.0f * q2 * q2 * q3 - 2.0f * q2 * ay;
+
+            norm = sqrtf(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+            if (norm > 0.0f)
+            {
+                norm = beta / norm;
+                qd0 -= norm * s0;
+                qd1 -= norm * s1;
+                qd2 -= norm * s2;
+                qd3 -= norm * s3;
+            }
+        }
+    }
+
+    q0 += qd0 * dt;
+    q1 += qd1 * dt;
+    q2 += qd2 * dt;
+    q3 += qd3 * dt;
+
+    norm = sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    if (norm > 0.0f)
+    {
+        norm = 1.0f / norm;
+        q->w = q0 * norm;
+        q->x = q1 * norm;
+        q->y = q2 * norm;
+        q->z = q3 * norm;
+    }
+}
+
+/**
+ *	@brief Convert an orientation quaternion to roll, pitch and yaw.
+ *
+ *	@param q			Orientation quaternion.
+ *	@param orient		[out] Angles in degrees.
+ *
+ *	Roll and pitch are measured like calculate_orientation() does,
+ *	from the direction of gravity, so both agree when at rest.
+ */
+void quaternion_to_orient(const struct quat_t *q, struct orient_t *orient)
+{
+    /* gravity as seen from the device */
+    float vx = 2.0f * (q->x * q->z - q->w * q->y);
+    float vy = 2.0f * (q->w * q->x + q->y * q->z);
+    float vz = q->w * q->w - q->x * q->x - q->y * q->y + q->z * q->z;
+
+    orient->roll  = RAD_TO_DEGREE(atan2f(vx, vz));
+    orient->pitch = RAD_TO_DEGREE(atan2f(vy, sqrtf(vx * vx + vz * vz)));
+    orient->yaw =
+        RAD_TO_DEGREE(atan2f(2.0f * (q->w * q->z + q->x * q->y), 1.0f - 2.0f * (q->y * q->y + q->z * q->z)));
+
+    orient->a_roll  = orient->roll;
+    orient->a_pitch = orient->pitch;
+}
+
+#ifdef WIIUSE_DYNAMICS_SSE2
+
+/**
+ *	@brief Four lane version of approx_atan2_deg().
+ *
+ *	Performs the same operations in the same order, so the
+ *	results are identical to the scalar function.
+ */
+static __m128 approx_atan2_deg_sse(__m128 y, __m128 x)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 ax         = _mm_andnot_ps(sign, x);
+    __m128 ay         = _mm_andnot_ps(sign, y);
+    __m128 mx         = _mm_max_ps(ax, ay);
+    __m128 swap       = _mm_cmpgt_ps(ay, ax);
+    __m128 t, t2, a, m;
+
+    /* reduce to an angle in [0, 45] degrees, 0/0 gives 0 */
+    t  = _mm_and_ps(_mm_div_ps(_mm_min_ps(ax, ay), mx), _mm_cmpgt_ps(mx, zero));
+    t2 = _mm_mul_ps(t, t);
+    a  = _mm_add_ps(_mm_set1_ps(ATAN_C7), _mm_mul_ps(t2, _mm_set1_ps(ATAN_C9)));
+    a  = _mm_add_ps(_mm_set1_ps(ATAN_C5), _mm_mul_ps(t2, a));
+    a  = _mm_add_ps(_mm_set1_ps(ATAN_C3), _mm_mul_ps(t2, a));
+    a  = _mm_add_ps(_mm_set1_ps(ATAN_C1), _mm_mul_ps(t2, a));
+    a  = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(t, a), _mm_set1_ps(180.0f)), _mm_set1_ps(WIIMOTE_PI));
+
+    /* and unfold it back into the right octant */
+    a = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps(90.0f), a)), _mm_andnot_ps(swap, a));
+    m = _mm_cmplt_ps(x, zero);
+    a = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps(180.0f), a)), _mm_andnot_ps(m, a));
+    m = _mm_cmplt_ps(y, zero);
+    a = _mm_or_ps(_mm_and_ps(m, _mm_xor_ps(a, sign)), _mm_andnot_ps(m, a));
+
+    return a;
+}
+
+static void orientation_lanes(const float *x, const float *y, const float *z, const struct accel_t *ac, float *roll,
+                              float *pitch)
+{
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    __m128 vx       = _mm_loadu_ps(x);
+    __m128 vy       = _mm_loadu_ps(y);
+    __m128 vz       = _mm_loadu_ps(z);
+
+    /* normalize to +/- 1g and clamp for the tan functions */
+    vx = _mm_mul_ps(_mm_sub_ps(vx, _mm_set1_ps((float)ac->cal_zero.x)), _mm_set1_ps(ac->cal_g_inv.x));
+    vy = _mm_mul_ps(_mm_sub_ps(vy, _mm_set1_ps((float)ac->cal_zero.y)), _mm_set1_ps(ac->cal_g_inv.y));
+    vz = _mm_mul_ps(_mm_sub_ps(vz, _mm_set1_ps((float)ac->cal_zero.z)), _mm_set1_ps(ac->cal_g_inv.z));
+    vx = _mm_min_ps(_mm_max_ps(vx, lo), hi);
+    vy = _mm_min_ps(_mm_max_ps(vy, lo), hi);
+    vz = _mm_min_ps(_mm_max_ps(vz, lo), hi);
+
+    _mm_storeu_ps(roll, approx_atan2_deg_sse(vx, vz));
+    _mm_storeu_ps(pitch,
+                  approx_atan2_deg_sse(vy, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vz, vz)))));
+}
+
+/**
+ *	@brief Compute the gravity forces of 4 samples.
+ *
+ *	4 samples are 12 consecutive bytes in and 12 consecutive floats
+ *	out, so \a cz and \a cg hold the calibration repeated 4 times
+ *	in x,y,z order.
+ */
+static void gforce_lanes(const float *cz, const float *cg, const struct vec3b_t *accel, struct gforce_t *gforce)
+{
+    const __m128i zero = _mm_setzero_si128();
+    byte raw[16]       = {0};
+    float *out         = &gforce->x;
+    __m128i b, w;
+
+    memcpy(raw, accel, 4 * sizeof(struct vec3b_t));
+    b = _mm_loadu_si128((const __m128i *)raw);
+
+    w = _mm_unpacklo_epi8(b, zero);
+    _mm_storeu_ps(out, _mm_div_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(w, zero)), _mm_loadu_ps(cz)),
+                                  _mm_loadu_ps(cg)));
+    _mm_storeu_ps(out + 4, _mm_div_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(w, zero)), _mm_loadu_ps(cz + 4)),
+                                      _mm_loadu_ps(cg + 4)));
+    w = _mm_unpackhi_epi8(b, zero);
+    _mm_storeu_ps(out + 8, _mm_div_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(w, zero)), _mm_loadu_ps(cz + 8)),
+                                      _mm_loadu_ps(cg + 8)));
+}
+
+#else
+
+static void orientation_lanes(const float *x, const float *y, const float *z, const struct accel_t *ac, float *roll,
+                              float *pitch)
+{
+    float vx, vy, vz;
+    int i;
+
+    for (i = 0; i < 4; ++i)
+    {
+        vx = (x[i] - (float)ac->cal_zero.x) * ac->cal_g_inv.x;
+        vy = (y[i] - (float)ac->cal_zero.y) * ac->cal_g_inv.y;
+        vz = (z[i] - (float)ac->cal_zero.z) * ac->cal_g_inv.z;
+        vx = (vx < -1.0f) ? -1.0f : ((vx > 1.0f) ? 1.0f : vx);
+        vy = (vy < -1.0f) ? -1.0f : ((vy > 1.0f) ? 1.0f : vy);
+        vz = (vz < -1.0f) ? -1.0f : ((vz > 1.0f) ? 1.0f : vz);
+
+        roll[i]  = approx_atan2_deg(vx, vz);
+        pitch[i] = approx_atan2_deg(vy, sqrtf(vx * vx + vz * vz));
+    }
+}
+
+static void gforce_lanes(const float *cz, const float *cg, const struct vec3b_t *accel, struct gforce_t *gforce)
+{
+    const byte *raw = &accel->x;
+    float *out      = &gforce->x;
+    int i;
+
+    for (i = 0; i < 12; ++i)
+    {
+        out[i] = ((float)raw[i] - cz[i]) / cg[i];
+    }
+}
+
+#endif
+
+/**
+ *	@brief Calculate the gravity forces of many samples.
+ *
+ *	@param ac			An accelerometer (accel_t) structure.
+ *	@param accel		[in] Array of \a count raw acceleration samples.
+ *	@param count		Number of samples.
+ *	@param gforce		[out] Array of \a count gforce_t structures.
+ *
+ *	The results are identical to calling calculate_gforce() on each sample.
+ */
+void wiiuse_calculate_gforce_batch(struct accel_t *ac, const struct vec3b_t *accel, int count,
+                                   struct gforce_t *gforce)
+{
+    float cz[12], cg[12];
+    int i;
+
+    if (!ac || !accel || !gforce || count <= 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < 4; ++i)
+    {
+        cz[3 * i]       = (float)ac->cal_zero.x;
+        cz[(3 * i) + 1] = (float)ac->cal_zero.y;
+        cz[(3 * i) + 2] = (float)ac->cal_zero.z;
+        cg[3 * i]       = (float)ac->cal_g.x;
+        cg[(3 * i) + 1] = (float)ac->cal_g.y;
+        cg[(3 * i) + 2] = (float)ac->cal_g.z;
+    }
+
+    for (i = 0; i + 4 <= count; i += 4)
+    {
+        gforce_lanes(cz, cg, accel + i, gforce + i);
+    }
+
+    for (; i < count; ++i)
+    {
+        calculate_gforce(ac, (struct vec3b_t *)&accel[i], &gforce[i]);
+    }
+}
+
+/**
+ *	@brief Calculate the roll and pitch of many samples.
+ *
+ *	@param ac			An accelerometer (accel_t) structure. Its smoothing
+ *						state is updated as if the samples arrived one by one.
+ *	@param accel		[in] Array of \a count raw acceleration samples.
+ *	@param count		Number of samples.
+ *	@param orient		[in,out] Array of \a count orient_t structures.
+ *	@param smooth		1 to smooth the angles, 0 to leave them raw.
+ *
+ *	Matches calling calculate_orientation() with WIIUSE_FAST_ORIENT on each
+ *	sample, and so stays within 0.001 degrees of the libm path.
+ *
+ *	A sample over 1g on an axis keeps the angle of the sample before it.
+ *	For the first sample that is whatever the caller left in orient[0].
+ */
+void wiiuse_calculate_orientation_batch(struct accel_t *ac, const struct vec3b_t *accel, int count,
+                                        struct orient_t *orient, int smooth)
+{
+    float x[4], y[4], z[4], roll[4], pitch[4];
+    struct orient_t *o, *prev;
+    int i, k, n;
+
+    if (!ac || !accel || !orient || count <= 0)
+    {
+        return;
+    }
+
+    calculate_accel_gains(ac);
+
+    for (i = 0; i < count; i += 4)
+    {
+        n = (count - i < 4) ? (count - i) : 4;
+
+        for (k = 0; k < 4; ++k)
+        {
+            x[k] = (k < n) ? (float)accel[i + k].x : 0.0f;
+            y[k] = (k < n) ? (float)accel[i + k].y : 0.0f;
+            z[k] = (k < n) ? (float)accel[i + k].z : 0.0f;
+        }
+
+        orientation_lanes(x, y, z, ac, roll, pitch);
+
+        /* holding the last angle and smoothing depend on the previous sample */
+        for (k = 0; k < n; ++k)
+        {
+            o    = &orient[i + k];
+            prev = (i + k) ? (o - 1) : o;
+
+            o->yaw = 0.0f;
+
+            if (abs(accel[i + k].x - ac->cal_zero.x) <= ac->cal_g.x)
+            {
+                o->roll   = roll[k];
+                o->a_roll = roll[k];
+            } else
+            {
+                o->roll   = prev->roll;
+                o->a_roll = prev->a_roll;
+            }
+
+            if (abs(accel[i + k].y - ac->cal_zero.y) <= ac->cal_g.y)
+            {
+                o->pitch   = pitch[k];
+                o->a_pitch = pitch[k];
+            } else
+            {
+                o->pitch   = prev->pitch;
+                o->a_pitch = prev->a_pitch;
+            }
+
+            if (smooth)
+            {
+                apply_smoothing(ac, o, SMOOTH_ROLL);
+                apply_smoothing(ac, o, SMOOTH_PITCH);
+            }
+        }
+    }
+}
@@ -47,10 +47,19 @@ extern "C" {
 /** @defgroup internal_dynamics Internal: Dynamics Functions */
 /** @{ */
 
-void calculate_orientation(struct accel_t *ac, struct vec3b_t *accel, struct orient_t *orient, int smooth);
+void calculate_accel_gains(struct accel_t *ac);
+void calculate_orientation(struct accel_t *ac, struct vec3b_t *accel, struct orient_t *orient, int flags);
 void calculate_gforce(struct accel_t *ac, struct vec3b_t *accel, struct gforce_t *gforce);
 void calc_joystick_state(struct joystick_t *js, float x, float y);
 void apply_smoothing(struct accel_t *ac, struct orient_t *orient, int type);
+float one_euro_filter(struct one_euro_t *f, float value, float min_cutoff, float beta, float dt);
+void apply_one_euro(struct accel_t *ac, struct orient_t *orient, struct gforce_t *gforce, float min_cutoff, float beta,
+                    float dt);
+void apply_one_euro_joystick(struct joystick_t *js, float min_cutoff, float beta, float dt);
+void quaternion_from_gravity(struct quat_t *q, const struct gforce_t *gforce);
+void fuse_orientation(struct quat_t *q, const struct ang3f_t *rate, const struct gforce_t *gforce, float beta,
+                      float dt);
+void quaternion_to_orient(const struct quat_t *q, struct orient_t *orient);
 /** @} */
 
 #ifdef __cplusplus
@@ -42,21 +42,38 @@
 #include "guitar_hero_3.h" /* for guitar_hero_3_disconnected, etc */
 #include "io.h"            /* for wiiuse_read_data_sync, etc */
 #include "ir.h"            /* for calculate_basic_ir, etc */
+#include "loop.h"          /* for loop_update */
 #include "motion_plus.h"   /* for motion_plus_disconnected, etc */
 #include "nunchuk.h"       /* for nunchuk_disconnected, etc */
+#include "reconnect.h"     /* for reconnect_step */
+#include "samples.h"       /* for sample_store_append */
 #include "wiiboard.h"      /* for wii_board_disconnected, etc */
 #include "tatacon.h"       /* for tatacon_disconnected, etc */
 
-#include "os.h" /* for wiiuse_os_poll */
+#include "os.h" /* for wiiuse_os_poll, wiiuse_os_ticks */
 
+#include <math.h>   /* for fabsf */
 #include <stdio.h>  /* for printf, perror */
 #include <stdlib.h> /* for free, malloc */
 #include <string.h> /* for memcpy, memset */
 
+/* idle smoothing steps, in milliseconds, about the report rate of a wiimote */
+#define IDLE_PERIOD 10
+
+/* degrees off the true angle at which idle smoothing stops */
+#define IDLE_SETTLED 0.01f
+
+/* parts of a report that were decoded, for smooth_report() */
+#define DECODED_ACC 0x01
+#define DECODED_IR 0x02
+#define DECODED_EXP 0x04
+
 static void event_data_read(struct wiimote_t *wm, byte *msg);
 static void event_data_write(struct wiimote_t *wm, byte *msg);
 static void event_status(struct wiimote_t *wm, byte *msg);
 static void handle_expansion(struct wiimote_t *wm, byte *msg);
+static void update_wm_accel(struct wiimote_t *wm);
+static void smooth_report(struct wiimote_t *wm, int decoded);
 
 static void save_state(struct wiimote_t *wm);
 static int state_changed(struct wiimote_t *wm);
@@ -73,37 +90,42 @@ static int state_changed(struct wiimote_t *wm);
  *	that occur.  If an event occurs on a particular wiimote,
  *	the event variable will be set.
  */
-int wiiuse_poll(struct wiimote_t **wm, int wiimotes) { return wiiuse_os_poll(wm, wiimotes); }
+int wiiuse_poll(struct wiimote_t **wm, int wiimotes)
+{
+    int evnt = wiiuse_os_poll(wm, wiimotes);
+
+    if (!wm)
+    {
+        return evnt;
+    }
+
+    /* put back wiimotes that dropped out */
+    evnt += reconnect_step(wm, wiimotes);
+
+    /* keep the descriptor from wiiuse_get_fd() in step */
+    loop_update(wm, wiimotes);
+
+    return evnt;
+}
 
 int wiiuse_update(struct wiimote_t **wiimotes, int nwiimotes, wiiuse_update_cb callback)
 {
     int evnt = 0;
     if (wiiuse_poll(wiimotes, nwiimotes))
     {
-        static struct wiimote_callback_data_t s;
         int i = 0;
         for (; i < nwiimotes; ++i)
         {
+            struct wiimote_callback_data_t *s = &wiimotes[i]->ctx->cb_data;
+
             switch (wiimotes[i]->event)
             {
             case WIIUSE_NONE:
                 break;
             default:
                 /* this could be:  WIIUSE_EVENT, WIIUSE_STATUS, WIIUSE_CONNECT, etc.. */
-                s.uid              = wiimotes[i]->unid;
-                s.leds             = wiimotes[i]->leds;
-                s.battery_level    = wiimotes[i]->battery_level;
-                s.accel            = wiimotes[i]->accel;
-                s.orient           = wiimotes[i]->orient;
-                s.gforce           = wiimotes[i]->gforce;
-                s.ir               = wiimotes[i]->ir;
-                s.buttons          = wiimotes[i]->btns;
-                s.buttons_held     = wiimotes[i]->btns_held;
-                s.buttons_released = wiimotes[i]->btns_released;
-                s.event            = wiimotes[i]->event;
-                s.state            = wiimotes[i]->state;
-                s.expansion        = wiimotes[i]->exp;
-                callback(&s);
+                fill_callback_data(wiimotes[i], s);
+                callback(s);
                 evnt++;
                 break;
             }
@@ -119,6 +141,8 @@ int wiiuse_update(struct wiimote_t **wiimotes, int nwiimotes, wiiuse_update_cb c
  */
 void idle_cycle(struct wiimote_t *wm)
 {
+    unsigned long now;
+
     /*
      *	Smooth the angles.
      *
@@ -129,17 +153,84 @@ void idle_cycle(struct wiimote_t *wm)
      *	is still an old value.  Smoothing needs to be applied in this
      *	case in order for the angle it reports to converge to the true
      *	angle of the device.
+     *
+     *	A step is taken every IDLE_PERIOD, as if reports still came
+     *	in, so how fast the angles converge does not depend on how
+     *	often the application polls.
      */
-    if (WIIUSE_USING_ACC(wm) && WIIMOTE_IS_FLAG_SET(wm, WIIUSE_SMOOTHING))
+    if (idle_deadline(wm) != WIIUSE_NEVER)
     {
-        apply_smoothing(&wm->accel_calib, &wm->orient, SMOOTH_ROLL);
-        apply_smoothing(&wm->accel_calib, &wm->orient, SMOOTH_PITCH);
+        now = wiiuse_os_ticks();
+        if (now >= wm->idle_next)
+        {
+            wm->idle_next = now + IDLE_PERIOD;
+            apply_smoothing(&wm->accel_calib, &wm->orient, SMOOTH_ROLL);
+            apply_smoothing(&wm->accel_calib, &wm->orient, SMOOTH_PITCH);
+        }
     }
 
     /* clear out any old read requests */
     clear_dirty_reads(wm);
 }
 
+/**
+ *	@brief When idle_cycle() has to smooth the angles next.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *
+ *	@return Ticks of the next smoothing step, WIIUSE_NEVER once the
+ *			smoothed angles caught up or smoothing is off.
+ */
+unsigned long idle_deadline(struct wiimote_t *wm)
+{
+    if (!WIIUSE_USING_ACC(wm) || !WIIMOTE_IS_FLAG_SET(wm, WIIUSE_SMOOTHING)
+        || WIIMOTE_IS_FLAG_SET(wm, WIIUSE_ONE_EURO))
+    {
+        return WIIUSE_NEVER;
+    }
+
+    if ((fabsf(wm->orient.roll - wm->orient.a_roll) < IDLE_SETTLED)
+        && (fabsf(wm->orient.pitch - wm->orient.a_pitch) < IDLE_SETTLED))
+    {
+        return WIIUSE_NEVER;
+    }
+
+    return wm->idle_next;
+}
+
+/**
+ *	@brief Take a snapshot of a wiimote for an event consumer.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param s		[out] The snapshot.
+ */
+void fill_callback_data(struct wiimote_t *wm, struct wiimote_callback_data_t *s)
+{
+    s->uid              = wm->unid;
+    s->leds             = wm->leds;
+    s->battery_level    = wm->battery_level;
+    s->accel            = wm->accel;
+    s->orient           = wm->orient;
+    s->gforce           = wm->gforce;
+    s->ir               = wm->ir;
+    s->buttons          = wm->btns;
+    s->buttons_held     = wm->btns_held;
+    s->buttons_released = wm->btns_released;
+    s->event            = wm->event;
+    s->state            = wm->state;
+    s->expansion        = wm->exp;
+
+    /* the pass-through pointers lead back into the wiimote, point them at the copy */
+    if (wm->exp.mp.nc == &wm->exp.nunchuk)
+    {
+        s->expansion.mp.nc = &s->expansion.nunchuk;
+    }
+    if (wm->exp.mp.classic == &wm->exp.classic)
+    {
+        s->expansion.mp.classic = &s->expansion.classic;
+    }
+}
+
 /**
  *	@brief Clear out all old 'dirty' read requests.
  *
@@ -151,10 +242,10 @@ void clear_dirty_reads(struct wiimote_t *wm)
 
     while (req && req->dirty)
     {
-        WIIUSE_DEBUG("Cleared old read request for address: %x", req->addr);
+        WIIUSE_CTX_DEBUG(wm->ctx, "Cleared old read request for address: %x", req->addr);
 
         wm->read_req = req->next;
-        free(req);
+        wiiuse_ctx_free(wm->ctx, req);
         req = wm->read_req;
     }
 }
@@ -171,9 +262,60 @@ static void handle_wm_accel(struct wiimote_t *wm, byte *msg)
     wm->accel.y = msg[3];
     wm->accel.z = msg[4];
 
+    update_wm_accel(wm);
+}
+
+/**
+ *	@brief Handle one half of an interleaved full IR mode report.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param msg		The message specified in the event packet.
+ *	@param second	0 for report 0x3e, 1 for report 0x3f.
+ *
+ *	Each half carries one accelerometer axis, four bits of the z axis
+ *	hidden in the button bytes, and two IR dots. Accelerometer and IR
+ *	are only updated once both halves are in. A second half without
+ *	its first half is dropped.
+ *
+ *	@return 1 once both halves are in, 0 otherwise.
+ */
+static int handle_interleaved(struct wiimote_t *wm, byte *msg, int second)
+{
+    if (!second)
+    {
+        wm->ir.half_accel[0] = msg[2];
+        wm->ir.half_accel[1] = ((msg[0] & 0x60) >> 1) | ((msg[1] & 0x60) << 1);
+        wm->ir.half_pending  = 1;
+
+        calculate_full_ir(wm, msg + 3, 0);
+        return 0;
+    }
+
+    if (!wm->ir.half_pending)
+    {
+        wm->ir.lost_halves++;
+        return 0;
+    }
+    wm->ir.half_pending = 0;
+
+    wm->accel.x = wm->ir.half_accel[0];
+    wm->accel.y = msg[2];
+    wm->accel.z = wm->ir.half_accel[1] | ((msg[0] & 0x60) >> 5) | ((msg[1] & 0x60) >> 3);
+    update_wm_accel(wm);
+
+    calculate_full_ir(wm, msg + 3, 1);
+    return 1;
+}
+
+/**
+ *	@brief Update orientation and gforce from the raw accel data.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ */
+static void update_wm_accel(struct wiimote_t *wm)
+{
     /* calculate the remote orientation */
-    calculate_orientation(&wm->accel_calib, &wm->accel, &wm->orient,
-                          WIIMOTE_IS_FLAG_SET(wm, WIIUSE_SMOOTHING));
+    calculate_orientation(&wm->accel_calib, &wm->accel, &wm->orient, wm->flags);
 
     /* calculate the gforces on each axis */
     calculate_gforce(&wm->accel_calib, &wm->accel, &wm->gforce);
@@ -190,6 +332,9 @@ static void handle_wm_accel(struct wiimote_t *wm, byte *msg)
  */
 void propagate_event(struct wiimote_t *wm, byte event, byte *msg)
 {
+    int complete = 1; /* 0 if the report brought no new sample */
+    int decoded  = 0; /* DECODED_* parts of the report */
+
     save_state(wm);
 
     switch (event)
@@ -206,6 +351,7 @@ void propagate_event(struct wiimote_t *wm, byte event, byte *msg)
         wiiuse_pressed_buttons(wm, msg);
 
         handle_wm_accel(wm, msg);
+        decoded = DECODED_ACC;
 
         break;
     }
@@ -231,6 +377,7 @@ void propagate_event(struct wiimote_t *wm, byte event, byte *msg)
         /* button - expansion */
         wiiuse_pressed_buttons(wm, msg);
         handle_expansion(wm, msg + 2);
+        decoded = DECODED_EXP;
 
         break;
     }
@@ -242,6 +389,7 @@ void propagate_event(struct wiimote_t *wm, byte event, byte *msg)
         handle_wm_accel(wm, msg);
 
         handle_expansion(wm, msg + 5);
+        decoded = DECODED_ACC | DECODED_EXP;
 
         break;
     }
@@ -254,6 +402,7 @@ void propagate_event(struct wiimote_t *wm, byte event, byte *msg)
 
         /* ir */
         calculate_extended_ir(wm, msg + 5);
+        decoded = DECODED_ACC | DECODED_IR;
 
         break;
     }
@@ -265,6 +414,7 @@ void propagate_event(struct wiimote_t *wm, byte event, byte *msg)
 
         /* ir */
         calculate_basic_ir(wm, msg + 2);
+        decoded = DECODED_IR | DECODED_EXP;
 
         break;
     }
@@ -279,6 +429,18 @@ void propagate_event(struct wiimote_t *wm, byte event, byte *msg)
 
         /* ir */
         calculate_basic_ir(wm, msg + 5);
+        decoded = DECODED_ACC | DECODED_IR | DECODED_EXP;
+
+        break;
+    }
+    case WM_RPT_INTERLEAVED_1:
+    case WM_RPT_INTERLEAVED_2:
+    {
+        /* button - half of motion and full ir */
+        wiiuse_pressed_buttons(wm, msg);
+
+        complete = handle_interleaved(wm, msg, event == WM_RPT_INTERLEAVED_2);
+        decoded  = complete ? (DECODED_ACC | DECODED_IR) : 0;
 
         break;
     }
@@ -294,19 +456,34 @@ void propagate_event(struct wiimote_t *wm, byte event, byte *msg)
     case WM_RPT_WRITE:
     {
         /* event_data_write(wm, msg); */
+        complete = 0;
         break;
     }
     default:
     {
-        WIIUSE_WARNING("Unknown event, can not handle it [Code 0x%x].", event);
+        WIIUSE_CTX_WARNING(wm->ctx, "Unknown event, can not handle it [Code 0x%x].", event);
         return;
     }
     }
 
+    if (decoded && WIIMOTE_IS_FLAG_SET(wm, WIIUSE_SMOOTHING) && WIIMOTE_IS_FLAG_SET(wm, WIIUSE_ONE_EURO))
+    {
+        smooth_report(wm, decoded);
+    }
+
+    ++wm->ctx->stats.reports;
+
+    /* keep every decoded report for columnar consumers */
+    if (wm->samples && complete)
+    {
+        sample_store_append(wm);
+    }
+
     /* was there an event? */
     if (state_changed(wm))
     {
         wm->event = WIIUSE_EVENT;
+        ++wm->ctx->stats.events;
     }
 }
 
@@ -364,7 +541,7 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
     /* if we don't have a request out then we didn't ask for this packet */
     if (!req)
     {
-        WIIUSE_WARNING("Received data packet when no request was made.");
+        WIIUSE_CTX_WARNING(wm->ctx, "Received data packet when no request was made.");
         return;
     }
 
@@ -372,13 +549,13 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
 
     if (err == 0x08)
     {
-        WIIUSE_WARNING("Unable to read data - address does not exist.");
+        WIIUSE_CTX_WARNING(wm->ctx, "Unable to read data - address does not exist.");
     } else if (err == 0x07)
     {
-        WIIUSE_WARNING("Unable to read data - address is for write-only registers.");
+        WIIUSE_CTX_WARNING(wm->ctx, "Unable to read data - address is for write-only registers.");
     } else if (err)
     {
-        WIIUSE_WARNING("Unable to read data - unknown error code %x.", err);
+        WIIUSE_CTX_WARNING(wm->ctx, "Unable to read data - unknown error code %x.", err);
     }
 
     if (err)
@@ -387,7 +564,7 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
 
         /* delete this request */
         wm->read_req = req->next;
-        free(req);
+        wiiuse_ctx_free(wm->ctx, req);
 
         /* if another request exists send it to the wiimote */
         if (wm->read_req)
@@ -409,12 +586,12 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
         req->wait = 0;
     }
 
-    WIIUSE_DEBUG("Received read packet:");
-    WIIUSE_DEBUG("    Packet read offset:   %i bytes", offset);
-    WIIUSE_DEBUG("    Request read offset:  %i bytes", req->addr);
-    WIIUSE_DEBUG("    Read offset into buf: %i bytes", offset - req->addr);
-    WIIUSE_DEBUG("    Read data size:       %i bytes", len);
-    WIIUSE_DEBUG("    Still need:           %i bytes", req->wait);
+    WIIUSE_CTX_DEBUG(wm->ctx, "Received read packet:");
+    WIIUSE_CTX_DEBUG(wm->ctx, "    Packet read offset:   %i bytes", offset);
+    WIIUSE_CTX_DEBUG(wm->ctx, "    Request read offset:  %i bytes", req->addr);
+    WIIUSE_CTX_DEBUG(wm->ctx, "    Read offset into buf: %i bytes", offset - req->addr);
+    WIIUSE_CTX_DEBUG(wm->ctx, "    Read data size:       %i bytes", len);
+    WIIUSE_CTX_DEBUG(wm->ctx, "    Still need:           %i bytes", req->wait);
 
     /* reconstruct this part of the data */
     memcpy((req->buf + offset - req->addr), (msg + 5), len);
@@ -441,7 +618,7 @@ static void event_data_read(struct wiimote_t *wm, byte *msg)
 
             /* delete this request */
             wm->read_req = req->next;
-            free(req);
+            wiiuse_ctx_free(wm->ctx, req);
         } else
         {
             /*
@@ -473,15 +650,15 @@ static void event_data_write(struct wiimote_t *wm, byte *msg)
     /* if we don't have a request out then we didn't ask for this packet */
     if (!req)
     {
-        WIIUSE_WARNING("Transmitting data packet when no request was made.");
+        WIIUSE_CTX_WARNING(wm->ctx, "Transmitting data packet when no request was made.");
         return;
     }
     if (!(req->state == REQ_SENT))
     {
-        WIIUSE_WARNING("Transmission is not necessary");
+        WIIUSE_CTX_WARNING(wm->ctx, "Transmission is not necessary");
         /* delete this request */
         wm->data_req = req->next;
-        free(req);
+        wiiuse_ctx_free(wm->ctx, req);
         return;
     }
 
@@ -493,7 +670,7 @@ static void event_data_write(struct wiimote_t *wm, byte *msg)
         req->cb(wm, NULL, 0);
         /* delete this request */
         wm->data_req = req->next;
-        free(req);
+        wiiuse_ctx_free(wm->ctx, req);
     } else
     {
         /*
@@ -570,7 +747,7 @@ static void event_status(struct wiimote_t *wm, byte *msg)
     /* is an attachment connected to the expansion port? */
     if ((msg[2] & WM_CTRL_STATUS_BYTE1_ATTACHMENT) == WM_CTRL_STATUS_BYTE1_ATTACHMENT)
     {
-        WIIUSE_DEBUG("Attachment detected!");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Attachment detected!");
         attachment = 1;
     }
 
@@ -606,7 +783,7 @@ static void event_status(struct wiimote_t *wm, byte *msg)
 #ifdef WIIUSE_WIN32
     if (!attachment)
     {
-        WIIUSE_DEBUG("Setting timeout to normal %i ms.", wm->normal_timeout);
+        WIIUSE_CTX_DEBUG(wm->ctx, "Setting timeout to normal %i ms.", wm->normal_timeout);
         wm->timeout = wm->normal_timeout;
     }
 #endif
@@ -645,7 +822,7 @@ static void event_status(struct wiimote_t *wm, byte *msg)
     wm->data_req = req->next;
     req->state   = REQ_DONE;
     /* if(req->cb!=NULL) req->cb(wm,msg,6); */
-    free(req);
+    wiiuse_ctx_free(wm->ctx, req);
 }
 
 /**
@@ -669,11 +846,21 @@ static void handle_expansion(struct wiimote_t *wm, byte *msg)
         break;
     case EXP_WII_BOARD:
         wii_board_event(&wm->exp.wb, msg);
+        if (wm->board_ring)
+        {
+            wii_board_ring_push(wm->board_ring, &wm->exp.wb, wiiuse_os_ticks());
+        }
         break;
     case EXP_MOTION_PLUS:
     case EXP_MOTION_PLUS_CLASSIC:
     case EXP_MOTION_PLUS_NUNCHUK:
-        motion_plus_event(&wm->exp.mp, wm->exp.type, msg);
+        if (motion_plus_event(&wm->exp.mp, wm->exp.type, msg))
+        {
+            struct gforce_t *gforce = WIIUSE_USING_ACC(wm) ? &wm->gforce : NULL;
+
+            motion_plus_track_bias(&wm->exp.mp, gforce);
+            motion_plus_fusion(&wm->exp.mp, gforce, wiiuse_os_ticks());
+        }
         break;
     case EXP_TATACON:
         tatacon_event(&wm->exp.tatacon, msg);
@@ -683,6 +870,79 @@ static void handle_expansion(struct wiimote_t *wm, byte *msg)
     }
 }
 
+/**
+ *	@brief Run the One Euro filter over a decoded report.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param decoded	DECODED_* parts the report carried.
+ *
+ *	Filters the orientation, gforce, IR cursor and expansion
+ *	joysticks. Only the parts the report carried are filtered,
+ *	held values would count as a sample that did not move.
+ */
+static void smooth_report(struct wiimote_t *wm, int decoded)
+{
+    unsigned long ts = wiiuse_os_ticks();
+    float fc         = wm->euro_min_cutoff;
+    float beta       = wm->euro_beta;
+    float dt         = (float)(ts - wm->euro_ts) / 1000.0f;
+
+    if (!wm->euro_ts || dt < WIIUSE_EURO_MIN_DT)
+    {
+        dt = WIIUSE_EURO_MIN_DT;
+    }
+    wm->euro_ts = ts;
+
+    if ((decoded & DECODED_ACC) && WIIUSE_USING_ACC(wm))
+    {
+        apply_one_euro(&wm->accel_calib, &wm->orient, &wm->gforce, fc, beta, dt);
+    }
+
+    if (decoded & DECODED_IR)
+    {
+        if (WIIUSE_USING_IR(wm) && wm->ir.num_dots)
+        {
+            wm->ir.x = (int)(one_euro_filter(&wm->ir.euro_x, (float)wm->ir.x, fc, beta / wm->ir.vres[0], dt) + 0.5f);
+            wm->ir.y = (int)(one_euro_filter(&wm->ir.euro_y, (float)wm->ir.y, fc, beta / wm->ir.vres[1], dt) + 0.5f);
+        } else
+        {
+            wm->ir.euro_x.primed = 0;
+            wm->ir.euro_y.primed = 0;
+        }
+    }
+
+    if (!(decoded & DECODED_EXP))
+    {
+        return;
+    }
+
+    switch (wm->exp.type)
+    {
+    case EXP_NUNCHUK:
+        apply_one_euro(&wm->exp.nunchuk.accel_calib, &wm->exp.nunchuk.orient, &wm->exp.nunchuk.gforce, fc, beta,
+                       dt);
+        apply_one_euro_joystick(&wm->exp.nunchuk.js, fc, beta, dt);
+        break;
+    case EXP_CLASSIC:
+        apply_one_euro_joystick(&wm->exp.classic.ljs, fc, beta, dt);
+        apply_one_euro_joystick(&wm->exp.classic.rjs, fc, beta, dt);
+        break;
+    case EXP_GUITAR_HERO_3:
+        apply_one_euro_joystick(&wm->exp.gh3.js, fc, beta, dt);
+        break;
+    case EXP_MOTION_PLUS_NUNCHUK:
+        apply_one_euro(&wm->exp.mp.nc->accel_calib, &wm->exp.mp.nc->orient, &wm->exp.mp.nc->gforce, fc, beta, dt);
+        apply_one_euro_joystick(&wm->exp.mp.nc->js, fc, beta, dt);
+        break;
+    case EXP_MOTION_PLUS_CLASSIC:
+        apply_one_euro_joystick(&wm->exp.mp.classic->ljs, fc, beta, dt);
+        apply_one_euro_joystick(&wm->exp.mp.classic->rjs, fc, beta, dt);
+        break;
+    default:
+        break;
+    }
+}
+
 /**
  *	@brief Handle the handshake data from the expansion device.
  *
@@ -694,7 +954,8 @@ static void handle_expansion(struct wiimote_t *wm, byte *msg)
  *	and invoke the correct handshake function.
  *
  *	If the data is NULL then this function will try to start
- *	a handshake with the expansion.
+ *	a handshake with the expansion. Otherwise \a data is a buffer
+ *	from wiiuse_ctx_malloc() and is freed here.
  */
 void handshake_expansion(struct wiimote_t *wm, byte *data, uint16_t len)
 {
@@ -714,6 +975,16 @@ void handshake_expansion(struct wiimote_t *wm, byte *data, uint16_t len)
      * hoping that it will sort itself out
      */
 
+    /* the buffer of a retried read, the handshake reads again below */
+    wiiuse_ctx_free(wm->ctx, data);
+
+    handshake_buf = (byte *)wiiuse_ctx_malloc(wm->ctx, EXP_HANDSHAKE_LEN * sizeof(byte));
+    if (!handshake_buf)
+    {
+        WIIUSE_CTX_ERROR(wm->ctx, "Out of memory for the expansion handshake [id %i].", wm->unid);
+        return;
+    }
+
     while (attempt < 10 && !init_good)
     {
         /*
@@ -723,7 +994,7 @@ void handshake_expansion(struct wiimote_t *wm, byte *data, uint16_t len)
         wm->expansion_state = 1;
 #ifdef WIIUSE_WIN32
         /* increase the timeout until the handshake completes */
-        WIIUSE_DEBUG("write 0x55 - Setting timeout to expansion %i ms.", wm->exp_timeout);
+        WIIUSE_CTX_DEBUG(wm->ctx, "write 0x55 - Setting timeout to expansion %i ms.", wm->exp_timeout);
         wm->timeout = wm->exp_timeout;
 #endif
         buf = 0x55;
@@ -731,7 +1002,7 @@ void handshake_expansion(struct wiimote_t *wm, byte *data, uint16_t len)
 
 #ifdef WIIUSE_WIN32
         /* increase the timeout until the handshake completes */
-        WIIUSE_DEBUG("write 0x00 - Setting timeout to expansion %i ms.", wm->exp_timeout);
+        WIIUSE_CTX_DEBUG(wm->ctx, "write 0x00 - Setting timeout to expansion %i ms.", wm->exp_timeout);
         wm->timeout = wm->exp_timeout;
 #endif
         buf = 0x00;
@@ -746,7 +1017,6 @@ void handshake_expansion(struct wiimote_t *wm, byte *data, uint16_t len)
         if (WIIMOTE_IS_SET(wm, WIIMOTE_STATE_EXP))
             disable_expansion(wm);
 
-        handshake_buf = (byte *)malloc(EXP_HANDSHAKE_LEN * sizeof(byte));
         /* tell the wiimote to send expansion data */
         WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_EXP);
         wiiuse_read_data_sync(wm, 0, WM_EXP_MEM_CALIBR, EXP_HANDSHAKE_LEN, handshake_buf);
@@ -821,11 +1091,11 @@ void handshake_expansion(struct wiimote_t *wm, byte *data, uint16_t len)
         break;
 
     default:
-        WIIUSE_WARNING("Unknown expansion type. Code: 0x%x", id);
+        WIIUSE_CTX_WARNING(wm->ctx, "Unknown expansion type. Code: 0x%x", id);
         break;
     }
 
-    free(handshake_buf);
+    wiiuse_ctx_free(wm->ctx, handshake_buf);
 
     if (gotIt)
     {
@@ -833,7 +1103,7 @@ void handshake_expansion(struct wiimote_t *wm, byte *data, uint16_t len)
         WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_EXP);
     } else
     {
-        WIIUSE_WARNING("Could not handshake with expansion id: 0x%x", id);
+        WIIUSE_CTX_WARNING(wm->ctx, "Could not handshake with expansion id: 0x%x", id);
     }
 
     wiiuse_set_ir_mode(wm);
@@ -852,7 +1122,7 @@ void handshake_expansion(struct wiimote_t *wm, byte *data, uint16_t len)
  */
 void disable_expansion(struct wiimote_t *wm)
 {
-    WIIUSE_DEBUG("Disabling expansion");
+    WIIUSE_CTX_DEBUG(wm->ctx, "Disabling expansion");
     if (!WIIMOTE_IS_SET(wm, WIIMOTE_STATE_EXP))
     {
         return;
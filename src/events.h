@@ -48,8 +48,10 @@ void disable_expansion(struct wiimote_t *wm);
 
 void propagate_event(struct wiimote_t *wm, byte event, byte *msg);
 void idle_cycle(struct wiimote_t *wm);
+unsigned long idle_deadline(struct wiimote_t *wm);
 
 void clear_dirty_reads(struct wiimote_t *wm);
+void fill_callback_data(struct wiimote_t *wm, struct wiimote_callback_data_t *s);
 /** @} */
 
 #endif /* EVENTS_H_INCLUDED */
@@ -0,0 +1,383 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+
+/**
+ *	@file
+ *	@brief Q16.16 fixed-point math.
+ *
+ *	Trig comes from 65 entry tables with linear interpolation,
+ *	square roots from an integer bit-by-bit root. Nothing here
+ *	touches the FPU except the final conversion of each result
+ *	into the float fields of the public structures.
+ *
+ *	The kernels are always built so the test suite can compare
+ *	them with the float code on any host.
+ */
+
+#include "fixed.h"
+
+#include <stdlib.h> /* for abs */
+
+/* sin(90 * i / 64 degrees), Q16.16 */
+static const fixed_t fixed_sin_table[65] = {
+    0, 1608, 3216, 4821, 6424, 8022, 9616, 11204,
+    12785, 14359, 15924, 17479, 19024, 20557, 22078, 23586,
+    25080, 26558, 28020, 29466, 30893, 32303, 33692, 35062,
+    36410, 37736, 39040, 40320, 41576, 42806, 44011, 45190,
+    46341, 47464, 48559, 49624, 50660, 51665, 52639, 53581,
+    54491, 55368, 56212, 57022, 57798, 58538, 59244, 59914,
+    60547, 61145, 61705, 62228, 62714, 63162, 63572, 63944,
+    64277, 64571, 64827, 65043, 65220, 65358, 65457, 65516,
+    65536
+};
+
+/* atan(i / 64) in degrees, Q16.16 */
+static const fixed_t fixed_atan_table[65] = {
+    0, 58666, 117304, 175884, 234379, 292760, 350999, 409070,
+    466945, 524598, 582003, 639135, 695970, 752484, 808654, 864460,
+    919879, 974893, 1029481, 1083627, 1137313, 1190524, 1243245, 1295461,
+    1347161, 1398332, 1448965, 1499049, 1548575, 1597536, 1645926, 1693738,
+    1740967, 1787610, 1833663, 1879123, 1923990, 1968261, 2011937, 2055018,
+    2097505, 2139399, 2180703, 2221419, 2261551, 2301101, 2340074, 2378474,
+    2416306, 2453574, 2490285, 2526443, 2562055, 2597126, 2631664, 2665673,
+    2699161, 2732134, 2764600, 2796564, 2828035, 2859019, 2889523, 2919554,
+    2949120
+};
+
+#define FIXED_DEG_90 FIXED_FROM_INT(90)
+#define FIXED_DEG_180 FIXED_FROM_INT(180)
+#define FIXED_DEG_360 FIXED_FROM_INT(360)
+
+/*
+ *	Normalized readings are kept in Q8.24 before they go into atan2
+ *	and hypot. In Q16.16 a reading of 1 or 2 counts above zero loses
+ *	enough in the division to move the angle by 0.01 degrees.
+ */
+#define UNIT_SHIFT 24
+#define UNIT_ONE (1 << UNIT_SHIFT)
+#define UNIT_TO_FLOAT(x) ((float)(x) * (1.0f / (float)UNIT_ONE))
+
+/* balance board kg per calibration point, WIIBOARD_MIDDLE_CALIB in wiiboard.c */
+#define FIXED_BOARD_CALIB 17
+
+/**
+ *	@brief Integer square root, rounded down.
+ */
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t root = 0;
+    uint64_t bit  = (uint64_t)1 << 62;
+
+    while (bit > v)
+    {
+        bit >>= 2;
+    }
+
+    while (bit)
+    {
+        if (v >= root + bit)
+        {
+            v   -= root + bit;
+            root = (root >> 1) + bit;
+        } else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)root;
+}
+
+/**
+ *	@brief sqrt(x * x + y * y) without overflow.
+ *
+ *	The result has the same number of fraction bits as the inputs.
+ */
+fixed_t fixed_hypot(fixed_t x, fixed_t y)
+{
+    int64_t xx = (int64_t)x * x;
+    int64_t yy = (int64_t)y * y;
+
+    /* the root of the 64 bit sum of squares is back in the input format */
+    return (fixed_t)isqrt64((uint64_t)xx + (uint64_t)yy);
+}
+
+/**
+ *	@brief atan(t) in degrees for t in [0, 1].
+ */
+static fixed_t atan_unit(fixed_t t)
+{
+    int idx  = t >> 10;
+    int frac = t & 0x3FF;
+
+    if (idx >= 64)
+    {
+        return fixed_atan_table[64];
+    }
+
+    return fixed_atan_table[idx] + (((fixed_atan_table[idx + 1] - fixed_atan_table[idx]) * frac) >> 10);
+}
+
+/**
+ *	@brief Fixed-point atan2(), in degrees.
+ *
+ *	@param y		Y coordinate, any scale.
+ *	@param x		X coordinate, same scale as \a y.
+ *
+ *	@return The angle in (-180, 180], within 0.002 degrees of atan2f().
+ */
+fixed_t fixed_atan2_deg(fixed_t y, fixed_t x)
+{
+    int64_t ax = (x < 0) ? -(int64_t)x : x;
+    int64_t ay = (y < 0) ? -(int64_t)y : y;
+    fixed_t a;
+
+    if (!ax && !ay)
+    {
+        return 0;
+    }
+
+    /* fold into the first octant so the table argument is in [0, 1] */
+    if (ay <= ax)
+    {
+        a = atan_unit((fixed_t)((ay << FIXED_SHIFT) / ax));
+    } else
+    {
+        a = FIXED_DEG_90 - atan_unit((fixed_t)((ax << FIXED_SHIFT) / ay));
+    }
+
+    if (x < 0)
+    {
+        a = FIXED_DEG_180 - a;
+    }
+
+    return (y < 0) ? -a : a;
+}
+
+/**
+ *	@brief sin() over a quarter turn.
+ *
+ *	@param ang		Angle in [0, 90] degrees.
+ */
+static fixed_t sin_quarter(fixed_t ang)
+{
+    /* position in the table, Q16.16 */
+    int64_t pos = ((int64_t)ang * 64) / 90;
+    int idx     = (int)(pos >> FIXED_SHIFT);
+    int64_t frac = pos & (FIXED_ONE - 1);
+
+    if (idx >= 64)
+    {
+        return fixed_sin_table[64];
+    }
+
+    return fixed_sin_table[idx] + (fixed_t)(((fixed_sin_table[idx + 1] - fixed_sin_table[idx]) * frac) >> FIXED_SHIFT);
+}
+
+/**
+ *	@brief Fixed-point sine and cosine.
+ *
+ *	@param ang		Angle in degrees, any range.
+ *	@param s		[out] sin(ang)
+ *	@param c		[out] cos(ang)
+ */
+void fixed_sincos_deg(fixed_t ang, fixed_t *s, fixed_t *c)
+{
+    fixed_t r;
+    int quadrant;
+
+    ang %= FIXED_DEG_360;
+    if (ang < 0)
+    {
+        ang += FIXED_DEG_360;
+    }
+
+    quadrant = ang / FIXED_DEG_90;
+    r        = ang - (quadrant * FIXED_DEG_90);
+
+    switch (quadrant)
+    {
+    case 0:
+        *s = sin_quarter(r);
+        *c = sin_quarter(FIXED_DEG_90 - r);
+        break;
+    case 1:
+        *s = sin_quarter(FIXED_DEG_90 - r);
+        *c = -sin_quarter(r);
+        break;
+    case 2:
+        *s = -sin_quarter(r);
+        *c = -sin_quarter(FIXED_DEG_90 - r);
+        break;
+    default:
+        *s = -sin_quarter(FIXED_DEG_90 - r);
+        *c = sin_quarter(r);
+        break;
+    }
+}
+
+/**
+ *	@brief Normalize one accelerometer axis to +/- 1g, in Q8.24.
+ */
+static int32_t accel_axis(int raw, int zero, int g)
+{
+    int d = raw - zero;
+
+    if (!g)
+    {
+        return 0;
+    }
+
+    if (d <= -g)
+    {
+        return -UNIT_ONE;
+    } else if (d >= g)
+    {
+        return UNIT_ONE;
+    }
+    return (int32_t)(((int64_t)d * UNIT_ONE) / g);
+}
+
+/**
+ *	@brief Fixed-point version of calculate_orientation().
+ *
+ *	@param ac			An accelerometer (accel_t) structure.
+ *	@param accel		[in] Raw acceleration data.
+ *	@param orient		[out] Orientation, unsmoothed.
+ *
+ *	Keeps the previous angle when the reading is over 1g, like the float code.
+ */
+void fixed_orientation(struct accel_t *ac, struct vec3b_t *accel, struct orient_t *orient)
+{
+    int32_t x = accel_axis(accel->x, ac->cal_zero.x, ac->cal_g.x);
+    int32_t y = accel_axis(accel->y, ac->cal_zero.y, ac->cal_g.y);
+    int32_t z = accel_axis(accel->z, ac->cal_zero.z, ac->cal_g.z);
+
+    orient->yaw = 0.0f;
+
+    if (abs(accel->x - ac->cal_zero.x) <= ac->cal_g.x)
+    {
+        float roll = FIXED_TO_FLOAT(fixed_atan2_deg(x, z));
+
+        orient->roll   = roll;
+        orient->a_roll = roll;
+    }
+
+    if (abs(accel->y - ac->cal_zero.y) <= ac->cal_g.y)
+    {
+        float pitch = FIXED_TO_FLOAT(fixed_atan2_deg(y, fixed_hypot(x, z)));
+
+        orient->pitch   = pitch;
+        orient->a_pitch = pitch;
+    }
+}
+
+/**
+ *	@brief Map a raw joystick axis to [-1, 1] in Q8.24, see applyCalibration() in dynamics.c.
+ */
+static int32_t joystick_axis(int in, int minval, int maxval, int centerval)
+{
+    if (in == centerval)
+    {
+        return 0;
+    } else if (in < centerval)
+    {
+        return (int32_t)(((int64_t)(in - minval) * UNIT_ONE) / (centerval - minval + 1)) - UNIT_ONE;
+    }
+    return (int32_t)(((int64_t)(in - centerval) * UNIT_ONE) / (maxval - centerval + 1));
+}
+
+/**
+ *	@brief Fixed-point version of calc_joystick_state().
+ *
+ *	@param js	[out] Pointer to a joystick_t structure.
+ *	@param x	The raw x-axis value.
+ *	@param y	The raw y-axis value.
+ */
+void fixed_joystick_state(struct joystick_t *js, int x, int y)
+{
+    int32_t rx = joystick_axis(x, js->min.x, js->max.x, js->center.x);
+    int32_t ry = joystick_axis(y, js->min.y, js->max.y, js->center.y);
+
+    js->x   = UNIT_TO_FLOAT(rx);
+    js->y   = UNIT_TO_FLOAT(ry);
+    js->ang = FIXED_TO_FLOAT(fixed_atan2_deg(ry, rx) + FIXED_DEG_180);
+    js->mag = UNIT_TO_FLOAT(fixed_hypot(rx, ry));
+}
+
+/**
+ *	@brief Fixed-point version of fix_rotated_ir_dots() in ir.c.
+ *
+ *	@param dot		An array of 4 ir_dot_t objects.
+ *	@param ang		The roll angle to correct by (-180, 180)
+ */
+void fixed_rotate_ir_dots(struct ir_dot_t *dot, float ang)
+{
+    fixed_t s, c;
+    int x, y;
+    int i;
+
+    fixed_sincos_deg(FIXED_FROM_FLOAT(ang), &s, &c);
+
+    for (i = 0; i < 4; ++i)
+    {
+        if (!dot[i].visible)
+        {
+            continue;
+        }
+
+        x = dot[i].rx - (1024 / 2);
+        y = dot[i].ry - (768 / 2);
+
+        /* divide rather than shift to truncate toward zero like the float cast */
+        dot[i].x = (uint32_t)(((c * x) - (s * y)) / FIXED_ONE) + (1024 / 2);
+        dot[i].y = (uint32_t)(((s * x) + (c * y)) / FIXED_ONE) + (768 / 2);
+    }
+}
+
+/**
+ *	@brief Fixed-point version of do_interpolate() in wiiboard.c.
+ *
+ *	@param raw		Raw sensor reading.
+ *	@param cal		Sensor readings at 0, 17 and 34 kg.
+ *
+ *	@return The weight on the sensor in kg.
+ */
+fixed_t fixed_interpolate_board(uint16_t raw, uint16_t cal[3])
+{
+    if (raw < cal[0])
+    {
+        return 0;
+    } else if (raw < cal[1])
+    {
+        return (fixed_t)(((int64_t)(raw - cal[0]) * FIXED_BOARD_CALIB * FIXED_ONE) / (cal[1] - cal[0]));
+    } else if (raw < cal[2])
+    {
+        return (fixed_t)(((int64_t)(raw - cal[1]) * FIXED_BOARD_CALIB * FIXED_ONE) / (cal[2] - cal[1]))
+               + FIXED_FROM_INT(FIXED_BOARD_CALIB);
+    } else
+    {
+        return FIXED_FROM_INT(FIXED_BOARD_CALIB * 2);
+    }
+}
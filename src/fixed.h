@@ -0,0 +1,69 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+
+/**
+ *	@file
+ *	@brief Q16.16 fixed-point math.
+ *
+ *	Integer versions of the float kernels used while decoding
+ *	reports, for targets without a fast FPU. They are selected
+ *	with WIIUSE_FIXED_POINT.
+ */
+
+#ifndef FIXED_H_INCLUDED
+#define FIXED_H_INCLUDED
+
+#include "wiiuse_internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @defgroup internal_fixed Internal: Fixed-Point Math */
+/** @{ */
+
+/* signed 16.16 fixed-point number */
+typedef int32_t fixed_t;
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+
+#define FIXED_FROM_INT(i) ((fixed_t)(i)*FIXED_ONE)
+#define FIXED_FROM_FLOAT(f) ((fixed_t)((f) * (float)FIXED_ONE))
+#define FIXED_TO_FLOAT(x) ((float)(x) * (1.0f / (float)FIXED_ONE))
+
+fixed_t fixed_hypot(fixed_t x, fixed_t y);
+fixed_t fixed_atan2_deg(fixed_t y, fixed_t x);
+void fixed_sincos_deg(fixed_t ang, fixed_t *s, fixed_t *c);
+
+void fixed_orientation(struct accel_t *ac, struct vec3b_t *accel, struct orient_t *orient);
+void fixed_joystick_state(struct joystick_t *js, int x, int y);
+void fixed_rotate_ir_dots(struct ir_dot_t *dot, float ang);
+fixed_t fixed_interpolate_board(uint16_t raw, uint16_t cal[3]);
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FIXED_H_INCLUDED */
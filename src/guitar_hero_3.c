@@ -83,9 +83,9 @@ int guitar_hero_3_handshake(struct wiimote_t *wm, struct guitar_hero_3_t *gh3, b
         if (data[16] == 0xFF)
         {
             /* get the calibration data */
-            byte *handshake_buf = (byte *)malloc(EXP_HANDSHAKE_LEN * sizeof(byte));
+            byte *handshake_buf = (byte *)wiiuse_ctx_malloc(wm->ctx, EXP_HANDSHAKE_LEN * sizeof(byte));
 
-            WIIUSE_DEBUG("Guitar Hero 3 handshake appears invalid, trying again.");
+            WIIUSE_CTX_DEBUG(wm->ctx, "Guitar Hero 3 handshake appears invalid, trying again.");
             wiiuse_read_data_cb(wm, handshake_expansion, handshake_buf, WM_EXP_MEM_CALIBR, EXP_HANDSHAKE_LEN);
 
             return 0;
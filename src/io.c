@@ -32,13 +32,17 @@
  */
 
 #include "io.h"
-#include "events.h" /* for propagate_event */
-#include "ir.h"     /* for wiiuse_set_ir_mode */
+#include "dynamics.h" /* for calculate_accel_gains */
+#include "events.h"   /* for propagate_event */
+#include "ir.h"       /* for wiiuse_set_ir_mode */
+#include "loop.h"     /* for loop_forget */
 #include "wiiuse_internal.h"
 
 #include "os.h" /* for wiiuse_os_* */
 
+#include <ctype.h>  /* for toupper */
 #include <stdlib.h> /* for free, malloc */
+#include <string.h> /* for strlen */
 
 /**
  *  @brief Find a wiimote or wiimotes.
@@ -107,6 +111,143 @@ int wiiuse_connect(struct wiimote_t **wm, int wiimotes) { return wiiuse_os_conne
  */
 void wiiuse_disconnect(struct wiimote_t *wm) { wiiuse_os_disconnect(wm); }
 
+/**
+ *  @brief Keep looking for wiimotes in the background.
+ *
+ *  @param ctx        The context, or NULL for the default one.
+ *  @param interval   Seconds between the end of one inquiry and the
+ *                    start of the next, 0 to stop.
+ *
+ *  @return 1 on success, 0 if discovery could not be started.
+ *
+ *  @see wiiuse_find()
+ *  @see wiiuse_os_set_discovery()
+ *
+ *  Unlike wiiuse_find() this does not block. The inquiries are run
+ *  by wiiuse_poll() on the wiimote array of \a ctx. A new remote
+ *  takes the next slot that is neither found nor connected and gets
+ *  a WIIUSE_FOUND event. Once the inquiry is over, the remotes
+ *  found by it are connected and get the usual WIIUSE_CONNECT event.
+ *  Remotes that were connected before and come back are connected
+ *  again in their old slot.
+ *
+ *  This function only delegates to the platform-specific implementation
+ *  wiiuse_os_set_discovery.
+ *
+ *  This function is declared in wiiuse.h
+ */
+int wiiuse_set_background_discovery(struct wiiuse_context_t *ctx, int interval)
+{
+    if (!ctx)
+    {
+        ctx = wiiuse_default_context();
+    }
+
+    /* the socket is closed, and maybe opened again with the same number */
+    if (ctx->discovery.enabled)
+    {
+        loop_forget(ctx, ctx->discovery.sock);
+    }
+
+    return wiiuse_os_set_discovery(ctx, interval);
+}
+
+/**
+ *  @brief Let wiimotes connect to us.
+ *
+ *  @param ctx      The context, or NULL for the default one.
+ *  @param enable   1 to listen, 0 to stop.
+ *
+ *  @return 1 on success, 0 if listening is not possible.
+ *
+ *  @see wiiuse_allow_incoming()
+ *  @see wiiuse_os_set_incoming()
+ *
+ *  A wiimote that is paired with this computer connects back by
+ *  itself when a button is pressed, no inquiry needed. wiiuse_poll()
+ *  on the wiimote array of \a ctx accepts such connections from the
+ *  addresses already in the array, and from those given to
+ *  wiiuse_allow_incoming(). A known wiimote gets its old slot back,
+ *  an allowed one takes the next free slot. Either way it then goes
+ *  through the same handshake as after wiiuse_connect(). Everything
+ *  else is refused.
+ *
+ *  On BlueZ the HID input service of bluetoothd may already be
+ *  listening on the wiimote channels, it has to be disabled.
+ *
+ *  This function only delegates to the platform-specific implementation
+ *  wiiuse_os_set_incoming.
+ *
+ *  This function is declared in wiiuse.h
+ */
+int wiiuse_set_accept_incoming(struct wiiuse_context_t *ctx, int enable)
+{
+    if (!ctx)
+    {
+        ctx = wiiuse_default_context();
+    }
+
+    if (ctx->incoming.enabled)
+    {
+        loop_forget(ctx, ctx->incoming.sock[0]);
+        loop_forget(ctx, ctx->incoming.sock[1]);
+    }
+
+    return wiiuse_os_set_incoming(ctx, enable);
+}
+
+/**
+ *  @brief Accept incoming connections from an address.
+ *
+ *  @param ctx        The context, or NULL for the default one.
+ *  @param address    Bluetooth address like "00:1F:32:AA:BB:CC".
+ *
+ *  @return 1 on success, 0 if the address is malformed or the list is full.
+ *
+ *  @see wiiuse_set_accept_incoming()
+ *
+ *  Used for wiimotes that were paired in an earlier session
+ *  and are not in the wiimote array yet.
+ *
+ *  This function is declared in wiiuse.h
+ */
+int wiiuse_allow_incoming(struct wiiuse_context_t *ctx, const char *address)
+{
+    struct wiiuse_incoming_t *incoming;
+    char *addr;
+    int i;
+
+    if (!ctx)
+    {
+        ctx = wiiuse_default_context();
+    }
+    incoming = &ctx->incoming;
+
+    if (!address || (strlen(address) != 17))
+    {
+        WIIUSE_CTX_ERROR(ctx, "Not a Bluetooth address: %s", address ? address : "(null)");
+        return 0;
+    }
+
+    if (incoming->allowed_count == WIIUSE_MAX_INCOMING_ALLOWED)
+    {
+        WIIUSE_CTX_ERROR(ctx, "Too many addresses allowed to connect, at most %i.",
+                         WIIUSE_MAX_INCOMING_ALLOWED);
+        return 0;
+    }
+
+    /* same case as the addresses we compare with */
+    addr = incoming->allowed[incoming->allowed_count];
+    for (i = 0; i < 17; ++i)
+    {
+        addr[i] = (char)toupper((unsigned char)address[i]);
+    }
+    addr[17] = '\0';
+
+    ++incoming->allowed_count;
+    return 1;
+}
+
 /**
 *    @brief Wait until specified report arrives and return it
 *
@@ -140,8 +281,8 @@ int wiiuse_wait_report(struct wiimote_t *wm, int report, byte *buffer, int buffe
             {
                 if (buffer[0] != 0x30) /* hack for chatty devices spamming the button report */
                 {
-                    WIIUSE_DEBUG("(id %i) dropping report 0x%x, waiting for 0x%x", wm->unid, buffer[0],
-                                 report);
+                    WIIUSE_CTX_DEBUG(wm->ctx, "(id %i) dropping report 0x%x, waiting for 0x%x", wm->unid,
+                                     buffer[0], report);
                 }
             }
         }
@@ -150,7 +291,7 @@ int wiiuse_wait_report(struct wiimote_t *wm, int report, byte *buffer, int buffe
         if (elapsed > timeout_ms && timeout_ms > 0)
         {
             result = -1;
-            WIIUSE_DEBUG("(id %i) timeout waiting for report 0x%x, aborting!", wm->unid, report);
+            WIIUSE_CTX_DEBUG(wm->ctx, "(id %i) timeout waiting for report 0x%x, aborting!", wm->unid, report);
             break;
         }
         wiiuse_millisleep(10);
@@ -282,7 +423,7 @@ void wiiuse_handshake(struct wiimote_t *wm, byte *data, uint16_t len)
         byte val = 0x55;
         wiiuse_write_data(wm, WM_EXP_MEM_ENABLE1, &val, 1);
 
-        WIIUSE_DEBUG("Wiimote reset!\n");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Wiimote reset!\n");
     }
 
     /* step 1 - calibration of accelerometers */
@@ -299,8 +440,9 @@ void wiiuse_handshake(struct wiimote_t *wm, byte *data, uint16_t len)
         accel->cal_g.x = buf[4] - accel->cal_zero.x;
         accel->cal_g.y = buf[5] - accel->cal_zero.y;
         accel->cal_g.z = buf[6] - accel->cal_zero.z;
+        calculate_accel_gains(accel);
 
-        WIIUSE_DEBUG("Calibrated wiimote acc\n");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Calibrated wiimote acc\n");
     }
 
     /* step 2 - re-enable IR and ask for status */
@@ -311,7 +453,7 @@ void wiiuse_handshake(struct wiimote_t *wm, byte *data, uint16_t len)
         /* now enable IR if it was set before the handshake completed */
         if (WIIMOTE_IS_SET(wm, WIIMOTE_STATE_IR))
         {
-            WIIUSE_DEBUG("Handshake finished, enabling IR.");
+            WIIUSE_CTX_DEBUG(wm->ctx, "Handshake finished, enabling IR.");
             WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_IR);
             wiiuse_set_ir(wm, 1);
         }
@@ -324,7 +466,7 @@ void wiiuse_handshake(struct wiimote_t *wm, byte *data, uint16_t len)
         {
             int rc = 0;
 
-            WIIUSE_DEBUG("Asking for status, attempt %d ...\n", i);
+            WIIUSE_CTX_DEBUG(wm->ctx, "Asking for status, attempt %d ...\n", i);
             wm->event = WIIUSE_CONNECT;
 
             wiiuse_status(wm);
@@ -367,7 +509,7 @@ void wiiuse_handshake(struct wiimote_t *wm, byte *data, uint16_t len)
         wiiuse_set_report_type(wm);
 
         /* send request to wiimote for accelerometer calibration */
-        buf = (byte *)malloc(sizeof(byte) * 8);
+        buf = (byte *)wiiuse_ctx_malloc(wm->ctx, sizeof(byte) * 8);
         wiiuse_read_data_cb(wm, wiiuse_handshake, buf, WM_MEM_OFFSET_CALIBRATION, 7);
         wm->handshake_state++;
 
@@ -390,14 +532,16 @@ void wiiuse_handshake(struct wiimote_t *wm, byte *data, uint16_t len)
         accel->cal_g.x = req->buf[4] - accel->cal_zero.x;
         accel->cal_g.y = req->buf[5] - accel->cal_zero.y;
         accel->cal_g.z = req->buf[6] - accel->cal_zero.z;
+        calculate_accel_gains(accel);
 
         /* done with the buffer */
-        free(req->buf);
+        wiiuse_ctx_free(wm->ctx, req->buf);
 
         /* handshake is done */
-        WIIUSE_DEBUG("Handshake finished. Calibration: Idle: X=%x Y=%x Z=%x\t+1g: X=%x Y=%x Z=%x",
-                     accel->cal_zero.x, accel->cal_zero.y, accel->cal_zero.z, accel->cal_g.x, accel->cal_g.y,
-                     accel->cal_g.z);
+        WIIUSE_CTX_DEBUG(wm->ctx,
+                         "Handshake finished. Calibration: Idle: X=%x Y=%x Z=%x\t+1g: X=%x Y=%x Z=%x",
+                         accel->cal_zero.x, accel->cal_zero.y, accel->cal_zero.z, accel->cal_g.x,
+                         accel->cal_g.y, accel->cal_g.z);
 
         /* M+ off */
         val = 0x55;
@@ -416,7 +560,7 @@ void wiiuse_handshake(struct wiimote_t *wm, byte *data, uint16_t len)
         /* now enable IR if it was set before the handshake completed */
         if (WIIMOTE_IS_SET(wm, WIIMOTE_STATE_IR))
         {
-            WIIUSE_DEBUG("Handshake finished, enabling IR.");
+            WIIUSE_CTX_DEBUG(wm->ctx, "Handshake finished, enabling IR.");
             WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_IR);
             wiiuse_set_ir(wm, 1);
         }
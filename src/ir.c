@@ -32,16 +32,38 @@
  */
 
 #include "ir.h"
+#include "fixed.h" /* for fixed_rotate_ir_dots */
+#include "os.h" /* for wiiuse_os_ticks */
 
-#include <math.h> /* for atanf, cos, sin, sqrt */
+#include <math.h>   /* for atanf, cos, sin, sqrt */
+#include <string.h> /* for memset */
+
+/* the cached sin/cos of the roll correction is reused within this many degrees */
+#define IR_ROLL_EPSILON 0.01f
+
+/* alpha-beta filter gains of the cursor predictor */
+#define IR_PREDICT_ALPHA 0.6f
+#define IR_PREDICT_BETA 0.2f
+
+/* weight of the newest report in the running prediction error */
+#define IR_PREDICT_ERROR_WEIGHT 0.05f
+
+/* assumed time between reports read in the same poll, in milliseconds */
+#define IR_PREDICT_MIN_DT 5
+
+/* the cursor is not extrapolated further than this, in milliseconds */
+#define IR_PREDICT_MAX_HORIZON 100
+
+/* after a longer pause the predictor starts over */
+#define IR_PREDICT_MAX_GAP 250
 
 static int get_ir_sens(struct wiimote_t *wm, const byte **block1, const byte **block2);
 static void interpret_ir_data(struct wiimote_t *wm);
-static void fix_rotated_ir_dots(struct ir_dot_t *dot, float ang);
-static void get_ir_dot_avg(struct ir_dot_t *dot, int *x, int *y);
+static void update_ir_prediction(struct ir_predict_t *p, int x, int y, unsigned long ts);
+static void fix_rotated_ir_dots(struct ir_t *ir, float ang, int *sum_x, int *sum_y);
 static void reorder_ir_dots(struct ir_dot_t *dot);
 static float ir_distance(struct ir_dot_t *dot);
-static int ir_correct_for_bounds(int *x, int *y, enum aspect_t aspect, int offset_x, int offset_y);
+static int ir_correct_to_vres(struct ir_t *ir, int *x, int *y);
 static void ir_convert_to_vres(int *x, int *y, enum aspect_t aspect, int vx, int vy);
 
 /* ir block data */
@@ -56,6 +78,27 @@ static const byte WM_IR_BLOCK2_LEVEL4[] = "\x35\x03";
 static const byte WM_IR_BLOCK1_LEVEL5[] = "\x07\x00\x00\x71\x01\x00\x72\x00\x20";
 static const byte WM_IR_BLOCK2_LEVEL5[] = "\x1f\x03";
 
+/**
+ *	@brief	Pick the IR camera mode that fits the report type.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *
+ *	Reports with expansion data only have room for basic IR.
+ *	The interleaved reports of full mode have no expansion data.
+ */
+static byte get_ir_mode(struct wiimote_t *wm)
+{
+    if (WIIMOTE_IS_FLAG_SET(wm, WIIUSE_IR_FULL))
+    {
+        return WM_IR_TYPE_FULL;
+    } else if (WIIMOTE_IS_SET(wm, WIIMOTE_STATE_EXP))
+    {
+        return WM_IR_TYPE_BASIC;
+    }
+
+    return WM_IR_TYPE_EXTENDED;
+}
+
 void wiiuse_set_ir_mode(struct wiimote_t *wm)
 {
     byte buf = 0x00;
@@ -69,13 +112,7 @@ void wiiuse_set_ir_mode(struct wiimote_t *wm)
         return;
     }
 
-    if (WIIMOTE_IS_SET(wm, WIIMOTE_STATE_EXP))
-    {
-        buf = WM_IR_TYPE_BASIC;
-    } else
-    {
-        buf = WM_IR_TYPE_EXTENDED;
-    }
+    buf = get_ir_mode(wm);
     wiiuse_write_data(wm, WM_REG_IR_MODENUM, &buf, 1);
 }
 /**
@@ -106,7 +143,7 @@ void wiiuse_set_ir(struct wiimote_t *wm, int status)
     {
         if (status)
         {
-            WIIUSE_DEBUG("Tried to enable IR, will wait until handshake finishes.");
+            WIIUSE_CTX_DEBUG(wm->ctx, "Tried to enable IR, will wait until handshake finishes.");
             WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_IR);
         } /* else ignoring request to turn off, since it's turned off by default */
         return;
@@ -118,7 +155,7 @@ void wiiuse_set_ir(struct wiimote_t *wm, int status)
     ir_level = get_ir_sens(wm, &block1, &block2);
     if (!ir_level)
     {
-        WIIUSE_ERROR("No IR sensitivity setting selected.");
+        WIIUSE_CTX_ERROR(wm->ctx, "No IR sensitivity setting selected.");
         return;
     }
 
@@ -147,7 +184,7 @@ void wiiuse_set_ir(struct wiimote_t *wm, int status)
 
     if (!status)
     {
-        WIIUSE_DEBUG("Disabled IR cameras for wiimote id %i.", wm->unid);
+        WIIUSE_CTX_DEBUG(wm->ctx, "Disabled IR cameras for wiimote id %i.", wm->unid);
         wiiuse_set_report_type(wm);
         return;
     }
@@ -164,13 +201,7 @@ void wiiuse_set_ir(struct wiimote_t *wm, int status)
     wiiuse_write_data(wm, WM_REG_IR_BLOCK2, (byte *)block2, 2);
 
     /* set the IR mode */
-    if (WIIMOTE_IS_SET(wm, WIIMOTE_STATE_EXP))
-    {
-        buf = WM_IR_TYPE_BASIC;
-    } else
-    {
-        buf = WM_IR_TYPE_EXTENDED;
-    }
+    buf = get_ir_mode(wm);
     wiiuse_write_data(wm, WM_REG_IR_MODENUM, &buf, 1);
 
     wiiuse_millisleep(50);
@@ -178,7 +209,8 @@ void wiiuse_set_ir(struct wiimote_t *wm, int status)
     /* set the wiimote report type */
     wiiuse_set_report_type(wm);
 
-    WIIUSE_DEBUG("Enabled IR camera for wiimote id %i (sensitivity level %i).", wm->unid, ir_level);
+    WIIUSE_CTX_DEBUG(wm->ctx, "Enabled IR camera for wiimote id %i (sensitivity level %i).", wm->unid,
+                     ir_level);
 }
 
 /**
@@ -377,7 +409,169 @@ void wiiuse_set_ir_sensitivity(struct wiimote_t *wm, int level)
     wiiuse_write_data(wm, WM_REG_IR_BLOCK1, block1, 9);
     wiiuse_write_data(wm, WM_REG_IR_BLOCK2, block2, 2);
 
-    WIIUSE_DEBUG("Set IR sensitivity to level %i (unid %i)", level, wm->unid);
+    WIIUSE_CTX_DEBUG(wm->ctx, "Set IR sensitivity to level %i (unid %i)", level, wm->unid);
+}
+
+/**
+ *	@brief	Use the interleaved full IR mode.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param status	1 to enable, 0 to disable.
+ *
+ *	Full mode adds dot size, bounding box and intensity even with an
+ *	expansion attached. Every report is split over the interleaved
+ *	reports 0x3e and 0x3f, which carry the accelerometer but no
+ *	expansion data, so the expansion is not read while this is on.
+ *	A full set of IR dots and accelerometer data arrives with every
+ *	second report.
+ */
+void wiiuse_set_ir_full(struct wiimote_t *wm, int status)
+{
+    if (!wm)
+    {
+        return;
+    }
+
+    if (status)
+    {
+        WIIMOTE_ENABLE_FLAG(wm, WIIUSE_IR_FULL);
+    } else
+    {
+        WIIMOTE_DISABLE_FLAG(wm, WIIUSE_IR_FULL);
+    }
+    wm->ir.half_pending = 0;
+
+    if (WIIMOTE_IS_SET(wm, WIIMOTE_STATE_HANDSHAKE_COMPLETE))
+    {
+        wiiuse_set_ir_mode(wm);
+        wiiuse_set_report_type(wm);
+    }
+}
+
+/**
+ *	@brief Enable or disable IR cursor prediction.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param status	1 to enable, 0 to disable.
+ *
+ *	The cursor is run through an alpha-beta filter on every IR
+ *	report so wiiuse_predict_ir() can extrapolate it. The error
+ *	of the filter's own one-report-ahead guess is kept in
+ *	wm->ir.predict to help pick a sensible lead.
+ */
+void wiiuse_set_ir_prediction(struct wiimote_t *wm, int status)
+{
+    if (!wm)
+    {
+        return;
+    }
+
+    memset(&wm->ir.predict, 0, sizeof(wm->ir.predict));
+    wm->ir.predict.enabled = status ? 1 : 0;
+}
+
+/**
+ *	@brief Extrapolate the IR cursor.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param lead		Milliseconds from now to the time the cursor is wanted for,
+ *					for example the time left until the next vsync.
+ *	@param x		[out] Predicted X coordinate.
+ *	@param y		[out] Predicted Y coordinate.
+ *
+ *	@return 1 if a prediction was made, 0 if prediction is off
+ *	        or no cursor is visible.
+ *
+ *	The age of the last report is added to \a lead, so the
+ *	result does not depend on when the events were polled.
+ *	The total horizon is capped at IR_PREDICT_MAX_HORIZON and
+ *	stored in wm->ir.predict.horizon.
+ */
+int wiiuse_predict_ir(struct wiimote_t *wm, int lead, int *x, int *y)
+{
+    struct ir_predict_t *p;
+    long horizon;
+    float dt;
+
+    if (!wm || !x || !y)
+    {
+        return 0;
+    }
+
+    p = &wm->ir.predict;
+    if (!p->enabled || !p->valid)
+    {
+        return 0;
+    }
+
+    horizon = (long)(wiiuse_os_ticks() - p->ts) + lead;
+    if (horizon < 0)
+    {
+        horizon = 0;
+    } else if (horizon > IR_PREDICT_MAX_HORIZON)
+    {
+        horizon = IR_PREDICT_MAX_HORIZON;
+    }
+    p->horizon = (unsigned long)horizon;
+
+    dt = (float)horizon / 1000.0f;
+    *x = (int)(p->x + p->vx * dt + 0.5f);
+    *y = (int)(p->y + p->vy * dt + 0.5f);
+
+    return 1;
+}
+
+/**
+ *	@brief Feed a new cursor position to the predictor.
+ *
+ *	@param p		The predictor.
+ *	@param x		Cursor X coordinate of the report.
+ *	@param y		Cursor Y coordinate of the report.
+ *	@param ts		Time the report was received, in milliseconds.
+ *
+ *	Reports read in the same poll share a timestamp, so each one is
+ *	taken to be at least IR_PREDICT_MIN_DT after the previous one.
+ *	The time of the predictor moves on by that much as well, and may
+ *	run ahead of \a ts until the burst has been read.
+ */
+static void update_ir_prediction(struct ir_predict_t *p, int x, int y, unsigned long ts)
+{
+    long elapsed = (long)(ts - p->ts);
+    float dt, px, py, rx, ry, err_sq, mean_sq;
+
+    if (!p->valid || elapsed > IR_PREDICT_MAX_GAP)
+    {
+        p->x     = (float)x;
+        p->y     = (float)y;
+        p->vx    = 0.0f;
+        p->vy    = 0.0f;
+        p->ts    = ts;
+        p->valid = 1;
+        return;
+    }
+
+    if (elapsed < IR_PREDICT_MIN_DT)
+    {
+        elapsed = IR_PREDICT_MIN_DT;
+    }
+    dt = (float)elapsed / 1000.0f;
+
+    px = p->x + p->vx * dt;
+    py = p->y + p->vy * dt;
+    rx = (float)x - px;
+    ry = (float)y - py;
+
+    err_sq       = (rx * rx) + (ry * ry);
+    mean_sq      = p->rms_error * p->rms_error;
+    mean_sq     += IR_PREDICT_ERROR_WEIGHT * (err_sq - mean_sq);
+    p->error     = sqrtf(err_sq);
+    p->rms_error = sqrtf(mean_sq);
+
+    p->x   = px + IR_PREDICT_ALPHA * rx;
+    p->y   = py + IR_PREDICT_ALPHA * ry;
+    p->vx += (IR_PREDICT_BETA / dt) * rx;
+    p->vy += (IR_PREDICT_BETA / dt) * ry;
+    p->ts += (unsigned long)elapsed;
 }
 
 /**
@@ -450,6 +644,54 @@ void calculate_extended_ir(struct wiimote_t *wm, byte *data)
     interpret_ir_data(wm);
 }
 
+/**
+ *	@brief Decode two IR spots in full IR mode format.
+ */
+static void decode_full_ir_dots(struct ir_dot_t *dot, byte *data)
+{
+    int i;
+
+    for (i = 0; i < 2; ++i, data += 9)
+    {
+        dot[i].rx      = 1023 - (data[0] | ((data[2] & 0x30) << 4));
+        dot[i].ry      = data[1] | ((data[2] & 0xC0) << 2);
+        dot[i].size    = data[2] & 0x0F;
+        dot[i].visible = (dot[i].ry != 1023);
+
+        dot[i].box_min.x = data[3] & 0x7F;
+        dot[i].box_min.y = data[4] & 0x7F;
+        dot[i].box_max.x = data[5] & 0x7F;
+        dot[i].box_max.y = data[6] & 0x7F;
+        dot[i].intensity = data[8];
+    }
+}
+
+/**
+ *	@brief Calculate the data from the IR spots.  Full IR mode.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param data		IR data of one interleaved report (18 bytes).
+ *	@param second	0 for the first half (report 0x3e), 1 for the second.
+ *
+ *	The first half is decoded and parked until the second one arrives.
+ *	The second half is decoded straight into the IR dots, so only the
+ *	two decoded spots of the first half are copied.
+ */
+void calculate_full_ir(struct wiimote_t *wm, byte *data, int second)
+{
+    if (!second)
+    {
+        decode_full_ir_dots(wm->ir.half_dot, data);
+        return;
+    }
+
+    decode_full_ir_dots(wm->ir.dot + 2, data);
+    wm->ir.dot[0] = wm->ir.half_dot[0];
+    wm->ir.dot[1] = wm->ir.half_dot[1];
+
+    interpret_ir_data(wm);
+}
+
 /**
  *	@brief Interpret IR data into more user friendly variables.
  *
@@ -461,6 +703,10 @@ static void interpret_ir_data(struct wiimote_t *wm)
     int i;
     float roll        = 0.0f;
     int last_num_dots = wm->ir.num_dots;
+    int new_sources   = 0;
+    int sum_x, sum_y;
+    int cursor        = 0; /* 1 if wm->ir.x/y got a new position */
+    unsigned long ts  = 0;
 
     if (WIIMOTE_IS_SET(wm, WIIMOTE_STATE_ACC))
     {
@@ -477,6 +723,16 @@ static void interpret_ir_data(struct wiimote_t *wm)
         }
     }
 
+    if (wm->ir.tracker.enabled || wm->ir.predict.enabled)
+    {
+        ts = wiiuse_os_ticks();
+    }
+
+    if (wm->ir.tracker.enabled)
+    {
+        new_sources = ir_track_dots(&wm->ir, ts);
+    }
+
     switch (wm->ir.num_dots)
     {
     case 0:
@@ -493,11 +749,13 @@ static void interpret_ir_data(struct wiimote_t *wm)
         wm->ir.y = 0;
         wm->ir.z = 0.0f;
 
+        wm->ir.predict.valid = 0;
+
         return;
     }
     case 1:
     {
-        fix_rotated_ir_dots(wm->ir.dot, roll);
+        fix_rotated_ir_dots(&wm->ir, roll, &sum_x, &sum_y);
 
         if (wm->ir.state < 2)
         {
@@ -518,6 +776,7 @@ static void interpret_ir_data(struct wiimote_t *wm)
                     /* wm->orient.yaw = calc_yaw(&wm->ir); */
 
                     ir_convert_to_vres(&wm->ir.x, &wm->ir.y, wm->ir.aspect, wm->ir.vres[0], wm->ir.vres[1]);
+                    cursor = 1;
                     break;
                 }
             }
@@ -552,11 +811,11 @@ static void interpret_ir_data(struct wiimote_t *wm)
                     wm->ir.ay      = y;
                     wm->orient.yaw = calc_yaw(&wm->ir);
 
-                    if (ir_correct_for_bounds(&x, &y, wm->ir.aspect, wm->ir.offset[0], wm->ir.offset[1]))
+                    if (ir_correct_to_vres(&wm->ir, &x, &y))
                     {
-                        ir_convert_to_vres(&x, &y, wm->ir.aspect, wm->ir.vres[0], wm->ir.vres[1]);
                         wm->ir.x = x;
                         wm->ir.y = y;
+                        cursor   = 1;
                     }
 
                     break;
@@ -577,10 +836,14 @@ static void interpret_ir_data(struct wiimote_t *wm)
         int x, y;
         wm->ir.state = 2;
 
-        fix_rotated_ir_dots(wm->ir.dot, roll);
+        fix_rotated_ir_dots(&wm->ir, roll, &sum_x, &sum_y);
 
-        /* if there is at least 1 new dot, reorder them all */
-        if (wm->ir.num_dots > last_num_dots)
+        /*
+         *	If there is at least 1 new dot, reorder them all.
+         *	The tracker also catches a dot being replaced by
+         *	another one in the same frame.
+         */
+        if (wm->ir.num_dots > last_num_dots || new_sources)
         {
             reorder_ir_dots(dot);
             wm->ir.x = 0;
@@ -590,17 +853,18 @@ static void interpret_ir_data(struct wiimote_t *wm)
         wm->ir.distance = ir_distance(dot);
         wm->ir.z        = 1023 - wm->ir.distance;
 
-        get_ir_dot_avg(wm->ir.dot, &x, &y);
+        x = sum_x / wm->ir.num_dots;
+        y = sum_y / wm->ir.num_dots;
 
         wm->ir.ax      = x;
         wm->ir.ay      = y;
         wm->orient.yaw = calc_yaw(&wm->ir);
 
-        if (ir_correct_for_bounds(&x, &y, wm->ir.aspect, wm->ir.offset[0], wm->ir.offset[1]))
+        if (ir_correct_to_vres(&wm->ir, &x, &y))
         {
-            ir_convert_to_vres(&x, &y, wm->ir.aspect, wm->ir.vres[0], wm->ir.vres[1]);
             wm->ir.x = x;
             wm->ir.y = y;
+            cursor   = 1;
         }
 
         break;
@@ -611,19 +875,25 @@ static void interpret_ir_data(struct wiimote_t *wm)
     }
     }
 
+    /* a cursor outside the screen keeps its old position, that is no new sample */
+    if (wm->ir.predict.enabled && cursor)
+    {
+        update_ir_prediction(&wm->ir.predict, wm->ir.x, wm->ir.y, ts);
+    }
+
 #ifdef WITH_WIIUSE_DEBUG
     {
         int ir_level;
         WIIUSE_GET_IR_SENSITIVITY(wm, &ir_level);
-        WIIUSE_DEBUG("IR sensitivity: %i", ir_level);
-        WIIUSE_DEBUG("IR visible dots: %i", wm->ir.num_dots);
+        WIIUSE_CTX_DEBUG(wm->ctx, "IR sensitivity: %i", ir_level);
+        WIIUSE_CTX_DEBUG(wm->ctx, "IR visible dots: %i", wm->ir.num_dots);
         for (i = 0; i < 4; ++i)
             if (dot[i].visible)
             {
-                WIIUSE_DEBUG("IR[%i][order %i] (%.3i, %.3i) -> (%.3i, %.3i)", i, dot[i].order, dot[i].rx,
-                             dot[i].ry, dot[i].x, dot[i].y);
+                WIIUSE_CTX_DEBUG(wm->ctx, "IR[%i][order %i] (%.3i, %.3i) -> (%.3i, %.3i)", i, dot[i].order,
+                                 dot[i].rx, dot[i].ry, dot[i].x, dot[i].y);
             }
-        WIIUSE_DEBUG("IR[absolute]: (%i, %i)", wm->ir.x, wm->ir.y);
+        WIIUSE_CTX_DEBUG(wm->ctx, "IR[absolute]: (%i, %i)", wm->ir.x, wm->ir.y);
     }
 #endif
 }
@@ -631,8 +901,10 @@ static void interpret_ir_data(struct wiimote_t *wm)
 /**
  *	@brief Fix the rotation of the IR dots.
  *
- *	@param dot		An array of 4 ir_dot_t objects.
+ *	@param ir		Pointer to an ir_t structure.
  *	@param ang		The roll angle to correct by (-180, 180)
+ *	@param sum_x	[out] Sum of the corrected X coordinates of the visible dots.
+ *	@param sum_y	[out] Sum of the corrected Y coordinates of the visible dots.
  *
  *	If there is roll then the dots are rotated
  *	around the origin and give a false cursor
@@ -641,25 +913,61 @@ static void interpret_ir_data(struct wiimote_t *wm)
  *	If the accelerometer is off then obviously
  *	this will not do anything and the cursor
  *	position may be inaccurate.
+ *
+ *	The sums are gathered in the same pass so the cursor
+ *	average does not need another loop over the dots.
  */
-static void fix_rotated_ir_dots(struct ir_dot_t *dot, float ang)
+static void fix_rotated_ir_dots(struct ir_t *ir, float ang, int *sum_x, int *sum_y)
 {
-    float s, c;
+    struct ir_dot_t *dot = ir->dot;
+#ifndef WIIUSE_FIXED_POINT
     int x, y;
+#endif
     int i;
 
+    *sum_x = 0;
+    *sum_y = 0;
+
     if (!ang)
     {
         for (i = 0; i < 4; ++i)
         {
             dot[i].x = dot[i].rx;
             dot[i].y = dot[i].ry;
+
+            if (dot[i].visible)
+            {
+                *sum_x += dot[i].x;
+                *sum_y += dot[i].y;
+            }
         }
         return;
     }
 
-    s = sinf(DEGREE_TO_RAD(ang));
-    c = cosf(DEGREE_TO_RAD(ang));
+#ifdef WIIUSE_FIXED_POINT
+    fixed_rotate_ir_dots(dot, ang);
+
+    for (i = 0; i < 4; ++i)
+    {
+        if (dot[i].visible)
+        {
+            *sum_x += dot[i].x;
+            *sum_y += dot[i].y;
+        }
+    }
+#else
+    /*
+     *	Roll only changes when a new accelerometer report
+     *	arrives, and is often the same for many IR reports.
+     *	Reuse the last sin/cos pair while it is close enough,
+     *	a 0.01 degree error moves a dot by less than 0.1 pixel.
+     */
+    if ((!ir->roll_sin && !ir->roll_cos) || fabsf(ang - ir->roll_ang) > IR_ROLL_EPSILON)
+    {
+        ir->roll_ang = ang;
+        ir->roll_sin = sinf(DEGREE_TO_RAD(ang));
+        ir->roll_cos = cosf(DEGREE_TO_RAD(ang));
+    }
 
     /*
      *	[ cos(theta)  -sin(theta) ][ ir->rx ]
@@ -676,40 +984,16 @@ static void fix_rotated_ir_dots(struct ir_dot_t *dot, float ang)
         x = dot[i].rx - (1024 / 2);
         y = dot[i].ry - (768 / 2);
 
-        dot[i].x = (uint32_t)((c * x) + (-s * y));
-        dot[i].y = (uint32_t)((s * x) + (c * y));
+        dot[i].x = (uint32_t)((ir->roll_cos * x) + (-ir->roll_sin * y));
+        dot[i].y = (uint32_t)((ir->roll_sin * x) + (ir->roll_cos * y));
 
         dot[i].x += (1024 / 2);
         dot[i].y += (768 / 2);
-    }
-}
 
-/**
- *	@brief Average IR dots.
- *
- *	@param dot		An array of 4 ir_dot_t objects.
- *	@param x		[out] Average X
- *	@param y		[out] Average Y
- */
-static void get_ir_dot_avg(struct ir_dot_t *dot, int *x, int *y)
-{
-    int vis = 0, i = 0;
-
-    *x = 0;
-    *y = 0;
-
-    for (; i < 4; ++i)
-    {
-        if (dot[i].visible)
-        {
-            *x += dot[i].x;
-            *y += dot[i].y;
-            ++vis;
-        }
+        *sum_x += dot[i].x;
+        *sum_y += dot[i].y;
     }
-
-    *x /= vis;
-    *y /= vis;
+#endif
 }
 
 /**
@@ -786,25 +1070,26 @@ static float ir_distance(struct ir_dot_t *dot)
 }
 
 /**
- *	@brief Correct for the IR bounding box.
+ *	@brief Correct for the IR bounding box and interpolate to the virtual screen.
  *
+ *	@param ir		Pointer to an ir_t structure.
  *	@param x		[out] The current X, it will be updated if valid.
  *	@param y		[out] The current Y, it will be updated if valid.
- *	@param aspect	Aspect ratio of the screen.
- *	@param offset_x	The X offset of the bounding box.
- *	@param offset_y	The Y offset of the bounding box.
  *
  *	@return Returns 1 if the point is valid and was updated.
  *
  *	Nintendo was smart with this bit. They sacrifice a little
  *	precision for a big increase in usability.
+ *
+ *	Same result as a bounds check followed by ir_convert_to_vres(),
+ *	with one aspect lookup.
  */
-static int ir_correct_for_bounds(int *x, int *y, enum aspect_t aspect, int offset_x, int offset_y)
+static int ir_correct_to_vres(struct ir_t *ir, int *x, int *y)
 {
-    int x0, y0;
+    int bx, by;
     int xs, ys;
 
-    if (aspect == WIIUSE_ASPECT_16_9)
+    if (ir->aspect == WIIUSE_ASPECT_16_9)
     {
         xs = WM_ASPECT_16_9_X;
         ys = WM_ASPECT_16_9_Y;
@@ -814,18 +1099,19 @@ static int ir_correct_for_bounds(int *x, int *y, enum aspect_t aspect, int offse
         ys = WM_ASPECT_4_3_Y;
     }
 
-    x0 = ((1024 - xs) / 2) + offset_x;
-    y0 = ((768 - ys) / 2) + offset_y;
+    /* position inside the bounding box, which is moved by the offset */
+    bx = *x - ir->offset[0] - ((1024 - xs) / 2);
+    by = *y - ir->offset[1] - ((768 - ys) / 2);
 
-    if ((*x >= x0) && (*x <= (x0 + xs)) && (*y >= y0) && (*y <= (y0 + ys)))
+    if ((bx < 0) || (bx > xs) || (by < 0) || (by > ys))
     {
-        *x -= offset_x;
-        *y -= offset_y;
-
-        return 1;
+        return 0;
     }
 
-    return 0;
+    *x = (int)((bx / (float)xs) * ir->vres[0]);
+    *y = (int)((by / (float)ys) * ir->vres[1]);
+
+    return 1;
 }
 
 /**
@@ -48,7 +48,9 @@ extern "C" {
 void wiiuse_set_ir_mode(struct wiimote_t *wm);
 void calculate_basic_ir(struct wiimote_t *wm, byte *data);
 void calculate_extended_ir(struct wiimote_t *wm, byte *data);
+void calculate_full_ir(struct wiimote_t *wm, byte *data, int second);
 float calc_yaw(struct ir_t *ir);
+int ir_track_dots(struct ir_t *ir, unsigned long ts);
 /** @} */
 
 #ifdef __cplusplus
@@ -0,0 +1,267 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Batch decoding of IR payloads.
+ *
+ *	Unpacks the IR dots of many reports at once into a
+ *	structure-of-arrays buffer. The results are identical to
+ *	calculate_basic_ir() and calculate_extended_ir().
+ */
+
+#include "wiiuse_internal.h"
+
+/* WIIUSE_NO_SIMD builds the portable kernel, to test it on x86 */
+#if defined(WIIUSE_NO_SIMD)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define WIIUSE_IR_BATCH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WIIUSE_IR_BATCH_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WIIUSE_IR_BATCH_NEON
+#endif
+
+/* dots decoded per kernel pass (4 reports) */
+#define IR_BATCH_CHUNK 16
+
+/**
+ *	@brief Split the 3 byte groups of an extended IR payload into byte planes.
+ */
+static void gather_extended(const byte *data, byte *xl, byte *yl, byte *hi)
+{
+    int i;
+
+    for (i = 0; i < 4; ++i)
+    {
+        xl[i] = data[3 * i];
+        yl[i] = data[(3 * i) + 1];
+        hi[i] = data[(3 * i) + 2];
+    }
+}
+
+/**
+ *	@brief Split a basic IR payload into byte planes.
+ *
+ *	Basic mode packs the high bits of two dots into one byte.
+ *	The second dot's bits are shifted up by 4 so both dots
+ *	can be unpacked with the extended mode masks.
+ */
+static void gather_basic(const byte *data, byte *xl, byte *yl, byte *hi)
+{
+    xl[0] = data[0];
+    yl[0] = data[1];
+    hi[0] = data[2];
+
+    xl[1] = data[3];
+    yl[1] = data[4];
+    hi[1] = (byte)(data[2] << 4);
+
+    xl[2] = data[5];
+    yl[2] = data[6];
+    hi[2] = data[7];
+
+    xl[3] = data[8];
+    yl[3] = data[9];
+    hi[3] = (byte)(data[7] << 4);
+}
+
+/**
+ *	@brief Unpack \a n dots from byte planes, one dot at a time.
+ */
+static void decode_dots_scalar(const byte *xl, const byte *yl, const byte *hi, int n, byte size_mask,
+                               int16_t *rx, int16_t *ry, byte *size, byte *visible)
+{
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+        rx[i]      = 1023 - (xl[i] | ((hi[i] & 0x30) << 4));
+        ry[i]      = yl[i] | ((hi[i] & 0xC0) << 2);
+        size[i]    = hi[i] & size_mask;
+        visible[i] = (ry[i] != 1023);
+    }
+}
+
+#if defined(WIIUSE_IR_BATCH_AVX2)
+
+static void decode_dots_chunk(const byte *xl, const byte *yl, const byte *hi, byte size_mask, int16_t *rx,
+                              int16_t *ry, byte *size, byte *visible)
+{
+    const __m256i max_coord = _mm256_set1_epi16(1023);
+    __m128i h8              = _mm_loadu_si128((const __m128i *)hi);
+    __m256i x               = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)xl));
+    __m256i y               = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)yl));
+    __m256i h               = _mm256_cvtepu8_epi16(h8);
+    __m256i vis;
+
+    x = _mm256_or_si256(x, _mm256_slli_epi16(_mm256_and_si256(h, _mm256_set1_epi16(0x30)), 4));
+    y = _mm256_or_si256(y, _mm256_slli_epi16(_mm256_and_si256(h, _mm256_set1_epi16(0xC0)), 2));
+    x = _mm256_sub_epi16(max_coord, x);
+
+    _mm256_storeu_si256((__m256i *)rx, x);
+    _mm256_storeu_si256((__m256i *)ry, y);
+    _mm_storeu_si128((__m128i *)size, _mm_and_si128(h8, _mm_set1_epi8((char)size_mask)));
+
+    vis = _mm256_cmpeq_epi16(y, max_coord);
+    _mm_storeu_si128((__m128i *)visible,
+                     _mm_andnot_si128(_mm_packs_epi16(_mm256_castsi256_si128(vis), _mm256_extracti128_si256(vis, 1)),
+                                      _mm_set1_epi8(1)));
+}
+
+#elif defined(WIIUSE_IR_BATCH_SSE2)
+
+static void decode_dots_half(const byte *xl, const byte *yl, const byte *hi, byte size_mask, int16_t *rx,
+                             int16_t *ry, byte *size, byte *visible)
+{
+    const __m128i zero      = _mm_setzero_si128();
+    const __m128i max_coord = _mm_set1_epi16(1023);
+    __m128i h8              = _mm_loadl_epi64((const __m128i *)hi);
+    __m128i x               = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)xl), zero);
+    __m128i y               = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)yl), zero);
+    __m128i h               = _mm_unpacklo_epi8(h8, zero);
+    __m128i vis;
+
+    x = _mm_or_si128(x, _mm_slli_epi16(_mm_and_si128(h, _mm_set1_epi16(0x30)), 4));
+    y = _mm_or_si128(y, _mm_slli_epi16(_mm_and_si128(h, _mm_set1_epi16(0xC0)), 2));
+    x = _mm_sub_epi16(max_coord, x);
+
+    _mm_storeu_si128((__m128i *)rx, x);
+    _mm_storeu_si128((__m128i *)ry, y);
+    _mm_storel_epi64((__m128i *)size, _mm_and_si128(h8, _mm_set1_epi8((char)size_mask)));
+
+    vis = _mm_packs_epi16(_mm_cmpeq_epi16(y, max_coord), zero);
+    _mm_storel_epi64((__m128i *)visible, _mm_andnot_si128(vis, _mm_set1_epi8(1)));
+}
+
+static void decode_dots_chunk(const byte *xl, const byte *yl, const byte *hi, byte size_mask, int16_t *rx,
+                              int16_t *ry, byte *size, byte *visible)
+{
+    decode_dots_half(xl, yl, hi, size_mask, rx, ry, size, visible);
+    decode_dots_half(xl + 8, yl + 8, hi + 8, size_mask, rx + 8, ry + 8, size + 8, visible + 8);
+}
+
+#elif defined(WIIUSE_IR_BATCH_NEON)
+
+static void decode_dots_half(const byte *xl, const byte *yl, const byte *hi, byte size_mask, int16_t *rx,
+                             int16_t *ry, byte *size, byte *visible)
+{
+    const uint16x8_t max_coord = vdupq_n_u16(1023);
+    uint8x8_t h8               = vld1_u8(hi);
+    uint16x8_t x               = vmovl_u8(vld1_u8(xl));
+    uint16x8_t y               = vmovl_u8(vld1_u8(yl));
+    uint16x8_t h               = vmovl_u8(h8);
+
+    x = vorrq_u16(x, vshlq_n_u16(vandq_u16(h, vdupq_n_u16(0x30)), 4));
+    y = vorrq_u16(y, vshlq_n_u16(vandq_u16(h, vdupq_n_u16(0xC0)), 2));
+    x = vsubq_u16(max_coord, x);
+
+    vst1q_s16(rx, vreinterpretq_s16_u16(x));
+    vst1q_s16(ry, vreinterpretq_s16_u16(y));
+    vst1_u8(size, vand_u8(h8, vdup_n_u8(size_mask)));
+    vst1_u8(visible, vand_u8(vmvn_u8(vmovn_u16(vceqq_u16(y, max_coord))), vdup_n_u8(1)));
+}
+
+static void decode_dots_chunk(const byte *xl, const byte *yl, const byte *hi, byte size_mask, int16_t *rx,
+                              int16_t *ry, byte *size, byte *visible)
+{
+    decode_dots_half(xl, yl, hi, size_mask, rx, ry, size, visible);
+    decode_dots_half(xl + 8, yl + 8, hi + 8, size_mask, rx + 8, ry + 8, size + 8, visible + 8);
+}
+
+#else
+
+static void decode_dots_chunk(const byte *xl, const byte *yl, const byte *hi, byte size_mask, int16_t *rx,
+                              int16_t *ry, byte *size, byte *visible)
+{
+    decode_dots_scalar(xl, yl, hi, IR_BATCH_CHUNK, size_mask, rx, ry, size, visible);
+}
+
+#endif
+
+/**
+ *	@brief Decode the IR dots of several reports at once.
+ *
+ *	@param data		Array of \a count pointers to IR payloads, the same
+ *					data that is normally passed to the IR decoders
+ *					(10 bytes in basic mode, 12 bytes in extended mode).
+ *	@param count	Number of payloads in \a data.
+ *	@param extended	1 if the payloads are in extended IR format, 0 for basic.
+ *	@param out		[out] Caller allocated buffer with room for 4 * \a count dots.
+ *
+ *	Dot \a d of payload \a n is stored at index (n * 4 + d) of each array
+ *	in \a out. Raw coordinates and visibility match what calculate_basic_ir()
+ *	and calculate_extended_ir() store in ir_dot_t. Basic mode carries no
+ *	dot size, so size is always 0 there.
+ *
+ *	The payloads may come from different wiimotes or from a recording of
+ *	one wiimote. No wiimote_t state is touched.
+ */
+void wiiuse_decode_ir_batch(const byte *const *data, int count, int extended, struct ir_dot_batch_t *out)
+{
+    byte xl[IR_BATCH_CHUNK], yl[IR_BATCH_CHUNK], hi[IR_BATCH_CHUNK];
+    byte size_mask = extended ? 0x0F : 0x00;
+    int n          = 0;
+    int i, k;
+
+    if (!data || !out || count <= 0)
+    {
+        return;
+    }
+
+    /* full chunks of 4 reports go through the vector kernel */
+    for (; n + 4 <= count; n += 4)
+    {
+        for (k = 0; k < 4; ++k)
+        {
+            i = 4 * k;
+            if (extended)
+            {
+                gather_extended(data[n + k], xl + i, yl + i, hi + i);
+            } else
+            {
+                gather_basic(data[n + k], xl + i, yl + i, hi + i);
+            }
+        }
+
+        i = 4 * n;
+        decode_dots_chunk(xl, yl, hi, size_mask, out->rx + i, out->ry + i, out->size + i, out->visible + i);
+    }
+
+    /* leftover reports */
+    for (; n < count; ++n)
+    {
+        if (extended)
+        {
+            gather_extended(data[n], xl, yl, hi);
+        } else
+        {
+            gather_basic(data[n], xl, yl, hi);
+        }
+
+        i = 4 * n;
+        decode_dots_scalar(xl, yl, hi, 4, size_mask, out->rx + i, out->ry + i, out->size + i, out->visible + i);
+    }
+}
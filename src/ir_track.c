@@ -0,0 +1,279 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+
+/**
+ *	@file
+ *	@brief IR dot tracking.
+ *
+ *	Follows up to 4 IR sources across frames so each keeps the
+ *	same id while it stays in view, no matter which slot the
+ *	camera reports it in. Every track predicts its position with
+ *	a constant velocity model and the visible dots are assigned
+ *	to the predictions with the lowest total squared distance.
+ */
+
+#include "ir.h"
+
+#include <string.h> /* for memset */
+
+/* largest distance, in camera pixels, between a prediction and the dot it is matched to */
+#define IR_TRACK_GATE 96.0f
+
+/* frames a track survives without a matching dot */
+#define IR_TRACK_MAX_MISSED 5
+
+/* alpha-beta filter gains for position and velocity */
+#define IR_TRACK_ALPHA 0.85f
+#define IR_TRACK_BETA 0.35f
+
+/* reports read in the same poll share a timestamp, assume this much time between them */
+#define IR_TRACK_MIN_DT 0.005f
+
+/* after a longer pause the old tracks are dropped */
+#define IR_TRACK_MAX_GAP 250
+
+/**
+ *	@brief Enable or disable IR dot tracking.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param status	1 to enable, 0 to disable.
+ *
+ *	While tracking is on, ir_dot_t::id holds a stable id for each
+ *	visible dot and wm->ir.tracker holds the filtered position and
+ *	velocity of every tracked source. Ids are never reused until
+ *	the counter wraps.
+ */
+void wiiuse_set_ir_tracking(struct wiimote_t *wm, int status)
+{
+    int i;
+
+    if (!wm)
+    {
+        return;
+    }
+
+    memset(wm->ir.tracker.track, 0, sizeof(wm->ir.tracker.track));
+    wm->ir.tracker.ts      = 0;
+    wm->ir.tracker.enabled = status ? 1 : 0;
+
+    for (i = 0; i < 4; ++i)
+    {
+        wm->ir.tracker.track[i].dot = -1;
+        wm->ir.dot[i].id            = 0;
+    }
+}
+
+/**
+ *	@brief Start a new track for a dot.
+ *
+ *	@param tr		The tracker.
+ *	@param dot		The dot to track.
+ *	@param index	Index of \a dot in ir_t::dot.
+ *
+ *	Uses a free slot if there is one, otherwise replaces the
+ *	track that has been missing the longest.
+ *
+ *	@return 1 if a track was started, 0 if all tracks hold visible dots.
+ */
+static int ir_track_start(struct ir_tracker_t *tr, struct ir_dot_t *dot, int index)
+{
+    struct ir_track_t *t = NULL;
+    int i;
+
+    for (i = 0; i < 4; ++i)
+    {
+        if (!tr->track[i].id)
+        {
+            t = &tr->track[i];
+            break;
+        }
+        if (tr->track[i].dot < 0 && (!t || tr->track[i].missed > t->missed))
+        {
+            t = &tr->track[i];
+        }
+    }
+
+    if (!t)
+    {
+        return 0;
+    }
+
+    if (!++tr->next_id)
+    {
+        tr->next_id = 1;
+    }
+
+    t->id     = tr->next_id;
+    t->dot    = index;
+    t->x      = dot->rx;
+    t->y      = dot->ry;
+    t->vx     = 0.0f;
+    t->vy     = 0.0f;
+    t->age    = 1;
+    t->missed = 0;
+    dot->id   = t->id;
+
+    return 1;
+}
+
+/**
+ *	@brief Match the current IR dots to the tracked sources.
+ *
+ *	@param ir		Pointer to an ir_t structure with the dots of the new frame.
+ *	@param ts		Time the report was received, in milliseconds.
+ *
+ *	@return The number of tracks started this frame.
+ *
+ *	All 24 ways of pairing 4 tracks with 4 dots are scored, so
+ *	two sources crossing or one leaving while another enters in
+ *	the same frame keep the right ids.
+ */
+int ir_track_dots(struct ir_t *ir, unsigned long ts)
+{
+    struct ir_tracker_t *tr = &ir->tracker;
+    const float gate        = IR_TRACK_GATE * IR_TRACK_GATE;
+    float px[4], py[4];
+    float cost[4][4];
+    float best              = 4.0f * gate + 1.0f;
+    int owner[4], match[4];
+    unsigned long elapsed;
+    float dt;
+    int a, b, c, d, i;
+    int started = 0;
+
+    elapsed = ts - tr->ts;
+    if (tr->ts && elapsed > IR_TRACK_MAX_GAP)
+    {
+        memset(tr->track, 0, sizeof(tr->track));
+    }
+    dt     = (float)elapsed / 1000.0f;
+    dt     = (!tr->ts || dt < IR_TRACK_MIN_DT) ? IR_TRACK_MIN_DT : dt;
+    tr->ts = ts;
+
+    /* predict where each source is now */
+    for (i = 0; i < 4; ++i)
+    {
+        px[i] = tr->track[i].x + tr->track[i].vx * dt;
+        py[i] = tr->track[i].y + tr->track[i].vy * dt;
+    }
+
+    /* leaving a track or a dot unmatched costs as much as the gate */
+    for (i = 0; i < 4; ++i)
+    {
+        for (d = 0; d < 4; ++d)
+        {
+            float dx = ir->dot[d].rx - px[i];
+            float dy = ir->dot[d].ry - py[i];
+
+            cost[i][d] = gate;
+            if (tr->track[i].id && ir->dot[d].visible && (dx * dx + dy * dy) < gate)
+            {
+                cost[i][d] = dx * dx + dy * dy;
+            }
+        }
+    }
+
+    match[0] = match[1] = match[2] = match[3] = 0;
+    for (a = 0; a < 4; ++a)
+    {
+        for (b = 0; b < 4; ++b)
+        {
+            if (b == a)
+            {
+                continue;
+            }
+            for (c = 0; c < 4; ++c)
+            {
+                float sum;
+
+                if (c == a || c == b)
+                {
+                    continue;
+                }
+                d   = 6 - a - b - c;
+                sum = cost[0][a] + cost[1][b] + cost[2][c] + cost[3][d];
+                if (sum < best)
+                {
+                    best     = sum;
+                    match[0] = a;
+                    match[1] = b;
+                    match[2] = c;
+                    match[3] = d;
+                }
+            }
+        }
+    }
+
+    for (d = 0; d < 4; ++d)
+    {
+        ir->dot[d].id = 0;
+        owner[d]      = -1;
+    }
+
+    /* update the matched tracks, coast or drop the others */
+    for (i = 0; i < 4; ++i)
+    {
+        struct ir_track_t *t = &tr->track[i];
+
+        t->dot = -1;
+        if (!t->id)
+        {
+            continue;
+        }
+
+        d = match[i];
+        if (cost[i][d] < gate)
+        {
+            float rx = ir->dot[d].rx - px[i];
+            float ry = ir->dot[d].ry - py[i];
+
+            t->x   = px[i] + IR_TRACK_ALPHA * rx;
+            t->y   = py[i] + IR_TRACK_ALPHA * ry;
+            t->vx += (IR_TRACK_BETA / dt) * rx;
+            t->vy += (IR_TRACK_BETA / dt) * ry;
+            t->dot = d;
+            t->age++;
+            t->missed     = 0;
+            ir->dot[d].id = t->id;
+            owner[d]      = i;
+        } else if (++t->missed > IR_TRACK_MAX_MISSED)
+        {
+            t->id = 0;
+        } else
+        {
+            t->x = px[i];
+            t->y = py[i];
+        }
+    }
+
+    /* new sources */
+    for (d = 0; d < 4; ++d)
+    {
+        if (ir->dot[d].visible && owner[d] < 0)
+        {
+            started += ir_track_start(tr, &ir->dot[d], d);
+        }
+    }
+
+    return started;
+}
@@ -0,0 +1,758 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Descriptor for application event loops.
+ *
+ *	wiiuse_poll() has work to do even when no report comes in:
+ *	background discovery, reconnect attempts, queued writes and idle
+ *	smoothing all wait for some time to pass. An application with
+ *	its own event loop gets a single descriptor from wiiuse_get_fd()
+ *	instead of calling wiiuse_poll() in a loop. On Linux it is an
+ *	epoll set with the sockets of the connected wiimotes, the
+ *	discovery and listening sockets, and a timerfd armed for the
+ *	earliest of those deadlines. wiiuse_poll() keeps the set and the
+ *	timer up to date.
+ *
+ *	wiiuse_poll_wait() sleeps on the same set itself, with an eventfd
+ *	added so that wiiuse_wakeup() can cut the wait short from another
+ *	thread.
+ */
+
+#include "loop.h"
+
+#include "events.h"    /* for idle_deadline */
+#include "os.h"        /* for wiiuse_os_fd, wiiuse_os_ticks */
+#include "reconnect.h" /* for reconnect_deadline */
+#include "uring.h"     /* for uring_fd, uring_queued */
+
+#include <string.h> /* for memcpy, memmove, memset */
+
+#if defined(WIIUSE_BLUEZ) || defined(WIIUSE_HIDRAW)
+#define LOOP_EPOLL
+#endif
+
+#ifdef LOOP_EPOLL
+#include <errno.h>       /* for errno */
+#include <stdint.h>      /* for uint64_t */
+#include <stdlib.h>      /* for qsort */
+#include <sys/epoll.h>   /* for epoll_create1, epoll_ctl, epoll_wait */
+#include <sys/eventfd.h> /* for eventfd */
+#include <sys/timerfd.h> /* for timerfd_create, timerfd_settime */
+#include <unistd.h>      /* for close, read */
+#endif
+
+/* descriptors of the context itself: discovery, the two listening sockets, the ring */
+#define LOOP_CTX_FDS 4
+
+/* ready descriptors taken from one epoll_wait() */
+#define LOOP_EVENTS 16
+
+/* where there is no descriptor, milliseconds between polls while waiting */
+#define LOOP_SLEEP 1
+
+/* entry of the watched list, a descriptor and if it waits to be writable */
+#define LOOP_ENTRY(fd, out) (((fd) << 1) | ((out) ? 1 : 0))
+#define LOOP_FD(entry) ((entry) >> 1)
+
+static unsigned long earliest(unsigned long a, unsigned long b) { return (a < b) ? a : b; }
+
+/**
+ *	@brief When wiiuse_poll() has work to do next on a wiimote array.
+ *
+ *	@return Ticks of the deadline, \a now if there is work already,
+ *			WIIUSE_NEVER if only a report or a connection can bring some.
+ */
+static unsigned long loop_deadline(struct wiimote_t **wm, int wiimotes, unsigned long now)
+{
+    struct wiiuse_discovery_t *disc = &wm[0]->ctx->discovery;
+    struct data_req_t *req;
+    unsigned long deadline = WIIUSE_NEVER;
+    int i;
+
+    if (disc->enabled)
+    {
+        /* while inquiring, next is when it times out */
+        deadline = disc->connect ? now : disc->next;
+    }
+
+    for (i = 0; (i < wiimotes) && (deadline > now); ++i)
+    {
+        deadline = earliest(deadline, reconnect_deadline(wm[i]));
+
+        if (!WIIMOTE_IS_CONNECTED(wm[i]))
+        {
+            continue;
+        }
+
+        /* writes go out one per poll */
+        req = wm[i]->data_req;
+        if (req && req->len && (req->state == REQ_READY))
+        {
+            deadline = now;
+        }
+
+#ifdef WIIUSE_IO_URING
+        /* the ring took these off the socket already */
+        if (uring_queued(wm[i]) > 0)
+        {
+            deadline = now;
+        }
+#endif
+
+        deadline = earliest(deadline, idle_deadline(wm[i]));
+    }
+
+    return deadline;
+}
+
+#ifdef LOOP_EPOLL
+
+static int compare_fd(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ *	@brief The eventfd of wiiuse_wakeup(), created on first use.
+ *
+ *	The waiting thread and a waking one may both get here first,
+ *	the one that loses closes its own.
+ *
+ *	@return The descriptor, -1 on failure.
+ */
+static int loop_waker(struct wiiuse_loop_t *loop)
+{
+    int expected = 0;
+    int fd;
+
+    fd = __atomic_load_n(&loop->wake, __ATOMIC_ACQUIRE);
+    if (fd)
+    {
+        return fd - 1;
+    }
+
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("eventfd()");
+        return -1;
+    }
+
+    if (!__atomic_compare_exchange_n(&loop->wake, &expected, fd + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        close(fd);
+        return expected - 1;
+    }
+
+    return fd;
+}
+
+/**
+ *	@brief Create the epoll set with its timer and eventfd.
+ *
+ *	@return 1 on success, 0 on failure.
+ */
+static int loop_open(struct wiiuse_loop_t *loop)
+{
+    struct epoll_event ev;
+    int wake;
+    int ok = 0;
+
+    loop->fd    = epoll_create1(EPOLL_CLOEXEC);
+    loop->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wake        = loop_waker(loop);
+
+    if ((loop->fd != -1) && (loop->timer != -1) && (wake != -1))
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events  = EPOLLIN;
+        ev.data.fd = loop->timer;
+        ok         = (epoll_ctl(loop->fd, EPOLL_CTL_ADD, loop->timer, &ev) == 0);
+
+        ev.data.fd = wake;
+        ok         = ok && (epoll_ctl(loop->fd, EPOLL_CTL_ADD, wake, &ev) == 0);
+    }
+
+    if (!ok)
+    {
+        WIIUSE_ERROR("Unable to set up the event loop descriptor.");
+        perror("Error Details");
+
+        if (loop->fd != -1)
+        {
+            close(loop->fd);
+        }
+        if (loop->timer != -1)
+        {
+            close(loop->timer);
+        }
+        return 0;
+    }
+
+    loop->deadline = WIIUSE_NEVER;
+    loop->count    = 0;
+    loop->enabled  = 1;
+
+    return 1;
+}
+
+/**
+ *	@brief Make room for \a size descriptors.
+ *
+ *	@return 1 on success, 0 if out of memory.
+ */
+static int loop_reserve(struct wiiuse_context_t *ctx, int size)
+{
+    struct wiiuse_loop_t *loop = &ctx->loop;
+    int *watched;
+    int *wanted;
+
+    if (size <= loop->size)
+    {
+        return 1;
+    }
+
+    watched = (int *)wiiuse_ctx_malloc(ctx, size * sizeof(int));
+    wanted  = (int *)wiiuse_ctx_malloc(ctx, size * sizeof(int));
+    if (!watched || !wanted)
+    {
+        WIIUSE_CTX_ERROR(ctx, "Out of memory for the event loop descriptor.");
+        wiiuse_ctx_free(ctx, watched);
+        wiiuse_ctx_free(ctx, wanted);
+        return 0;
+    }
+
+    if (loop->count)
+    {
+        memcpy(watched, loop->watched, loop->count * sizeof(int));
+    }
+    wiiuse_ctx_free(ctx, loop->watched);
+    wiiuse_ctx_free(ctx, loop->wanted);
+
+    loop->watched = watched;
+    loop->wanted  = wanted;
+    loop->size    = size;
+
+    return 1;
+}
+
+/**
+ *	@brief Bring the epoll set in line with the sockets in use.
+ */
+static void loop_watch(struct wiiuse_context_t *ctx, struct wiimote_t **wm, int wiimotes)
+{
+    struct wiiuse_loop_t *loop = &ctx->loop;
+    struct epoll_event ev;
+    int *swap;
+    int count = 0;
+    int connecting;
+    int fd;
+    int i, j;
+
+    if (!loop_reserve(ctx, wiimotes + LOOP_CTX_FDS))
+    {
+        return;
+    }
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        /* a pending connect() is done when its socket is writable */
+        connecting = WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTING);
+        if ((connecting || WIIMOTE_IS_CONNECTED(wm[i])) && ((fd = wiiuse_os_fd(wm[i])) != -1))
+        {
+            loop->wanted[count++] = LOOP_ENTRY(fd, connecting);
+        }
+    }
+    if (ctx->discovery.enabled && (ctx->discovery.sock != -1))
+    {
+        loop->wanted[count++] = LOOP_ENTRY(ctx->discovery.sock, 0);
+    }
+    if (ctx->incoming.enabled)
+    {
+        loop->wanted[count++] = LOOP_ENTRY(ctx->incoming.sock[0], 0);
+        loop->wanted[count++] = LOOP_ENTRY(ctx->incoming.sock[1], 0);
+    }
+#ifdef WIIUSE_IO_URING
+    if (ctx->uring)
+    {
+        /* completions are posted on the way back from any system call */
+        loop->wanted[count++] = LOOP_ENTRY(uring_fd(ctx->uring), 0);
+    }
+#endif
+    qsort(loop->wanted, count, sizeof(int), compare_fd);
+
+    memset(&ev, 0, sizeof(ev));
+
+    /* both are sorted, walk them side by side */
+    i = 0;
+    j = 0;
+    while ((i < loop->count) || (j < count))
+    {
+        if ((j == count) || ((i < loop->count) && (LOOP_FD(loop->watched[i]) < LOOP_FD(loop->wanted[j]))))
+        {
+            /* not in use any more */
+            epoll_ctl(loop->fd, EPOLL_CTL_DEL, LOOP_FD(loop->watched[i]), NULL);
+            ++i;
+            continue;
+        }
+
+        ev.events  = (loop->wanted[j] & 1) ? EPOLLOUT : EPOLLIN;
+        ev.data.fd = LOOP_FD(loop->wanted[j]);
+
+        if ((i == loop->count) || (LOOP_FD(loop->wanted[j]) < LOOP_FD(loop->watched[i])))
+        {
+            if ((epoll_ctl(loop->fd, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1) && (errno != EEXIST))
+            {
+                WIIUSE_CTX_WARNING(ctx, "Could not add descriptor %i to the event loop descriptor.", ev.data.fd);
+            }
+            ++j;
+        } else
+        {
+            /* a channel that finished connecting is watched for reports from now on */
+            if (loop->watched[i] != loop->wanted[j])
+            {
+                epoll_ctl(loop->fd, EPOLL_CTL_MOD, ev.data.fd, &ev);
+            }
+            ++i;
+            ++j;
+        }
+    }
+
+    swap          = loop->watched;
+    loop->watched = loop->wanted;
+    loop->wanted  = swap;
+    loop->count   = count;
+}
+
+/**
+ *	@brief Arm the timer for the next deadline.
+ */
+static void loop_arm(struct wiiuse_loop_t *loop, struct wiimote_t **wm, int wiimotes)
+{
+    struct itimerspec its;
+    unsigned long now      = wiiuse_os_ticks();
+    unsigned long deadline = loop_deadline(wm, wiimotes, now);
+    unsigned long ms;
+    uint64_t expirations;
+
+    if ((loop->deadline != WIIUSE_NEVER) && (now >= loop->deadline))
+    {
+        /* it went off, reading it takes it out of the ready list */
+        if (read(loop->timer, &expirations, sizeof(expirations)) == -1)
+        {
+            /* not yet, setting it again below resets it all the same */
+        }
+        loop->deadline = WIIUSE_NEVER;
+    }
+
+    if (deadline == loop->deadline)
+    {
+        return;
+    }
+
+    memset(&its, 0, sizeof(its));
+    if (deadline != WIIUSE_NEVER)
+    {
+        ms                   = (deadline > now) ? (deadline - now) : 0;
+        its.it_value.tv_sec  = ms / 1000;
+        its.it_value.tv_nsec = (long)(ms % 1000) * 1000000;
+        if (!ms)
+        {
+            /* zero would disarm it */
+            its.it_value.tv_nsec = 1;
+        }
+    }
+
+    if (timerfd_settime(loop->timer, 0, &its, NULL) == -1)
+    {
+        perror("timerfd_settime()");
+        return;
+    }
+    loop->deadline = deadline;
+}
+
+/**
+ *	@brief Quiet the eventfd after wiiuse_wakeup().
+ *
+ *	wiiuse_wakeup() writes to it before it sets the flag, so once
+ *	the flag is seen the write is there to be read.
+ */
+static void loop_drain(struct wiiuse_loop_t *loop)
+{
+    uint64_t wakeups;
+
+    if (!WIIUSE_LOAD_ACQUIRE(&loop->woken))
+    {
+        return;
+    }
+
+    WIIUSE_STORE_RELEASE(&loop->woken, 0);
+    if (read(loop->wake - 1, &wakeups, sizeof(wakeups)) == -1)
+    {
+        /* read along with an earlier wakeup */
+    }
+}
+
+/**
+ *	@brief Sleep on the epoll set until there is work, then poll.
+ *
+ *	Wakes for reports, connections, wiiuse_wakeup() and the timers
+ *	of wiiuse_poll(). Waking for a timer only polls and goes back
+ *	to sleep unless that brought an event.
+ */
+static int loop_wait(struct wiimote_t **wm, int wiimotes, int timeout)
+{
+    struct wiiuse_loop_t *loop = &wm[0]->ctx->loop;
+    struct epoll_event ev[LOOP_EVENTS];
+    unsigned long start = wiiuse_os_ticks();
+    unsigned long elapsed;
+    int left = timeout;
+    int woken;
+    int evnt;
+    int r;
+    int i;
+
+    /* woken before the wait, polling drains it */
+    if (WIIUSE_LOAD_ACQUIRE(&loop->woken))
+    {
+        timeout = 0;
+        left    = 0;
+    }
+
+    /* wiimotes may have connected since the last poll */
+    loop_update(wm, wiimotes);
+
+    for (;;)
+    {
+        r = epoll_wait(loop->fd, ev, LOOP_EVENTS, left);
+        if ((r == -1) && (errno != EINTR))
+        {
+            perror("epoll_wait()");
+            return wiiuse_poll(wm, wiimotes);
+        }
+
+        woken = 0;
+        for (i = 0; i < r; ++i)
+        {
+            woken |= (ev[i].data.fd == loop->wake - 1);
+        }
+
+        loop->waited = 1;
+        evnt         = wiiuse_poll(wm, wiimotes);
+        loop->waited = 0;
+
+        if (evnt || woken || !timeout)
+        {
+            return evnt;
+        }
+
+        if (timeout > 0)
+        {
+            elapsed = wiiuse_os_ticks() - start;
+            if (elapsed >= (unsigned long)timeout)
+            {
+                return 0;
+            }
+            left = timeout - (int)elapsed;
+        }
+    }
+}
+
+#endif /* LOOP_EPOLL */
+
+/**
+ *	@brief Get a descriptor for an application event loop.
+ *
+ *	@param wm		An array of pointers to wiimote_t structures.
+ *	@param wiimotes	The number of wiimote_t structures in the \a wm array.
+ *
+ *	@return A descriptor that becomes readable when wiiuse_poll()
+ *			has work to do, -1 if the platform has none.
+ *
+ *	@see wiiuse_get_timeout()
+ *
+ *	Watch it for reading and call wiiuse_poll() on the same array
+ *	when it is ready, instead of polling all the time. It becomes
+ *	ready when a report or a connection comes in, when a connect
+ *	started by the reconnect supervisor is done, and when one of
+ *	the timers of wiiuse_poll() is due. It is level triggered and
+ *	stays ready while reports are left to read. wiiuse_poll() keeps
+ *	it up to date as wiimotes come and go.
+ *
+ *	There is one per context, for a single wiimote array. Do not
+ *	read from it or close it, wiiuse_cleanup() releases it.
+ *
+ *	Only Linux has one, an epoll descriptor. Elsewhere
+ *	wiiuse_get_timeout() tells how long to wait between polls.
+ */
+int wiiuse_get_fd(struct wiimote_t **wm, int wiimotes)
+{
+#ifdef LOOP_EPOLL
+    struct wiiuse_context_t *ctx;
+
+    if (!wm || (wiimotes <= 0))
+    {
+        return -1;
+    }
+
+    ctx = wm[0]->ctx;
+    if (!ctx->loop.enabled && !loop_open(&ctx->loop))
+    {
+        return -1;
+    }
+
+    loop_update(wm, wiimotes);
+
+    return ctx->loop.fd;
+#else
+    (void)wm;
+    (void)wiimotes;
+
+    WIIUSE_WARNING("Event loop descriptors are not supported on this platform.");
+    return -1;
+#endif
+}
+
+/**
+ *	@brief How long an event loop may wait before polling again.
+ *
+ *	@param wm		An array of pointers to wiimote_t structures.
+ *	@param wiimotes	The number of wiimote_t structures in the \a wm array.
+ *
+ *	@return Milliseconds until wiiuse_poll() has work to do even if
+ *			no report comes in, 0 if it has already, -1 if only a
+ *			report or a connection can bring some.
+ *
+ *	@see wiiuse_get_fd()
+ *
+ *	Meant for a timer next to the descriptors an event loop already
+ *	watches, or the timeout of a wait. wiiuse_poll() has to run again
+ *	after the timeout even if nothing came in.
+ */
+int wiiuse_get_timeout(struct wiimote_t **wm, int wiimotes)
+{
+    unsigned long now;
+    unsigned long deadline;
+
+    if (!wm || (wiimotes <= 0))
+    {
+        return -1;
+    }
+
+    now      = wiiuse_os_ticks();
+    deadline = loop_deadline(wm, wiimotes, now);
+    if (deadline == WIIUSE_NEVER)
+    {
+        return -1;
+    }
+
+    return (deadline > now) ? (int)(deadline - now) : 0;
+}
+
+/**
+ *	@brief Poll the wiimotes, waiting for something to happen first.
+ *
+ *	@param wm		An array of pointers to wiimote_t structures.
+ *	@param wiimotes	The number of wiimote_t structures in the \a wm array.
+ *	@param timeout	Milliseconds to wait at most, -1 to wait until
+ *					something happens, 0 not to wait.
+ *
+ *	@return Returns number of wiimotes that an event has occurred on,
+ *			0 after a timeout or a wiiuse_wakeup().
+ *
+ *	@see wiiuse_poll()
+ *
+ *	Instead of calling wiiuse_poll() over and over, a program can
+ *	sleep in here until a wiimote has an event. The timers of
+ *	wiiuse_poll() (discovery, reconnects, idle smoothing) are run
+ *	when they are due without returning. To render frames at a fixed
+ *	rate, pass the time left until the next frame.
+ *
+ *	On Linux it sleeps on the descriptor of wiiuse_get_fd() and
+ *	wakes as soon as a report comes in. Elsewhere it polls every
+ *	millisecond.
+ */
+int wiiuse_poll_wait(struct wiimote_t **wm, int wiimotes, int timeout)
+{
+    struct wiiuse_loop_t *loop;
+    unsigned long start;
+    int evnt;
+
+    if (!wm || (wiimotes <= 0))
+    {
+        return 0;
+    }
+    loop = &wm[0]->ctx->loop;
+
+#ifdef LOOP_EPOLL
+    if (loop->enabled || loop_open(loop))
+    {
+        return loop_wait(wm, wiimotes, timeout);
+    }
+#endif
+
+    /* nothing to sleep on */
+    start = wiiuse_os_ticks();
+    for (;;)
+    {
+        evnt = wiiuse_poll(wm, wiimotes);
+        if (WIIUSE_LOAD_ACQUIRE(&loop->woken))
+        {
+            WIIUSE_STORE_RELEASE(&loop->woken, 0);
+            return evnt;
+        }
+
+        if (evnt || !timeout || ((timeout > 0) && (wiiuse_os_ticks() - start >= (unsigned long)timeout)))
+        {
+            return evnt;
+        }
+
+        wiiuse_millisleep(LOOP_SLEEP);
+    }
+}
+
+/**
+ *	@brief End a wiiuse_poll_wait() early, from any thread.
+ *
+ *	@param ctx	The context of the wiimotes, or NULL for the default one.
+ *
+ *	The wait returns as soon as its current poll is done. If nothing
+ *	waits, the next wait returns right away. The descriptor of
+ *	wiiuse_get_fd() gets ready as well, until the next wiiuse_poll().
+ *
+ *	Can be called until the wiimotes are released by wiiuse_cleanup().
+ */
+void wiiuse_wakeup(struct wiiuse_context_t *ctx)
+{
+#ifdef LOOP_EPOLL
+    uint64_t one = 1;
+    int fd;
+#endif
+
+    if (!ctx)
+    {
+        ctx = wiiuse_default_context();
+    }
+
+#ifdef LOOP_EPOLL
+    /* before the flag, see loop_drain() */
+    fd = loop_waker(&ctx->loop);
+    if ((fd != -1) && (write(fd, &one, sizeof(one)) == -1))
+    {
+        /* the counter is full, it is ready all the same */
+    }
+#endif
+
+    WIIUSE_STORE_RELEASE(&ctx->loop.woken, 1);
+}
+
+/**
+ *	@brief Keep the descriptor from wiiuse_get_fd() up to date.
+ *
+ *	Called by wiiuse_poll() after everything else.
+ */
+void loop_update(struct wiimote_t **wm, int wiimotes)
+{
+#ifdef LOOP_EPOLL
+    struct wiiuse_context_t *ctx;
+
+    if (!wm || (wiimotes <= 0))
+    {
+        return;
+    }
+
+    ctx = wm[0]->ctx;
+    if (!ctx->loop.enabled)
+    {
+        return;
+    }
+
+    loop_drain(&ctx->loop);
+    loop_watch(ctx, wm, wiimotes);
+    loop_arm(&ctx->loop, wm, wiimotes);
+#else
+    (void)wm;
+    (void)wiimotes;
+#endif
+}
+
+/**
+ *	@brief Take a descriptor out of the epoll set before it is closed.
+ *
+ *	Closing it would do that as well, but a socket opened again
+ *	with the same number before the next update would be missed.
+ */
+void loop_forget(struct wiiuse_context_t *ctx, int fd)
+{
+#ifdef LOOP_EPOLL
+    struct wiiuse_loop_t *loop = &ctx->loop;
+    int i;
+
+    if (!loop->enabled || (fd == -1))
+    {
+        return;
+    }
+
+    for (i = 0; i < loop->count; ++i)
+    {
+        if (LOOP_FD(loop->watched[i]) == fd)
+        {
+            epoll_ctl(loop->fd, EPOLL_CTL_DEL, fd, NULL);
+            memmove(loop->watched + i, loop->watched + i + 1, (loop->count - i - 1) * sizeof(int));
+            --loop->count;
+            return;
+        }
+    }
+#else
+    (void)ctx;
+    (void)fd;
+#endif
+}
+
+/**
+ *	@brief Release the descriptor from wiiuse_get_fd().
+ */
+void loop_destroy(struct wiiuse_context_t *ctx)
+{
+    struct wiiuse_loop_t *loop = &ctx->loop;
+
+#ifdef LOOP_EPOLL
+    if (loop->enabled)
+    {
+        close(loop->timer);
+        close(loop->fd);
+    }
+    if (loop->wake)
+    {
+        close(loop->wake - 1);
+    }
+#endif
+
+    wiiuse_ctx_free(ctx, loop->watched);
+    wiiuse_ctx_free(ctx, loop->wanted);
+    memset(loop, 0, sizeof(*loop));
+}
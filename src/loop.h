@@ -0,0 +1,48 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Descriptor for application event loops.
+ */
+
+#ifndef LOOP_H_INCLUDED
+#define LOOP_H_INCLUDED
+
+#include "wiiuse_internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @defgroup internal_loop Internal: Event Loop Descriptor */
+/** @{ */
+void loop_update(struct wiimote_t **wm, int wiimotes);
+void loop_forget(struct wiiuse_context_t *ctx, int fd);
+void loop_destroy(struct wiiuse_context_t *ctx);
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOOP_H_INCLUDED */
@@ -30,15 +30,26 @@
 
 #include "motion_plus.h"
 
+#include "classic.h"  /* for classic_ctrl_passthrough_event */
 #include "dynamics.h" /* for calc_joystick_state, etc */
 #include "events.h"   /* for disable_expansion */
 #include "io.h"       /* for wiiuse_read */
 #include "ir.h"       /* for wiiuse_set_ir_mode */
 #include "nunchuk.h"  /* for nunchuk_pressed_buttons */
 
-#include <math.h>   /* for fabs */
+#include <math.h>   /* for fabs, sqrtf */
 #include <string.h> /* for memset */
 
+/* gyro variance below which the device counts as still, raw units squared */
+#define GYRO_STILL_VAR 36
+/* allowed deviation of the accelerometer from 1g when still, milli-g */
+#define GYRO_STILL_ACCEL_MEAN 50
+#define GYRO_STILL_ACCEL_VAR 400
+/* how far the bias and confidence move per still frame */
+#define GYRO_BIAS_RATE 0.01f
+/* how much confidence is lost per moving frame */
+#define GYRO_BIAS_DECAY 0.0002f
+
 static void wiiuse_calibrate_motion_plus(struct motion_plus_t *mp);
 static void calculate_gyro_rates(struct motion_plus_t *mp);
 
@@ -52,7 +63,7 @@ void wiiuse_probe_motion_plus(struct wiimote_t *wm)
     /* check error code */
     if ((buf[5] & 0x0f) == 0)
     {
-        WIIUSE_DEBUG("No Motion+ available, stopping probe.");
+        WIIUSE_CTX_DEBUG(wm->ctx, "No Motion+ available, stopping probe.");
         WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_MPLUS_PRESENT);
         return;
     }
@@ -65,12 +76,12 @@ void wiiuse_probe_motion_plus(struct wiimote_t *wm)
         && id != EXP_ID_CODE_NLA_MOTION_PLUS_CLASSIC)
     {
         /* we have read something weird */
-        WIIUSE_DEBUG("Motion+ ID doesn't match, probably not connected.");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Motion+ ID doesn't match, probably not connected.");
         WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_MPLUS_PRESENT);
         return;
     }
 
-    WIIUSE_DEBUG("Detected inactive Motion+!");
+    WIIUSE_CTX_DEBUG(wm->ctx, "Detected inactive Motion+!");
     WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_MPLUS_PRESENT);
 
     /* init M+ */
@@ -92,6 +103,11 @@ void wiiuse_probe_motion_plus(struct wiimote_t *wm)
     wm->exp.mp.orient.pitch       = 0.0;
     wm->exp.mp.orient.yaw         = 0.0;
     wm->exp.mp.raw_gyro_threshold = 10;
+    wm->exp.mp.fusion_beta        = WIIUSE_DEFAULT_FUSION_BETA;
+    wm->exp.mp.fusion_ts          = 0;
+
+    memset(&wm->exp.mp.gyro_bias, 0, sizeof(struct gyro_bias_t));
+    wm->exp.mp.gyro_bias.enabled = 1;
 
     wm->exp.mp.nc         = &(wm->exp.nunchuk);
     wm->exp.mp.classic    = &(wm->exp.classic);
@@ -135,16 +151,17 @@ void wiiuse_motion_plus_handshake(struct wiimote_t *wm, byte *data, unsigned sho
 
             case EXP_ID_CODE_MOTION_PLUS_CLASSIC:
                 wm->exp.type = EXP_MOTION_PLUS_CLASSIC;
+                classic_ctrl_passthrough_calibration(&wm->exp.classic);
                 break;
 
             default:
                 /* huh? */
-                WIIUSE_WARNING("Unknown ID returned in Motion+ handshake %d\n", val);
+                WIIUSE_CTX_WARNING(wm->ctx, "Unknown ID returned in Motion+ handshake %d\n", val);
                 wm->exp.type = EXP_MOTION_PLUS;
                 break;
             }
 
-            WIIUSE_DEBUG("Motion plus connected");
+            WIIUSE_CTX_DEBUG(wm->ctx, "Motion plus connected");
 
             /* Init gyroscopes */
             wm->exp.mp.cal_gyro.roll      = 0;
@@ -154,6 +171,11 @@ void wiiuse_motion_plus_handshake(struct wiimote_t *wm, byte *data, unsigned sho
             wm->exp.mp.orient.pitch       = 0.0;
             wm->exp.mp.orient.yaw         = 0.0;
             wm->exp.mp.raw_gyro_threshold = 10;
+            wm->exp.mp.fusion_beta        = WIIUSE_DEFAULT_FUSION_BETA;
+            wm->exp.mp.fusion_ts          = 0;
+
+            memset(&wm->exp.mp.gyro_bias, 0, sizeof(struct gyro_bias_t));
+            wm->exp.mp.gyro_bias.enabled = 1;
 
             wm->exp.mp.nc         = &(wm->exp.nunchuk);
             wm->exp.mp.classic    = &(wm->exp.classic);
@@ -187,7 +209,7 @@ void wiiuse_set_motion_plus(struct wiimote_t *wm, int status)
 
     if (status)
     {
-        WIIUSE_DEBUG("Enabling Motion+\n");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Enabling Motion+\n");
 
         WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_EXP_HANDSHAKE);
         val = (status == 1) ? 0x04 : 0x05;
@@ -198,7 +220,7 @@ void wiiuse_set_motion_plus(struct wiimote_t *wm, int status)
 
     } else
     {
-        WIIUSE_DEBUG("Disabling Motion+\n");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Disabling Motion+\n");
 
         disable_expansion(wm);
         val = 0x55;
@@ -217,7 +239,7 @@ void wiiuse_set_motion_plus(struct wiimote_t *wm, int status)
         {
             int rc = 0;
 
-            WIIUSE_DEBUG("Asking for status, attempt %d ...\n", i);
+            WIIUSE_CTX_DEBUG(wm->ctx, "Asking for status, attempt %d ...\n", i);
             wm->event = WIIUSE_CONNECT;
 
             do
@@ -235,13 +257,62 @@ void wiiuse_set_motion_plus(struct wiimote_t *wm, int status)
     }
 }
 
+/**
+ *	@brief Set the gain of the Motion Plus orientation fusion.
+ *
+ *	@param wm		Pointer to the wiimote with Motion+
+ *	@param beta		How fast the accelerometer corrects gyro drift.
+ *					0 integrates the gyros only.
+ *
+ *	The default is WIIUSE_DEFAULT_FUSION_BETA. The accelerometer is
+ *	only used when the wiimote reports include it.
+ */
+void wiiuse_set_motion_plus_fusion_gain(struct wiimote_t *wm, float beta)
+{
+    if (!wm)
+    {
+        return;
+    }
+
+    wm->exp.mp.fusion_beta = (beta < 0.0f) ? 0.0f : beta;
+}
+
+/**
+ *	@brief Enable/disable the Motion Plus gyro bias tracker.
+ *
+ *	@param wm		Pointer to the wiimote with Motion+
+ *	@param status	1 to keep refining the gyro bias while the device
+ *					is still, 0 to keep the first calibration.
+ *
+ *	The tracker is enabled by default. Its state is reported in
+ *	wm->exp.mp.gyro_bias.
+ */
+void wiiuse_set_motion_plus_bias_tracking(struct wiimote_t *wm, int status)
+{
+    if (!wm)
+    {
+        return;
+    }
+
+    wm->exp.mp.gyro_bias.enabled = status ? 1 : 0;
+}
+
 void motion_plus_disconnected(struct motion_plus_t *mp)
 {
     WIIUSE_DEBUG("Motion plus disconnected");
     memset(mp, 0, sizeof(struct motion_plus_t));
 }
 
-void motion_plus_event(struct motion_plus_t *mp, int exp_type, byte *msg)
+/**
+ *	@brief Handle Motion Plus event.
+ *
+ *	@param mp		A pointer to a motion_plus_t structure.
+ *	@param exp_type	Type of the expansion, with or without pass-through.
+ *	@param msg		The message specified in the event packet.
+ *
+ *	@return 1 if the message was a gyro frame, 0 if it was pass-through data.
+ */
+int motion_plus_event(struct motion_plus_t *mp, int exp_type, byte *msg)
 {
     /*
      * Pass-through modes interleave data from the gyro
@@ -270,6 +341,8 @@ void motion_plus_event(struct motion_plus_t *mp, int exp_type, byte *msg)
 
         /* Calculate angular rates in deg/sec and performs some simple filtering */
         calculate_gyro_rates(mp);
+
+        return 1;
     }
 
     else
@@ -290,8 +363,7 @@ void motion_plus_event(struct motion_plus_t *mp, int exp_type, byte *msg)
             mp->nc->accel.y = msg[3];
             mp->nc->accel.z = (msg[4] & 0xFE) | ((msg[5] >> 5) & 0x04);
 
-            calculate_orientation(&(mp->nc->accel_calib), &(mp->nc->accel), &(mp->nc->orient),
-                                  NUNCHUK_IS_FLAG_SET(mp->nc, WIIUSE_SMOOTHING));
+            calculate_orientation(&(mp->nc->accel_calib), &(mp->nc->accel), &(mp->nc->orient), *mp->nc->flags);
 
             calculate_gforce(&(mp->nc->accel_calib), &(mp->nc->accel), &(mp->nc->gforce));
 
@@ -299,7 +371,7 @@ void motion_plus_event(struct motion_plus_t *mp, int exp_type, byte *msg)
 
         else if (exp_type == EXP_MOTION_PLUS_CLASSIC)
         {
-            WIIUSE_ERROR("Classic controller pass-through is not implemented!\n");
+            classic_ctrl_passthrough_event(mp->classic, msg);
         }
 
         else
@@ -307,6 +379,161 @@ void motion_plus_event(struct motion_plus_t *mp, int exp_type, byte *msg)
             WIIUSE_ERROR("Unsupported mode passed to motion_plus_event() !\n");
         }
     }
+
+    return 0;
+}
+
+/**
+ *	@brief Fuse the last gyro frame into the Motion Plus orientation.
+ *
+ *	@param mp		A pointer to a motion_plus_t structure.
+ *	@param gforce	Wiimote accelerometer reading of the same report, or NULL.
+ *	@param ts		Time the report was received, in milliseconds.
+ *
+ *	Updates mp->quat and mp->orient. Yaw is relative to the
+ *	orientation at the time the gyros were calibrated.
+ */
+void motion_plus_fusion(struct motion_plus_t *mp, struct gforce_t *gforce, unsigned long ts)
+{
+    unsigned long elapsed = ts - mp->fusion_ts;
+
+    /* rates are meaningless until the gyros are calibrated */
+    if (!mp->cal_gyro.roll && !mp->cal_gyro.pitch && !mp->cal_gyro.yaw)
+    {
+        return;
+    }
+
+    if (!mp->fusion_ts)
+    {
+        /* first frame, start from the accelerometer */
+        quaternion_from_gravity(&mp->quat, gforce);
+    } else if (elapsed <= WIIUSE_FUSION_MAX_GAP)
+    {
+        fuse_orientation(&mp->quat, &mp->angle_rate_gyro, gforce, mp->fusion_beta, (float)elapsed / 1000.0f);
+    }
+
+    mp->fusion_ts = ts;
+    quaternion_to_orient(&mp->quat, &mp->orient);
+}
+
+/**
+ *	@brief Refine the gyro bias from the last gyro frame.
+ *
+ *	@param mp		A pointer to a motion_plus_t structure.
+ *	@param gforce	Wiimote accelerometer reading of the same report, or NULL.
+ *
+ *	Keeps running sums over the last WIIUSE_GYRO_BIAS_WINDOW frames so
+ *	each frame costs the same. When the gyro variance is low and the
+ *	accelerometer reads a steady 1g over the whole window, the device is
+ *	still and the bias moves towards the window mean.
+ *
+ *	Without accelerometer data a slow, steady turn looks just as still,
+ *	so the bias and its confidence are left alone and the window starts
+ *	over once the accelerometer is back.
+ */
+void motion_plus_track_bias(struct motion_plus_t *mp, struct gforce_t *gforce)
+{
+    struct gyro_bias_t *gb = &mp->gyro_bias;
+    int16_t gyro[3];
+    int16_t accel;
+    int64_t n, var;
+    int32_t mean;
+    float *bias[3];
+    int i, still;
+
+    /* nothing to refine before the first calibration */
+    if (!gb->enabled || (!mp->cal_gyro.roll && !mp->cal_gyro.pitch && !mp->cal_gyro.yaw))
+    {
+        return;
+    }
+
+    gyro[0] = mp->raw_gyro.roll;
+    gyro[1] = mp->raw_gyro.pitch;
+    gyro[2] = mp->raw_gyro.yaw;
+
+    if (!gforce)
+    {
+        memset(gb->sum_gyro, 0, sizeof(gb->sum_gyro));
+        memset(gb->sum_sq_gyro, 0, sizeof(gb->sum_sq_gyro));
+        gb->sum_accel    = 0;
+        gb->sum_sq_accel = 0;
+        gb->pos          = 0;
+        gb->fill         = 0;
+        gb->still        = 0;
+        return;
+    }
+
+    /* deviation from 1g in milli-g */
+    accel = (int16_t)((sqrtf(gforce->x * gforce->x + gforce->y * gforce->y + gforce->z * gforce->z) - 1.0f)
+                      * 1000.0f);
+
+    /* slide the window */
+    if (gb->fill == WIIUSE_GYRO_BIAS_WINDOW)
+    {
+        for (i = 0; i < 3; ++i)
+        {
+            gb->sum_gyro[i] -= gb->win_gyro[gb->pos][i];
+            gb->sum_sq_gyro[i] -= (int64_t)gb->win_gyro[gb->pos][i] * gb->win_gyro[gb->pos][i];
+        }
+        gb->sum_accel -= gb->win_accel[gb->pos];
+        gb->sum_sq_accel -= (int64_t)gb->win_accel[gb->pos] * gb->win_accel[gb->pos];
+    } else
+    {
+        ++gb->fill;
+    }
+
+    for (i = 0; i < 3; ++i)
+    {
+        gb->win_gyro[gb->pos][i] = gyro[i];
+        gb->sum_gyro[i] += gyro[i];
+        gb->sum_sq_gyro[i] += (int64_t)gyro[i] * gyro[i];
+    }
+    gb->win_accel[gb->pos] = accel;
+    gb->sum_accel += accel;
+    gb->sum_sq_accel += (int64_t)accel * accel;
+
+    gb->pos = (gb->pos + 1) % WIIUSE_GYRO_BIAS_WINDOW;
+
+    if (gb->fill < WIIUSE_GYRO_BIAS_WINDOW)
+    {
+        return;
+    }
+
+    /* variances times n^2, to stay in integers */
+    n     = WIIUSE_GYRO_BIAS_WINDOW;
+    still = 1;
+    for (i = 0; i < 3; ++i)
+    {
+        var = n * gb->sum_sq_gyro[i] - (int64_t)gb->sum_gyro[i] * gb->sum_gyro[i];
+        if (var > GYRO_STILL_VAR * n * n)
+        {
+            still = 0;
+        }
+    }
+
+    mean = gb->sum_accel / WIIUSE_GYRO_BIAS_WINDOW;
+    var  = n * gb->sum_sq_accel - (int64_t)gb->sum_accel * gb->sum_accel;
+    if (mean > GYRO_STILL_ACCEL_MEAN || mean < -GYRO_STILL_ACCEL_MEAN || var > GYRO_STILL_ACCEL_VAR * n * n)
+    {
+        still = 0;
+    }
+
+    gb->still = still;
+    if (!still)
+    {
+        /* the estimate slowly gets stale while moving */
+        gb->confidence -= GYRO_BIAS_DECAY * gb->confidence;
+        return;
+    }
+
+    bias[0] = &gb->bias.roll;
+    bias[1] = &gb->bias.pitch;
+    bias[2] = &gb->bias.yaw;
+    for (i = 0; i < 3; ++i)
+    {
+        *bias[i] += GYRO_BIAS_RATE * ((float)gb->sum_gyro[i] / (float)n - *bias[i]);
+    }
+    gb->confidence += GYRO_BIAS_RATE * (1.0f - gb->confidence);
 }
 
 /**
@@ -319,47 +546,58 @@ void motion_plus_event(struct motion_plus_t *mp, int exp_type, byte *msg)
  */
 void wiiuse_calibrate_motion_plus(struct motion_plus_t *mp)
 {
+    int enabled;
+
     mp->cal_gyro.roll  = mp->raw_gyro.roll;
     mp->cal_gyro.pitch = mp->raw_gyro.pitch;
     mp->cal_gyro.yaw   = mp->raw_gyro.yaw;
     mp->orient.roll    = 0.0;
     mp->orient.pitch   = 0.0;
     mp->orient.yaw     = 0.0;
+    mp->fusion_ts      = 0;
+
+    /* restart the bias tracker from this first guess */
+    enabled = mp->gyro_bias.enabled;
+    memset(&mp->gyro_bias, 0, sizeof(struct gyro_bias_t));
+    mp->gyro_bias.enabled    = enabled;
+    mp->gyro_bias.bias.roll  = mp->cal_gyro.roll;
+    mp->gyro_bias.bias.pitch = mp->cal_gyro.pitch;
+    mp->gyro_bias.bias.yaw   = mp->cal_gyro.yaw;
 }
 
 static void calculate_gyro_rates(struct motion_plus_t *mp)
 {
-    short int tmp_r, tmp_p, tmp_y;
+    float tmp_r, tmp_p, tmp_y;
     float tmp_roll, tmp_pitch, tmp_yaw;
 
-    /* We consider calibration data */
-    tmp_r = mp->raw_gyro.roll - mp->cal_gyro.roll;
-    tmp_p = mp->raw_gyro.pitch - mp->cal_gyro.pitch;
-    tmp_y = mp->raw_gyro.yaw - mp->cal_gyro.yaw;
+    /* We consider calibration data, as refined by the bias tracker */
+    tmp_r = (float)mp->raw_gyro.roll - mp->gyro_bias.bias.roll;
+    tmp_p = (float)mp->raw_gyro.pitch - mp->gyro_bias.bias.pitch;
+    tmp_y = (float)mp->raw_gyro.yaw - mp->gyro_bias.bias.yaw;
 
     /* We convert to degree/sec according to fast/slow mode */
     if (mp->acc_mode & 0x04)
     {
-        tmp_roll = (float)tmp_r / 20.0f;
+        tmp_roll = tmp_r / 20.0f;
     } else
     {
-        tmp_roll = (float)tmp_r / 4.0f;
+        tmp_roll = tmp_r / 4.0f;
     }
 
     if (mp->acc_mode & 0x02)
     {
-        tmp_pitch = (float)tmp_p / 20.0f;
+        tmp_pitch = tmp_p / 20.0f;
     } else
     {
-        tmp_pitch = (float)tmp_p / 4.0f;
+        tmp_pitch = tmp_p / 4.0f;
     }
 
     if (mp->acc_mode & 0x01)
     {
-        tmp_yaw = (float)tmp_y / 20.0f;
+        tmp_yaw = tmp_y / 20.0f;
     } else
     {
-        tmp_yaw = (float)tmp_y / 4.0f;
+        tmp_yaw = tmp_y / 4.0f;
     }
 
     /* Simple filtering */
@@ -73,9 +73,9 @@ int nunchuk_handshake(struct wiimote_t *wm, struct nunchuk_t *nc, byte *data, un
         if (len < 17 || len < HANDSHAKE_BYTES_USED + 16 || data[16] == 0xFF)
         {
             /* get the calibration data */
-            byte *handshake_buf = (byte *)malloc(EXP_HANDSHAKE_LEN * sizeof(byte));
+            byte *handshake_buf = (byte *)wiiuse_ctx_malloc(wm->ctx, EXP_HANDSHAKE_LEN * sizeof(byte));
 
-            WIIUSE_DEBUG("Nunchuk handshake appears invalid, trying again.");
+            WIIUSE_CTX_DEBUG(wm->ctx, "Nunchuk handshake appears invalid, trying again.");
             wiiuse_read_data_cb(wm, handshake_expansion, handshake_buf, WM_EXP_MEM_CALIBR, EXP_HANDSHAKE_LEN);
 
             return 0;
@@ -91,14 +91,16 @@ int nunchuk_handshake(struct wiimote_t *wm, struct nunchuk_t *nc, byte *data, un
     nc->accel_calib.cal_g.x    = data[4];
     nc->accel_calib.cal_g.y    = data[5];
     nc->accel_calib.cal_g.z    = data[6];
+    calculate_accel_gains(&nc->accel_calib);
     nc->js.max.x               = data[8];
     nc->js.min.x               = data[9];
     nc->js.center.x            = data[10];
     nc->js.max.y               = data[11];
     nc->js.min.y               = data[12];
     nc->js.center.y            = data[13];
-    WIIUSE_DEBUG("Nunchuk calibration X: min %x, max %x, center %x Y: min %x, max %x, center %x",
-                 nc->js.min.x, nc->js.max.x, nc->js.center.x, nc->js.min.y, nc->js.max.y, nc->js.center.y);
+    WIIUSE_CTX_DEBUG(wm->ctx, "Nunchuk calibration X: min %x, max %x, center %x Y: min %x, max %x, center %x",
+                     nc->js.min.x, nc->js.max.x, nc->js.center.x, nc->js.min.y, nc->js.max.y,
+                     nc->js.center.y);
 
     /* If the calibration data makes no sense, fake it. */
     if (nc->js.max.x < nc->js.center.x)
@@ -152,8 +154,7 @@ void nunchuk_event(struct nunchuk_t *nc, byte *msg)
     nc->accel.y = msg[3];
     nc->accel.z = msg[4];
 
-    calculate_orientation(&nc->accel_calib, &nc->accel, &nc->orient,
-                          NUNCHUK_IS_FLAG_SET(nc, WIIUSE_SMOOTHING));
+    calculate_orientation(&nc->accel_calib, &nc->accel, &nc->orient, *nc->flags);
     calculate_gforce(&nc->accel_calib, &nc->accel, &nc->gforce);
 }
 
@@ -46,14 +46,23 @@ void wiiuse_init_platform_fields(struct wiimote_t *wm);
 void wiiuse_cleanup_platform_fields(struct wiimote_t *wm);
 
 int wiiuse_os_find(struct wiimote_t **wm, int max_wiimotes, int timeout);
+int wiiuse_os_set_discovery(struct wiiuse_context_t *ctx, int interval);
+int wiiuse_os_set_incoming(struct wiiuse_context_t *ctx, int enable);
+int wiiuse_os_set_reconnect(struct wiimote_t *wm, int enable);
 
 int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes);
+/* connect wm[which] again, the rest of the array only counts for adapter placement,
+   1 once connected or, where the platform can do it without blocking, once under way */
+int wiiuse_os_reconnect(struct wiimote_t **wm, int wiimotes, int which);
 void wiiuse_os_disconnect(struct wiimote_t *wm);
 
 int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes);
 /* buf[0] will be the report type, buf+1 the rest of the report */
 int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len);
 int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len);
+/* descriptor that is readable when the wiimote has a report, or writable when
+   a pending connect is done for a WIIMOTE_STATE_CONNECTING one, -1 if there is none */
+int wiiuse_os_fd(struct wiimote_t *wm);
 
 unsigned long wiiuse_os_ticks();
 /** @} */
@@ -274,7 +274,7 @@ static int wiiuse_os_connect_single(struct wiimote_t *wm)
     while (!WIIMOTE_IS_CONNECTED(wm) && wm->event != WIIUSE_UNEXPECTED_DISCONNECT) {
         bte_wait_events(10000);
     }
-    WIIUSE_INFO("Connected to wiimote [id %i].", wm->unid);
+    WIIUSE_CTX_INFO(wm->ctx, "Connected to wiimote [id %i].", wm->unid);
 
     if (!WIIMOTE_IS_CONNECTED(wm))
         return 0;
@@ -318,6 +318,28 @@ int wiiuse_os_find(struct wiimote_t **wm, int max_wiimotes, int timeout)
     return ctx.num_found;
 }
 
+int wiiuse_os_set_discovery(struct wiiuse_context_t *ctx, int interval)
+{
+    if (interval > 0)
+    {
+        WIIUSE_CTX_WARNING(ctx, "Background discovery is not supported on this platform.");
+        return 0;
+    }
+
+    return 1;
+}
+
+int wiiuse_os_set_incoming(struct wiiuse_context_t *ctx, int enable)
+{
+    if (enable)
+    {
+        WIIUSE_CTX_WARNING(ctx, "Incoming connections are not supported on this platform.");
+        return 0;
+    }
+
+    return 1;
+}
+
 /**
  *	@see wiiuse_connect()
  */
@@ -343,6 +365,22 @@ int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes)
     return connected;
 }
 
+int wiiuse_os_set_reconnect(struct wiimote_t *wm, int enable)
+{
+    (void)wm;
+    (void)enable;
+
+    return 1;
+}
+
+int wiiuse_os_reconnect(struct wiimote_t **wm, int wiimotes, int which)
+{
+    /* there is a single controller */
+    (void)wiimotes;
+
+    return wiiuse_os_connect_single(wm[which]);
+}
+
 void wiiuse_os_disconnect(struct wiimote_t *wm)
 {
     if (!wm || WIIMOTE_IS_CONNECTED(wm))
@@ -434,6 +472,13 @@ int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len)
                                   bte_buffer_writer_end(&writer));
 }
 
+int wiiuse_os_fd(struct wiimote_t *wm)
+{
+    /* the stack delivers through bte_wait_events(), not descriptors */
+    (void)wm;
+    return -1;
+}
+
 void wiiuse_init_platform_fields(struct wiimote_t *wm)
 {
     wm->intr_channel = NULL;
@@ -0,0 +1,653 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Handles device I/O through the Linux hidraw interface.
+ *
+ *	With this backend the kernel owns the Bluetooth connection:
+ *	a wiimote paired and connected with the usual tools
+ *	(bluetoothctl, ...) gets bound to hid-wiimote and shows up as
+ *	a /dev/hidraw node. wiiuse finds those nodes through sysfs,
+ *	the same data udev matches on, and talks to the wiimote with
+ *	plain read() and write() of HID reports.
+ *
+ *	The kernel driver keeps running next to wiiuse. As long as
+ *	nothing opens the input devices it creates it leaves the
+ *	reporting mode alone.
+ *
+ *	Virtual wiimotes created through /dev/uhid look exactly like
+ *	real ones here, which is how this backend is tested.
+ */
+
+#include "wiiuse_internal.h" /* for WM_RPT_CTRL_STATUS */
+#include "events.h"
+#include "io.h"
+#include "loop.h" /* for loop_forget */
+#include "os.h"
+
+#ifdef WIIUSE_HIDRAW
+
+#include <ctype.h>  /* for toupper */
+#include <dirent.h> /* for opendir */
+#include <errno.h>
+#include <fcntl.h>  /* for open */
+#include <poll.h>   /* for poll */
+#include <stdio.h>  /* for fopen, snprintf */
+#include <string.h> /* for memset */
+#include <time.h>   /* for clock_gettime */
+#include <unistd.h> /* for close, read, write */
+
+/* where the hidraw class devices are listed */
+#ifndef WIIUSE_HIDRAW_SYSFS
+#define WIIUSE_HIDRAW_SYSFS "/sys/class/hidraw"
+#endif
+
+/* where the nodes themselves are */
+#ifndef WIIUSE_HIDRAW_DEV
+#define WIIUSE_HIDRAW_DEV "/dev"
+#endif
+
+/* HID_ID of a wiimote: Bluetooth bus, Nintendo */
+#define HIDRAW_BUS_BLUETOOTH 0x0005
+#define HIDRAW_VENDOR        0x057E
+#define HIDRAW_PRODUCT       0x0306 /* RVL-CNT-01, also the balance board */
+#define HIDRAW_PRODUCT_TR    0x0330 /* RVL-CNT-01-TR (MotionPlus Inside) */
+
+/* how often wiiuse_os_find() looks at sysfs while waiting */
+#define HIDRAW_RESCAN_DELAY 250
+
+/* nodes handed to one poll() call */
+#define HIDRAW_POLL_BATCH 16
+
+/**
+ *	@brief Read the HID properties of a hidraw node from sysfs.
+ *
+ *	@param node		Name of the node, like "hidraw3".
+ *	@param type		[out] The wiimote type.
+ *	@param addr		[out] Bluetooth address, from HID_UNIQ.
+ *
+ *	@return 1 if the node is a wiimote, 0 otherwise.
+ */
+static int hidraw_probe(const char *node, WIIUSE_WIIMOTE_TYPE *type, char *addr)
+{
+    char path[128];
+    char line[128];
+    unsigned int bus     = 0;
+    unsigned int vendor  = 0;
+    unsigned int product = 0;
+    FILE *uevent;
+    int i;
+
+    snprintf(path, sizeof(path), "%s/%s/device/uevent", WIIUSE_HIDRAW_SYSFS, node);
+    uevent = fopen(path, "r");
+    if (!uevent)
+    {
+        return 0;
+    }
+
+    addr[0] = '\0';
+    while (fgets(line, sizeof(line), uevent))
+    {
+        if (sscanf(line, "HID_ID=%x:%x:%x", &bus, &vendor, &product) == 3)
+        {
+            continue;
+        }
+
+        if (!strncmp(line, "HID_UNIQ=", 9))
+        {
+            /* same case as the BlueZ backend */
+            for (i = 0; (i < 17) && line[9 + i] && (line[9 + i] != '\n'); ++i)
+            {
+                addr[i] = (char)toupper((unsigned char)line[9 + i]);
+            }
+            addr[i] = '\0';
+        }
+    }
+    fclose(uevent);
+
+    if ((bus != HIDRAW_BUS_BLUETOOTH) || (vendor != HIDRAW_VENDOR))
+    {
+        return 0;
+    }
+
+    if (product == HIDRAW_PRODUCT)
+    {
+        *type = WIIUSE_WIIMOTE_REGULAR;
+    } else if (product == HIDRAW_PRODUCT_TR)
+    {
+        *type = WIIUSE_WIIMOTE_MOTION_PLUS_INSIDE;
+    } else
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ *	@brief Put the wiimotes listed in sysfs into free slots.
+ *
+ *	@param wm		An array of pointers to wiimote_t structures.
+ *	@param wiimotes	The number of wiimote_t structures in the \a wm array.
+ *	@param flags	State flags set on each new wiimote besides WIIMOTE_STATE_DEV_FOUND.
+ *
+ *	Nodes that already belong to a slot are skipped.
+ *
+ *	@return The number of wiimotes added.
+ */
+static int hidraw_scan(struct wiimote_t **wm, int wiimotes, int flags)
+{
+    WIIUSE_WIIMOTE_TYPE type;
+    struct dirent *entry;
+    char addr[18];
+    char devnode[32];
+    DIR *dir;
+    int added = 0;
+    int i;
+
+    dir = opendir(WIIUSE_HIDRAW_SYSFS);
+    if (!dir)
+    {
+        return 0;
+    }
+
+    while ((entry = readdir(dir)))
+    {
+        if (strncmp(entry->d_name, "hidraw", 6) || !hidraw_probe(entry->d_name, &type, addr))
+        {
+            continue;
+        }
+        if (snprintf(devnode, sizeof(devnode), "%s/%s", WIIUSE_HIDRAW_DEV, entry->d_name) >= (int)sizeof(devnode))
+        {
+            continue;
+        }
+
+        /* known already */
+        for (i = 0; i < wiimotes; ++i)
+        {
+            if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND) && !strcmp(wm[i]->devnode, devnode))
+            {
+                break;
+            }
+        }
+        if (i < wiimotes)
+        {
+            continue;
+        }
+
+        /* next free slot */
+        for (i = 0; i < wiimotes; ++i)
+        {
+            if (!WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND) && !WIIMOTE_IS_CONNECTED(wm[i]))
+            {
+                break;
+            }
+        }
+        if (i == wiimotes)
+        {
+            break;
+        }
+
+        strcpy(wm[i]->devnode, devnode);
+        strcpy(wm[i]->bdaddr_str, addr);
+        wm[i]->type = type;
+        WIIMOTE_ENABLE_STATE(wm[i], WIIMOTE_STATE_DEV_FOUND | flags);
+
+        WIIUSE_INFO("Found wiimote (%s) on %s [id %i].", addr, devnode, wm[i]->unid);
+        ++added;
+    }
+
+    closedir(dir);
+    return added;
+}
+
+/**
+ *	@brief Look for wiimotes the kernel is connected to.
+ *
+ *	Waits up to \a timeout seconds for the array to fill up.
+ */
+int wiiuse_os_find(struct wiimote_t **wm, int max_wiimotes, int timeout)
+{
+    unsigned long deadline = wiiuse_os_ticks() + (unsigned long)timeout * 1000;
+    int found              = 0;
+
+    for (;;)
+    {
+        found += hidraw_scan(wm, max_wiimotes, 0);
+        if ((found >= max_wiimotes) || (wiiuse_os_ticks() >= deadline))
+        {
+            break;
+        }
+        wiiuse_millisleep(HIDRAW_RESCAN_DELAY);
+    }
+
+    return found;
+}
+
+/**
+ *	@see wiiuse_set_background_discovery()
+ *
+ *	Nothing to inquire here, new nodes are picked up by looking
+ *	at sysfs every \a interval seconds.
+ */
+int wiiuse_os_set_discovery(struct wiiuse_context_t *ctx, int interval)
+{
+    struct wiiuse_discovery_t *disc = &ctx->discovery;
+
+    disc->enabled = 0;
+    disc->connect = 0;
+
+    if (interval <= 0)
+    {
+        return 1;
+    }
+
+    disc->sock     = -1;
+    disc->interval = (unsigned long)interval * 1000;
+    disc->next     = wiiuse_os_ticks();
+    disc->enabled  = 1;
+
+    return 1;
+}
+
+/**
+ *	@see wiiuse_set_accept_incoming()
+ */
+int wiiuse_os_set_incoming(struct wiiuse_context_t *ctx, int enable)
+{
+    if (enable)
+    {
+        WIIUSE_CTX_WARNING(ctx,
+                           "The kernel accepts incoming connections, use background discovery to pick them up.");
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ *	@brief Open the hidraw node of a found wiimote and do the handshake.
+ *
+ *	@return 1 on success, 0 on failure
+ */
+static int hidraw_connect_single(struct wiimote_t *wm)
+{
+    if (WIIMOTE_IS_CONNECTED(wm))
+    {
+        return 0;
+    }
+
+    /* drop the node a dropped link left behind */
+    wiiuse_os_disconnect(wm);
+
+    wm->fd = open(wm->devnode, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (wm->fd == -1)
+    {
+        WIIUSE_CTX_ERROR(wm->ctx, "Unable to open %s.", wm->devnode);
+        perror("Error Details");
+        return 0;
+    }
+
+    /* the kernel does not tell us which adapter */
+    wm->adapter = -1;
+    WIIUSE_CTX_INFO(wm->ctx, "Connected to wiimote [id %i].", wm->unid);
+
+    /* do the handshake */
+    WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_CONNECTED);
+    wiiuse_handshake(wm, NULL, 0);
+
+    wiiuse_set_report_type(wm);
+
+    return 1;
+}
+
+/**
+ *	@see wiiuse_connect()
+ */
+int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes)
+{
+    int connected = 0;
+    int i;
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        if (!WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND) || WIIMOTE_IS_CONNECTED(wm[i]))
+        {
+            continue;
+        }
+
+        connected += hidraw_connect_single(wm[i]);
+    }
+
+    return connected;
+}
+
+int wiiuse_os_set_reconnect(struct wiimote_t *wm, int enable)
+{
+    (void)wm;
+    (void)enable;
+
+    return 1;
+}
+
+int wiiuse_os_reconnect(struct wiimote_t **wm, int wiimotes, int which)
+{
+    /* the kernel picks the adapter */
+    (void)wiimotes;
+
+    return hidraw_connect_single(wm[which]);
+}
+
+void wiiuse_os_disconnect(struct wiimote_t *wm)
+{
+    if (!wm || WIIMOTE_IS_CONNECTED(wm))
+    {
+        return;
+    }
+
+    if (wm->fd != -1)
+    {
+        loop_forget(wm->ctx, wm->fd);
+        close(wm->fd);
+        wm->fd = -1;
+    }
+
+    wm->adapter = -1;
+    wm->event   = WIIUSE_NONE;
+
+    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_CONNECTED);
+    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_HANDSHAKE);
+}
+
+/**
+ *	@brief Time driven part of background discovery.
+ *
+ *	@return The number of wiimotes that got an event.
+ */
+static int discovery_step(struct wiiuse_context_t *ctx, struct wiimote_t **wm, int wiimotes)
+{
+    struct wiiuse_discovery_t *disc = &ctx->discovery;
+    unsigned long now;
+    int evnt = 0;
+    int i;
+
+    /* found on the last scan, connect them now that their event went out */
+    if (disc->connect)
+    {
+        disc->connect = 0;
+
+        for (i = 0; i < wiimotes; ++i)
+        {
+            if (!WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_SEEN))
+            {
+                continue;
+            }
+
+            WIIMOTE_DISABLE_STATE(wm[i], WIIMOTE_STATE_DEV_SEEN);
+            if (hidraw_connect_single(wm[i]))
+            {
+                evnt += (wm[i]->event != WIIUSE_NONE);
+            }
+        }
+    }
+
+    now = wiiuse_os_ticks();
+    if (now < disc->next)
+    {
+        return evnt;
+    }
+    disc->next = now + disc->interval;
+
+    if (!hidraw_scan(wm, wiimotes, WIIMOTE_STATE_DEV_SEEN))
+    {
+        return evnt;
+    }
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_SEEN) && (wm[i]->event == WIIUSE_NONE))
+        {
+            wm[i]->event = WIIUSE_FOUND;
+            ++evnt;
+        }
+    }
+    disc->connect = 1;
+
+    return evnt;
+}
+
+/**
+ *	@brief Read whatever arrived on a batch of hidraw nodes.
+ *
+ *	@param polled	The wiimotes behind \a fds.
+ *	@param fds		One entry per wiimote, filled in by the caller.
+ *	@param nfds		Number of entries in \a fds.
+ *	@param timeout	Milliseconds poll() may block.
+ *
+ *	@return The number of wiimotes that got an event.
+ */
+static int hidraw_poll_batch(struct wiimote_t **polled, struct pollfd *fds, int nfds, int timeout)
+{
+    byte read_buffer[MAX_PAYLOAD];
+    int evnt = 0;
+    int r;
+    int i;
+
+    if (poll(fds, nfds, timeout) == -1)
+    {
+        if (errno != EINTR)
+        {
+            WIIUSE_ERROR("Unable to poll() the wiimote hidraw node(s).");
+            perror("Error Details");
+        }
+        return 0;
+    }
+
+    /* check each node for an event */
+    for (i = 0; i < nfds; ++i)
+    {
+        if (fds[i].revents & (POLLIN | POLLERR | POLLHUP))
+        {
+            /* clear out the event buffer */
+            memset(read_buffer, 0, sizeof(read_buffer));
+
+            /* clear out any old read data */
+            clear_dirty_reads(polled[i]);
+
+            r = wiiuse_os_read(polled[i], read_buffer, sizeof(read_buffer));
+            if (r > 0)
+            {
+                /* propagate the event */
+                propagate_event(polled[i], read_buffer[0], read_buffer + 1);
+                evnt += (polled[i]->event != WIIUSE_NONE);
+            } else if (!WIIMOTE_IS_CONNECTED(polled[i]))
+            {
+                /* freshly disconnected */
+                polled[i]->event = WIIUSE_UNEXPECTED_DISCONNECT;
+                evnt++;
+                /* propagate the event:
+                   Emit a controller-status type event. */
+                propagate_event(polled[i], WM_RPT_CTRL_STATUS, 0);
+            }
+        } else
+        {
+            /* send out any waiting writes */
+            wiiuse_send_next_pending_write_request(polled[i]);
+            idle_cycle(polled[i]);
+        }
+    }
+
+    return evnt;
+}
+
+int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes)
+{
+    struct pollfd fds[HIDRAW_POLL_BATCH];
+    struct wiimote_t *polled[HIDRAW_POLL_BATCH];
+    int timeout = 1; /* like the 1/2000th of a second select() of the BlueZ backend, rounded up */
+    int nfds    = 0;
+    int evnt    = 0;
+    int i;
+
+    if (!wm)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        wm[i]->event = WIIUSE_NONE;
+    }
+
+    if ((wiimotes > 0) && wm[0]->ctx->loop.waited)
+    {
+        /* wiiuse_poll_wait() did the waiting */
+        timeout = 0;
+    }
+
+    if ((wiimotes > 0) && wm[0]->ctx->discovery.enabled)
+    {
+        evnt += discovery_step(wm[0]->ctx, wm, wiimotes);
+    }
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        /* only poll it if it is connected */
+        if (!WIIMOTE_IS_CONNECTED(wm[i]))
+        {
+            continue;
+        }
+
+        fds[nfds].fd      = wm[i]->fd;
+        fds[nfds].events  = POLLIN;
+        fds[nfds].revents = 0;
+        polled[nfds]      = wm[i];
+
+        if (++nfds == HIDRAW_POLL_BATCH)
+        {
+            /* only the first batch waits */
+            evnt += hidraw_poll_batch(polled, fds, nfds, timeout);
+            timeout = 0;
+            nfds    = 0;
+        }
+    }
+
+    if (nfds)
+    {
+        evnt += hidraw_poll_batch(polled, fds, nfds, timeout);
+    }
+
+    return evnt;
+}
+
+int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len)
+{
+    int rc;
+
+    rc = read(wm->fd, buf, len);
+    if (rc == -1)
+    {
+        switch (errno)
+        {
+        case EAGAIN:
+        case EINTR:
+            /* no data available yet */
+            break;
+
+        default:
+            /* the kernel dropped the connection, the node is gone */
+            WIIUSE_CTX_ERROR(wm->ctx, "Wiimote [id %i] went away (%s).", wm->unid, strerror(errno));
+            wiiuse_disconnected(wm);
+            wiiuse_os_disconnect(wm);
+            break;
+        }
+    } else if (rc == 0)
+    {
+        wiiuse_disconnected(wm);
+        wiiuse_os_disconnect(wm);
+    } else
+    {
+/* log the received data */
+#ifdef WITH_WIIUSE_DEBUG
+        if (buf[0] != 0x30)
+        { /* hack for chatty Balance Boards that flood the logs with useless button reports */
+            int i;
+            printf("[DEBUG] (id %i) RECV: (%.2x) ", wm->unid, buf[0]);
+            for (i = 1; i < rc; i++)
+            {
+                printf("%.2x ", buf[i]);
+            }
+            printf("\n");
+        }
+#endif
+    }
+
+    return rc;
+}
+
+int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len)
+{
+    int rc;
+    byte write_buffer[MAX_PAYLOAD];
+
+    /* hidraw takes the report id first, the kernel adds the HID header */
+    write_buffer[0] = report_type;
+    memcpy(write_buffer + 1, buf, len);
+
+    rc = write(wm->fd, write_buffer, len + 1);
+
+    if (rc < 0)
+    {
+        wiiuse_disconnected(wm);
+    }
+
+    return rc;
+}
+
+int wiiuse_os_fd(struct wiimote_t *wm) { return wm->fd; }
+
+void wiiuse_init_platform_fields(struct wiimote_t *wm)
+{
+    wm->bdaddr_str[0] = '\0';
+    wm->devnode[0]    = '\0';
+    wm->fd            = -1;
+}
+
+void wiiuse_cleanup_platform_fields(struct wiimote_t *wm)
+{
+    if (wm->fd != -1)
+    {
+        close(wm->fd);
+    }
+    wm->fd = -1;
+}
+
+unsigned long wiiuse_os_ticks()
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    unsigned long ms = 1000 * tp.tv_sec + tp.tv_nsec / 1e6;
+    return ms;
+}
+
+#endif /* ifdef WIIUSE_HIDRAW */
@@ -237,4 +237,22 @@ int wiiuse_os_find(struct wiimote_t** wm, int max_wiimotes, int timeout) {
 	return result;
 }
 
+int wiiuse_os_set_discovery(struct wiiuse_context_t* ctx, int interval) {
+	if (interval > 0) {
+		WIIUSE_CTX_WARNING(ctx, "Background discovery is not supported on this platform.");
+		return 0;
+	}
+	
+	return 1;
+}
+
+int wiiuse_os_set_incoming(struct wiiuse_context_t* ctx, int enable) {
+	if (enable) {
+		WIIUSE_CTX_WARNING(ctx, "Incoming connections are not supported on this platform.");
+		return 0;
+	}
+	
+	return 1;
+}
+
 #endif // __APPLE__
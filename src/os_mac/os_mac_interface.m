@@ -70,14 +70,14 @@ static short wiiuse_os_connect_single(struct wiimote_t* wm) {
 		WIIUSE_ERROR("No Wiimote given.");
 		return 0;
 	} else if(wm && (!WIIMOTE_IS_SET(wm, WIIMOTE_STATE_DEV_FOUND) || wm->objc_wm == NULL)) {
-		WIIUSE_ERROR("Tried to connect Wiimote without an address.");
+		WIIUSE_CTX_ERROR(wm->ctx, "Tried to connect Wiimote without an address.");
 		return 0;
 	} else if(WIIMOTE_IS_CONNECTED(wm)) {
-		WIIUSE_WARNING("Wiimote [id %i] is already connected.", wm->unid);
+		WIIUSE_CTX_WARNING(wm->ctx, "Wiimote [id %i] is already connected.", wm->unid);
 		return 1;
 	}
 	
-	WIIUSE_DEBUG("Connecting to Wiimote [id %i].", wm->unid);
+	WIIUSE_CTX_DEBUG(wm->ctx, "Connecting to Wiimote [id %i].", wm->unid);
 	
 	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
 	short result = 0;
@@ -85,7 +85,7 @@ static short wiiuse_os_connect_single(struct wiimote_t* wm) {
 	// connect
 	WiiuseWiimote* objc_wm = (WiiuseWiimote*) wm->objc_wm;
 	if([objc_wm connect] == kIOReturnSuccess) {
-		WIIUSE_INFO("Connected to Wiimote [id %i].", wm->unid);
+		WIIUSE_CTX_INFO(wm->ctx, "Connected to Wiimote [id %i].", wm->unid);
 		
 		// save the connect structure to retrieve data later on
 		wm->objc_wm = (void*)objc_wm;
@@ -126,6 +126,20 @@ int wiiuse_os_connect(struct wiimote_t** wm, int wiimotes) {
 	return connected;
 }
 
+int wiiuse_os_set_reconnect(struct wiimote_t* wm, int enable) {
+	(void)wm;
+	(void)enable;
+	
+	return 1;
+}
+
+int wiiuse_os_reconnect(struct wiimote_t** wm, int wiimotes, int which) {
+	// IOBluetooth picks the adapter
+	(void)wiimotes;
+	
+	return wiiuse_os_connect(&wm[which], 1);
+}
+
 void wiiuse_os_disconnect(struct wiimote_t* wm) {
 	if (!wm || !WIIMOTE_IS_CONNECTED(wm) || !wm->objc_wm)
 		return;
@@ -169,7 +183,7 @@ int wiiuse_os_poll(struct wiimote_t** wm, int wiimotes) {
 int wiiuse_os_read(struct wiimote_t* wm, byte* buf, int len) {
 	if(!wm || !wm->objc_wm) return 0;
 	if(!WIIMOTE_IS_CONNECTED(wm)) {
-		WIIUSE_ERROR("Attempting to read from unconnected Wiimote");
+		WIIUSE_CTX_ERROR(wm->ctx, "Attempting to read from unconnected Wiimote");
 		return 0;
 	}
 	
@@ -185,7 +199,7 @@ int wiiuse_os_read(struct wiimote_t* wm, byte* buf, int len) {
 int wiiuse_os_write(struct wiimote_t* wm, byte report_type, byte* buf, int len) {
 	if(!wm || !wm->objc_wm) return 0;
 	if(!WIIMOTE_IS_CONNECTED(wm)) {
-		WIIUSE_ERROR("Attempting to write to unconnected Wiimote");
+		WIIUSE_CTX_ERROR(wm->ctx, "Attempting to write to unconnected Wiimote");
 		return 0;
 	}
 	
@@ -198,6 +212,12 @@ int wiiuse_os_write(struct wiimote_t* wm, byte report_type, byte* buf, int len)
 	return result;
 }
 
+int wiiuse_os_fd(struct wiimote_t* wm) {
+	/* reports come in on the run loop of IOBluetooth */
+	(void)wm;
+	return -1;
+}
+
 #pragma mark -
 #pragma mark platform fields
 
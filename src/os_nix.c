@@ -32,9 +32,12 @@
  */
 
 #include "wiiuse_internal.h" /* for WM_RPT_CTRL_STATUS */
+#include "adapters.h"        /* for adapter_claim, adapter_update */
 #include "events.h"
 #include "io.h"
+#include "loop.h" /* for loop_forget */
 #include "os.h"
+#include "uring.h" /* for uring_arm, uring_read, etc */
 
 #ifdef WIIUSE_BLUEZ
 
@@ -44,7 +47,9 @@
 #include <bluetooth/l2cap.h>     /* for sockaddr_l2 */
 
 #include <errno.h>
+#include <fcntl.h> /* for fcntl */
 #include <stdbool.h>
+#include <stddef.h> /* for offsetof */
 #include <stdio.h>      /* for perror */
 #include <string.h>     /* for memset */
 #include <sys/socket.h> /* for connect, socket */
@@ -52,233 +57,1182 @@
 #include <time.h>       /* for clock_gettime */
 #include <unistd.h>     /* for close, write */
 
-static int wiiuse_os_connect_single(struct wiimote_t *wm, char *address);
+/* length of a background inquiry, in units of 1.28 seconds */
+#define WIIUSE_DISCOVERY_LENGTH 4
 
+static int wiiuse_os_connect_single(struct wiimote_t *wm, char *address, const struct wiiuse_adapter_t *adapter);
+static int connect_start(struct wiimote_t *wm, const struct wiiuse_adapter_t *adapter);
+
+/* local adapters seen by hci_for_each_dev() */
+struct hci_scan_t
+{
+    struct wiiuse_adapter_t adapter[WIIUSE_MAX_ADAPTERS];
+    int count;
+};
+
+/**
+ *	@brief Add an HCI device to the adapters found.
+ *
+ *	Callback of hci_for_each_dev().
+ */
+static int add_hci_adapter(int dd, int dev_id, long arg)
+{
+    struct hci_scan_t *scan = (struct hci_scan_t *)arg;
+    struct wiiuse_adapter_t *ad;
+    bdaddr_t bdaddr;
+
+    (void)dd;
+
+    if ((scan->count >= WIIUSE_MAX_ADAPTERS) || (hci_devba(dev_id, &bdaddr) < 0))
+    {
+        return 0;
+    }
+
+    ad        = &scan->adapter[scan->count++];
+    ad->id    = dev_id;
+    ad->links = 0;
+    ba2str(&bdaddr, ad->addr);
+
+    /* keep going */
+    return 0;
+}
+
+/**
+ *	@brief Refresh the list of local adapters that are up.
+ *
+ *	@param ctx		The context, the list of its poller is refreshed for a shard.
+ *	@param found	[out] Caller allocated room for WIIUSE_MAX_ADAPTERS adapters, or NULL.
+ *
+ *	@return The number of adapters found.
+ */
+static int find_adapters(struct wiiuse_context_t *ctx, struct wiiuse_adapter_t *found)
+{
+    struct hci_scan_t scan;
+    int i;
+
+    /* the scan does system calls, so it is not done under the lock */
+    scan.count = 0;
+    hci_for_each_dev(HCI_UP, add_hci_adapter, (long)&scan);
+    adapter_update(ctx, scan.adapter, scan.count);
+
+    for (i = 0; i < scan.count; ++i)
+    {
+        WIIUSE_CTX_INFO(ctx, "Using Bluetooth adapter hci%i (%s).", scan.adapter[i].id, scan.adapter[i].addr);
+    }
+
+    if (found)
+    {
+        memcpy(found, scan.adapter, scan.count * sizeof(struct wiiuse_adapter_t));
+    }
+    return scan.count;
+}
+
+/**
+ *	@brief Look for wiimotes through one adapter.
+ *
+ *	@param device_id		HCI device id of the adapter.
+ *	@param wm				An array of pointers to wiimote_t structures.
+ *	@param found_wiimotes	Wiimotes found so far, through other adapters.
+ *	@param max_wiimotes		The number of wiimote_t structures in the \a wm array.
+ *	@param timeout			Inquiry length, in units of 1.28 seconds.
+ *
+ *	@return The number of wiimotes found so far, including the new ones.
+ */
+static int find_on_adapter(int device_id, struct wiimote_t **wm, int found_wiimotes, int max_wiimotes, int timeout)
+{
+    int device_sock;
+    inquiry_info scan_info_arr[128];
+    inquiry_info *scan_info = scan_info_arr;
+    int found_devices;
+    int i = 0;
+    int j;
+
+    /* create a socket to the device */
+    device_sock = hci_open_dev(device_id);
+    if (device_sock < 0)
+    {
+        perror("hci_open_dev");
+        return found_wiimotes;
+    }
+
+    memset(&scan_info_arr, 0, sizeof(scan_info_arr));
+
+    /* scan for bluetooth devices for 'timeout' seconds */
+    found_devices = hci_inquiry(device_id, timeout, 128, NULL, &scan_info, IREQ_CACHE_FLUSH);
+    if (found_devices < 0)
+    {
+        perror("hci_inquiry");
+        close(device_sock);
+        return found_wiimotes;
+    }
+
+    WIIUSE_INFO("Found %i bluetooth device(s) on hci%i.", found_devices, device_id);
+
+    /* display discovered devices */
+    for (i = 0; (i < found_devices) && (found_wiimotes < max_wiimotes); ++i)
+    {
+        bool is_wiimote_regular = (scan_info[i].dev_class[0] == WM_DEV_CLASS_0)
+                                  && (scan_info[i].dev_class[1] == WM_DEV_CLASS_1)
+                                  && (scan_info[i].dev_class[2] == WM_DEV_CLASS_2);
+
+        bool is_wiimote_plus = (scan_info[i].dev_class[0] == WM_PLUS_DEV_CLASS_0)
+                               && (scan_info[i].dev_class[1] == WM_PLUS_DEV_CLASS_1)
+                               && (scan_info[i].dev_class[2] == WM_PLUS_DEV_CLASS_2);
+
+        /* already seen through another adapter */
+        for (j = 0; j < found_wiimotes; ++j)
+        {
+            if (!bacmp(&wm[j]->bdaddr, &scan_info[i].bdaddr))
+            {
+                break;
+            }
+        }
+        if (j < found_wiimotes)
+        {
+            continue;
+        }
+
+        if (is_wiimote_regular || is_wiimote_plus)
+        {
+            /* found a device */
+            ba2str(&scan_info[i].bdaddr, wm[found_wiimotes]->bdaddr_str);
+
+            const char *str_type;
+            if (is_wiimote_regular)
+            {
+                wm[found_wiimotes]->type = WIIUSE_WIIMOTE_REGULAR;
+                str_type                 = " (regular wiimote)";
+            } else if (is_wiimote_plus)
+            {
+                wm[found_wiimotes]->type = WIIUSE_WIIMOTE_MOTION_PLUS_INSIDE;
+                str_type                 = " (motion plus inside)";
+            }
+
+            WIIUSE_INFO("Found wiimote (type: %s) (%s) [id %i].", str_type, wm[found_wiimotes]->bdaddr_str,
+                        wm[found_wiimotes]->unid);
+
+            wm[found_wiimotes]->bdaddr = scan_info[i].bdaddr;
+            WIIMOTE_ENABLE_STATE(wm[found_wiimotes], WIIMOTE_STATE_DEV_FOUND);
+            ++found_wiimotes;
+        }
+    }
+
+    close(device_sock);
+    return found_wiimotes;
+}
+
+/**
+ *	@brief Look for wiimotes through every local adapter.
+ *
+ *	The adapters are asked one after the other, so with N
+ *	adapters the search takes up to N times \a timeout.
+ */
 int wiiuse_os_find(struct wiimote_t **wm, int max_wiimotes, int timeout)
 {
-    int device_id;
-    int device_sock;
-    inquiry_info scan_info_arr[128];
-    inquiry_info *scan_info = scan_info_arr;
-    int found_devices;
-    int found_wiimotes;
-    int i = 0;
+    struct wiiuse_adapter_t adapter[WIIUSE_MAX_ADAPTERS];
+    int found_wiimotes;
+    int adapters;
+    int a;
+
+    /* reset all wiimote bluetooth device addresses */
+    for (found_wiimotes = 0; found_wiimotes < max_wiimotes; ++found_wiimotes)
+    {
+        /* bacpy(&(wm[found_wiimotes]->bdaddr), BDADDR_ANY); */
+        memset(&(wm[found_wiimotes]->bdaddr), 0, sizeof(bdaddr_t));
+    }
+    found_wiimotes = 0;
+
+    if (max_wiimotes <= 0)
+    {
+        return 0;
+    }
+
+    adapters = find_adapters(wm[0]->ctx, adapter);
+    if (!adapters)
+    {
+        WIIUSE_ERROR("Could not detect a Bluetooth adapter!");
+        return 0;
+    }
+
+    for (a = 0; (a < adapters) && (found_wiimotes < max_wiimotes); ++a)
+    {
+        found_wiimotes = find_on_adapter(adapter[a].id, wm, found_wiimotes, max_wiimotes, timeout);
+    }
+
+    return found_wiimotes;
+}
+
+/**
+ *	@brief Connect a found wiimote through the adapter picked by the placement policy.
+ *
+ *	@param ctx		The context of the wiimote.
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param wait		1 to wait for the connection, 0 to only start it,
+ *					wiiuse_os_poll() does the rest.
+ *
+ *	The links of the wiimotes of \a ctx must be counted with
+ *	adapter_sync_links(), those of other contexts on the same
+ *	adapter list are already in it.
+ *
+ *	@return 1 on success or once the connect is under way, 0 on failure
+ */
+static int connect_placed(struct wiiuse_context_t *ctx, struct wiimote_t *wm, int wait)
+{
+    struct wiiuse_adapter_t adapter;
+    int placed;
+
+    placed = adapter_claim(ctx, &adapter);
+    if (!placed && find_adapters(ctx, NULL))
+    {
+        placed = adapter_claim(ctx, &adapter);
+    }
+
+    if (placed < 0)
+    {
+        WIIUSE_CTX_WARNING(wm->ctx, "All Bluetooth adapters are full, wiimote [id %i] not connected.", wm->unid);
+        return 0;
+    }
+
+    /* with no adapter list let the kernel route the connection,
+       the wiimote holds the claimed link from here on */
+    if (wait)
+    {
+        return wiiuse_os_connect_single(wm, NULL, placed ? &adapter : NULL);
+    }
+    return connect_start(wm, placed ? &adapter : NULL);
+}
+
+/**
+ *	@see wiiuse_connect()
+ *	@see wiiuse_os_connect_single()
+ */
+int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes)
+{
+    struct wiiuse_context_t *ctx;
+    int connected = 0;
+    int i         = 0;
+
+    if (wiimotes <= 0)
+    {
+        return 0;
+    }
+    ctx = wm[0]->ctx;
+
+    adapter_sync_links(ctx, wm, wiimotes);
+
+    for (; i < wiimotes; ++i)
+    {
+        if (!WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND) || WIIMOTE_IS_CONNECTED(wm[i]))
+        /* if the device address is not set, skip it */
+        {
+            continue;
+        }
+
+        connected += connect_placed(ctx, wm[i], 1);
+    }
+
+    return connected;
+}
+
+int wiiuse_os_set_reconnect(struct wiimote_t *wm, int enable)
+{
+    (void)wm;
+    (void)enable;
+
+    return 1;
+}
+
+/**
+ *	@see reconnect_step()
+ *
+ *	Same placement as wiiuse_os_connect(), so the links of the
+ *	whole array are counted first. Only starts the connect, the
+ *	poll thread must not sit in connect() for as long as a wiimote
+ *	that is not there takes to time out.
+ */
+int wiiuse_os_reconnect(struct wiimote_t **wm, int wiimotes, int which)
+{
+    struct wiiuse_context_t *ctx = wm[which]->ctx;
+
+    adapter_sync_links(ctx, wm, wiimotes);
+
+    return connect_placed(ctx, wm[which], 0);
+}
+
+/**
+ *	@brief Open one L2CAP channel to a wiimote without waiting for it.
+ *
+ *	@param remote	Address of the wiimote.
+ *	@param psm		The channel, WM_OUTPUT_CHANNEL or WM_INPUT_CHANNEL.
+ *	@param local	Address of the local adapter to go out through, or NULL for any.
+ *
+ *	@return The non-blocking socket, connected or still connecting, -1 on failure.
+ */
+static int connect_channel(const bdaddr_t *remote, int psm, const bdaddr_t *local)
+{
+    struct sockaddr_l2 addr;
+    int sock;
+    int flags;
+
+    sock = socket(AF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_L2CAP);
+    if (sock == -1)
+    {
+        perror("socket() L2CAP");
+        return -1;
+    }
+
+    flags = fcntl(sock, F_GETFL, 0);
+    if ((flags < 0) || (fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0))
+    {
+        perror("fcntl() L2CAP");
+        close(sock);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.l2_family = AF_BLUETOOTH;
+
+    if (local)
+    {
+        addr.l2_bdaddr = *local;
+        if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            perror("bind() to adapter");
+            close(sock);
+            return -1;
+        }
+    }
+
+    addr.l2_bdaddr = *remote;
+    addr.l2_psm    = htobs(psm);
+
+    /* connect to wiimote */
+    if ((connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) && (errno != EINPROGRESS))
+    {
+        perror((psm == WM_OUTPUT_CHANNEL) ? "connect() output sock" : "connect() interrupt sock");
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+/**
+ *	@brief Put a connected channel back in blocking mode, like the upstream sockets.
+ *
+ *	@return 1 on success, 0 on failure.
+ */
+static int connect_blocking(int sock)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+
+    return (flags >= 0) && (fcntl(sock, F_SETFL, flags & ~O_NONBLOCK) == 0);
+}
+
+/**
+ *	@brief Start connecting a found wiimote, without waiting.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param adapter	The local adapter to connect through, or NULL for any.
+ *
+ *	@return 1 if the connect is under way, 0 on failure.
+ *
+ *	The wiimote is WIIMOTE_STATE_CONNECTING until connect_continue()
+ *	has both channels up. From here on it holds the link claimed on
+ *	\a adapter, wiiuse_os_disconnect() gives it back.
+ */
+static int connect_start(struct wiimote_t *wm, const struct wiiuse_adapter_t *adapter)
+{
+    bdaddr_t local;
+
+    /* drop whatever the slot still holds from an earlier link */
+    wiiuse_os_disconnect(wm);
+    wm->adapter = adapter ? adapter->id : -1;
+
+    if (adapter)
+    {
+        str2ba(adapter->addr, &local);
+    }
+
+    /*
+     *	OUTPUT CHANNEL, the input channel follows once it is up
+     */
+    wm->out_sock = connect_channel(&wm->bdaddr, WM_OUTPUT_CHANNEL, adapter ? &local : NULL);
+    if (wm->out_sock == -1)
+    {
+        wiiuse_os_disconnect(wm);
+        return 0;
+    }
+
+    WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_CONNECTING);
+    return 1;
+}
+
+/**
+ *	@brief Go on with a connect once its pending channel is writable.
+ *
+ *	@param wm		Pointer to a wiimote_t structure that is WIIMOTE_STATE_CONNECTING.
+ *
+ *	@return 1 if the wiimote got an event, 0 otherwise.
+ *
+ *	Reads the result of the pending connect() with SO_ERROR. Opens
+ *	the input channel once the output one is up, through the same
+ *	adapter, and does the handshake once both are.
+ */
+static int connect_continue(struct wiimote_t *wm)
+{
+    struct sockaddr_l2 local;
+    int sock         = wiiuse_os_fd(wm);
+    int err          = 0;
+    socklen_t len    = sizeof(local);
+    socklen_t errlen = sizeof(err);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0)
+    {
+        err = errno;
+    }
+
+    if (err)
+    {
+        errno = err;
+        perror((sock == wm->out_sock) ? "connect() output sock" : "connect() interrupt sock");
+        wiiuse_os_disconnect(wm);
+        return 0;
+    }
+
+    if (wm->in_sock == -1)
+    {
+        /*
+         *	INPUT CHANNEL
+         */
+        if (getsockname(wm->out_sock, (struct sockaddr *)&local, &len) == 0)
+        {
+            wm->in_sock = connect_channel(&wm->bdaddr, WM_INPUT_CHANNEL, &local.l2_bdaddr);
+        }
+
+        if (wm->in_sock == -1)
+        {
+            wiiuse_os_disconnect(wm);
+        }
+        return 0;
+    }
+
+    if (!connect_blocking(wm->out_sock) || !connect_blocking(wm->in_sock))
+    {
+        perror("fcntl() L2CAP");
+        wiiuse_os_disconnect(wm);
+        return 0;
+    }
+
+    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_CONNECTING);
+    WIIUSE_CTX_INFO(wm->ctx, "Connected to wiimote [id %i].", wm->unid);
+
+    /* do the handshake */
+    WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_CONNECTED);
+    wiiuse_handshake(wm, NULL, 0);
+
+    wiiuse_set_report_type(wm);
+
+    return (wm->event != WIIUSE_NONE);
+}
+
+/**
+ *	@brief Connect to a wiimote with a known address.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param address	The address of the device to connect to.
+ *					If NULL, use the address in the struct set by wiiuse_os_find().
+ *	@param adapter	The local adapter to connect through, or NULL for any.
+ *
+ *	@return 1 on success, 0 on failure
+ *
+ *	Waits for both channels, for wiiuse_connect().
+ */
+static int wiiuse_os_connect_single(struct wiimote_t *wm, char *address, const struct wiiuse_adapter_t *adapter)
+{
+    fd_set fds;
+    int sock;
+
+    if (!wm || WIIMOTE_IS_CONNECTED(wm))
+    {
+        return 0;
+    }
+
+    if (address)
+    /* use provided address */
+    {
+        str2ba(address, &wm->bdaddr);
+    }
+
+    if (!connect_start(wm, adapter))
+    {
+        return 0;
+    }
+
+    while (WIIMOTE_IS_SET(wm, WIIMOTE_STATE_CONNECTING))
+    {
+        sock = wiiuse_os_fd(wm);
+
+        FD_ZERO(&fds);
+        FD_SET(sock, &fds);
+        if ((select(sock + 1, NULL, &fds, NULL, NULL) < 0) && (errno != EINTR))
+        {
+            perror("select() L2CAP");
+            wiiuse_os_disconnect(wm);
+            return 0;
+        }
+
+        connect_continue(wm);
+    }
+
+    return WIIMOTE_IS_CONNECTED(wm);
+}
+
+void wiiuse_os_disconnect(struct wiimote_t *wm)
+{
+    if (!wm || WIIMOTE_IS_CONNECTED(wm))
+    {
+        return;
+    }
+
+#ifdef WIIUSE_IO_URING
+    uring_forget(wm);
+#endif
+    /* the output channel is only watched while it connects */
+    loop_forget(wm->ctx, wm->in_sock);
+    loop_forget(wm->ctx, wm->out_sock);
+
+    if (wm->adapter >= 0)
+    {
+        adapter_release(wm->ctx, wm->adapter);
+    }
+
+    close(wm->out_sock);
+    close(wm->in_sock);
+
+    wm->out_sock = -1;
+    wm->in_sock  = -1;
+    wm->adapter  = -1;
+    wm->event    = WIIUSE_NONE;
+
+    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_CONNECTED);
+    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_CONNECTING);
+    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_HANDSHAKE);
+}
+
+/**
+ *	@brief Tell the wiimote type from a device class.
+ *
+ *	@return 1 if \a dev_class is the class of a wiimote, 0 otherwise.
+ */
+static int wiimote_class_type(const uint8_t *dev_class, WIIUSE_WIIMOTE_TYPE *type)
+{
+    if ((dev_class[0] == WM_DEV_CLASS_0) && (dev_class[1] == WM_DEV_CLASS_1) && (dev_class[2] == WM_DEV_CLASS_2))
+    {
+        *type = WIIUSE_WIIMOTE_REGULAR;
+        return 1;
+    }
+
+    if ((dev_class[0] == WM_PLUS_DEV_CLASS_0) && (dev_class[1] == WM_PLUS_DEV_CLASS_1)
+        && (dev_class[2] == WM_PLUS_DEV_CLASS_2))
+    {
+        *type = WIIUSE_WIIMOTE_MOTION_PLUS_INSIDE;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ *	@brief Stop background discovery, see wiiuse_os_set_discovery().
+ */
+static void discovery_stop(struct wiiuse_discovery_t *disc)
+{
+    if (!disc->enabled)
+    {
+        return;
+    }
+
+    if (disc->inquiring)
+    {
+        hci_send_cmd(disc->sock, OGF_LINK_CTL, OCF_INQUIRY_CANCEL, 0, NULL);
+    }
+
+    hci_close_dev(disc->sock);
+    disc->sock      = -1;
+    disc->enabled   = 0;
+    disc->inquiring = 0;
+    disc->connect   = 0;
+}
+
+/**
+ *	@see wiiuse_set_background_discovery()
+ *
+ *	Inquiries go out through the first adapter that is up, on a
+ *	non-blocking raw HCI socket that wiiuse_os_poll() adds to its
+ *	select() set. Connecting starts one poll after the inquiry
+ *	ended and goes on in the polls after it, the same way as a
+ *	reconnect, see connect_continue().
+ */
+int wiiuse_os_set_discovery(struct wiiuse_context_t *ctx, int interval)
+{
+    struct wiiuse_discovery_t *disc = &ctx->discovery;
+    struct wiiuse_adapter_t adapter[WIIUSE_MAX_ADAPTERS];
+    struct hci_filter flt;
+    int flags;
+
+    discovery_stop(disc);
+
+    if (interval <= 0)
+    {
+        return 1;
+    }
+
+    if (!find_adapters(ctx, adapter))
+    {
+        WIIUSE_CTX_ERROR(ctx, "Could not detect a Bluetooth adapter!");
+        return 0;
+    }
+
+    disc->sock = hci_open_dev(adapter[0].id);
+    if (disc->sock < 0)
+    {
+        perror("hci_open_dev");
+        return 0;
+    }
+
+    /* only the events of an inquiry */
+    hci_filter_clear(&flt);
+    hci_filter_set_ptype(HCI_EVENT_PKT, &flt);
+    hci_filter_set_event(EVT_CMD_STATUS, &flt);
+    hci_filter_set_event(EVT_INQUIRY_RESULT, &flt);
+    hci_filter_set_event(EVT_INQUIRY_RESULT_WITH_RSSI, &flt);
+    hci_filter_set_event(EVT_EXTENDED_INQUIRY_RESULT, &flt);
+    hci_filter_set_event(EVT_INQUIRY_COMPLETE, &flt);
+
+    flags = fcntl(disc->sock, F_GETFL, 0);
+    if ((setsockopt(disc->sock, SOL_HCI, HCI_FILTER, &flt, sizeof(flt)) < 0)
+        || (flags < 0) || (fcntl(disc->sock, F_SETFL, flags | O_NONBLOCK) < 0))
+    {
+        perror("HCI socket setup");
+        hci_close_dev(disc->sock);
+        disc->sock = -1;
+        return 0;
+    }
+
+    disc->interval = (unsigned long)interval * 1000;
+    disc->next     = wiiuse_os_ticks();
+    disc->enabled  = 1;
+
+    WIIUSE_CTX_INFO(ctx, "Looking for wiimotes on hci%i every %i seconds.", adapter[0].id, interval);
+
+    return 1;
+}
+
+/**
+ *	@brief Start an inquiry without waiting for it.
+ */
+static void discovery_inquire(struct wiiuse_discovery_t *disc, unsigned long now)
+{
+    inquiry_cp cp;
+
+    memset(&cp, 0, sizeof(cp));
+
+    /* general inquiry access code 0x9E8B33, no limit on the responses */
+    cp.lap[0] = 0x33;
+    cp.lap[1] = 0x8b;
+    cp.lap[2] = 0x9e;
+    cp.length = WIIUSE_DISCOVERY_LENGTH;
+
+    if (hci_send_cmd(disc->sock, OGF_LINK_CTL, OCF_INQUIRY, INQUIRY_CP_SIZE, &cp) < 0)
+    {
+        perror("hci_send_cmd() inquiry");
+        disc->next = now + disc->interval;
+        return;
+    }
+
+    /* give up on the complete event a second after it is due */
+    disc->inquiring = 1;
+    disc->next      = now + (WIIUSE_DISCOVERY_LENGTH * 1280) + 1000;
+}
+
+/**
+ *	@brief End the running inquiry, its wiimotes get connected on the next poll.
+ */
+static void discovery_done(struct wiiuse_discovery_t *disc)
+{
+    disc->inquiring = 0;
+    disc->connect   = 1;
+    disc->next      = wiiuse_os_ticks() + disc->interval;
+}
+
+/**
+ *	@brief Put a device from an inquiry result in a wiimote slot.
+ *
+ *	@return 1 if a wiimote got a WIIUSE_FOUND event, 0 otherwise.
+ */
+static int discovery_found(struct wiimote_t **wm, int wiimotes, const bdaddr_t *bdaddr, const uint8_t *dev_class)
+{
+    WIIUSE_WIIMOTE_TYPE type;
+    int i;
+
+    if (!wiimote_class_type(dev_class, &type))
+    {
+        return 0;
+    }
+
+    /* a wiimote we know, it may have come back */
+    for (i = 0; i < wiimotes; ++i)
+    {
+        if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND) && !bacmp(&wm[i]->bdaddr, bdaddr))
+        {
+            if (WIIMOTE_IS_CONNECTED(wm[i]) || WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTING)
+                || WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_SEEN))
+            {
+                return 0;
+            }
+
+            WIIMOTE_ENABLE_STATE(wm[i], WIIMOTE_STATE_DEV_SEEN);
+            wm[i]->event = WIIUSE_FOUND;
+            return 1;
+        }
+    }
+
+    /* next free slot */
+    for (i = 0; i < wiimotes; ++i)
+    {
+        if (!WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND) && !WIIMOTE_IS_CONNECTED(wm[i]))
+        {
+            break;
+        }
+    }
+    if (i == wiimotes)
+    {
+        return 0;
+    }
+
+    wm[i]->bdaddr = *bdaddr;
+    wm[i]->type   = type;
+    ba2str(bdaddr, wm[i]->bdaddr_str);
+    WIIMOTE_ENABLE_STATE(wm[i], WIIMOTE_STATE_DEV_FOUND | WIIMOTE_STATE_DEV_SEEN);
+    wm[i]->event = WIIUSE_FOUND;
+
+    WIIUSE_INFO("Found wiimote (%s) [id %i].", wm[i]->bdaddr_str, wm[i]->unid);
+
+    return 1;
+}
+
+/**
+ *	@brief Walk the responses of an inquiry result event.
+ *
+ *	The three kinds of result events only differ in the size of a
+ *	response and where the device class is in it.
+ */
+static int discovery_results(struct wiimote_t **wm, int wiimotes, const byte *ptr, int len, int size,
+                             int class_offset)
+{
+    const byte *info;
+    int evnt = 0;
+    int i;
+
+    for (i = 0; (i < ptr[0]) && (1 + ((i + 1) * size) <= len); ++i)
+    {
+        info = ptr + 1 + (i * size);
+        evnt += discovery_found(wm, wiimotes, (const bdaddr_t *)info, info + class_offset);
+    }
+
+    return evnt;
+}
+
+/**
+ *	@brief Handle the HCI events that wait on the discovery socket.
+ *
+ *	@return The number of wiimotes that got an event.
+ */
+static int discovery_read(struct wiiuse_discovery_t *disc, struct wiimote_t **wm, int wiimotes)
+{
+    byte buf[HCI_MAX_EVENT_SIZE];
+    const hci_event_hdr *hdr;
+    const evt_cmd_status *status;
+    const byte *ptr;
+    int evnt = 0;
+    int len;
+
+    while ((len = read(disc->sock, buf, sizeof(buf))) > 0)
+    {
+        if ((len < 1 + HCI_EVENT_HDR_SIZE) || (buf[0] != HCI_EVENT_PKT))
+        {
+            continue;
+        }
+
+        hdr = (const hci_event_hdr *)(buf + 1);
+        ptr = buf + 1 + HCI_EVENT_HDR_SIZE;
+        len -= 1 + HCI_EVENT_HDR_SIZE;
+
+        switch (hdr->evt)
+        {
+        case EVT_INQUIRY_RESULT:
+            evnt += discovery_results(wm, wiimotes, ptr, len, INQUIRY_INFO_SIZE, offsetof(inquiry_info, dev_class));
+            break;
+
+        case EVT_INQUIRY_RESULT_WITH_RSSI:
+            evnt += discovery_results(wm, wiimotes, ptr, len, INQUIRY_INFO_WITH_RSSI_SIZE,
+                                      offsetof(inquiry_info_with_rssi, dev_class));
+            break;
+
+        case EVT_EXTENDED_INQUIRY_RESULT:
+            evnt += discovery_results(wm, wiimotes, ptr, len, EXTENDED_INQUIRY_INFO_SIZE,
+                                      offsetof(extended_inquiry_info, dev_class));
+            break;
+
+        case EVT_CMD_STATUS:
+            status = (const evt_cmd_status *)ptr;
+            if ((len >= EVT_CMD_STATUS_SIZE) && status->status
+                && (status->opcode == htobs(cmd_opcode_pack(OGF_LINK_CTL, OCF_INQUIRY))))
+            {
+                WIIUSE_WARNING("Bluetooth inquiry failed (HCI status 0x%02x).", status->status);
+                discovery_done(disc);
+            }
+            break;
+
+        case EVT_INQUIRY_COMPLETE:
+            if (disc->inquiring)
+            {
+                discovery_done(disc);
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if ((len < 0) && (errno != EAGAIN) && (errno != EINTR))
+    {
+        perror("read() HCI event");
+    }
+
+    return evnt;
+}
+
+/**
+ *	@brief Time driven part of background discovery.
+ *
+ *	Starts connecting the wiimotes found by the last inquiry
+ *	and starts the next inquiry when it is due. The connects
+ *	end with the usual events in a later wiiuse_os_poll().
+ */
+static void discovery_step(struct wiiuse_context_t *ctx, struct wiimote_t **wm, int wiimotes)
+{
+    struct wiiuse_discovery_t *disc = &ctx->discovery;
+    unsigned long now;
+    int i;
 
-    /* reset all wiimote bluetooth device addresses */
-    for (found_wiimotes = 0; found_wiimotes < max_wiimotes; ++found_wiimotes)
+    if (disc->connect)
     {
-        /* bacpy(&(wm[found_wiimotes]->bdaddr), BDADDR_ANY); */
-        memset(&(wm[found_wiimotes]->bdaddr), 0, sizeof(bdaddr_t));
+        disc->connect = 0;
+        adapter_sync_links(ctx, wm, wiimotes);
+
+        for (i = 0; i < wiimotes; ++i)
+        {
+            if (!WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_SEEN))
+            {
+                continue;
+            }
+
+            WIIMOTE_DISABLE_STATE(wm[i], WIIMOTE_STATE_DEV_SEEN);
+            if (!WIIMOTE_IS_CONNECTED(wm[i]) && !WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTING))
+            {
+                connect_placed(ctx, wm[i], 0);
+            }
+        }
     }
-    found_wiimotes = 0;
 
-    /* get the id of the first bluetooth device. */
-    device_id = hci_get_route(NULL);
-    if (device_id < 0)
+    now = wiiuse_os_ticks();
+    if (now >= disc->next)
     {
-        if (errno == ENODEV)
+        if (disc->inquiring)
         {
-            WIIUSE_ERROR("Could not detect a Bluetooth adapter!");
+            WIIUSE_CTX_WARNING(ctx, "Bluetooth inquiry did not complete in time.");
+            discovery_done(disc);
         } else
         {
-            perror("hci_get_route");
+            discovery_inquire(disc, now);
         }
-        return 0;
     }
+}
 
-    /* create a socket to the device */
-    device_sock = hci_open_dev(device_id);
-    if (device_sock < 0)
+/**
+ *	@brief Stop listening, see wiiuse_os_set_incoming().
+ */
+static void incoming_stop(struct wiiuse_incoming_t *incoming)
+{
+    int i;
+
+    if (!incoming->enabled)
     {
-        perror("hci_open_dev");
-        return 0;
+        return;
     }
 
-    memset(&scan_info_arr, 0, sizeof(scan_info_arr));
+    for (i = 0; i < 2; ++i)
+    {
+        close(incoming->sock[i]);
+        incoming->sock[i] = -1;
+    }
+    incoming->enabled = 0;
+}
 
-    /* scan for bluetooth devices for 'timeout' seconds */
-    found_devices = hci_inquiry(device_id, timeout, 128, NULL, &scan_info, IREQ_CACHE_FLUSH);
-    if (found_devices < 0)
+/**
+ *	@brief Open a non-blocking L2CAP server socket on a PSM of every adapter.
+ *
+ *	@return The socket, -1 on failure.
+ */
+static int incoming_listen(unsigned short psm)
+{
+    struct sockaddr_l2 addr;
+    int sock;
+    int flags;
+
+    sock = socket(AF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_L2CAP);
+    if (sock == -1)
     {
-        perror("hci_inquiry");
-        close(device_sock);
-        return 0;
+        perror("socket() listen");
+        return -1;
     }
 
-    WIIUSE_INFO("Found %i bluetooth device(s).", found_devices);
+    memset(&addr, 0, sizeof(addr));
+    addr.l2_family = AF_BLUETOOTH;
+    addr.l2_psm    = htobs(psm);
 
-    /* display discovered devices */
-    for (i = 0; (i < found_devices) && (found_wiimotes < max_wiimotes); ++i)
+    flags = fcntl(sock, F_GETFL, 0);
+    if ((bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(sock, 2) < 0) || (flags < 0)
+        || (fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0))
     {
-        bool is_wiimote_regular = (scan_info[i].dev_class[0] == WM_DEV_CLASS_0)
-                                  && (scan_info[i].dev_class[1] == WM_DEV_CLASS_1)
-                                  && (scan_info[i].dev_class[2] == WM_DEV_CLASS_2);
+        WIIUSE_ERROR("Could not listen on L2CAP PSM 0x%02x, is the bluetoothd input service using it?", psm);
+        perror("Error Details");
+        close(sock);
+        return -1;
+    }
 
-        bool is_wiimote_plus = (scan_info[i].dev_class[0] == WM_PLUS_DEV_CLASS_0)
-                               && (scan_info[i].dev_class[1] == WM_PLUS_DEV_CLASS_1)
-                               && (scan_info[i].dev_class[2] == WM_PLUS_DEV_CLASS_2);
-        if (is_wiimote_regular || is_wiimote_plus)
-        {
-            /* found a device */
-            ba2str(&scan_info[i].bdaddr, wm[found_wiimotes]->bdaddr_str);
+    return sock;
+}
 
-            const char *str_type;
-            if (is_wiimote_regular)
-            {
-                wm[found_wiimotes]->type = WIIUSE_WIIMOTE_REGULAR;
-                str_type                 = " (regular wiimote)";
-            } else if (is_wiimote_plus)
-            {
-                wm[found_wiimotes]->type = WIIUSE_WIIMOTE_MOTION_PLUS_INSIDE;
-                str_type                 = " (motion plus inside)";
-            }
+/**
+ *	@see wiiuse_set_accept_incoming()
+ *
+ *	Listens on the control and interrupt PSMs of all adapters.
+ *	The accepted sockets are used the same way as the ones
+ *	wiiuse_os_connect_single() opens.
+ */
+int wiiuse_os_set_incoming(struct wiiuse_context_t *ctx, int enable)
+{
+    struct wiiuse_incoming_t *incoming = &ctx->incoming;
 
-            WIIUSE_INFO("Found wiimote (type: %s) (%s) [id %i].", str_type, wm[found_wiimotes]->bdaddr_str,
-                        wm[found_wiimotes]->unid);
+    incoming_stop(incoming);
 
-            wm[found_wiimotes]->bdaddr = scan_info[i].bdaddr;
-            WIIMOTE_ENABLE_STATE(wm[found_wiimotes], WIIMOTE_STATE_DEV_FOUND);
-            ++found_wiimotes;
-        }
+    if (!enable)
+    {
+        return 1;
     }
 
-    close(device_sock);
-    return found_wiimotes;
+    /* to tell which adapter a link came in on */
+    find_adapters(ctx, NULL);
+
+    incoming->sock[0] = incoming_listen(WM_OUTPUT_CHANNEL);
+    if (incoming->sock[0] == -1)
+    {
+        return 0;
+    }
+
+    incoming->sock[1] = incoming_listen(WM_INPUT_CHANNEL);
+    if (incoming->sock[1] == -1)
+    {
+        close(incoming->sock[0]);
+        incoming->sock[0] = -1;
+        return 0;
+    }
+
+    incoming->enabled = 1;
+    WIIUSE_CTX_INFO(ctx, "Waiting for wiimotes to connect.");
+
+    return 1;
 }
 
 /**
- *	@see wiiuse_connect()
- *	@see wiiuse_os_connect_single()
+ *	@brief Pick the slot for an incoming connection.
+ *
+ *	@param claim	1 to give an allowed address the next free slot.
+ *
+ *	@return The slot, -1 if the address is not allowed or there is no room.
  */
-int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes)
+static int incoming_slot(struct wiiuse_context_t *ctx, struct wiimote_t **wm, int wiimotes, const bdaddr_t *bdaddr,
+                         const char *addr, int claim)
 {
-    int connected = 0;
-    int i         = 0;
+    int i;
 
-    for (; i < wiimotes; ++i)
+    /* a wiimote we know */
+    for (i = 0; i < wiimotes; ++i)
     {
-        if (!WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND))
-        /* if the device address is not set, skip it */
+        if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND) && !bacmp(&wm[i]->bdaddr, bdaddr))
         {
-            continue;
+            return WIIMOTE_IS_CONNECTED(wm[i]) ? -1 : i;
         }
+    }
 
-        if (wiiuse_os_connect_single(wm[i], NULL))
+    for (i = 0; i < ctx->incoming.allowed_count; ++i)
+    {
+        if (!strcmp(ctx->incoming.allowed[i], addr))
         {
-            ++connected;
+            break;
         }
     }
+    if (!claim || (i == ctx->incoming.allowed_count))
+    {
+        return -1;
+    }
 
-    return connected;
+    /* next free slot */
+    for (i = 0; i < wiimotes; ++i)
+    {
+        if (!WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_DEV_FOUND) && !WIIMOTE_IS_CONNECTED(wm[i]))
+        {
+            wm[i]->bdaddr = *bdaddr;
+            strcpy(wm[i]->bdaddr_str, addr);
+            WIIMOTE_ENABLE_STATE(wm[i], WIIMOTE_STATE_DEV_FOUND);
+            return i;
+        }
+    }
+
+    return -1;
 }
 
 /**
- *	@brief Connect to a wiimote with a known address.
- *
- *	@param wm		Pointer to a wiimote_t structure.
- *	@param address	The address of the device to connect to.
- *					If NULL, use the address in the struct set by wiiuse_os_find().
- *
- *	@return 1 on success, 0 on failure
+ *	@brief The HCI device id of the adapter a socket is bound to, -1 if unknown.
  */
-static int wiiuse_os_connect_single(struct wiimote_t *wm, char *address)
+static int incoming_adapter(struct wiiuse_context_t *ctx, int sock)
 {
-    struct sockaddr_l2 addr;
-    memset(&addr, 0, sizeof(addr));
-
-    if (!wm || WIIMOTE_IS_CONNECTED(wm))
+    struct wiiuse_context_t *table;
+    struct sockaddr_l2 local;
+    socklen_t len = sizeof(local);
+    char addr[18];
+    int id = -1;
+    int a;
+
+    if (getsockname(sock, (struct sockaddr *)&local, &len) < 0)
     {
-        return 0;
+        return -1;
     }
 
-    addr.l2_family   = AF_BLUETOOTH;
-    bdaddr_t *bdaddr = &wm->bdaddr;
-    if (address)
-    /* use provided address */
-    {
-        str2ba(address, &addr.l2_bdaddr);
-    } else
+    ba2str(&local.l2_bdaddr, addr);
+
+    table = adapter_table(ctx);
+    adapter_lock(table);
+    for (a = 0; a < table->adapters; ++a)
     {
-        /** @todo this line doesn't make sense
-        bacmp(bdaddr, BDADDR_ANY);*/
-        /* use address of device discovered */
-        addr.l2_bdaddr = *bdaddr;
+        if (!strcmp(table->adapter[a].addr, addr))
+        {
+            id = table->adapter[a].id;
+            break;
+        }
     }
+    adapter_unlock(table);
 
-    /*
-     *	OUTPUT CHANNEL
-     */
-    wm->out_sock = socket(AF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_L2CAP);
-    if (wm->out_sock == -1)
+    return id;
+}
+
+/**
+ *	@brief Is @a sock a control channel opened by @a bdaddr?
+ */
+static int incoming_paired(int sock, const bdaddr_t *bdaddr)
+{
+    struct sockaddr_l2 peer;
+    socklen_t len = sizeof(peer);
+
+    if ((sock == -1) || (getpeername(sock, (struct sockaddr *)&peer, &len) < 0))
     {
         return 0;
     }
 
-    addr.l2_psm = htobs(WM_OUTPUT_CHANNEL);
+    return !bacmp(&peer.l2_bdaddr, bdaddr);
+}
 
-    /* connect to wiimote */
-    if (connect(wm->out_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+/**
+ *	@brief Accept a connection on the control (0) or interrupt (1) channel.
+ *
+ *	A wiimote opens the control channel first. The wiimote is
+ *	connected once its interrupt channel comes in as well, on top
+ *	of the control channel that the same wiimote opened.
+ *
+ *	@return 1 if a wiimote got an event, 0 otherwise.
+ */
+static int incoming_accept(struct wiiuse_context_t *ctx, struct wiimote_t **wm, int wiimotes, int channel)
+{
+    struct sockaddr_l2 remote;
+    socklen_t len = sizeof(remote);
+    char addr[18];
+    int sock;
+    int i;
+
+    sock = accept(ctx->incoming.sock[channel], (struct sockaddr *)&remote, &len);
+    if (sock < 0)
     {
-        perror("connect() output sock");
+        if ((errno != EAGAIN) && (errno != EINTR))
+        {
+            perror("accept()");
+        }
         return 0;
     }
 
-    /*
-     *	INPUT CHANNEL
-     */
-    wm->in_sock = socket(AF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_L2CAP);
-    if (wm->in_sock == -1)
+    ba2str(&remote.l2_bdaddr, addr);
+
+    i = incoming_slot(ctx, wm, wiimotes, &remote.l2_bdaddr, addr, channel == 0);
+    if ((i < 0) ||
+        ((channel == 1) && ((wm[i]->in_sock != -1) || !incoming_paired(wm[i]->out_sock, &remote.l2_bdaddr))))
     {
-        close(wm->out_sock);
-        wm->out_sock = -1;
+        WIIUSE_CTX_INFO(ctx, "Refused incoming connection from %s.", addr);
+        close(sock);
         return 0;
     }
 
-    addr.l2_psm = htobs(WM_INPUT_CHANNEL);
-
-    /* connect to wiimote */
-    if (connect(wm->in_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    if (channel == 0)
     {
-        perror("connect() interrupt sock");
-        close(wm->out_sock);
-        wm->out_sock = -1;
+        /* drop whatever the slot still holds from an earlier link */
+        wiiuse_os_disconnect(wm[i]);
+        wm[i]->out_sock = sock;
         return 0;
     }
 
-    WIIUSE_INFO("Connected to wiimote [id %i].", wm->unid);
-
-    /* do the handshake */
-    WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_CONNECTED);
-    wiiuse_handshake(wm, NULL, 0);
-
-    wiiuse_set_report_type(wm);
-
-    return 1;
-}
-
-void wiiuse_os_disconnect(struct wiimote_t *wm)
-{
-    if (!wm || WIIMOTE_IS_CONNECTED(wm))
+    wm[i]->in_sock = sock;
+    wm[i]->adapter = incoming_adapter(ctx, sock);
+    if (wm[i]->adapter >= 0)
     {
-        return;
+        adapter_bind(ctx, wm[i]->adapter);
     }
+    WIIUSE_CTX_INFO(ctx, "Wiimote %s connected to us [id %i].", addr, wm[i]->unid);
 
-    close(wm->out_sock);
-    close(wm->in_sock);
+    /* do the handshake */
+    WIIMOTE_ENABLE_STATE(wm[i], WIIMOTE_STATE_CONNECTED);
+    wiiuse_handshake(wm[i], NULL, 0);
 
-    wm->out_sock = -1;
-    wm->in_sock  = -1;
-    wm->event    = WIIUSE_NONE;
+    wiiuse_set_report_type(wm[i]);
 
-    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_CONNECTED);
-    WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_HANDSHAKE);
+    return (wm[i]->event != WIIUSE_NONE);
 }
 
 int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes)
 {
+    struct wiiuse_discovery_t *disc;
+    struct wiiuse_incoming_t *incoming;
+#ifdef WIIUSE_IO_URING
+    struct wiiuse_uring_t *ring;
+#endif
+    int armed = 0;
+    int ready;
     int evnt;
     struct timeval tv;
     fd_set fds;
+    fd_set wfds;
+    int connecting = 0;
     int r;
     int i;
     byte read_buffer[MAX_PAYLOAD];
@@ -290,14 +1244,27 @@ int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes)
         return 0;
     }
 
-    /* block select() for 1/2000th of a second */
+    /* block select() for 1/2000th of a second, unless wiiuse_poll_wait() did the waiting */
     tv.tv_sec  = 0;
-    tv.tv_usec = 500;
+    tv.tv_usec = ((wiimotes > 0) && wm[0]->ctx->loop.waited) ? 0 : 500;
 
     FD_ZERO(&fds);
+    FD_ZERO(&wfds);
+
+#ifdef WIIUSE_IO_URING
+    ring = (wiimotes > 0) ? uring_attach(wm[0]->ctx) : NULL;
+#endif
 
     for (i = 0; i < wiimotes; ++i)
     {
+#ifdef WIIUSE_IO_URING
+        /* the ring watches the connected ones */
+        if (ring && WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTED))
+        {
+            uring_arm(ring, wm[i]);
+            ++armed;
+        } else
+#endif
         /* only poll it if it is connected */
         if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTED))
         {
@@ -310,32 +1277,110 @@ int wiiuse_os_poll(struct wiimote_t **wm, int wiimotes)
             }
         }
 
+        /* a pending connect() is done when its socket is writable */
+        if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTING))
+        {
+            FD_SET(wiiuse_os_fd(wm[i]), &wfds);
+            ++connecting;
+            if (wiiuse_os_fd(wm[i]) > highest_fd)
+            {
+                highest_fd = wiiuse_os_fd(wm[i]);
+            }
+        }
+
         wm[i]->event = WIIUSE_NONE;
     }
 
-    if (highest_fd == -1)
+    disc = (wiimotes > 0) ? &wm[0]->ctx->discovery : NULL;
+    if (disc && disc->enabled)
+    {
+        discovery_step(wm[0]->ctx, wm, wiimotes);
+
+        FD_SET(disc->sock, &fds);
+        if (disc->sock > highest_fd)
+        {
+            highest_fd = disc->sock;
+        }
+    } else
+    {
+        disc = NULL;
+    }
+
+    incoming = (wiimotes > 0) ? &wm[0]->ctx->incoming : NULL;
+    if (incoming && incoming->enabled)
+    {
+        for (i = 0; i < 2; ++i)
+        {
+            FD_SET(incoming->sock[i], &fds);
+            if (incoming->sock[i] > highest_fd)
+            {
+                highest_fd = incoming->sock[i];
+            }
+        }
+    } else
+    {
+        incoming = NULL;
+    }
+
+    if ((highest_fd == -1) && !armed)
     /* nothing to poll */
     {
         return 0;
     }
 
-    if (select(highest_fd + 1, &fds, NULL, NULL, &tv) == -1)
+#ifdef WIIUSE_IO_URING
+    if (armed)
+    {
+        /* the ring does the waiting, the other sockets are only checked */
+        uring_wait(ring, tv.tv_usec);
+        tv.tv_usec = 0;
+    }
+#endif
+
+    if ((highest_fd != -1) && (select(highest_fd + 1, &fds, connecting ? &wfds : NULL, NULL, &tv) == -1))
     {
         WIIUSE_ERROR("Unable to select() the wiimote interrupt socket(s).");
         perror("Error Details");
         return 0;
     }
 
+    if (disc && FD_ISSET(disc->sock, &fds))
+    {
+        evnt += discovery_read(disc, wm, wiimotes);
+    }
+
+    if (incoming)
+    {
+        for (i = 0; i < 2; ++i)
+        {
+            if (FD_ISSET(incoming->sock[i], &fds))
+            {
+                evnt += incoming_accept(wm[0]->ctx, wm, wiimotes, i);
+            }
+        }
+    }
+
     /* check each socket for an event */
     for (i = 0; i < wiimotes; ++i)
     {
+        if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTING) && FD_ISSET(wiiuse_os_fd(wm[i]), &wfds))
+        {
+            evnt += connect_continue(wm[i]);
+            continue;
+        }
+
         /* if this wiimote is not connected, skip it */
         if (!WIIMOTE_IS_CONNECTED(wm[i]))
         {
             continue;
         }
 
-        if (FD_ISSET(wm[i]->in_sock, &fds))
+#ifdef WIIUSE_IO_URING
+        ready = ring ? (uring_queued(wm[i]) > 0) : FD_ISSET(wm[i]->in_sock, &fds);
+#else
+        ready = FD_ISSET(wm[i]->in_sock, &fds);
+#endif
+        if (ready)
         {
             /* clear out the event buffer */
             memset(read_buffer, 0, sizeof(read_buffer));
@@ -374,20 +1419,29 @@ int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len)
 {
     int rc;
 
-    rc = recv(wm->in_sock, buf, len, MSG_DONTWAIT);
+#ifdef WIIUSE_IO_URING
+    if (uring_active(wm))
+    {
+        rc = uring_read(wm, buf, len);
+    } else
+#endif
+    {
+        rc = recv(wm->in_sock, buf, len, MSG_DONTWAIT);
+    }
     if (rc == -1)
     {
         switch(errno)
         {
         case ENOTCONN:
             /* this can happen if the bluetooth dongle is disconnected */
-            WIIUSE_ERROR("Receiving wiimote data (id %i).", wm->unid);
+            WIIUSE_CTX_ERROR(wm->ctx, "Receiving wiimote data (id %i).", wm->unid);
             perror("Error Details");
 
-            WIIUSE_ERROR("Bluetooth appears to be disconnected. Wiimote unid %i will be disconnected.",
-                         wm->unid);
-            wiiuse_os_disconnect(wm);
+            WIIUSE_CTX_ERROR(wm->ctx,
+                             "Bluetooth appears to be disconnected. Wiimote unid %i will be disconnected.",
+                             wm->unid);
             wiiuse_disconnected(wm);
+            wiiuse_os_disconnect(wm);
             break;
 
         case EAGAIN:
@@ -396,15 +1450,16 @@ int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len)
 
         default:
             /* error reading data */
-            WIIUSE_ERROR("Receiving wiimote data (id %i).", wm->unid);
+            WIIUSE_CTX_ERROR(wm->ctx, "Receiving wiimote data (id %i).", wm->unid);
             perror("Error Details");
             break;
         }
 
     } else if (rc == 0)
     {
-        /* remote disconnect */
+        /* remote disconnect, the sockets are of no use anymore */
         wiiuse_disconnected(wm);
+        wiiuse_os_disconnect(wm);
     } else
     {
         /* read successful */
@@ -438,7 +1493,16 @@ int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len)
     write_buffer[1] = report_type;
     memcpy(write_buffer + 2, buf, len);
 
-    rc = send(wm->in_sock, write_buffer, len + 2, 0);
+#ifdef WIIUSE_IO_URING
+    if (uring_active(wm))
+    {
+        /* goes out with the next poll, along with the others */
+        rc = uring_write(wm, write_buffer, len + 2);
+    } else
+#endif
+    {
+        rc = send(wm->in_sock, write_buffer, len + 2, 0);
+    }
 
     if (rc < 0)
     {
@@ -448,6 +1512,13 @@ int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len)
     return rc;
 }
 
+int wiiuse_os_fd(struct wiimote_t *wm)
+{
+    /* readable before the ring takes the report, too, while connecting
+       the channel that is not up yet, the output one goes first */
+    return (wm->in_sock != -1) ? wm->in_sock : wm->out_sock;
+}
+
 void wiiuse_init_platform_fields(struct wiimote_t *wm)
 {
     memset(&(wm->bdaddr), 0, sizeof(bdaddr_t)); /* = *BDADDR_ANY;*/
@@ -457,6 +1528,9 @@ void wiiuse_init_platform_fields(struct wiimote_t *wm)
 
 void wiiuse_cleanup_platform_fields(struct wiimote_t *wm)
 {
+#ifdef WIIUSE_IO_URING
+    uring_forget(wm);
+#endif
     wm->out_sock = -1;
     wm->in_sock  = -1;
 }
@@ -174,6 +174,28 @@ int wiiuse_os_find(struct wiimote_t **wm, int max_wiimotes, int timeout)
     return found;
 }
 
+int wiiuse_os_set_discovery(struct wiiuse_context_t *ctx, int interval)
+{
+    if (interval > 0)
+    {
+        WIIUSE_CTX_WARNING(ctx, "Background discovery is not supported on this platform.");
+        return 0;
+    }
+
+    return 1;
+}
+
+int wiiuse_os_set_incoming(struct wiiuse_context_t *ctx, int enable)
+{
+    if (enable)
+    {
+        WIIUSE_CTX_WARNING(ctx, "Incoming connections are not supported on this platform.");
+        return 0;
+    }
+
+    return 1;
+}
+
 int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes)
 {
     int connected = 0;
@@ -194,6 +216,27 @@ int wiiuse_os_connect(struct wiimote_t **wm, int wiimotes)
     return connected;
 }
 
+int wiiuse_os_set_reconnect(struct wiimote_t *wm, int enable)
+{
+    if (enable)
+    {
+        WIIUSE_CTX_WARNING(wm->ctx, "Reconnecting is not supported on this platform.");
+        return 0;
+    }
+
+    return 1;
+}
+
+int wiiuse_os_reconnect(struct wiimote_t **wm, int wiimotes, int which)
+{
+    /* wiimotes are only opened by wiiuse_os_find(), see wiiuse_os_set_reconnect() */
+    (void)wm;
+    (void)wiimotes;
+    (void)which;
+
+    return 0;
+}
+
 void wiiuse_os_disconnect(struct wiimote_t *wm)
 {
     if (!wm || WIIMOTE_IS_CONNECTED(wm))
@@ -284,7 +327,7 @@ int wiiuse_os_read(struct wiimote_t *wm, byte *buf, int len)
             return 0;
         } else if (r == WAIT_FAILED)
         {
-            WIIUSE_WARNING("A wait error occurred on reading from wiimote %i.", wm->unid);
+            WIIUSE_CTX_WARNING(wm->ctx, "A wait error occurred on reading from wiimote %i.", wm->unid);
             return 0;
         }
 
@@ -343,7 +386,7 @@ int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len)
             return i;
         }
 
-        WIIUSE_ERROR("Unable to determine bluetooth stack type.");
+        WIIUSE_CTX_ERROR(wm->ctx, "Unable to determine bluetooth stack type.");
         return 0;
     }
 
@@ -358,6 +401,13 @@ int wiiuse_os_write(struct wiimote_t *wm, byte report_type, byte *buf, int len)
     return 0;
 }
 
+int wiiuse_os_fd(struct wiimote_t *wm)
+{
+    /* overlapped HID handles are no use to a select() style loop */
+    (void)wm;
+    return -1;
+}
+
 void wiiuse_init_platform_fields(struct wiimote_t *wm)
 {
     wm->dev_handle     = 0;
@@ -0,0 +1,521 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Sharded multi-threaded poller.
+ *
+ *	Splits a wiimote array across worker threads. Each worker
+ *	runs its own wiiuse_poll() loop and decode path over its
+ *	shard, so a handshake or a synchronous read only stalls the
+ *	wiimotes of one shard. Events are copied into one lock-free
+ *	queue per shard and merged for the consumer by
+ *	wiiuse_poller_read().
+ *
+ *	Every shard gets a fresh context that logs and allocates like
+ *	the context of its wiimotes. The only state workers share is
+ *	the adapter list of that context, so a worker placing a
+ *	reconnect sees the links of all of them, see adapters.c.
+ */
+
+/* for pthread_setaffinity_np, must come before any system header */
+#if defined(__linux) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "adapters.h" /* for adapter_move, adapter_table */
+#include "events.h"   /* for fill_callback_data */
+#include "uring.h"    /* for uring_forget, uring_destroy */
+#include "wiiuse_internal.h"
+
+#include <string.h> /* for memcpy, memset */
+
+#ifdef WIIUSE_THREADS
+#ifdef WIIUSE_WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h> /* for cpu_set_t */
+#endif
+#endif
+
+/* sleep of a worker whose wiimotes are all disconnected, in milliseconds */
+#define POLLER_IDLE_SLEEP 10
+
+/**
+ *	@brief One worker thread and the wiimotes it polls.
+ *
+ *	The event queue is single producer (the worker) and single
+ *	consumer (the wiiuse_poller_read() caller), like the balance
+ *	board ring.
+ */
+struct poller_shard_t
+{
+    unsigned long head;     /* events queued, written by the worker		*/
+    unsigned long overruns; /* events dropped because the queue was full	*/
+    unsigned long reports;  /* copy of ctx.stats, published by the worker	*/
+    unsigned long events;
+    byte pad[WIIUSE_CACHE_LINE];
+
+    unsigned long tail; /* events read, written by the consumer			*/
+    byte pad2[WIIUSE_CACHE_LINE];
+
+    struct wiiuse_poller_t *poller;
+    struct wiimote_t **wm;
+    struct wiiuse_context_t **owner; /* context of each wiimote before the poller started */
+    int count;
+    int cpu; /* -1 if not pinned */
+
+    unsigned long mask;
+    struct wiimote_callback_data_t *queue;
+
+    struct wiiuse_context_t ctx;
+
+#ifdef WIIUSE_THREADS
+#ifdef WIIUSE_WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+#endif
+    int running;
+};
+
+struct wiiuse_poller_t
+{
+    unsigned long stop;
+    struct wiiuse_context_t *ctx; /* allocates the poller */
+    int shards;
+    int next; /* shard wiiuse_poller_read() starts with */
+    struct poller_shard_t *shard;
+};
+
+#ifdef WIIUSE_THREADS
+
+/**
+ *	@brief Pin the calling thread to one CPU.
+ *
+ *	@return 1 on success, 0 if not possible.
+ */
+static int pin_thread(int cpu)
+{
+#if defined(WIIUSE_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return 0;
+#endif
+}
+
+/**
+ *	@brief Queue a snapshot of a wiimote that raised an event.
+ */
+static void push_event(struct poller_shard_t *sh, struct wiimote_t *wm)
+{
+    unsigned long head = sh->head;
+
+    if (head - WIIUSE_LOAD_ACQUIRE(&sh->tail) > sh->mask)
+    {
+        WIIUSE_STORE_RELEASE(&sh->overruns, sh->overruns + 1);
+        return;
+    }
+
+    fill_callback_data(wm, &sh->queue[head & sh->mask]);
+    WIIUSE_STORE_RELEASE(&sh->head, head + 1);
+}
+
+/**
+ *	@brief Body of a worker thread.
+ */
+static void run_shard(struct poller_shard_t *sh)
+{
+    int i, connected;
+
+    wiiuse_context_make_current(&sh->ctx);
+
+    if ((sh->cpu >= 0) && !pin_thread(sh->cpu))
+    {
+        WIIUSE_WARNING("Unable to pin poller thread to CPU %i.", sh->cpu);
+    }
+
+    while (!WIIUSE_LOAD_ACQUIRE(&sh->poller->stop))
+    {
+        if (wiiuse_poll(sh->wm, sh->count))
+        {
+            for (i = 0; i < sh->count; ++i)
+            {
+                if (sh->wm[i]->event != WIIUSE_NONE)
+                {
+                    push_event(sh, sh->wm[i]);
+                }
+            }
+        } else
+        {
+            for (connected = 0, i = 0; i < sh->count; ++i)
+            {
+                connected |= WIIMOTE_IS_CONNECTED(sh->wm[i]);
+            }
+
+            /* wiiuse_poll() does not block without a connection */
+            if (!connected)
+            {
+                wiiuse_millisleep(POLLER_IDLE_SLEEP);
+            }
+        }
+
+        WIIUSE_STORE_RELEASE(&sh->reports, sh->ctx.stats.reports);
+        WIIUSE_STORE_RELEASE(&sh->events, sh->ctx.stats.events);
+    }
+
+    wiiuse_context_make_current(NULL);
+}
+
+#ifdef WIIUSE_WIN32
+static DWORD WINAPI shard_main(LPVOID arg)
+{
+    run_shard((struct poller_shard_t *)arg);
+    return 0;
+}
+#else
+static void *shard_main(void *arg)
+{
+    run_shard((struct poller_shard_t *)arg);
+    return NULL;
+}
+#endif
+
+static int start_thread(struct poller_shard_t *sh)
+{
+#ifdef WIIUSE_WIN32
+    sh->thread = CreateThread(NULL, 0, shard_main, sh, 0, NULL);
+    return sh->thread != NULL;
+#else
+    return pthread_create(&sh->thread, NULL, shard_main, sh) == 0;
+#endif
+}
+
+static void join_thread(struct poller_shard_t *sh)
+{
+#ifdef WIIUSE_WIN32
+    WaitForSingleObject(sh->thread, INFINITE);
+    CloseHandle(sh->thread);
+#else
+    pthread_join(sh->thread, NULL);
+#endif
+}
+
+#endif /* WIIUSE_THREADS */
+
+/**
+ *	@brief Give the wiimotes of a shard back to their own contexts and free it.
+ */
+static void release_shard(struct wiiuse_poller_t *p, struct poller_shard_t *sh)
+{
+    int i;
+
+#ifdef WIIUSE_IO_URING
+    /* the worker is gone, and with it everything it had pending */
+    uring_destroy(&sh->ctx);
+#endif
+
+    for (i = 0; i < sh->count; ++i)
+    {
+        adapter_move(&sh->ctx, sh->owner[i], sh->wm[i]);
+        sh->wm[i]->ctx = sh->owner[i];
+    }
+
+    wiiuse_ctx_free(p->ctx, sh->queue);
+    wiiuse_ctx_free(p->ctx, sh->owner);
+    wiiuse_ctx_free(p->ctx, sh->wm);
+}
+
+/**
+ *	@brief Stop a poller and release its threads.
+ *
+ *	@param p		The poller from wiiuse_poller_start().
+ *
+ *	Events still queued are lost. The wiimotes go back to the
+ *	contexts they were created in and can be polled with
+ *	wiiuse_poll() again.
+ */
+void wiiuse_poller_stop(struct wiiuse_poller_t *p)
+{
+    int i;
+
+    if (!p)
+    {
+        return;
+    }
+
+    WIIUSE_STORE_RELEASE(&p->stop, 1);
+
+    for (i = 0; i < p->shards; ++i)
+    {
+#ifdef WIIUSE_THREADS
+        if (p->shard[i].running)
+        {
+            join_thread(&p->shard[i]);
+        }
+#endif
+        release_shard(p, &p->shard[i]);
+    }
+
+    wiiuse_ctx_free(p->ctx, p->shard);
+    wiiuse_ctx_free(p->ctx, p);
+}
+
+/**
+ *	@brief Poll wiimotes from several worker threads.
+ *
+ *	@param wm			An array of pointers to wiimote_t structures.
+ *	@param wiimotes		The number of wiimote_t structures in the \a wm array.
+ *	@param threads		Number of worker threads, at most one per wiimote.
+ *	@param queue		Events each worker can queue before it drops them,
+ *						rounded up to a power of two.
+ *	@param cpus			CPU to pin each worker to, or NULL to not pin them.
+ *
+ *	@return The poller, or NULL if threads are not available or out of memory.
+ *
+ *	Wiimote i is polled by worker (i % threads). Fetch the events
+ *	of all workers with wiiuse_poller_read(). While the poller runs
+ *	the wiimotes belong to it: do not call wiiuse_poll() on them,
+ *	and only use them from the thread that owns them.
+ *
+ *	The wiimotes must share one allocator, which is also used
+ *	from the worker threads.
+ */
+struct wiiuse_poller_t *wiiuse_poller_start(struct wiimote_t **wm, int wiimotes, int threads, int queue,
+                                            const int *cpus)
+{
+#ifdef WIIUSE_THREADS
+    struct wiiuse_poller_t *p;
+    struct poller_shard_t *sh;
+    unsigned long size = 1;
+    int i, n;
+
+    if (!wm || (wiimotes <= 0) || (queue <= 0))
+    {
+        return NULL;
+    }
+
+    if (threads > wiimotes)
+    {
+        threads = wiimotes;
+    } else if (threads <= 0)
+    {
+        threads = 1;
+    }
+
+    while (size < (unsigned long)queue)
+    {
+        size <<= 1;
+    }
+
+    p = (struct wiiuse_poller_t *)wiiuse_ctx_malloc(wm[0]->ctx, sizeof(struct wiiuse_poller_t));
+    if (!p)
+    {
+        return NULL;
+    }
+    memset(p, 0, sizeof(struct wiiuse_poller_t));
+    p->ctx = wm[0]->ctx;
+
+    p->shard = (struct poller_shard_t *)wiiuse_ctx_malloc(p->ctx, threads * sizeof(struct poller_shard_t));
+    if (!p->shard)
+    {
+        wiiuse_ctx_free(p->ctx, p);
+        return NULL;
+    }
+    memset(p->shard, 0, threads * sizeof(struct poller_shard_t));
+
+    /* carve up the array before any thread runs */
+    for (i = 0; i < threads; ++i)
+    {
+        sh         = &p->shard[i];
+        sh->poller = p;
+        sh->cpu    = cpus ? cpus[i] : -1;
+        sh->mask   = size - 1;
+
+        n         = (wiimotes - i + threads - 1) / threads;
+        sh->wm    = (struct wiimote_t **)wiiuse_ctx_malloc(p->ctx, n * sizeof(struct wiimote_t *));
+        sh->owner = (struct wiiuse_context_t **)wiiuse_ctx_malloc(p->ctx, n * sizeof(struct wiiuse_context_t *));
+        sh->queue = (struct wiimote_callback_data_t *)wiiuse_ctx_malloc(
+            p->ctx, size * sizeof(struct wiimote_callback_data_t));
+        ++p->shards;
+
+        if (!sh->wm || !sh->owner || !sh->queue)
+        {
+            wiiuse_poller_stop(p);
+            return NULL;
+        }
+
+        /* a fresh context, logging and allocating like the original and
+           placing on its adapters, discovery and incoming connections
+           stay with the original, each worker sets up its own ring */
+        memcpy(sh->ctx.logtarget, p->ctx->logtarget, sizeof(sh->ctx.logtarget));
+        sh->ctx.malloc_cb     = p->ctx->malloc_cb;
+        sh->ctx.free_cb       = p->ctx->free_cb;
+        sh->ctx.banner        = 1;
+        sh->ctx.adapter_owner = adapter_table(p->ctx);
+#ifdef WIIUSE_IO_URING
+        sh->ctx.uring_unavailable = p->ctx->uring_unavailable;
+#endif
+    }
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        sh = &p->shard[i % threads];
+
+#ifdef WIIUSE_IO_URING
+        /* leave the ring of the original context while it is still ours to use */
+        uring_forget(wm[i]);
+#endif
+
+        adapter_move(wm[i]->ctx, &sh->ctx, wm[i]);
+        sh->owner[sh->count] = wm[i]->ctx;
+        sh->wm[sh->count++]  = wm[i];
+        wm[i]->ctx           = &sh->ctx;
+    }
+
+    for (i = 0; i < threads; ++i)
+    {
+        p->shard[i].running = start_thread(&p->shard[i]);
+        if (!p->shard[i].running)
+        {
+            WIIUSE_ERROR("Unable to start poller thread %i.", i);
+            wiiuse_poller_stop(p);
+            return NULL;
+        }
+    }
+
+    WIIUSE_INFO("Polling %i wiimotes from %i threads.", wiimotes, threads);
+    return p;
+#else
+    (void)wm;
+    (void)wiimotes;
+    (void)threads;
+    (void)queue;
+    (void)cpus;
+
+    WIIUSE_ERROR("This build of wiiuse has no thread support.");
+    return NULL;
+#endif
+}
+
+/**
+ *	@brief Fetch the events of all workers of a poller.
+ *
+ *	@param p		The poller from wiiuse_poller_start().
+ *	@param out		[out] Caller allocated array of \a max events.
+ *	@param max		Maximum number of events to fetch.
+ *
+ *	@return Number of events copied to \a out.
+ *
+ *	Takes one event from each worker in turn, so a busy shard
+ *	cannot starve the others. Events of one wiimote keep their
+ *	order. Must always be called from the same thread.
+ */
+int wiiuse_poller_read(struct wiiuse_poller_t *p, struct wiimote_callback_data_t *out, int max)
+{
+    struct poller_shard_t *sh;
+    int n = 0;
+    int idle, i;
+
+    if (!p || !out)
+    {
+        return 0;
+    }
+
+    for (idle = 0; (n < max) && (idle < p->shards);)
+    {
+        i  = p->next;
+        sh = &p->shard[i];
+
+        p->next = (i + 1 < p->shards) ? i + 1 : 0;
+
+        if (sh->tail == WIIUSE_LOAD_ACQUIRE(&sh->head))
+        {
+            ++idle;
+            continue;
+        }
+        idle = 0;
+
+        out[n++] = sh->queue[sh->tail & sh->mask];
+        WIIUSE_STORE_RELEASE(&sh->tail, sh->tail + 1);
+    }
+
+    return n;
+}
+
+/**
+ *	@brief Number of events dropped because a worker queue was full.
+ *
+ *	@param p		The poller from wiiuse_poller_start().
+ */
+unsigned long wiiuse_poller_overruns(struct wiiuse_poller_t *p)
+{
+    unsigned long overruns = 0;
+    int i;
+
+    if (!p)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < p->shards; ++i)
+    {
+        overruns += WIIUSE_LOAD_ACQUIRE(&p->shard[i].overruns);
+    }
+
+    return overruns;
+}
+
+/**
+ *	@brief Read the statistics of all workers of a poller.
+ *
+ *	@param p		The poller from wiiuse_poller_start().
+ *	@param stats	[out] The statistics, summed over the workers.
+ *
+ *	Reports decoded by the workers are only counted here, not in
+ *	the contexts the wiimotes were created in.
+ */
+void wiiuse_poller_get_stats(struct wiiuse_poller_t *p, struct wiiuse_stats_t *stats)
+{
+    int i;
+
+    if (!p || !stats)
+    {
+        return;
+    }
+
+    memset(stats, 0, sizeof(struct wiiuse_stats_t));
+    for (i = 0; i < p->shards; ++i)
+    {
+        stats->reports += WIIUSE_LOAD_ACQUIRE(&p->shard[i].reports);
+        stats->events += WIIUSE_LOAD_ACQUIRE(&p->shard[i].events);
+    }
+}
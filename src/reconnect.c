@@ -0,0 +1,300 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Reconnecting wiimotes that drop out.
+ *
+ *	When a supervised wiimote goes away, the state the application
+ *	set up on it is saved before wiiuse_disconnected() resets it.
+ *	wiiuse_poll() then tries to connect it again, waiting twice as
+ *	long after every failed attempt. Once it is back, the saved
+ *	state is sent in one go and the application gets a single
+ *	WIIUSE_RECONNECT event.
+ */
+
+#include "reconnect.h"
+
+#include "os.h" /* for wiiuse_os_reconnect, wiiuse_os_set_reconnect, wiiuse_os_ticks */
+
+/* backoff between connect attempts, in milliseconds */
+#define RECONNECT_MIN_DELAY 500
+#define RECONNECT_MAX_DELAY 30000
+
+/* wiimote_restore_t.pending */
+#define RESTORE_NONE 0
+#define RESTORE_CONNECT 1      /* waiting for the wiimote to be back */
+#define RESTORE_MOTION_PLUS 2  /* waiting for the Motion Plus to show up */
+
+#define IR_SENS_STATES                                                                                           \
+    (WIIMOTE_STATE_IR_SENS_LVL1 | WIIMOTE_STATE_IR_SENS_LVL2 | WIIMOTE_STATE_IR_SENS_LVL3                        \
+     | WIIMOTE_STATE_IR_SENS_LVL4 | WIIMOTE_STATE_IR_SENS_LVL5)
+
+/**
+ *	@brief Reconnect a wiimote by itself when it drops out.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *	@param status	1 to supervise the wiimote, 0 to stop.
+ *
+ *	@return 1 on success, 0 if reconnecting is not supported.
+ *
+ *	@see wiiuse_os_set_reconnect()
+ *
+ *	What is put back: LEDs, motion sensing, IR with its sensitivity,
+ *	and the Motion Plus mode. Everything that survives a disconnect
+ *	anyway (flags such as WIIUSE_CONTINUOUS, IR virtual resolution,
+ *	position and aspect ratio, thresholds) stays as it was. Rumble
+ *	is left off.
+ *
+ *	The dropout still shows up as a WIIUSE_DISCONNECT or
+ *	WIIUSE_UNEXPECTED_DISCONNECT event. While the wiimote is gone
+ *	wiiuse_poll() tries to connect it, with a backoff from half a
+ *	second up to 30 seconds. A connect attempt blocks like
+ *	wiiuse_connect(). If the context accepts incoming connections
+ *	(wiiuse_set_accept_incoming()) no attempts are made, a paired
+ *	wiimote comes back by itself when a button is pressed.
+ */
+int wiiuse_set_reconnect(struct wiimote_t *wm, int status)
+{
+    if (!wm)
+    {
+        return 0;
+    }
+
+    wm->restore.enabled = 0;
+    wm->restore.pending = RESTORE_NONE;
+
+    if (!wiiuse_os_set_reconnect(wm, status))
+    {
+        return 0;
+    }
+
+    wm->restore.enabled = status ? 1 : 0;
+    return 1;
+}
+
+/**
+ *	@brief Save the state of a supervised wiimote that just dropped out.
+ *
+ *	Called by wiiuse_disconnected() before it resets the wiimote.
+ */
+void reconnect_remember(struct wiimote_t *wm)
+{
+    struct wiimote_restore_t *r = &wm->restore;
+
+    if (!r->enabled)
+    {
+        return;
+    }
+
+    /* dropped again before the state was back, keep what we have */
+    if (r->pending == RESTORE_NONE)
+    {
+        r->state = wm->state & (WIIMOTE_STATE_DEV_FOUND | WIIMOTE_STATE_ACC | WIIMOTE_STATE_IR | IR_SENS_STATES);
+        r->leds  = wm->leds & 0xF0;
+
+        switch (wm->exp.type)
+        {
+        case EXP_MOTION_PLUS:
+            r->motion_plus = 1;
+            break;
+
+        case EXP_MOTION_PLUS_NUNCHUK:
+        case EXP_MOTION_PLUS_CLASSIC:
+            r->motion_plus = 2;
+            break;
+
+        default:
+            r->motion_plus = 0;
+            break;
+        }
+    }
+
+    r->pending = RESTORE_CONNECT;
+    r->delay   = RECONNECT_MIN_DELAY;
+    r->next    = wiiuse_os_ticks() + r->delay;
+}
+
+/**
+ *	@brief Keep the slot of a wiimote that was reset by wiiuse_disconnected().
+ *
+ *	The address stays valid, so the wiimote can be connected
+ *	again and discovery does not hand the slot to another one.
+ */
+void reconnect_keep_slot(struct wiimote_t *wm)
+{
+    if (wm->restore.pending != RESTORE_NONE)
+    {
+        WIIMOTE_ENABLE_STATE(wm, wm->restore.state & WIIMOTE_STATE_DEV_FOUND);
+    }
+}
+
+/**
+ *	@brief Send the saved state to a wiimote that is back.
+ */
+static void reconnect_replay(struct wiimote_t *wm)
+{
+    struct wiimote_restore_t *r = &wm->restore;
+
+    WIIUSE_CTX_INFO(wm->ctx, "Restoring the state of wiimote [id %i].", wm->unid);
+
+    /* set the flags first, so the report type goes out once */
+    WIIMOTE_DISABLE_STATE(wm, IR_SENS_STATES);
+    WIIMOTE_ENABLE_STATE(wm, r->state & (WIIMOTE_STATE_ACC | IR_SENS_STATES));
+
+    wiiuse_set_leds(wm, r->leds);
+
+    if (r->state & WIIMOTE_STATE_IR)
+    {
+        /* also sets the report type */
+        wiiuse_set_ir(wm, 1);
+    } else
+    {
+        wiiuse_set_report_type(wm);
+    }
+
+    r->pending = r->motion_plus ? RESTORE_MOTION_PLUS : RESTORE_NONE;
+    wm->event  = WIIUSE_RECONNECT;
+}
+
+/**
+ *	@brief Try to connect wm[which], a wiimote that is gone.
+ *
+ *	The whole array goes to the platform, which places the
+ *	connection on an adapter with room left.
+ */
+static void reconnect_attempt(struct wiimote_t **wms, int wiimotes, int which, unsigned long now)
+{
+    struct wiimote_t *wm        = wms[which];
+    struct wiimote_restore_t *r = &wm->restore;
+
+    /* release what is left of the old connection */
+    wiiuse_os_disconnect(wm);
+    WIIMOTE_ENABLE_STATE(wm, r->state & WIIMOTE_STATE_DEV_FOUND);
+
+    /* the platform may only start the connect, if that fails later the next try waits as well */
+    r->delay = (r->delay * 2 > RECONNECT_MAX_DELAY) ? RECONNECT_MAX_DELAY : r->delay * 2;
+    r->next  = now + r->delay;
+
+    if (!wiiuse_os_reconnect(wms, wiimotes, which))
+    {
+        WIIUSE_DEBUG("Wiimote [id %i] not back yet, next try in %lu ms.", wm->unid, r->delay);
+    }
+}
+
+/**
+ *	@brief When reconnect_step() has work for a wiimote next.
+ *
+ *	@return Ticks of the next connect attempt or replay, WIIUSE_NEVER
+ *			if it waits for something else.
+ */
+unsigned long reconnect_deadline(struct wiimote_t *wm)
+{
+    struct wiimote_restore_t *r = &wm->restore;
+
+    /* the Motion Plus waits for a status report */
+    if ((r->pending == RESTORE_NONE) || (r->pending == RESTORE_MOTION_PLUS))
+    {
+        return WIIUSE_NEVER;
+    }
+
+    if (WIIMOTE_IS_CONNECTED(wm))
+    {
+        return WIIMOTE_IS_SET(wm, WIIMOTE_STATE_HANDSHAKE_COMPLETE) ? 0 : WIIUSE_NEVER;
+    }
+
+    /* the wiimote connects by itself, or the socket tells when the connect is done */
+    if (wm->ctx->incoming.enabled || WIIMOTE_IS_SET(wm, WIIMOTE_STATE_CONNECTING))
+    {
+        return WIIUSE_NEVER;
+    }
+
+    return r->next;
+}
+
+/**
+ *	@brief Drive the supervised wiimotes of an array.
+ *
+ *	Called by wiiuse_poll() after the platform poll.
+ *
+ *	@return The number of wiimotes that got an event here
+ *			and not in the platform poll.
+ */
+int reconnect_step(struct wiimote_t **wm, int wiimotes)
+{
+    struct wiimote_restore_t *r;
+    unsigned long now = 0;
+    int evnt          = 0;
+    int had_event;
+    int i;
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        r = &wm[i]->restore;
+        if (r->pending == RESTORE_NONE)
+        {
+            continue;
+        }
+
+        /* the Motion Plus needs the status report that tells it is there */
+        if (r->pending == RESTORE_MOTION_PLUS)
+        {
+            if (WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_MPLUS_PRESENT)
+                && !WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_EXP_HANDSHAKE))
+            {
+                r->pending = RESTORE_NONE;
+                wiiuse_set_motion_plus(wm[i], r->motion_plus);
+            }
+            continue;
+        }
+
+        had_event = (wm[i]->event != WIIUSE_NONE);
+
+        if (!WIIMOTE_IS_CONNECTED(wm[i]))
+        {
+            /* let the disconnect event go out first, and a connect that was started finish */
+            if (had_event || wm[i]->ctx->incoming.enabled || WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_CONNECTING))
+            {
+                continue;
+            }
+
+            if (!now)
+            {
+                now = wiiuse_os_ticks();
+            }
+            if (now < r->next)
+            {
+                continue;
+            }
+
+            reconnect_attempt(wm, wiimotes, i, now);
+        }
+
+        if (WIIMOTE_IS_CONNECTED(wm[i]) && WIIMOTE_IS_SET(wm[i], WIIMOTE_STATE_HANDSHAKE_COMPLETE))
+        {
+            reconnect_replay(wm[i]);
+            evnt += !had_event;
+        }
+    }
+
+    return evnt;
+}
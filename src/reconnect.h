@@ -0,0 +1,49 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Reconnecting wiimotes that drop out.
+ */
+
+#ifndef RECONNECT_H_INCLUDED
+#define RECONNECT_H_INCLUDED
+
+#include "wiiuse_internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @defgroup internal_reconnect Internal: Reconnect Supervisor */
+/** @{ */
+void reconnect_remember(struct wiimote_t *wm);
+void reconnect_keep_slot(struct wiimote_t *wm);
+int reconnect_step(struct wiimote_t **wm, int wiimotes);
+unsigned long reconnect_deadline(struct wiimote_t *wm);
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECONNECT_H_INCLUDED */
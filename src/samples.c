@@ -0,0 +1,256 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief Columnar sample store.
+ *
+ *	Keeps a copy of every decoded report as a set of contiguous
+ *	per-field arrays, so that analysis code can run over a window
+ *	of samples without gathering fields out of wiimote_t.
+ */
+
+#include "samples.h"
+#include "os.h" /* for wiiuse_os_ticks */
+
+#include <string.h> /* for memset */
+
+/* every column starts on a 16 byte boundary so SIMD loads stay aligned */
+#define SAMPLE_COLUMN_ALIGN 16
+
+static size_t column_bytes(size_t elem_size, int capacity)
+{
+    return (elem_size * (size_t)capacity + SAMPLE_COLUMN_ALIGN - 1) & ~(size_t)(SAMPLE_COLUMN_ALIGN - 1);
+}
+
+/**
+ *	@brief Hand out the next column from the store's memory block.
+ *
+ *	@param block	Memory to carve, or NULL to only account for the size.
+ *	@param used		[in/out] Bytes of \a block handed out so far.
+ */
+static void *carve_column(byte *block, size_t *used, size_t elem_size, int capacity)
+{
+    size_t offset = *used;
+
+    *used += column_bytes(elem_size, capacity);
+    return block ? (void *)(block + offset) : NULL;
+}
+
+/**
+ *	@brief Lay out all columns of a store in one block.
+ *
+ *	@param st		The store to fill in.
+ *	@param block	Memory to carve, or NULL to only compute the size.
+ *
+ *	@return Size of the block in bytes.
+ */
+static size_t layout_columns(struct sample_store_t *st, byte *block, int capacity)
+{
+    size_t used = 0;
+
+    st->timestamp = (unsigned long *)carve_column(block, &used, sizeof(unsigned long), capacity);
+    st->gforce_x  = (float *)carve_column(block, &used, sizeof(float), capacity);
+    st->gforce_y  = (float *)carve_column(block, &used, sizeof(float), capacity);
+    st->gforce_z  = (float *)carve_column(block, &used, sizeof(float), capacity);
+    st->roll      = (float *)carve_column(block, &used, sizeof(float), capacity);
+    st->pitch     = (float *)carve_column(block, &used, sizeof(float), capacity);
+    st->yaw       = (float *)carve_column(block, &used, sizeof(float), capacity);
+    st->ir_x      = (int *)carve_column(block, &used, sizeof(int), capacity);
+    st->ir_y      = (int *)carve_column(block, &used, sizeof(int), capacity);
+    st->exp_ljs_x = (float *)carve_column(block, &used, sizeof(float), capacity);
+    st->exp_ljs_y = (float *)carve_column(block, &used, sizeof(float), capacity);
+    st->exp_rjs_x = (float *)carve_column(block, &used, sizeof(float), capacity);
+    st->exp_rjs_y = (float *)carve_column(block, &used, sizeof(float), capacity);
+
+    st->ir_dots.rx = (int16_t *)carve_column(block, &used, sizeof(int16_t), 4 * capacity);
+    st->ir_dots.ry = (int16_t *)carve_column(block, &used, sizeof(int16_t), 4 * capacity);
+    st->btns       = (uint16_t *)carve_column(block, &used, sizeof(uint16_t), capacity);
+    st->exp_btns   = (uint16_t *)carve_column(block, &used, sizeof(uint16_t), capacity);
+
+    st->ir_dots.size    = (byte *)carve_column(block, &used, sizeof(byte), 4 * capacity);
+    st->ir_dots.visible = (byte *)carve_column(block, &used, sizeof(byte), 4 * capacity);
+    st->accel_x         = (byte *)carve_column(block, &used, sizeof(byte), capacity);
+    st->accel_y         = (byte *)carve_column(block, &used, sizeof(byte), capacity);
+    st->accel_z         = (byte *)carve_column(block, &used, sizeof(byte), capacity);
+
+    return used;
+}
+
+/**
+ *	@brief Enable, resize or disable the columnar sample store of a wiimote.
+ *
+ *	@param wm			Pointer to a wiimote_t structure.
+ *	@param capacity		Number of samples each column can hold, or 0 to
+ *						disable the store and free its memory.
+ *
+ *	@return 1 on success, 0 if the memory could not be allocated.
+ *
+ *	Once enabled, every input report decoded for this wiimote is
+ *	appended to wm->samples. When the store is full further samples
+ *	are counted in \a dropped until wiiuse_reset_sample_store() starts
+ *	a new slice.
+ */
+int wiiuse_set_sample_store(struct wiimote_t *wm, int capacity)
+{
+    struct sample_store_t *st;
+    byte *block;
+
+    if (!wm)
+    {
+        return 0;
+    }
+
+    if (wm->samples)
+    {
+        wiiuse_ctx_free(wm->ctx, wm->samples->block);
+        wiiuse_ctx_free(wm->ctx, wm->samples);
+        wm->samples = NULL;
+    }
+
+    if (capacity <= 0)
+    {
+        return 1;
+    }
+
+    st = (struct sample_store_t *)wiiuse_ctx_malloc(wm->ctx, sizeof(struct sample_store_t));
+    if (!st)
+    {
+        return 0;
+    }
+    memset(st, 0, sizeof(struct sample_store_t));
+
+    /* pad by the alignment so the first column can be aligned too */
+    block = (byte *)wiiuse_ctx_malloc(wm->ctx, layout_columns(st, NULL, capacity) + SAMPLE_COLUMN_ALIGN);
+    if (!block)
+    {
+        wiiuse_ctx_free(wm->ctx, st);
+        return 0;
+    }
+
+    st->block    = block;
+    st->capacity = capacity;
+
+    /* move the first column up to the next aligned address */
+    block += (SAMPLE_COLUMN_ALIGN - ((uintptr_t)block % SAMPLE_COLUMN_ALIGN)) % SAMPLE_COLUMN_ALIGN;
+    layout_columns(st, block, capacity);
+
+    wm->samples = st;
+
+    WIIUSE_CTX_DEBUG(wm->ctx, "Sample store enabled for wiimote id %i (%i samples).", wm->unid, capacity);
+    return 1;
+}
+
+/**
+ *	@brief Start a new slice in the sample store.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *
+ *	Discards the stored samples and clears the dropped counter.
+ *	The columns keep their memory.
+ */
+void wiiuse_reset_sample_store(struct wiimote_t *wm)
+{
+    if (!wm || !wm->samples)
+    {
+        return;
+    }
+
+    wm->samples->count   = 0;
+    wm->samples->dropped = 0;
+}
+
+/**
+ *	@brief Append the current state of a wiimote to its sample store.
+ *
+ *	@param wm		Pointer to a wiimote_t structure.
+ *
+ *	Called from propagate_event() for every input report.
+ */
+void sample_store_append(struct wiimote_t *wm)
+{
+    struct sample_store_t *st = wm->samples;
+    struct joystick_t *ljs    = NULL;
+    struct joystick_t *rjs    = NULL;
+    uint16_t exp_btns         = 0;
+    int n, d;
+
+    if (st->count >= st->capacity)
+    {
+        ++st->dropped;
+        return;
+    }
+    n = st->count++;
+
+    st->timestamp[n] = wiiuse_os_ticks();
+    st->btns[n]      = wm->btns;
+
+    st->accel_x[n]  = wm->accel.x;
+    st->accel_y[n]  = wm->accel.y;
+    st->accel_z[n]  = wm->accel.z;
+    st->gforce_x[n] = wm->gforce.x;
+    st->gforce_y[n] = wm->gforce.y;
+    st->gforce_z[n] = wm->gforce.z;
+    st->roll[n]     = wm->orient.roll;
+    st->pitch[n]    = wm->orient.pitch;
+    st->yaw[n]      = wm->orient.yaw;
+
+    st->ir_x[n] = wm->ir.x;
+    st->ir_y[n] = wm->ir.y;
+    for (d = 0; d < 4; ++d)
+    {
+        st->ir_dots.rx[4 * n + d]      = wm->ir.dot[d].rx;
+        st->ir_dots.ry[4 * n + d]      = wm->ir.dot[d].ry;
+        st->ir_dots.size[4 * n + d]    = wm->ir.dot[d].size;
+        st->ir_dots.visible[4 * n + d] = wm->ir.dot[d].visible;
+    }
+
+    switch (wm->exp.type)
+    {
+    case EXP_NUNCHUK:
+    case EXP_MOTION_PLUS_NUNCHUK:
+        ljs      = &wm->exp.nunchuk.js;
+        exp_btns = wm->exp.nunchuk.btns;
+        break;
+    case EXP_CLASSIC:
+    case EXP_MOTION_PLUS_CLASSIC:
+        ljs      = &wm->exp.classic.ljs;
+        rjs      = &wm->exp.classic.rjs;
+        exp_btns = wm->exp.classic.btns;
+        break;
+    case EXP_GUITAR_HERO_3:
+        ljs      = &wm->exp.gh3.js;
+        exp_btns = wm->exp.gh3.btns;
+        break;
+    case EXP_TATACON:
+        exp_btns = wm->exp.tatacon.btns;
+        break;
+    default:
+        break;
+    }
+
+    st->exp_ljs_x[n] = ljs ? ljs->x : 0.0f;
+    st->exp_ljs_y[n] = ljs ? ljs->y : 0.0f;
+    st->exp_rjs_x[n] = rjs ? rjs->x : 0.0f;
+    st->exp_rjs_y[n] = rjs ? rjs->y : 0.0f;
+    st->exp_btns[n]  = exp_btns;
+}
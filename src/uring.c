@@ -0,0 +1,992 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief io_uring transport for the BlueZ backend.
+ *
+ *	Every connected wiimote keeps a multishot receive armed on its
+ *	interrupt socket. Reports land in buffers the kernel picks from
+ *	a shared buffer ring, and output reports are queued as send
+ *	requests that go out together with the next wait. The sends of
+ *	a wiimote are linked so they reach it in order. A poll costs
+ *	one io_uring_enter() however many wiimotes are connected and
+ *	however many reports came in.
+ *
+ *	Completions are copied out of the completion queue into a
+ *	backlog right away and handed out one at a time by
+ *	uring_read(), so the select() code in os_nix.c keeps working
+ *	unchanged on top of it, including the synchronous reads done
+ *	during expansion handshakes.
+ *
+ *	The ring belongs to a context and is set up on its first poll.
+ *	It keeps its own entry for each wiimote armed on it, so the
+ *	layout of wiimote_t does not depend on WIIUSE_IO_URING. Kernels
+ *	older than 6.0 or with io_uring disabled get the select() path
+ *	instead.
+ */
+
+#include "uring.h"
+
+#ifdef WIIUSE_IO_URING
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <signal.h>   /* for _NSIG */
+#include <string.h>   /* for memset */
+#include <sys/mman.h> /* for mmap */
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>   /* for struct timespec */
+#include <unistd.h> /* for syscall, close */
+
+/* submission queue size, the completion queue is 4 times larger */
+#define URING_ENTRIES 128
+
+/* receive buffers shared by all wiimotes of a ring, a power of two */
+#define URING_BUFFERS     256
+#define URING_BUFFER_SIZE MAX_PAYLOAD
+#define URING_GROUP       0
+
+/* completions waiting for uring_read() */
+#define URING_BACKLOG (2 * URING_BUFFERS)
+
+/* give up waiting for the requests of a wiimote after this many 100ms rounds */
+#define URING_WAIT_ROUNDS 10
+
+/* what a completion is for, in the low bits of user_data */
+#define URING_RECV   0 /* the wiimote_t pointer itself */
+#define URING_SEND   1 /* write slot << 2 */
+#define URING_CANCEL 2
+#define URING_TAG(ud) ((ud)&3)
+
+/* entries for the wiimotes of a ring to start with, a power of two */
+#define URING_WIIMOTES 8
+
+/**
+ *	@brief What a ring keeps for one of its wiimotes.
+ */
+struct uring_wiimote_t
+{
+    struct wiimote_t *wm; /* NULL if the entry is free */
+    int armed;            /* 1 while a receive is armed, -1 once it ended for good */
+    int queued;           /* reports received but not read yet */
+    int first, last;      /* writes not submitted yet, oldest first, -1 if none */
+    int sending;          /* writes submitted but not completed */
+};
+
+/**
+ *	@brief A send request the kernel may still read from.
+ */
+struct uring_write_t
+{
+    struct wiimote_t *wm; /* NULL if the slot is free or the wiimote was forgotten */
+    int busy;
+    int len;
+    int next; /* next write of the same wiimote not submitted yet, -1 if none */
+    byte data[MAX_PAYLOAD];
+};
+
+/**
+ *	@brief A report (or end of stream) received but not read yet.
+ */
+struct uring_report_t
+{
+    struct wiimote_t *wm; /* NULL once read */
+    int res;              /* byte count, 0 on end of stream or -errno */
+    int bid;              /* receive buffer, -1 if none */
+};
+
+struct wiiuse_uring_t
+{
+    struct wiiuse_context_t *ctx;
+    int fd;
+
+    /* rings shared with the kernel */
+    void *ring_ptr;
+    size_t ring_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    struct io_uring_cqe *cqes;
+    unsigned sq_local_tail;
+    unsigned to_submit;
+
+    /* receive buffers */
+    struct io_uring_buf_ring *br;
+    size_t br_size;
+    byte *buf;
+    unsigned short br_tail;
+
+    struct uring_wiimote_t *wiimote;
+    int wiimotes;      /* entries allocated, a power of two */
+    int wiimotes_used; /* entries taken */
+
+    struct uring_write_t write[URING_ENTRIES];
+    int writes; /* slots in use */
+    int unsent; /* slots not submitted yet */
+
+    struct uring_report_t backlog[URING_BACKLOG];
+    int backlog_len;
+    int backlog_read; /* entries read, compacted on the next reap */
+};
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/**
+ *	@brief Check that a freshly set up ring has everything used here.
+ *
+ *	The setup flags themselves are checked by setting the ring up.
+ *	Multishot receives cannot be asked for, they came with 6.0 along
+ *	with zero copy sends, which can. Provided buffer rings are checked
+ *	when they get registered.
+ */
+static int uring_supported(int fd, const struct io_uring_params *p)
+{
+    static const int needed[] = {IORING_OP_RECV, IORING_OP_SEND, IORING_OP_SEND_ZC};
+    struct
+    {
+        struct io_uring_probe probe;
+        struct io_uring_probe_op ops[IORING_OP_LAST];
+    } probe;
+    int i;
+
+    if ((p->features & (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG)) !=
+        (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG))
+    {
+        return 0;
+    }
+
+    memset(&probe, 0, sizeof(probe));
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, &probe, IORING_OP_LAST) < 0)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < (int)(sizeof(needed) / sizeof(needed[0])); ++i)
+    {
+        if ((needed[i] >= probe.probe.ops_len) || !(probe.ops[needed[i]].flags & IO_URING_OP_SUPPORTED))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void uring_free(struct wiiuse_uring_t *ring)
+{
+    if (ring->br)
+    {
+        munmap(ring->br, ring->br_size);
+    }
+    if (ring->sqes)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->ring_ptr)
+    {
+        munmap(ring->ring_ptr, ring->ring_size);
+    }
+    if (ring->fd != -1)
+    {
+        close(ring->fd);
+    }
+
+    wiiuse_ctx_free(ring->ctx, ring->wiimote);
+    wiiuse_ctx_free(ring->ctx, ring->buf);
+    wiiuse_ctx_free(ring->ctx, ring);
+}
+
+/**
+ *	@brief Give a receive buffer back to the kernel.
+ */
+static void uring_recycle(struct wiiuse_uring_t *ring, int bid)
+{
+    struct io_uring_buf *b = &ring->br->bufs[ring->br_tail & (URING_BUFFERS - 1)];
+
+    b->addr = (unsigned long)(ring->buf + bid * URING_BUFFER_SIZE);
+    b->len  = URING_BUFFER_SIZE;
+    b->bid  = (unsigned short)bid;
+
+    ++ring->br_tail;
+    WIIUSE_STORE_RELEASE(&ring->br->tail, ring->br_tail);
+}
+
+/**
+ *	@brief Set up a ring with its receive buffers.
+ *
+ *	@return The new ring, or NULL if io_uring cannot be used.
+ */
+static struct wiiuse_uring_t *uring_create(struct wiiuse_context_t *ctx)
+{
+    struct wiiuse_uring_t *ring;
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    size_t sq_size, cq_size;
+    int i;
+
+    ring = (struct wiiuse_uring_t *)wiiuse_ctx_malloc(ctx, sizeof(struct wiiuse_uring_t));
+    if (!ring)
+    {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(struct wiiuse_uring_t));
+    ring->ctx = ctx;
+
+    memset(&p, 0, sizeof(p));
+    p.flags      = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_CQSIZE;
+    p.cq_entries = 4 * URING_ENTRIES;
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (ring->fd < 0)
+    {
+        ring->fd = -1;
+        uring_free(ring);
+        return NULL;
+    }
+
+    if (!uring_supported(ring->fd, &p))
+    {
+        uring_free(ring);
+        return NULL;
+    }
+
+    /* both rings in one mapping */
+    sq_size         = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size         = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+    ring->ring_ptr  = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                           IORING_OFF_SQ_RING);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes      = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if ((ring->ring_ptr == MAP_FAILED) || (ring->sqes == MAP_FAILED))
+    {
+        ring->ring_ptr = (ring->ring_ptr == MAP_FAILED) ? NULL : ring->ring_ptr;
+        ring->sqes     = (ring->sqes == MAP_FAILED) ? NULL : ring->sqes;
+        uring_free(ring);
+        return NULL;
+    }
+
+    ring->sq_head  = (unsigned *)((byte *)ring->ring_ptr + p.sq_off.head);
+    ring->sq_tail  = (unsigned *)((byte *)ring->ring_ptr + p.sq_off.tail);
+    ring->sq_mask  = (unsigned *)((byte *)ring->ring_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((byte *)ring->ring_ptr + p.sq_off.array);
+    ring->cq_head  = (unsigned *)((byte *)ring->ring_ptr + p.cq_off.head);
+    ring->cq_tail  = (unsigned *)((byte *)ring->ring_ptr + p.cq_off.tail);
+    ring->cq_mask  = (unsigned *)((byte *)ring->ring_ptr + p.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *)((byte *)ring->ring_ptr + p.cq_off.cqes);
+
+    ring->sq_local_tail = *ring->sq_tail;
+
+    /* the buffer ring has to be page aligned */
+    ring->br_size = URING_BUFFERS * sizeof(struct io_uring_buf);
+    ring->br      = (struct io_uring_buf_ring *)mmap(NULL, ring->br_size, PROT_READ | PROT_WRITE,
+                                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->buf     = (byte *)wiiuse_ctx_malloc(ctx, URING_BUFFERS * URING_BUFFER_SIZE);
+    ring->wiimote = (struct uring_wiimote_t *)wiiuse_ctx_malloc(ctx, URING_WIIMOTES * sizeof(struct uring_wiimote_t));
+    if ((ring->br == MAP_FAILED) || !ring->buf || !ring->wiimote)
+    {
+        ring->br = (ring->br == MAP_FAILED) ? NULL : ring->br;
+        uring_free(ring);
+        return NULL;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (unsigned long)ring->br;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid         = URING_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        uring_free(ring);
+        return NULL;
+    }
+
+    for (i = 0; i < URING_BUFFERS; ++i)
+    {
+        uring_recycle(ring, i);
+    }
+
+    memset(ring->wiimote, 0, URING_WIIMOTES * sizeof(struct uring_wiimote_t));
+    ring->wiimotes = URING_WIIMOTES;
+
+    return ring;
+}
+
+/**
+ *	@brief Get the ring of a context, setting it up on first use.
+ *
+ *	@return The ring, or NULL if the select() path has to be used.
+ */
+struct wiiuse_uring_t *uring_attach(struct wiiuse_context_t *ctx)
+{
+    if (ctx->uring || ctx->uring_unavailable)
+    {
+        return ctx->uring;
+    }
+
+    ctx->uring = uring_create(ctx);
+    if (!ctx->uring)
+    {
+        WIIUSE_CTX_INFO(ctx, "io_uring is not available, polling with select().");
+        ctx->uring_unavailable = 1;
+    }
+
+    return ctx->uring;
+}
+
+/**
+ *	@brief The descriptor of a ring.
+ *
+ *	It polls readable while completions wait to be reaped. Those can
+ *	be posted when the thread comes back from any system call, with
+ *	the socket already drained.
+ */
+int uring_fd(struct wiiuse_uring_t *ring) { return ring->fd; }
+
+/**
+ *	@brief Release the ring of a context.
+ *
+ *	Closing the ring cancels whatever is still pending, nothing is
+ *	waited for. The thread that submitted the requests has to be
+ *	done with them, like a poller thread that was joined. The
+ *	wiimotes that were armed on it go with it.
+ */
+void uring_destroy(struct wiiuse_context_t *ctx)
+{
+    struct wiiuse_uring_t *ring = ctx->uring;
+
+    if (!ring)
+    {
+        return;
+    }
+
+    ctx->uring = NULL;
+    uring_free(ring);
+}
+
+/**
+ *	@brief Look for an entry, starting where the entry of \a wm should be.
+ *
+ *	@param ring	The ring.
+ *	@param wm	The wiimote whose address gives the first entry to look at.
+ *	@param key	The wiimote to look for, NULL for a free entry.
+ *
+ *	The table is kept at most half full, so a wiimote is mostly found
+ *	on the first try even with a lot of them polled. \a wm is not
+ *	dereferenced, it may be a wiimote that is gone.
+ *
+ *	@return The entry, or NULL if there is none.
+ */
+static struct uring_wiimote_t *uring_probe(struct wiiuse_uring_t *ring, struct wiimote_t *wm, struct wiimote_t *key)
+{
+    unsigned h = (unsigned)((uintptr_t)wm >> 4);
+    int i, n;
+
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+
+    for (i = (int)(h & (ring->wiimotes - 1)), n = 0; n < ring->wiimotes; ++n)
+    {
+        if (ring->wiimote[i].wm == key)
+        {
+            return &ring->wiimote[i];
+        }
+        i = (i + 1) & (ring->wiimotes - 1);
+    }
+
+    return NULL;
+}
+
+/**
+ *	@brief Find the entry of a wiimote.
+ *
+ *	@return The entry, or NULL if the wiimote is not on \a ring.
+ */
+static struct uring_wiimote_t *uring_find(struct wiiuse_uring_t *ring, struct wiimote_t *wm)
+{
+    return uring_probe(ring, wm, wm);
+}
+
+/**
+ *	@brief Give a wiimote an entry, growing the table if it gets too full.
+ *
+ *	@return The entry, or NULL if out of memory.
+ */
+static struct uring_wiimote_t *uring_add(struct wiiuse_uring_t *ring, struct wiimote_t *wm)
+{
+    struct uring_wiimote_t *old = ring->wiimote;
+    struct uring_wiimote_t *e;
+    int n = ring->wiimotes;
+    int i;
+
+    if (2 * (ring->wiimotes_used + 1) > n)
+    {
+        ring->wiimote = (struct uring_wiimote_t *)wiiuse_ctx_malloc(ring->ctx, 2 * n * sizeof(struct uring_wiimote_t));
+        if (!ring->wiimote)
+        {
+            ring->wiimote = old;
+            return NULL;
+        }
+        memset(ring->wiimote, 0, 2 * n * sizeof(struct uring_wiimote_t));
+        ring->wiimotes = 2 * n;
+
+        for (i = 0; i < n; ++i)
+        {
+            if (old[i].wm)
+            {
+                *uring_probe(ring, old[i].wm, NULL) = old[i];
+            }
+        }
+        wiiuse_ctx_free(ring->ctx, old);
+    }
+
+    e = uring_probe(ring, wm, NULL);
+    memset(e, 0, sizeof(*e));
+    e->wm    = wm;
+    e->first = -1;
+    e->last  = -1;
+    ++ring->wiimotes_used;
+
+    return e;
+}
+
+/**
+ *	@brief The entry of a wiimote on the ring of its context.
+ *
+ *	@return The entry, or NULL if the wiimote is not armed on a ring.
+ */
+static struct uring_wiimote_t *uring_entry(struct wiimote_t *wm)
+{
+    return wm->ctx->uring ? uring_find(wm->ctx->uring, wm) : NULL;
+}
+
+/**
+ *	@brief Check if reads and writes of a wiimote go through a ring.
+ */
+int uring_active(struct wiimote_t *wm) { return uring_entry(wm) != NULL; }
+
+/**
+ *	@brief The number of reports of a wiimote waiting for uring_read().
+ */
+int uring_queued(struct wiimote_t *wm)
+{
+    struct uring_wiimote_t *e = uring_entry(wm);
+
+    return e ? e->queued : 0;
+}
+
+/**
+ *	@brief Get a free submission queue entry.
+ *
+ *	Submits what is queued if the queue is full.
+ */
+static struct io_uring_sqe *uring_sqe(struct wiiuse_uring_t *ring)
+{
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    if (ring->sq_local_tail - WIIUSE_LOAD_ACQUIRE(ring->sq_head) >= URING_ENTRIES)
+    {
+        int r = uring_enter(ring->fd, ring->to_submit, 0, 0, NULL, 0);
+        if (r > 0)
+        {
+            ring->to_submit -= r;
+        }
+        if (ring->sq_local_tail - WIIUSE_LOAD_ACQUIRE(ring->sq_head) >= URING_ENTRIES)
+        {
+            return NULL;
+        }
+    }
+
+    idx                 = ring->sq_local_tail & *ring->sq_mask;
+    ring->sq_array[idx] = idx;
+    sqe                 = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+/**
+ *	@brief Make a filled in entry visible to the kernel.
+ */
+static void uring_push(struct wiiuse_uring_t *ring)
+{
+    ++ring->sq_local_tail;
+    ++ring->to_submit;
+    WIIUSE_STORE_RELEASE(ring->sq_tail, ring->sq_local_tail);
+}
+
+/**
+ *	@brief Submit the queued writes of a wiimote as one chain of linked sends.
+ *
+ *	Sends on the same socket that are in flight together may complete
+ *	in any order, so a chain is only started once the previous one of
+ *	that wiimote is done. A chain is never split over two submissions.
+ */
+static void uring_flush_wiimote(struct wiiuse_uring_t *ring, struct uring_wiimote_t *e)
+{
+    struct io_uring_sqe *sqe;
+    struct uring_write_t *w;
+    int count;
+    int i;
+
+    if (e->sending || (e->first == -1))
+    {
+        return;
+    }
+
+    for (count = 0, i = e->first; i != -1; i = ring->write[i].next)
+    {
+        ++count;
+    }
+    if (URING_ENTRIES - (ring->sq_local_tail - WIIUSE_LOAD_ACQUIRE(ring->sq_head)) < (unsigned)count)
+    {
+        /* next time, once the queue went to the kernel */
+        return;
+    }
+
+    for (i = e->first; i != -1; i = w->next)
+    {
+        w   = &ring->write[i];
+        sqe = uring_sqe(ring);
+
+        sqe->opcode    = IORING_OP_SEND;
+        sqe->fd        = e->wm->in_sock;
+        sqe->flags     = (w->next != -1) ? IOSQE_IO_LINK : 0;
+        sqe->addr      = (uintptr_t)w->data;
+        sqe->len       = w->len;
+        sqe->user_data = ((unsigned long)i << 2) | URING_SEND;
+        uring_push(ring);
+    }
+
+    e->sending = count;
+    e->first   = -1;
+    e->last    = -1;
+    ring->unsent -= count;
+}
+
+/**
+ *	@brief Submit the queued writes of all wiimotes that have none in flight.
+ */
+static void uring_flush(struct wiiuse_uring_t *ring)
+{
+    int i;
+
+    for (i = 0; (i < ring->wiimotes) && ring->unsent; ++i)
+    {
+        if (ring->wiimote[i].wm)
+        {
+            uring_flush_wiimote(ring, &ring->wiimote[i]);
+        }
+    }
+}
+
+/**
+ *	@brief Move the completions from the completion queue to the backlog.
+ */
+static void uring_reap(struct wiiuse_uring_t *ring)
+{
+    struct io_uring_cqe *cqe;
+    struct uring_write_t *w;
+    struct uring_report_t *rpt;
+    struct uring_wiimote_t *e;
+    unsigned head = *ring->cq_head;
+    unsigned tail = WIIUSE_LOAD_ACQUIRE(ring->cq_tail);
+    int i, n;
+
+    /* drop the entries uring_read() is done with */
+    if (ring->backlog_read)
+    {
+        for (i = 0, n = 0; i < ring->backlog_len; ++i)
+        {
+            if (ring->backlog[i].wm)
+            {
+                ring->backlog[n++] = ring->backlog[i];
+            }
+        }
+        ring->backlog_len  = n;
+        ring->backlog_read = 0;
+    }
+
+    /* what does not fit stays in the completion queue */
+    for (; (head != tail) && (ring->backlog_len < URING_BACKLOG); ++head)
+    {
+        cqe = &ring->cqes[head & *ring->cq_mask];
+
+        switch (URING_TAG(cqe->user_data))
+        {
+        case URING_RECV:
+            e = uring_find(ring, (struct wiimote_t *)(uintptr_t)cqe->user_data);
+            if (!e)
+            {
+                /* forgotten before the receive ended */
+                if (cqe->flags & IORING_CQE_F_BUFFER)
+                {
+                    uring_recycle(ring, (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+                }
+                break;
+            }
+
+            if (!(cqe->flags & IORING_CQE_F_MORE))
+            {
+                /* armed again when out of buffers, and after an error like
+                   recv() would be, the end of stream only comes after it */
+                e->armed = ((cqe->res < 0) && (cqe->res != -ECANCELED)) ? 0 : -1;
+            }
+
+            if ((cqe->res == -ENOBUFS) || (cqe->res == -ECANCELED))
+            {
+                break;
+            }
+
+            rpt      = &ring->backlog[ring->backlog_len++];
+            rpt->wm  = e->wm;
+            rpt->res = cqe->res;
+            rpt->bid = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+            ++e->queued;
+            break;
+
+        case URING_SEND:
+            w = &ring->write[cqe->user_data >> 2];
+            if (w->wm && (e = uring_find(ring, w->wm)))
+            {
+                --e->sending;
+            }
+            /* a failed send cancels the rest of its chain */
+            if (w->wm && (cqe->res < 0) && WIIMOTE_IS_CONNECTED(w->wm))
+            {
+                wiiuse_disconnected(w->wm);
+            }
+            w->wm   = NULL;
+            w->busy = 0;
+            --ring->writes;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    WIIUSE_STORE_RELEASE(ring->cq_head, head);
+}
+
+/**
+ *	@brief Submit what is queued, wait for \a wait completions and reap them.
+ */
+static void uring_submit(struct wiiuse_uring_t *ring, unsigned long timeout_us, unsigned wait)
+{
+    struct io_uring_getevents_arg arg;
+    struct timespec ts;
+    int r;
+
+    uring_flush(ring);
+
+    memset(&arg, 0, sizeof(arg));
+    ts.tv_sec      = timeout_us / 1000000;
+    ts.tv_nsec     = (timeout_us % 1000000) * 1000;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts         = (unsigned long)&ts;
+
+    r = uring_enter(ring->fd, ring->to_submit, wait, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                    sizeof(arg));
+    if (r > 0)
+    {
+        ring->to_submit -= r;
+    } else if ((r < 0) && (errno != ETIME) && (errno != EINTR))
+    {
+        WIIUSE_ERROR("Unable to wait for io_uring completions.");
+        perror("Error Details");
+    }
+
+    uring_reap(ring);
+}
+
+/**
+ *	@brief Submit what is queued and wait for completions.
+ *
+ *	@param ring			The ring.
+ *	@param timeout_us	Microseconds to wait for a first completion,
+ *						0 to only pick up what is there.
+ *
+ *	Does not block if there is nothing the kernel could complete
+ *	or if there is already something to read.
+ */
+void uring_wait(struct wiiuse_uring_t *ring, unsigned long timeout_us)
+{
+    unsigned wait = 0;
+
+    if (timeout_us && (ring->backlog_len == ring->backlog_read) &&
+        (*ring->cq_head == WIIUSE_LOAD_ACQUIRE(ring->cq_tail)))
+    {
+        wait = 1;
+    }
+
+    uring_submit(ring, timeout_us, wait);
+}
+
+/**
+ *	@brief Wait until the requests of a wiimote are done.
+ *
+ *	@param ring		The ring of the wiimote.
+ *	@param e		The entry of the wiimote.
+ *	@param receive	1 to wait for its receive to end too, 0 for the writes only.
+ *
+ *	@return 1 once they are done, 0 if they did not finish in time.
+ */
+static int uring_settle(struct wiiuse_uring_t *ring, struct uring_wiimote_t *e, int receive)
+{
+    int rounds;
+
+    for (rounds = 0; rounds < URING_WAIT_ROUNDS; ++rounds)
+    {
+        if (!e->sending && (e->first == -1) && (!receive || (e->armed != 1)))
+        {
+            return 1;
+        }
+
+        uring_submit(ring, 100000, 1);
+    }
+
+    WIIUSE_WARNING("Requests of wiimote [id %i] did not finish.", e->wm->unid);
+    return 0;
+}
+
+/**
+ *	@brief Keep a multishot receive armed on the interrupt socket of a wiimote.
+ *
+ *	Nothing to do if it is armed already. \a ring has to be the ring
+ *	of the context of \a wm.
+ */
+void uring_arm(struct wiiuse_uring_t *ring, struct wiimote_t *wm)
+{
+    struct uring_wiimote_t *e = uring_find(ring, wm);
+    struct io_uring_sqe *sqe;
+
+    if (!e && !(e = uring_add(ring, wm)))
+    {
+        return;
+    }
+
+    if (e->armed)
+    {
+        return;
+    }
+
+    sqe = uring_sqe(ring);
+    if (!sqe)
+    {
+        return;
+    }
+
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = wm->in_sock;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_GROUP;
+    sqe->user_data = (uintptr_t)wm | URING_RECV;
+    uring_push(ring);
+
+    e->armed = 1;
+}
+
+/**
+ *	@brief Take a wiimote off its ring.
+ *
+ *	Cancels the receive, waits for its writes and drops whatever
+ *	was received but not read. Called before the sockets are closed
+ *	and before the wiimote_t goes away.
+ */
+void uring_forget(struct wiimote_t *wm)
+{
+    struct wiiuse_uring_t *ring = wm->ctx->uring;
+    struct uring_wiimote_t *e   = uring_entry(wm);
+    struct io_uring_sqe *sqe;
+    int i;
+
+    if (!e)
+    {
+        return;
+    }
+
+    if ((e->armed == 1) && (sqe = uring_sqe(ring)))
+    {
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->addr      = (uintptr_t)wm | URING_RECV;
+        sqe->user_data = URING_CANCEL;
+        uring_push(ring);
+    }
+
+    uring_settle(ring, e, 1);
+
+    /* writes that never went out are dropped, the others are left to the kernel */
+    for (i = e->first; i != -1; i = ring->write[i].next)
+    {
+        ring->write[i].busy = 0;
+        --ring->writes;
+        --ring->unsent;
+    }
+    for (i = 0; i < URING_ENTRIES; ++i)
+    {
+        if (ring->write[i].wm == wm)
+        {
+            ring->write[i].wm = NULL;
+        }
+    }
+
+    for (i = 0; i < ring->backlog_len; ++i)
+    {
+        if (ring->backlog[i].wm == wm)
+        {
+            if (ring->backlog[i].bid >= 0)
+            {
+                uring_recycle(ring, ring->backlog[i].bid);
+            }
+            ring->backlog[i].wm = NULL;
+            ++ring->backlog_read;
+        }
+    }
+
+    e->wm = NULL;
+    --ring->wiimotes_used;
+}
+
+/**
+ *	@brief Read the next report of a wiimote.
+ *
+ *	Same results as a non-blocking recv() on its interrupt socket.
+ */
+int uring_read(struct wiimote_t *wm, byte *buf, int len)
+{
+    struct wiiuse_uring_t *ring = wm->ctx->uring;
+    struct uring_wiimote_t *e   = uring_find(ring, wm);
+    struct uring_report_t *rpt  = NULL;
+    int rc;
+    int i;
+
+    /* a synchronous read, outside of wiiuse_os_poll() */
+    if (!e->queued)
+    {
+        uring_wait(ring, 0);
+    }
+
+    for (i = 0; (i < ring->backlog_len) && e->queued; ++i)
+    {
+        if (ring->backlog[i].wm == wm)
+        {
+            rpt = &ring->backlog[i];
+            break;
+        }
+    }
+
+    if (!rpt)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    rc = rpt->res;
+    if (rpt->bid >= 0)
+    {
+        if (rc > len)
+        {
+            rc = len;
+        }
+        memcpy(buf, ring->buf + rpt->bid * URING_BUFFER_SIZE, rc);
+        uring_recycle(ring, rpt->bid);
+    }
+
+    if (rc < 0)
+    {
+        errno = -rc;
+        rc    = -1;
+    }
+
+    rpt->wm = NULL;
+    ++ring->backlog_read;
+    --e->queued;
+
+    return rc;
+}
+
+/**
+ *	@brief Queue a report for the interrupt socket of a wiimote.
+ *
+ *	Goes out with the next wait, after the reports queued before it.
+ *	Failures show up as a disconnect then.
+ *
+ *	@return \a len, or what send() returned if the ring is full.
+ */
+int uring_write(struct wiimote_t *wm, byte *buf, int len)
+{
+    struct wiiuse_uring_t *ring = wm->ctx->uring;
+    struct uring_wiimote_t *e   = uring_find(ring, wm);
+    struct uring_write_t *w;
+    int i;
+
+    if (ring->writes == URING_ENTRIES)
+    {
+        uring_wait(ring, 1000);
+    }
+
+    for (i = 0; (i < URING_ENTRIES) && ring->write[i].busy; ++i)
+        ;
+
+    if (i == URING_ENTRIES)
+    {
+        /* sent directly, so not before what is still queued */
+        if (!uring_settle(ring, e, 0))
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        return send(wm->in_sock, buf, len, 0);
+    }
+
+    w = &ring->write[i];
+    memcpy(w->data, buf, len);
+    w->wm   = wm;
+    w->busy = 1;
+    w->len  = len;
+    w->next = -1;
+    ++ring->writes;
+    ++ring->unsent;
+
+    if (e->last == -1)
+    {
+        e->first = i;
+    } else
+    {
+        ring->write[e->last].next = i;
+    }
+    e->last = i;
+
+    return len;
+}
+
+#endif /* WIIUSE_IO_URING */
@@ -0,0 +1,55 @@
+/*
+ *	wiiuse
+ *
+ *	This file is part of wiiuse.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *	$Header$
+ *
+ */
+
+/**
+ *	@file
+ *	@brief io_uring transport for the BlueZ backend.
+ */
+
+#ifndef URING_H_INCLUDED
+#define URING_H_INCLUDED
+
+#include "wiiuse_internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @defgroup internal_uring Internal: io_uring Transport */
+/** @{ */
+struct wiiuse_uring_t *uring_attach(struct wiiuse_context_t *ctx);
+int uring_fd(struct wiiuse_uring_t *ring);
+void uring_destroy(struct wiiuse_context_t *ctx);
+int uring_active(struct wiimote_t *wm);
+int uring_queued(struct wiimote_t *wm);
+void uring_arm(struct wiiuse_uring_t *ring, struct wiimote_t *wm);
+void uring_forget(struct wiimote_t *wm);
+void uring_wait(struct wiiuse_uring_t *ring, unsigned long timeout_us);
+int uring_read(struct wiimote_t *wm, byte *buf, int len);
+int uring_write(struct wiimote_t *wm, byte *buf, int len);
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* URING_H_INCLUDED */
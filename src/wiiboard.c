@@ -32,10 +32,21 @@
  */
 
 #include "wiiboard.h"
+#include "fixed.h" /* for fixed_interpolate_board */
 #include "io.h"
 
+#include <math.h>   /* for sqrtf */
 #include <stdio.h>  /* for printf */
-#include <string.h> /* for memset */
+#include <string.h> /* for memset, memcpy */
+
+/* kg at the middle calibration point, twice that at the top one */
+#define WIIBOARD_MIDDLE_CALIB 17.0f
+
+/* below this total weight the center of pressure is undefined */
+#define WIIBOARD_MIN_COP_WEIGHT 1.0f
+
+/* weight of the newest block in the running center of pressure statistics */
+#define WIIBOARD_STABILITY_ALPHA 0.02f
 
 /**
  *	@brief Handle the handshake data from the wiiboard.
@@ -95,6 +106,8 @@ int wii_board_handshake(struct wiimote_t *wm, struct wii_board_t *wb, byte *data
     wb->ctl[2] = unbuffer_big_endian_uint16_t(&bufptr);
     wb->cbl[2] = unbuffer_big_endian_uint16_t(&bufptr);
 
+    wii_board_calc_gains(wb);
+
     wb->use_alternate_report = 0;
 
     /* handshake done */
@@ -117,7 +130,9 @@ void wii_board_disconnected(struct wii_board_t *wb) { memset(wb, 0, sizeof(struc
 
 static float do_interpolate(uint16_t raw, uint16_t cal[3])
 {
-#define WIIBOARD_MIDDLE_CALIB 17.0f
+#ifdef WIIUSE_FIXED_POINT
+    return FIXED_TO_FLOAT(fixed_interpolate_board(raw, cal));
+#else
     if (raw < cal[0])
     {
         return 0.0f;
@@ -132,6 +147,133 @@ static float do_interpolate(uint16_t raw, uint16_t cal[3])
     {
         return WIIBOARD_MIDDLE_CALIB * 2.0f;
     }
+#endif
+}
+
+/**
+ *	@brief Precompute the slope and intercept of one sensor.
+ */
+static void calc_gain(struct wii_board_gain_t *g, uint16_t cal[3])
+{
+    g->zero = cal[0];
+    g->knee = cal[1];
+    g->top  = cal[2];
+
+    g->slope[0]     = (cal[1] > cal[0]) ? WIIBOARD_MIDDLE_CALIB / (float)(cal[1] - cal[0]) : 0.0f;
+    g->intercept[0] = -(float)cal[0] * g->slope[0];
+    g->slope[1]     = (cal[2] > cal[1]) ? WIIBOARD_MIDDLE_CALIB / (float)(cal[2] - cal[1]) : 0.0f;
+    g->intercept[1] = WIIBOARD_MIDDLE_CALIB - (float)cal[1] * g->slope[1];
+}
+
+/**
+ *	@brief Precompute the sensor gains from the calibration.
+ *
+ *	@param wb		A pointer to a wii_board_t structure.
+ *
+ *	Must be called whenever the calibration values change.
+ */
+void wii_board_calc_gains(struct wii_board_t *wb)
+{
+    calc_gain(&wb->gain[0], wb->ctl);
+    calc_gain(&wb->gain[1], wb->ctr);
+    calc_gain(&wb->gain[2], wb->cbl);
+    calc_gain(&wb->gain[3], wb->cbr);
+}
+
+/**
+ *	@brief Same as do_interpolate() with the precomputed gains.
+ */
+static float gain_to_kg(const struct wii_board_gain_t *g, uint16_t raw)
+{
+    int seg;
+
+    if (raw < g->zero)
+    {
+        return 0.0f;
+    } else if (raw >= g->top)
+    {
+        return WIIBOARD_MIDDLE_CALIB * 2.0f;
+    }
+
+    seg = (raw >= g->knee);
+    return (float)raw * g->slope[seg] + g->intercept[seg];
+}
+
+/**
+ *	@brief 1 / v for v > 0, without a divide.
+ *
+ *	A bit level first guess refined by three Newton-Raphson
+ *	steps, which is as close as float allows.
+ */
+static float reciprocal(float v)
+{
+    uint32_t i;
+    float r;
+
+    memcpy(&i, &v, sizeof(i));
+    i = 0x7EF311C3u - i;
+    memcpy(&r, &i, sizeof(r));
+
+    r = r * (2.0f - v * r);
+    r = r * (2.0f - v * r);
+    r = r * (2.0f - v * r);
+
+    return r;
+}
+
+/**
+ *	@brief Feed the corner weights of one report to the center of pressure pipeline.
+ *
+ *	@param wb		A pointer to a wii_board_t structure.
+ *
+ *	Reports are averaged in blocks of cop_decimation. At the end
+ *	of a block the total weight, the center of pressure and the
+ *	stability index are updated and cop_ready is set.
+ */
+static void update_cop(struct wii_board_t *wb)
+{
+    float tl, tr, bl, br, inv, dx, dy;
+
+    wb->cop_sum[0] += wb->tl;
+    wb->cop_sum[1] += wb->tr;
+    wb->cop_sum[2] += wb->bl;
+    wb->cop_sum[3] += wb->br;
+
+    wb->cop_ready = (++wb->cop_count >= wb->cop_decimation);
+    if (!wb->cop_ready)
+    {
+        return;
+    }
+
+    tl = wb->cop_sum[0] * wb->cop_inv_n;
+    tr = wb->cop_sum[1] * wb->cop_inv_n;
+    bl = wb->cop_sum[2] * wb->cop_inv_n;
+    br = wb->cop_sum[3] * wb->cop_inv_n;
+
+    memset(wb->cop_sum, 0, sizeof(wb->cop_sum));
+    wb->cop_count = 0;
+
+    wb->total = tl + tr + bl + br;
+    if (wb->total < WIIBOARD_MIN_COP_WEIGHT)
+    {
+        /* nobody on the board */
+        wb->cop_x = 0.0f;
+        wb->cop_y = 0.0f;
+        return;
+    }
+
+    inv       = reciprocal(wb->total);
+    wb->cop_x = ((tr + br) - (tl + bl)) * inv;
+    wb->cop_y = ((tl + tr) - (bl + br)) * inv;
+
+    /* exponentially weighted variance of the sway */
+    dx             = wb->cop_x - wb->cop_mean_x;
+    dy             = wb->cop_y - wb->cop_mean_y;
+    wb->cop_mean_x += WIIBOARD_STABILITY_ALPHA * dx;
+    wb->cop_mean_y += WIIBOARD_STABILITY_ALPHA * dy;
+    wb->cop_var_x  = (1.0f - WIIBOARD_STABILITY_ALPHA) * (wb->cop_var_x + WIIBOARD_STABILITY_ALPHA * dx * dx);
+    wb->cop_var_y  = (1.0f - WIIBOARD_STABILITY_ALPHA) * (wb->cop_var_y + WIIBOARD_STABILITY_ALPHA * dy * dy);
+    wb->stability  = sqrtf(wb->cop_var_x + wb->cop_var_y);
 }
 
 /**
@@ -149,6 +291,18 @@ void wii_board_event(struct wii_board_t *wb, byte *msg)
     wb->rtl = unbuffer_big_endian_uint16_t(&bufPtr);
     wb->rbl = unbuffer_big_endian_uint16_t(&bufPtr);
 
+    if (wb->cop_enabled)
+    {
+        /* fast path, no divides */
+        wb->tl = gain_to_kg(&wb->gain[0], wb->rtl);
+        wb->tr = gain_to_kg(&wb->gain[1], wb->rtr);
+        wb->bl = gain_to_kg(&wb->gain[2], wb->rbl);
+        wb->br = gain_to_kg(&wb->gain[3], wb->rbr);
+
+        update_cop(wb);
+        return;
+    }
+
     /*
             Interpolate values
             Calculations borrowed from wiili.org - No names to mention sadly :(
@@ -171,6 +325,9 @@ void wiiuse_set_wii_board_calib(struct wiimote_t *wm)
     uint16_t test = 1;
     memset(pkt, 0, sizeof(pkt));
 
+    /* the reports are decoded with these values, whether the board takes them or not */
+    wii_board_calc_gains(&wm->exp.wb);
+
     /*
      * address in big endian first, the leading byte will
      * be overwritten (only 3 bytes are sent)
@@ -203,3 +360,54 @@ void wiiuse_set_wii_board_calib(struct wiimote_t *wm)
     wiiuse_send(wm, WM_CMD_WRITE_DATA, pkt, sizeof(pkt));
     wiiuse_millisleep(100);
 }
+
+/**
+ *	@brief Track the total weight and center of pressure on a Balance Board.
+ *
+ *	@param wm			Pointer to a wiimote_t structure.
+ *	@param decimation	Number of reports averaged into each result, 1 for
+ *						every report, 0 to turn tracking off.
+ *
+ *	@return 1 on success, 0 if no Balance Board is connected.
+ *
+ *	While on, every report updates tl, tr, bl and br from gains
+ *	precomputed from the calibration, and every \a decimation
+ *	reports the averaged total, cop_x, cop_y and stability are
+ *	updated and cop_ready is set. Call it after the board is
+ *	connected, the handshake resets it.
+ */
+int wiiuse_set_wii_board_cop(struct wiimote_t *wm, int decimation)
+{
+    struct wii_board_t *wb;
+
+    if (!wm)
+    {
+        return 0;
+    }
+
+    if (wm->exp.type != EXP_WII_BOARD)
+    {
+        WIIUSE_CTX_WARNING(wm->ctx, "Center of pressure can only be tracked on a Balance Board.");
+        return 0;
+    }
+
+    wb              = &wm->exp.wb;
+    wb->cop_enabled = (decimation > 0);
+    wb->cop_count   = 0;
+    wb->cop_ready   = 0;
+    wb->cop_mean_x  = 0.0f;
+    wb->cop_mean_y  = 0.0f;
+    wb->cop_var_x   = 0.0f;
+    wb->cop_var_y   = 0.0f;
+    wb->stability   = 0.0f;
+    memset(wb->cop_sum, 0, sizeof(wb->cop_sum));
+
+    if (wb->cop_enabled)
+    {
+        wb->cop_decimation = decimation;
+        wb->cop_inv_n      = 1.0f / (float)decimation;
+        wii_board_calc_gains(wb);
+    }
+
+    return 1;
+}
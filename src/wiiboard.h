@@ -47,6 +47,10 @@ int wii_board_handshake(struct wiimote_t *wm, struct wii_board_t *wb, byte *data
 void wii_board_disconnected(struct wii_board_t *wb);
 
 void wii_board_event(struct wii_board_t *wb, byte *msg);
+
+void wii_board_calc_gains(struct wii_board_t *wb);
+
+void wii_board_ring_push(struct wii_board_ring_t *ring, const struct wii_board_t *wb, unsigned long ts);
 /** @} */
 #ifdef __cplusplus
 }
@@ -36,14 +36,15 @@
  */
 
 #include "io.h" /* for wiiuse_handshake, etc */
-#include "os.h" /* for wiiuse_os_* */
+#include "loop.h"      /* for loop_destroy */
+#include "os.h"        /* for wiiuse_os_* */
+#include "reconnect.h" /* for reconnect_remember */
 #include "wiiuse_internal.h"
 
 #include <stdio.h>  /* for printf, FILE */
 #include <stdlib.h> /* for malloc, free */
 #include <string.h> /* for memcpy, memset */
 
-static int g_banner                         = 0;
 static const char g_wiiuse_version_string[] = WIIUSE_VERSION;
 
 /**
@@ -51,11 +52,6 @@ static const char g_wiiuse_version_string[] = WIIUSE_VERSION;
  */
 const char *wiiuse_version() { return g_wiiuse_version_string; }
 
-/**
- *	@brief Output FILE stream for each wiiuse_loglevel.
- */
-FILE *logtarget[4];
-
 /**
  *	@brief Specify an alternate FILE stream for a log level.
  *
@@ -65,30 +61,47 @@ FILE *logtarget[4];
  *
  *  The default <code>FILE*</code> for all loglevels is <code>stderr</code>
  */
-void wiiuse_set_output(enum wiiuse_loglevel loglevel, FILE *logfile) { logtarget[(int)loglevel] = logfile; }
+void wiiuse_set_output(enum wiiuse_loglevel loglevel, FILE *logfile)
+{
+    wiiuse_context_set_output(NULL, loglevel, logfile);
+}
 
 /**
  *	@brief Clean up wiimote_t array created by wiiuse_init()
  */
 void wiiuse_cleanup(struct wiimote_t **wm, int wiimotes)
 {
+    struct wiiuse_context_t *ctx;
     int i = 0;
 
     if (!wm)
     {
         return;
     }
+    ctx = (wiimotes > 0) ? wm[0]->ctx : NULL;
 
     WIIUSE_INFO("wiiuse clean up...");
 
+    /* discovery and incoming connections fill this array, stop them first */
+    if (ctx)
+    {
+        wiiuse_set_background_discovery(ctx, 0);
+        wiiuse_set_accept_incoming(ctx, 0);
+
+        /* it watches this array */
+        loop_destroy(ctx);
+    }
+
     for (; i < wiimotes; ++i)
     {
         wiiuse_disconnect(wm[i]);
         wiiuse_cleanup_platform_fields(wm[i]);
-        free(wm[i]);
+        wiiuse_set_sample_store(wm[i], 0);
+        wiiuse_set_wii_board_ring(wm[i], 0);
+        wiiuse_ctx_free(wm[i]->ctx, wm[i]);
     }
 
-    free(wm);
+    wiiuse_ctx_free(ctx, wm);
 
     return;
 }
@@ -103,50 +116,94 @@ void wiiuse_cleanup(struct wiimote_t **wm, int wiimotes)
  *	@see wiiuse_connect()
  *
  *	The array returned by this function can be passed to various
- *	functions, including wiiuse_connect().
+ *	functions, including wiiuse_connect(). The wiimotes belong to
+ *	the default context, whose log levels are all reset to stderr.
  */
 struct wiimote_t **wiiuse_init(int wiimotes)
+{
+    struct wiiuse_context_t *ctx = wiiuse_default_context();
+
+    ctx->logtarget[0] = stderr;
+    ctx->logtarget[1] = stderr;
+    ctx->logtarget[2] = stderr;
+    ctx->logtarget[3] = stderr;
+
+    return wiiuse_context_init(ctx, wiimotes);
+}
+
+/**
+ *	@brief Initialize an array of wiimote structures in a context.
+ *
+ *	@param ctx			The context from wiiuse_context_create(), or NULL
+ *						for the default one.
+ *	@param wiimotes		Number of wiimote_t structures to create.
+ *
+ *	@return An array of initialized wiimote_t structures, NULL if
+ *			the allocator of \a ctx runs out of memory.
+ *
+ *	Same as wiiuse_init(), except that the wiimotes use the log
+ *	targets, allocator and statistics of \a ctx.
+ */
+struct wiimote_t **wiiuse_context_init(struct wiiuse_context_t *ctx, int wiimotes)
 {
     int i                 = 0;
     struct wiimote_t **wm = NULL;
 
+    if (!ctx)
+    {
+        ctx = wiiuse_default_context();
+    }
+
     /*
      *	Please do not remove this banner.
      *	GPL asks that you please leave output credits intact.
      *	Thank you.
      *
-     *	This banner is only displayed once so that if you need
-     *	to call this function again it won't be intrusive.
+     *	This banner is only displayed once per context so that if
+     *	you need to call this function again it won't be intrusive.
      *
      *	2018: Replaced wiiuse.net with sourceforge project, since
      *	wiiuse.net is now abandoned and "parked".
      */
-    if (!g_banner)
+    if (!ctx->banner)
     {
         printf("wiiuse v" WIIUSE_VERSION " loaded.\n"
                "  De-facto official fork at http://github.com/wiiuse/wiiuse\n"
                "  Original By: Michael Laforest <thepara[at]gmail{dot}com> <https://sourceforge.net/projects/wiiuse/>\n");
-        g_banner = 1;
+        ctx->banner = 1;
     }
 
-    logtarget[0] = stderr;
-    logtarget[1] = stderr;
-    logtarget[2] = stderr;
-    logtarget[3] = stderr;
-
     if (!wiimotes || wiimotes < 0)
     {
         return NULL;
     }
 
-    wm = (struct wiimote_t **)calloc((size_t)wiimotes, sizeof(struct wiimote_t *));
+    wm = (struct wiimote_t **)wiiuse_ctx_malloc(ctx, (size_t)wiimotes * sizeof(struct wiimote_t *));
+    if (!wm)
+    {
+        WIIUSE_CTX_ERROR(ctx, "Out of memory for %i wiimotes.", wiimotes);
+        return NULL;
+    }
+    memset(wm, 0, (size_t)wiimotes * sizeof(struct wiimote_t *));
 
     for (i = 0; i < wiimotes; ++i)
     {
-        wm[i] = (struct wiimote_t *)malloc(sizeof(struct wiimote_t));
+        wm[i] = (struct wiimote_t *)wiiuse_ctx_malloc(ctx, sizeof(struct wiimote_t));
+        if (!wm[i])
+        {
+            WIIUSE_CTX_ERROR(ctx, "Out of memory for %i wiimotes.", wiimotes);
+            while (i--)
+            {
+                wiiuse_ctx_free(ctx, wm[i]);
+            }
+            wiiuse_ctx_free(ctx, wm);
+            return NULL;
+        }
         memset(wm[i], 0, sizeof(struct wiimote_t));
 
-        wm[i]->unid = i + 1;
+        wm[i]->ctx     = ctx;
+        wm[i]->unid    = i + 1;
+        wm[i]->adapter = -1;
         wiiuse_init_platform_fields(wm[i]);
 
         wm[i]->state = WIIMOTE_INIT_STATES;
@@ -164,6 +221,8 @@ struct wiimote_t **wiiuse_init(int wiimotes)
         wm[i]->accel_threshold  = 5;
 
         wm[i]->accel_calib.st_alpha = WIIUSE_DEFAULT_SMOOTH_ALPHA;
+        wm[i]->euro_min_cutoff      = WIIUSE_DEFAULT_EURO_MIN_CUTOFF;
+        wm[i]->euro_beta            = WIIUSE_DEFAULT_EURO_BETA;
 
         wm[i]->type = WIIUSE_WIIMOTE_REGULAR;
     }
@@ -183,7 +242,10 @@ void wiiuse_disconnected(struct wiimote_t *wm)
         return;
     }
 
-    WIIUSE_INFO("Wiimote disconnected [id %i].", wm->unid);
+    WIIUSE_CTX_INFO(wm->ctx, "Wiimote disconnected [id %i].", wm->unid);
+
+    /* save what the reconnect supervisor has to put back */
+    reconnect_remember(wm);
 
     /* disable the connected flag */
     WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_CONNECTED);
@@ -198,6 +260,7 @@ void wiiuse_disconnected(struct wiimote_t *wm)
     wm->btns          = 0;
     wm->btns_held     = 0;
     wm->btns_released = 0;
+    reconnect_keep_slot(wm);
 
     wm->event = WIIUSE_DISCONNECT;
 }
@@ -222,12 +285,12 @@ void wiiuse_rumble(struct wiimote_t *wm, int status)
 
     if (status)
     {
-        WIIUSE_DEBUG("Starting rumble...");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Starting rumble...");
         WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_RUMBLE);
         buf |= 0x01;
     } else
     {
-        WIIUSE_DEBUG("Stopping rumble...");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Stopping rumble...");
         WIIMOTE_DISABLE_STATE(wm, WIIMOTE_STATE_RUMBLE);
         buf &= ~(0x01);
     }
@@ -348,7 +411,11 @@ int wiiuse_set_report_type(struct wiimote_t *wm)
     ir            = WIIMOTE_IS_SET(wm, WIIMOTE_STATE_IR);
     balance_board = exp && (wm->exp.type == EXP_WII_BOARD);
 
-    if (motion && ir && exp)
+    if (ir && WIIMOTE_IS_FLAG_SET(wm, WIIUSE_IR_FULL))
+    {
+        /* the wiimote alternates between 0x3e and 0x3f */
+        buf[1] = WM_RPT_INTERLEAVED_1;
+    } else if (motion && ir && exp)
     {
         buf[1] = WM_RPT_BTN_ACC_IR_EXP;
     } else if (motion && exp)
@@ -380,7 +447,7 @@ int wiiuse_set_report_type(struct wiimote_t *wm)
         buf[1] = WM_RPT_BTN;
     }
 
-    WIIUSE_DEBUG("Setting report type: 0x%x", buf[1]);
+    WIIUSE_CTX_DEBUG(wm->ctx, "Setting report type: 0x%x", buf[1]);
 
     exp = wiiuse_send(wm, WM_CMD_REPORT_TYPE, buf, 2);
     if (exp <= 0)
@@ -423,7 +490,7 @@ int wiiuse_read_data_cb(struct wiimote_t *wm, wiiuse_read_cb read_cb, byte *buff
     }
 
     /* make this request structure */
-    req = (struct read_req_t *)malloc(sizeof(struct read_req_t));
+    req = (struct read_req_t *)wiiuse_ctx_malloc(wm->ctx, sizeof(struct read_req_t));
     if (req == NULL)
     {
         return 0;
@@ -442,7 +509,7 @@ int wiiuse_read_data_cb(struct wiimote_t *wm, wiiuse_read_cb read_cb, byte *buff
         /* root node */
         wm->read_req = req;
 
-        WIIUSE_DEBUG("Data read request can be sent out immediately.");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Data read request can be sent out immediately.");
 
         /* send the request out immediately */
         wiiuse_send_next_pending_read_request(wm);
@@ -455,7 +522,7 @@ int wiiuse_read_data_cb(struct wiimote_t *wm, wiiuse_read_cb read_cb, byte *buff
         }
         nptr->next = req;
 
-        WIIUSE_DEBUG("Added pending data read request.");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Added pending data read request.");
     }
 
     return 1;
@@ -522,7 +589,7 @@ void wiiuse_send_next_pending_read_request(struct wiimote_t *wm)
     /* the length is in big endian */
     to_big_endian_uint16_t(buf + 4, req->size);
 
-    WIIUSE_DEBUG("Request read at address: 0x%x  length: %i", req->addr, req->size);
+    WIIUSE_CTX_DEBUG(wm->ctx, "Request read at address: 0x%x  length: %i", req->addr, req->size);
     wiiuse_send(wm, WM_CMD_READ_DATA, buf, 6);
 }
 
@@ -542,7 +609,7 @@ void wiiuse_status(struct wiimote_t *wm)
         return;
     }
 
-    WIIUSE_DEBUG("Requested wiimote status.");
+    WIIUSE_CTX_DEBUG(wm->ctx, "Requested wiimote status.");
 
     wiiuse_send(wm, WM_CMD_CTRL_STATUS, &buf, 1);
 }
@@ -594,21 +661,21 @@ int wiiuse_write_data(struct wiimote_t *wm, unsigned int addr, const byte *data,
     byte *bufPtr = buf;
     if (!wm || !WIIMOTE_IS_CONNECTED(wm))
     {
-        WIIUSE_ERROR("Attempt to write, but no wiimote available or not connected!");
+        WIIUSE_CTX_ERROR(wm ? wm->ctx : NULL, "Attempt to write, but no wiimote available or not connected!");
         return 0;
     }
     if (!data || !len)
     {
-        WIIUSE_ERROR("Attempt to write, but no data or length == 0");
+        WIIUSE_CTX_ERROR(wm->ctx, "Attempt to write, but no data or length == 0");
         return 0;
     }
     if (len > 16)
     {
-        WIIUSE_ERROR("Attempt to write more than 16 bytes at once (len=%d)", len);
+        WIIUSE_CTX_ERROR(wm->ctx, "Attempt to write more than 16 bytes at once (len=%d)", len);
         return 0;
     }
 
-    WIIUSE_DEBUG("Writing %i bytes to memory location 0x%x...", len, addr);
+    WIIUSE_CTX_DEBUG(wm->ctx, "Writing %i bytes to memory location 0x%x...", len, addr);
 
 #ifdef WITH_WIIUSE_DEBUG
     {
@@ -665,7 +732,11 @@ int wiiuse_write_data_cb(struct wiimote_t *wm, unsigned int addr, byte *data, by
         return 0;
     }
 
-    req      = (struct data_req_t *)malloc(sizeof(struct data_req_t));
+    req = (struct data_req_t *)wiiuse_ctx_malloc(wm->ctx, sizeof(struct data_req_t));
+    if (req == NULL)
+    {
+        return 0;
+    }
     req->cb  = write_cb;
     req->len = (len > 16) ? 16 : len;
     memcpy(req->data, data, req->len);
@@ -678,21 +749,21 @@ int wiiuse_write_data_cb(struct wiimote_t *wm, unsigned int addr, byte *data, by
         /* root node */
         wm->data_req = req;
 
-        WIIUSE_DEBUG("Data write request can be sent out immediately.");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Data write request can be sent out immediately.");
 
         /* send the request out immediately */
         wiiuse_send_next_pending_write_request(wm);
     } else
     {
         struct data_req_t *nptr = wm->data_req;
-        WIIUSE_DEBUG("chaud2fois");
+        WIIUSE_CTX_DEBUG(wm->ctx, "chaud2fois");
         for (; nptr->next; nptr = nptr->next)
         {
             ;
         }
         nptr->next = req;
 
-        WIIUSE_DEBUG("Added pending data write request.");
+        WIIUSE_CTX_DEBUG(wm->ctx, "Added pending data write request.");
     }
 
     return 1;
@@ -844,6 +915,31 @@ float wiiuse_set_smooth_alpha(struct wiimote_t *wm, float alpha)
     return old;
 }
 
+/**
+ *	@brief	Set the parameters of the One Euro filter.
+ *
+ *	@param wm			Pointer to a wiimote_t structure.
+ *	@param min_cutoff	Cutoff frequency at rest, in Hz. Lower values remove more jitter.
+ *	@param beta			How fast the cutoff rises with speed, per full range
+ *						per second. Higher values reduce lag during fast motion.
+ *
+ *	The One Euro filter replaces the exponential smoothing when both
+ *	WIIUSE_SMOOTHING and WIIUSE_ONE_EURO are set. It is then applied to
+ *	the orientation and gforce of the wiimote and nunchuk, the IR cursor
+ *	and all expansion joysticks. wiiuse_set_smooth_alpha() keeps
+ *	controlling the exponential smoothing.
+ */
+void wiiuse_set_one_euro(struct wiimote_t *wm, float min_cutoff, float beta)
+{
+    if (!wm)
+    {
+        return;
+    }
+
+    wm->euro_min_cutoff = min_cutoff;
+    wm->euro_beta       = beta;
+}
+
 /**
  *	@brief	Set the bluetooth stack type to use.
  *
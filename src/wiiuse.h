@@ -148,6 +148,8 @@
 #define WIIMOTE_STATE_EXP_EXTERN         0x20000    /* actual M+ connection exists but handshake failed */
 #define WIIMOTE_STATE_EXP_FAILED         0x40000    /* actual M+ connection exists but handshake failed */
 #define WIIMOTE_STATE_MPLUS_PRESENT      0x80000 /* Motion+ is connected */
+#define WIIMOTE_STATE_DEV_SEEN           0x100000 /* found by background discovery, not connected yet */
+#define WIIMOTE_STATE_CONNECTING         0x200000 /* L2CAP channels being opened, not connected yet */
 
 #define WIIMOTE_ID(wm) (wm->unid)
 
@@ -240,6 +242,9 @@
 #define WIIUSE_SMOOTHING     0x01
 #define WIIUSE_CONTINUOUS    0x02
 #define WIIUSE_ORIENT_THRESH 0x04
+#define WIIUSE_FAST_ORIENT   0x08
+#define WIIUSE_IR_FULL       0x10
+#define WIIUSE_ONE_EURO      0x20
 #define WIIUSE_INIT_FLAGS (WIIUSE_SMOOTHING | WIIUSE_ORIENT_THRESH)
 
 #define WIIUSE_ORIENT_PRECISION 100.0f
@@ -347,6 +352,9 @@ struct wiimote_t;
 struct vec3b_t;
 struct orient_t;
 struct gforce_t;
+struct wii_board_ring_t;
+struct wiiuse_context_t;
+struct wiiuse_poller_t;
 
 /**
  *      @brief Callback that handles a read event.
@@ -398,6 +406,15 @@ typedef struct ang3f_t
     float roll, pitch, yaw;
 } ang3f_t;
 
+/**
+ *  @struct quat_t
+ *  @brief Orientation quaternion.
+ */
+typedef struct quat_t
+{
+    float w, x, y, z;
+} quat_t;
+
 /**
  *	@brief Unsigned x,y byte vector.
  */
@@ -445,17 +462,32 @@ typedef struct gforce_t
     float x, y, z;
 } gforce_t;
 
+/**
+ *	@brief State of a One Euro filter on a single axis.
+ */
+typedef struct one_euro_t
+{
+    float x;    /**< last filtered value					*/
+    float dx;   /**< last filtered rate of change			*/
+    int primed; /**< 0 until the first sample has been seen	*/
+} one_euro_t;
+
 /**
  *	@brief Accelerometer struct. For any device with an accelerometer.
  */
 typedef struct accel_t
 {
-    struct vec3b_t cal_zero; /**< zero calibration					*/
-    struct vec3b_t cal_g;    /**< 1g difference around 0cal			*/
+    struct vec3b_t cal_zero;  /**< zero calibration					*/
+    struct vec3b_t cal_g;     /**< 1g difference around 0cal			*/
+    struct vec3f_t cal_g_inv; /**< 1 / cal_g, used by WIIUSE_FAST_ORIENT	*/
 
     float st_roll;  /**< last smoothed roll value			*/
     float st_pitch; /**< last smoothed roll pitch			*/
     float st_alpha; /**< alpha value for smoothing [0-1]	*/
+
+    struct one_euro_t euro_roll;      /**< One Euro state of the roll angle		*/
+    struct one_euro_t euro_pitch;     /**< One Euro state of the pitch angle		*/
+    struct one_euro_t euro_gforce[3]; /**< One Euro state of the gforce axes	*/
 } accel_t;
 
 /**
@@ -474,8 +506,57 @@ typedef struct ir_dot_t
     byte order; /**< increasing order by x-axis value	*/
 
     byte size; /**< size of the IR dot (0-15)			*/
+
+    struct vec2b_t box_min; /**< bounding box corner as reported by the camera (0-127), full IR mode only */
+    struct vec2b_t box_max; /**< opposite bounding box corner, full IR mode only */
+    byte intensity;         /**< brightness of the IR dot, full IR mode only */
+
+    unsigned int id; /**< stable id of the source across frames, 0 if IR tracking is off */
 } ir_dot_t;
 
+/**
+ *	@brief A single IR source followed by the IR tracker.
+ *
+ *	Positions and velocities are in raw camera coordinates.
+ */
+typedef struct ir_track_t
+{
+    unsigned int id;     /**< stable id, 0 if the slot is free		*/
+    int dot;             /**< index into ir_t.dot, -1 if not seen this frame */
+    float x, y;          /**< filtered position					*/
+    float vx, vy;        /**< velocity in camera pixels per second	*/
+    unsigned int age;    /**< frames since the source was first seen */
+    unsigned int missed; /**< consecutive frames without a match	*/
+} ir_track_t;
+
+/**
+ *	@brief IR tracker state, see wiiuse_set_ir_tracking().
+ */
+typedef struct ir_tracker_t
+{
+    int enabled;                 /**< 1 if dots are tracked across frames	*/
+    struct ir_track_t track[4];  /**< tracked sources, in no particular order */
+    unsigned int next_id;        /**< last id handed out				*/
+    unsigned long ts;            /**< time of the last update, in milliseconds */
+} ir_tracker_t;
+
+/**
+ *	@brief IR cursor predictor state, see wiiuse_set_ir_prediction().
+ *
+ *	Positions are in virtual screen units, the same as ir_t::x and ir_t::y.
+ */
+typedef struct ir_predict_t
+{
+    int enabled;             /**< 1 if the cursor is being filtered		*/
+    int valid;               /**< 1 once a cursor position has been seen	*/
+    float x, y;              /**< filtered cursor position at \a ts		*/
+    float vx, vy;            /**< cursor velocity in units per second		*/
+    unsigned long ts;        /**< time of the last report, in milliseconds	*/
+    unsigned long horizon;   /**< lead of the last wiiuse_predict_ir() call, in milliseconds */
+    float error;             /**< distance between the last report and its one-report-ahead prediction */
+    float rms_error;         /**< running RMS of \a error				*/
+} ir_predict_t;
+
 /**
  *	@brief Screen aspect ratio.
  */
@@ -505,8 +586,40 @@ typedef struct ir_t
 
     float distance; /**< pixel distance between first 2 dots*/
     float z;        /**< calculated distance				*/
+
+    unsigned long lost_halves; /**< interleaved full mode reports dropped for a missing half */
+
+    struct ir_tracker_t tracker; /**< dot identity tracking, off by default */
+    struct ir_predict_t predict; /**< cursor prediction, off by default */
+
+    struct one_euro_t euro_x; /**< One Euro state of the cursor X coordinate */
+    struct one_euro_t euro_y; /**< One Euro state of the cursor Y coordinate */
+
+    /* first half of an interleaved full mode report, internal */
+    struct ir_dot_t half_dot[2];
+    byte half_accel[2];
+    byte half_pending;
+
+    /* sin/cos of the last roll correction, internal */
+    float roll_ang;
+    float roll_sin;
+    float roll_cos;
 } ir_t;
 
+/**
+ *	@brief Structure-of-arrays IR dot buffer, filled by wiiuse_decode_ir_batch().
+ *
+ *	All arrays are allocated by the caller and hold 4 entries per
+ *	decoded report. Dot d of report n is at index (n * 4 + d).
+ */
+typedef struct ir_dot_batch_t
+{
+    int16_t *rx;   /**< raw X coordinates (0-1023)			*/
+    int16_t *ry;   /**< raw Y coordinates (0-767)			*/
+    byte *size;    /**< dot sizes (0-15), 0 in basic mode	*/
+    byte *visible; /**< 1 if the IR source is visible		*/
+} ir_dot_batch_t;
+
 /**
  *	@brief Joystick calibration structure.
  *
@@ -531,6 +644,9 @@ typedef struct joystick_t
     float mag; /**< magnitude of the joystick (range 0-1)	*/
     float x;   /**< horizontal position of the joystick (range [-1, 1]	*/
     float y;   /**< vertical position of the joystick (range [-1, 1]	*/
+
+    struct one_euro_t euro_x; /**< One Euro state of the horizontal axis	*/
+    struct one_euro_t euro_y; /**< One Euro state of the vertical axis	*/
 } joystick_t;
 
 /**
@@ -585,6 +701,31 @@ typedef struct guitar_hero_3_t
     struct joystick_t js; /**< joystick calibration					*/
 } guitar_hero_3_t;
 
+/** Number of gyro frames the Motion Plus bias tracker looks at */
+#define WIIUSE_GYRO_BIAS_WINDOW 64
+
+/**
+ *	@brief Motion Plus gyro bias tracker.
+ *
+ *	Refines the gyro zero point whenever the device is held still.
+ */
+typedef struct gyro_bias_t
+{
+    int enabled;         /**< 1 to keep refining the bias, 0 to keep the first calibration */
+    int still;           /**< 1 if the device is still over the whole window */
+    struct ang3f_t bias; /**< estimated zero rate, in raw gyro units */
+    float confidence;    /**< 0 for the first sample guess, approaches 1 after long still periods */
+
+    /* sliding window, internal */
+    int16_t win_gyro[WIIUSE_GYRO_BIAS_WINDOW][3];
+    int16_t win_accel[WIIUSE_GYRO_BIAS_WINDOW];
+    int32_t sum_gyro[3];
+    int64_t sum_sq_gyro[3];
+    int32_t sum_accel;
+    int64_t sum_sq_accel;
+    int pos, fill;
+} gyro_bias_t;
+
 /**
  * 	@brief Motion Plus expansion device
  */
@@ -596,9 +737,13 @@ typedef struct motion_plus_t
     struct ang3s_t cal_gyro;        /**< calibration raw gyroscope data */
     struct ang3f_t angle_rate_gyro; /**< current gyro angle rate */
     struct orient_t orient;         /**< current orientation on each axis using Motion Plus gyroscopes */
+    struct quat_t quat;             /**< current orientation as a quaternion, same source as orient */
+    float fusion_beta;              /**< how fast the accelerometer corrects gyro drift */
+    unsigned long fusion_ts;        /**< time of the last fused gyro frame, in milliseconds */
     byte acc_mode; /**< Fast/slow rotation mode for roll, pitch and yaw (0 if rotating fast, 1 if slow or
                       still) */
-    int raw_gyro_threshold; /**< threshold for gyroscopes to generate an event */
+    int raw_gyro_threshold;       /**< threshold for gyroscopes to generate an event */
+    struct gyro_bias_t gyro_bias; /**< running estimate of the gyro zero point */
 
     struct nunchuk_t *nc; /**< pointers to nunchuk & classic in pass-through-mode */
     struct classic_ctrl_t *classic;
@@ -612,6 +757,21 @@ typedef struct tatacon_t
     int8_t btns;          /**< what buttons have just been pressed	*/
 } tatacon_t;
 
+/**
+ *	@brief Linear map from a raw balance board reading to kg.
+ *
+ *	Readings below \a knee use the first segment, the others
+ *	the second one: kg = raw * slope + intercept.
+ */
+typedef struct wii_board_gain_t
+{
+    uint16_t zero;  /**< readings below this are 0 kg			*/
+    uint16_t knee;  /**< calibration point at 17 kg			*/
+    uint16_t top;   /**< readings from here on are 34 kg		*/
+    float slope[2];
+    float intercept[2];
+} wii_board_gain_t;
+
 /**
  *	@brief Wii Balance Board "expansion" device.
  *
@@ -651,8 +811,38 @@ typedef struct wii_board_t
     /** @} */
     uint8_t update_calib;
     uint8_t use_alternate_report;
+
+    /** @name Center of pressure, see wiiuse_set_wii_board_cop() */
+    /** @{ */
+    float total;     /**< total weight on the board (kg)						*/
+    float cop_x;     /**< center of pressure, -1 (left edge) to 1 (right edge)	*/
+    float cop_y;     /**< center of pressure, -1 (bottom edge) to 1 (top edge)	*/
+    float stability; /**< RMS distance of the center of pressure from its running mean, 0 if perfectly still */
+    int cop_ready;   /**< 1 if the last report completed a decimation block		*/
+    /** @} */
+
+    /* center of pressure pipeline, internal */
+    int cop_enabled;
+    int cop_decimation;
+    int cop_count;
+    float cop_inv_n;
+    float cop_sum[4];
+    float cop_mean_x, cop_mean_y;
+    float cop_var_x, cop_var_y;
+    struct wii_board_gain_t gain[4]; /* tl, tr, bl, br */
 } wii_board_t;
 
+/**
+ *	@brief One balance board report, as kept by wiiuse_set_wii_board_ring().
+ */
+typedef struct wii_board_sample_t
+{
+    unsigned long seq;       /**< report number, a gap marks dropped reports	*/
+    unsigned long timestamp; /**< time of decoding in milliseconds			*/
+    float tl, tr, bl, br;    /**< weight on each sensor (kg)				*/
+    uint16_t rtl, rtr, rbl, rbr; /**< raw sensor readings					*/
+} wii_board_sample_t;
+
 /**
  *	@brief Generic expansion device plugged into wiimote.
  */
@@ -715,6 +905,49 @@ typedef struct wiimote_state_t
     struct vec3b_t accel;
 } wiimote_state_t;
 
+/**
+ *	@brief Columnar store of decoded samples.
+ *
+ *	Enabled per wiimote with wiiuse_set_sample_store(). Each decoded
+ *	input report appends one entry to every column, so a window of
+ *	samples can be scanned field by field. Sample n of every column
+ *	belongs to the same report; IR dots use the ir_dot_batch_t layout
+ *	(4 entries per sample).
+ */
+typedef struct sample_store_t
+{
+    int capacity;          /**< samples each column can hold				*/
+    int count;             /**< samples stored in the current slice		*/
+    unsigned long dropped; /**< samples lost because the slice was full	*/
+
+    unsigned long *timestamp; /**< time of decoding in milliseconds			*/
+    uint16_t *btns;           /**< wiimote buttons pressed					*/
+
+    byte *accel_x; /**< raw acceleration								*/
+    byte *accel_y;
+    byte *accel_z;
+
+    float *gforce_x; /**< gravity forces								*/
+    float *gforce_y;
+    float *gforce_z;
+
+    float *roll; /**< orientation, as in wiimote_t.orient			*/
+    float *pitch;
+    float *yaw;
+
+    int *ir_x; /**< IR cursor position							*/
+    int *ir_y;
+    struct ir_dot_batch_t ir_dots; /**< raw IR dots, 4 per sample			*/
+
+    float *exp_ljs_x; /**< left (or only) expansion joystick			*/
+    float *exp_ljs_y;
+    float *exp_rjs_x; /**< right expansion joystick (classic only)		*/
+    float *exp_rjs_y;
+    uint16_t *exp_btns; /**< expansion buttons pressed					*/
+
+    void *block; /**< memory backing all columns (internal)		*/
+} sample_store_t;
+
 /**
  *	@brief Events that wiiuse can generate from a poll.
  */
@@ -738,7 +971,9 @@ typedef enum WIIUSE_EVENT_TYPE {
     WIIUSE_MOTION_PLUS_ACTIVATED,
     WIIUSE_MOTION_PLUS_REMOVED,
     WIIUSE_TATACON_CTRL_INSERTED,
-    WIIUSE_TATACON_CTRL_REMOVED
+    WIIUSE_TATACON_CTRL_REMOVED,
+    WIIUSE_FOUND,
+    WIIUSE_RECONNECT
 } WIIUSE_EVENT_TYPE;
 
 /**
@@ -749,6 +984,22 @@ typedef enum WIIUSE_WIIMOTE_TYPE {
     WIIUSE_WIIMOTE_MOTION_PLUS_INSIDE,
 } WIIUSE_WIIMOTE_TYPE;
 
+/**
+ *	@brief What wiiuse_set_reconnect() puts back after a dropout.
+ */
+typedef struct wiimote_restore_t
+{
+    int enabled; /**< 1 if the wiimote is supervised				*/
+    int pending; /**< set from the dropout until the state is back	*/
+
+    int state;       /**< IR, motion sensing and IR sensitivity state flags */
+    byte leds;       /**< lit leds									*/
+    int motion_plus; /**< mode for wiiuse_set_motion_plus(), 0 if off	*/
+
+    unsigned long delay; /**< current backoff, in milliseconds			*/
+    unsigned long next;  /**< ticks of the next connect attempt			*/
+} wiimote_restore_t;
+
 /**
  *	@brief Main Wiimote device structure.
  *
@@ -756,7 +1007,8 @@ typedef enum WIIUSE_WIIMOTE_TYPE {
  */
 typedef struct wiimote_t
 {
-    int unid; /**< user specified id						*/
+    int unid;    /**< user specified id						*/
+    int adapter; /**< local Bluetooth adapter the wiimote is connected through, -1 if none or unknown */
 
 #ifdef WIIUSE_BLUEZ
     /** @name Linux-specific (BlueZ) members */
@@ -768,6 +1020,15 @@ typedef struct wiimote_t
                                 /** @} */
 #endif
 
+#ifdef WIIUSE_HIDRAW
+    /** @name Members specific to the Linux hidraw backend */
+    /** @{ */
+    char bdaddr_str[18]; /**< readable bt address, as reported by the kernel	*/
+    char devnode[32];    /**< hidraw device node							*/
+    int fd;              /**< open hidraw node, -1 if none					*/
+    /** @} */
+#endif
+
 #ifdef WIIUSE_BT_EMBEDDED
     /** @name Members specific to the bt-embedded backend */
     /** @{ */
@@ -826,11 +1087,24 @@ typedef struct wiimote_t
     float orient_threshold;  /**< threshold for orient to generate an event */
     int32_t accel_threshold; /**< threshold for accel to generate an event */
 
+    float euro_min_cutoff; /**< One Euro cutoff frequency at rest, in Hz	*/
+    float euro_beta;       /**< One Euro cutoff increase with speed		*/
+    unsigned long euro_ts; /**< time of the last filtered report, in milliseconds */
+
+    unsigned long idle_next; /**< ticks of the next idle smoothing step		*/
+
     struct wiimote_state_t lstate; /**< last saved state						*/
 
     WIIUSE_EVENT_TYPE event; /**< type of event that occurred				*/
     byte motion_plus_id[6];
     WIIUSE_WIIMOTE_TYPE type;
+
+    struct sample_store_t *samples; /**< columnar sample store, NULL if disabled	*/
+    struct wii_board_ring_t *board_ring; /**< balance board sample ring, NULL if disabled */
+
+    struct wiimote_restore_t restore; /**< state put back by wiiuse_set_reconnect()	*/
+
+    struct wiiuse_context_t *ctx; /**< context the wiimote was created in		*/
 } wiimote;
 
 /** @brief Data passed to a callback during wiiuse_update() */
@@ -887,6 +1161,39 @@ struct data_req_t
     struct data_req_t *next;
 };
 
+/**
+ *	@brief Library context, see wiiuse_context_create().
+ *
+ *	Owns the log targets, allocator and statistics of the
+ *	wiimotes created in it. The layout is private.
+ */
+typedef struct wiiuse_context_t wiiuse_context;
+
+/** @brief Allocation function for wiiuse_context_set_allocator() */
+typedef void *(*wiiuse_malloc_cb)(size_t size);
+
+/** @brief Release function for wiiuse_context_set_allocator() */
+typedef void (*wiiuse_free_cb)(void *ptr);
+
+/**
+ *	@brief Statistics of a library context.
+ */
+typedef struct wiiuse_stats_t
+{
+    unsigned long reports; /**< input reports decoded				*/
+    unsigned long events;  /**< reports that raised WIIUSE_EVENT	*/
+} wiiuse_stats_t;
+
+/**
+ *	@brief How connections are spread over local Bluetooth adapters.
+ *
+ *	@see wiiuse_context_set_placement()
+ */
+typedef enum wiiuse_placement_t {
+    WIIUSE_PLACE_ROUND_ROBIN = 0, /**< each adapter in turn				*/
+    WIIUSE_PLACE_LEAST_LOADED     /**< adapter with the fewest wiimotes	*/
+} wiiuse_placement_t;
+
 /**
  *	@brief Loglevels supported by wiiuse.
  */
@@ -936,6 +1243,7 @@ WIIUSE_EXPORT extern const char *wiiuse_version();
 WIIUSE_EXPORT extern void wiiuse_set_output(enum wiiuse_loglevel loglevel, FILE *logtarget);
 
 WIIUSE_EXPORT extern struct wiimote_t **wiiuse_init(int wiimotes);
+WIIUSE_EXPORT extern struct wiimote_t **wiiuse_context_init(struct wiiuse_context_t *ctx, int wiimotes);
 WIIUSE_EXPORT extern void wiiuse_disconnected(struct wiimote_t *wm);
 WIIUSE_EXPORT extern void wiiuse_cleanup(struct wiimote_t **wm, int wiimotes);
 WIIUSE_EXPORT extern void wiiuse_rumble(struct wiimote_t *wm, int status);
@@ -950,6 +1258,7 @@ WIIUSE_EXPORT extern void wiiuse_status(struct wiimote_t *wm);
 WIIUSE_EXPORT extern struct wiimote_t *wiiuse_get_by_id(struct wiimote_t **wm, int wiimotes, int unid);
 WIIUSE_EXPORT extern int wiiuse_set_flags(struct wiimote_t *wm, int enable, int disable);
 WIIUSE_EXPORT extern float wiiuse_set_smooth_alpha(struct wiimote_t *wm, float alpha);
+WIIUSE_EXPORT extern void wiiuse_set_one_euro(struct wiimote_t *wm, float min_cutoff, float beta);
 WIIUSE_EXPORT extern void wiiuse_set_bluetooth_stack(struct wiimote_t **wm, int wiimotes,
                                                      enum win_bt_stack_t type);
 WIIUSE_EXPORT extern void wiiuse_set_orient_threshold(struct wiimote_t *wm, float threshold);
@@ -963,6 +1272,9 @@ WIIUSE_EXPORT extern void wiiuse_wiiboard_use_alternate_report(struct wiimote_t
 WIIUSE_EXPORT extern int wiiuse_find(struct wiimote_t **wm, int max_wiimotes, int timeout);
 WIIUSE_EXPORT extern int wiiuse_connect(struct wiimote_t **wm, int wiimotes);
 WIIUSE_EXPORT extern void wiiuse_disconnect(struct wiimote_t *wm);
+WIIUSE_EXPORT extern int wiiuse_set_background_discovery(struct wiiuse_context_t *ctx, int interval);
+WIIUSE_EXPORT extern int wiiuse_set_accept_incoming(struct wiiuse_context_t *ctx, int enable);
+WIIUSE_EXPORT extern int wiiuse_allow_incoming(struct wiiuse_context_t *ctx, const char *address);
 
 /* events.c */
 WIIUSE_EXPORT extern int wiiuse_poll(struct wiimote_t **wm, int wiimotes);
@@ -978,12 +1290,38 @@ WIIUSE_EXPORT extern int wiiuse_poll(struct wiimote_t **wm, int wiimotes);
  */
 WIIUSE_EXPORT extern int wiiuse_update(struct wiimote_t **wm, int wiimotes, wiiuse_update_cb callback);
 
+/* loop.c */
+WIIUSE_EXPORT extern int wiiuse_get_fd(struct wiimote_t **wm, int wiimotes);
+WIIUSE_EXPORT extern int wiiuse_get_timeout(struct wiimote_t **wm, int wiimotes);
+WIIUSE_EXPORT extern int wiiuse_poll_wait(struct wiimote_t **wm, int wiimotes, int timeout);
+WIIUSE_EXPORT extern void wiiuse_wakeup(struct wiiuse_context_t *ctx);
+
+/* dynamics.c */
+WIIUSE_EXPORT extern void wiiuse_calculate_gforce_batch(struct accel_t *ac, const struct vec3b_t *accel, int count,
+                                                        struct gforce_t *gforce);
+WIIUSE_EXPORT extern void wiiuse_calculate_orientation_batch(struct accel_t *ac, const struct vec3b_t *accel,
+                                                             int count, struct orient_t *orient, int smooth);
+
 /* ir.c */
 WIIUSE_EXPORT extern void wiiuse_set_ir(struct wiimote_t *wm, int status);
 WIIUSE_EXPORT extern void wiiuse_set_ir_vres(struct wiimote_t *wm, unsigned int x, unsigned int y);
 WIIUSE_EXPORT extern void wiiuse_set_ir_position(struct wiimote_t *wm, enum ir_position_t pos);
 WIIUSE_EXPORT extern void wiiuse_set_aspect_ratio(struct wiimote_t *wm, enum aspect_t aspect);
 WIIUSE_EXPORT extern void wiiuse_set_ir_sensitivity(struct wiimote_t *wm, int level);
+WIIUSE_EXPORT extern void wiiuse_set_ir_full(struct wiimote_t *wm, int status);
+WIIUSE_EXPORT extern void wiiuse_set_ir_prediction(struct wiimote_t *wm, int status);
+WIIUSE_EXPORT extern int wiiuse_predict_ir(struct wiimote_t *wm, int lead, int *x, int *y);
+
+/* ir_track.c */
+WIIUSE_EXPORT extern void wiiuse_set_ir_tracking(struct wiimote_t *wm, int status);
+
+/* samples.c */
+WIIUSE_EXPORT extern int wiiuse_set_sample_store(struct wiimote_t *wm, int capacity);
+WIIUSE_EXPORT extern void wiiuse_reset_sample_store(struct wiimote_t *wm);
+
+/* ir_batch.c */
+WIIUSE_EXPORT extern void wiiuse_decode_ir_batch(const byte *const *data, int count, int extended,
+                                                 struct ir_dot_batch_t *out);
 
 /* nunchuk.c */
 WIIUSE_EXPORT extern void wiiuse_set_nunchuk_orient_threshold(struct wiimote_t *wm, float threshold);
@@ -991,8 +1329,39 @@ WIIUSE_EXPORT extern void wiiuse_set_nunchuk_accel_threshold(struct wiimote_t *w
 
 /* wiiboard.c */
 WIIUSE_EXPORT extern void wiiuse_set_wii_board_calib(struct wiimote_t *wm);
+WIIUSE_EXPORT extern int wiiuse_set_wii_board_cop(struct wiimote_t *wm, int decimation);
+
+/* context.c */
+WIIUSE_EXPORT extern struct wiiuse_context_t *wiiuse_context_create();
+WIIUSE_EXPORT extern void wiiuse_context_destroy(struct wiiuse_context_t *ctx);
+WIIUSE_EXPORT extern void wiiuse_context_set_output(struct wiiuse_context_t *ctx, enum wiiuse_loglevel loglevel,
+                                                    FILE *logtarget);
+WIIUSE_EXPORT extern void wiiuse_context_set_allocator(struct wiiuse_context_t *ctx, wiiuse_malloc_cb malloc_cb,
+                                                       wiiuse_free_cb free_cb);
+WIIUSE_EXPORT extern void wiiuse_context_make_current(struct wiiuse_context_t *ctx);
+WIIUSE_EXPORT extern void wiiuse_context_set_placement(struct wiiuse_context_t *ctx,
+                                                       enum wiiuse_placement_t placement);
+WIIUSE_EXPORT extern void wiiuse_context_get_stats(struct wiiuse_context_t *ctx, struct wiiuse_stats_t *stats);
+
+/* poller.c */
+WIIUSE_EXPORT extern struct wiiuse_poller_t *wiiuse_poller_start(struct wiimote_t **wm, int wiimotes, int threads,
+                                                                 int queue, const int *cpus);
+WIIUSE_EXPORT extern void wiiuse_poller_stop(struct wiiuse_poller_t *p);
+WIIUSE_EXPORT extern int wiiuse_poller_read(struct wiiuse_poller_t *p, struct wiimote_callback_data_t *out, int max);
+WIIUSE_EXPORT extern unsigned long wiiuse_poller_overruns(struct wiiuse_poller_t *p);
+WIIUSE_EXPORT extern void wiiuse_poller_get_stats(struct wiiuse_poller_t *p, struct wiiuse_stats_t *stats);
+
+/* board_ring.c */
+WIIUSE_EXPORT extern int wiiuse_set_wii_board_ring(struct wiimote_t *wm, int capacity);
+WIIUSE_EXPORT extern int wiiuse_read_wii_board_ring(struct wiimote_t *wm, struct wii_board_sample_t *out, int max);
+WIIUSE_EXPORT extern unsigned long wiiuse_wii_board_ring_overruns(struct wiimote_t *wm);
+
+/* reconnect.c */
+WIIUSE_EXPORT extern int wiiuse_set_reconnect(struct wiimote_t *wm, int status);
 
 WIIUSE_EXPORT extern void wiiuse_set_motion_plus(struct wiimote_t *wm, int status);
+WIIUSE_EXPORT extern void wiiuse_set_motion_plus_fusion_gain(struct wiimote_t *wm, float beta);
+WIIUSE_EXPORT extern void wiiuse_set_motion_plus_bias_tracking(struct wiimote_t *wm, int status);
 
 #ifdef __cplusplus
 }
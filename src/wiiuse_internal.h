@@ -76,6 +76,10 @@
 #include <arpa/inet.h> /* htons() */
 #include <bt-embedded/l2cap.h>
 #endif
+#ifdef WIIUSE_HIDRAW
+#include <arpa/inet.h> /* htons() */
+#include <string.h>    /* memcpy() */
+#endif
 #ifdef WIIUSE_MAC
 /* mac */
 #include <CoreFoundation/CoreFoundation.h>  /*CFRunLoops and CFNumberRef in Bluetooth classes*/
@@ -131,6 +135,8 @@
 #define WM_RPT_BTN_ACC_EXP    0x35
 #define WM_RPT_BTN_IR_EXP     0x36
 #define WM_RPT_BTN_ACC_IR_EXP 0x37
+#define WM_RPT_INTERLEAVED_1  0x3E
+#define WM_RPT_INTERLEAVED_2  0x3F
 
 #define WM_BT_INPUT           0x01
 #define WM_BT_OUTPUT          0x02
@@ -199,6 +205,7 @@
 
 #define WM_IR_TYPE_BASIC                     0x01
 #define WM_IR_TYPE_EXTENDED                  0x03
+#define WM_IR_TYPE_FULL                      0x05
 
 /* controller status flags for the first message byte */
 /* bit 1 is unknown */
@@ -279,6 +286,30 @@
 #define SMOOTH_ROLL 0x01
 #define SMOOTH_PITCH 0x02
 
+/*
+ *	One Euro filter (Casiez et al.), used instead of the exponential
+ *	average when WIIUSE_ONE_EURO is set. The cutoff frequency is
+ *		fc = min_cutoff + beta * |speed|
+ *	where speed is measured in full ranges per second, so the same
+ *	beta works for angles (360 degrees), gforce (6 g), joysticks (2)
+ *	and the IR cursor (the virtual screen resolution).
+ */
+#define WIIUSE_DEFAULT_EURO_MIN_CUTOFF 1.0f
+#define WIIUSE_DEFAULT_EURO_BETA 5.0f
+#define WIIUSE_EURO_D_CUTOFF 1.0f
+
+/* reports read in the same poll share a timestamp, assume this much time between them */
+#define WIIUSE_EURO_MIN_DT 0.005f
+
+/*
+ *	Gain of the Motion Plus fusion filter (beta in Madgwick's paper).
+ *	Higher values trust the accelerometer more and the gyros less.
+ */
+#define WIIUSE_DEFAULT_FUSION_BETA 0.1f
+
+/* longer gaps between gyro frames are not integrated */
+#define WIIUSE_FUSION_MAX_GAP 250
+
 #define WIIUSE_READ_TIMEOUT 5000
 
 /** @} */
@@ -297,12 +328,140 @@
 #define INLINE_UTIL static inline
 #endif
 
+/* unsigned long shared between two threads, one writer, or swapped by any thread */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#pragma intrinsic(_InterlockedOr, _InterlockedExchange)
+#define WIIUSE_LOAD_ACQUIRE(p) ((unsigned long)_InterlockedOr((volatile long *)(p), 0))
+#define WIIUSE_STORE_RELEASE(p, v) _InterlockedExchange((volatile long *)(p), (long)(v))
+#define WIIUSE_EXCHANGE_ACQUIRE(p, v) ((unsigned long)_InterlockedExchange((volatile long *)(p), (long)(v)))
+#elif defined(__GNUC__)
+#define WIIUSE_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define WIIUSE_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define WIIUSE_EXCHANGE_ACQUIRE(p, v) __atomic_exchange_n((p), (v), __ATOMIC_ACQUIRE)
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_ATOMICS__)
+/* any other C11 compiler, the io_uring rings also share unsigned and unsigned short */
+#include <stdatomic.h>
+#define WIIUSE_ATOMIC_PTR(p)                                                                          \
+    _Generic((p), unsigned short *: (_Atomic unsigned short *)(p), unsigned *: (_Atomic unsigned *)(p), \
+             default: (_Atomic unsigned long *)(p))
+#define WIIUSE_LOAD_ACQUIRE(p) atomic_load_explicit(WIIUSE_ATOMIC_PTR(p), memory_order_acquire)
+#define WIIUSE_STORE_RELEASE(p, v) atomic_store_explicit(WIIUSE_ATOMIC_PTR(p), (v), memory_order_release)
+#define WIIUSE_EXCHANGE_ACQUIRE(p, v) atomic_exchange_explicit(WIIUSE_ATOMIC_PTR(p), (v), memory_order_acquire)
+_Static_assert(sizeof(_Atomic unsigned long) == sizeof(unsigned long), "atomics must not need a lock");
+#else
+/* a volatile access orders nothing, the lock-free rings would break on weakly ordered CPUs */
+#error "wiiuse needs acquire/release atomics, build it with a C11 compiler, GCC, Clang or MSVC"
+#endif
+
+/* keeps data written by different threads on separate cache lines */
+#define WIIUSE_CACHE_LINE 64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /* not part of the api */
 
+/* local Bluetooth adapters a context keeps track of */
+#define WIIUSE_MAX_ADAPTERS 16
+
+/* active links a Bluetooth controller can hold */
+#define WIIUSE_ADAPTER_MAX_LINKS 7
+
+/**
+ *	@brief A local Bluetooth adapter, see adapters.c.
+ */
+struct wiiuse_adapter_t
+{
+    int id;        /* platform id, the HCI device id on BlueZ */
+    char addr[18]; /* readable address */
+    int links;     /* connected wiimotes bound to it */
+};
+
+/* addresses a context accepts incoming connections from, besides its wiimotes */
+#define WIIUSE_MAX_INCOMING_ALLOWED 16
+
+/**
+ *	@brief Listening for wiimotes that reconnect, see wiiuse_set_accept_incoming().
+ */
+struct wiiuse_incoming_t
+{
+    int enabled;
+    int sock[2]; /* listening control and interrupt channel, platform handles */
+    char allowed[WIIUSE_MAX_INCOMING_ALLOWED][18];
+    int allowed_count;
+};
+
+/**
+ *	@brief Background discovery of a context, see wiiuse_set_background_discovery().
+ */
+struct wiiuse_discovery_t
+{
+    int enabled;
+    int sock;               /* platform handle, the raw HCI socket on BlueZ */
+    int inquiring;          /* 1 while an inquiry runs */
+    int connect;            /* 1 once an inquiry finished and its wiimotes wait to be connected */
+    unsigned long interval; /* ms from the end of an inquiry to the next one */
+    unsigned long next;     /* ticks of the next inquiry, or of the inquiry timeout while inquiring */
+};
+
+/* a deadline that never comes */
+#define WIIUSE_NEVER ((unsigned long)-1)
+
+/**
+ *	@brief Descriptor for an application event loop, see wiiuse_get_fd().
+ */
+struct wiiuse_loop_t
+{
+    int enabled;
+    int fd;                 /* epoll set handed to the application */
+    int timer;              /* timerfd in the set, armed for the next deadline */
+    int wake;               /* eventfd in the set plus one, 0 until wiiuse_wakeup() or a wait needs it */
+    unsigned long woken;    /* set by wiiuse_wakeup() from any thread */
+    int waited;             /* 1 while wiiuse_poll_wait() polls, the platform poll must not block */
+    unsigned long deadline; /* ticks the timer is armed for, WIIUSE_NEVER if it is not */
+    int *watched;           /* other descriptors in the set, sorted, see LOOP_ENTRY() */
+    int *wanted;            /* room to gather the descriptors of the next update */
+    int count;              /* entries in watched */
+    int size;               /* room in watched and wanted */
+};
+
+/**
+ *	@brief Library context, see context.c.
+ */
+struct wiiuse_context_t
+{
+    FILE *logtarget[4]; /* output stream for each wiiuse_loglevel */
+    wiiuse_malloc_cb malloc_cb;
+    wiiuse_free_cb free_cb;
+    struct wiiuse_stats_t stats;
+    struct wiimote_callback_data_t cb_data; /* passed to the wiiuse_update() callback */
+    int banner;                             /* 1 once the banner was shown */
+
+    enum wiiuse_placement_t placement;
+    int place_cursor; /* next adapter for round-robin placement */
+    struct wiiuse_adapter_t adapter[WIIUSE_MAX_ADAPTERS];
+    int adapters;
+    unsigned long adapter_lock;             /* guards adapter, links and place_cursor, see adapters.c */
+    struct wiiuse_context_t *adapter_owner; /* context whose adapter list is used, NULL for this one */
+    struct wiiuse_adapter_t own[WIIUSE_MAX_ADAPTERS]; /* links of the wiimotes of this context */
+    int owns;
+
+    struct wiiuse_discovery_t discovery;
+    struct wiiuse_incoming_t incoming;
+    struct wiiuse_loop_t loop;
+
+#ifdef WIIUSE_IO_URING
+    struct wiiuse_uring_t *uring; /* set up on the first poll */
+    int uring_unavailable;        /* 1 once setting it up failed, select() is used */
+#endif
+};
+
+struct wiiuse_context_t *wiiuse_default_context();
+void *wiiuse_ctx_malloc(struct wiiuse_context_t *ctx, size_t size);
+void wiiuse_ctx_free(struct wiiuse_context_t *ctx, void *ptr);
+
 /** @brief Cross-platform call to sleep for at least the specified number
  * of milliseconds.
  *
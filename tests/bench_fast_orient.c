@@ -0,0 +1,133 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* wiiuse internal headers for calculate_orientation() */
+#include "wiiuse_internal.h"
+#include "dynamics.h"
+
+/*
+ * Compare the roll and pitch of calculate_orientation() with
+ * WIIUSE_FAST_ORIENT, which uses a polynomial atan2, against the
+ * libm path. Every raw reading within 1g on all axes is tried, for
+ * the calibration of a typical wiimote and for wider ones whose
+ * finer steps reach more of the atan2 input range.
+ *
+ * Prints the largest difference and nanoseconds per sample. Fails
+ * if the difference is over the 0.001 degrees the fast path promises.
+ */
+
+#define SAMPLES 4096
+#define ROUNDS 500
+
+#define MAX_ERROR 0.001
+
+static struct vec3b_t sample[SAMPLES];
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double angle_diff(float a, float b)
+{
+    double d = fabs((double)a - (double)b);
+
+    /* -180 and 180 are the same roll */
+    return (d > 180.0) ? 360.0 - d : d;
+}
+
+static void calibrate(struct accel_t *ac, byte g)
+{
+    ac->cal_zero.x = ac->cal_zero.y = ac->cal_zero.z = 128;
+    ac->cal_g.x = ac->cal_g.y = ac->cal_g.z = g;
+    calculate_accel_gains(ac);
+}
+
+/* largest difference over every reading within 1g */
+static double max_error(byte g)
+{
+    struct accel_t ac;
+    struct orient_t fast, libm;
+    struct vec3b_t raw;
+    double err = 0, d;
+    int x, y, z;
+
+    calibrate(&ac, g);
+
+    for (x = 128 - g; x <= 128 + g; ++x)
+    {
+        for (y = 128 - g; y <= 128 + g; ++y)
+        {
+            for (z = 128 - g; z <= 128 + g; ++z)
+            {
+                raw.x = (byte)x;
+                raw.y = (byte)y;
+                raw.z = (byte)z;
+
+                calculate_orientation(&ac, &raw, &fast, WIIUSE_FAST_ORIENT);
+                calculate_orientation(&ac, &raw, &libm, 0);
+
+                d   = angle_diff(fast.roll, libm.roll);
+                err = (d > err) ? d : err;
+                d   = angle_diff(fast.pitch, libm.pitch);
+                err = (d > err) ? d : err;
+            }
+        }
+    }
+
+    return err;
+}
+
+static double time_orientation(int flags)
+{
+    struct accel_t ac;
+    struct orient_t orient;
+    double start;
+    int n, r;
+
+    calibrate(&ac, 26);
+
+    start = now();
+    for (r = 0; r < ROUNDS; ++r)
+    {
+        for (n = 0; n < SAMPLES; ++n)
+        {
+            calculate_orientation(&ac, &sample[n], &orient, flags);
+        }
+    }
+
+    return (now() - start) / ((double)ROUNDS * SAMPLES);
+}
+
+int main(void)
+{
+    static const byte gs[] = {26, 64, 127};
+    double err = 0, e;
+    int n, i;
+
+    for (i = 0; i < 3; ++i)
+    {
+        e = max_error(gs[i]);
+        printf("largest difference, 1g = %3i counts: %.5f degrees\n", gs[i], e);
+        err = (e > err) ? e : err;
+    }
+
+    /* readings of a wiimote held in the hand, within 1g */
+    srand(1234);
+    for (n = 0; n < SAMPLES; ++n)
+    {
+        sample[n].x = (byte)(102 + rand() % 53);
+        sample[n].y = (byte)(102 + rand() % 53);
+        sample[n].z = (byte)(102 + rand() % 53);
+    }
+
+    printf("WIIUSE_FAST_ORIENT: %6.1f ns/sample\n", time_orientation(WIIUSE_FAST_ORIENT));
+    printf("libm atan2f:        %6.1f ns/sample\n", time_orientation(0));
+
+    return (err <= MAX_ERROR) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
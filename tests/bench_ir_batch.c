@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* wiiuse internal headers for the per-report IR decoders */
+#include "wiiuse_internal.h"
+#include "ir.h"
+
+/*
+ * Time wiiuse_decode_ir_batch() against decoding the same extended
+ * IR payloads one report at a time. The per-report path also runs
+ * the cursor math of interpret_ir_data(), which is what a program
+ * decoding a recording pays today.
+ *
+ * Not a test: prints nanoseconds per report and always succeeds.
+ */
+
+#define REPORTS 4096
+#define ROUNDS 200
+
+static byte payload[REPORTS][12];
+static const byte *payloads[REPORTS];
+
+static int16_t rx[REPORTS * 4];
+static int16_t ry[REPORTS * 4];
+static byte size[REPORTS * 4];
+static byte visible[REPORTS * 4];
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    struct wiimote_t **wm = wiiuse_init(1);
+    struct ir_dot_batch_t out;
+    double start, batch, single;
+    int n, d, r;
+
+    srand(1234);
+    for (n = 0; n < REPORTS; ++n)
+    {
+        for (d = 0; d < 12; ++d)
+        {
+            payload[n][d] = (byte)rand();
+        }
+        payloads[n] = payload[n];
+    }
+
+    out.rx      = rx;
+    out.ry      = ry;
+    out.size    = size;
+    out.visible = visible;
+
+    start = now();
+    for (r = 0; r < ROUNDS; ++r)
+    {
+        wiiuse_decode_ir_batch(payloads, REPORTS, 1, &out);
+    }
+    batch = (now() - start) / ((double)ROUNDS * REPORTS);
+
+    start = now();
+    for (r = 0; r < ROUNDS; ++r)
+    {
+        for (n = 0; n < REPORTS; ++n)
+        {
+            calculate_extended_ir(wm[0], payload[n]);
+        }
+    }
+    single = (now() - start) / ((double)ROUNDS * REPORTS);
+
+    printf("wiiuse_decode_ir_batch: %6.1f ns/report\n", batch);
+    printf("calculate_extended_ir:  %6.1f ns/report\n", single);
+
+    wiiuse_cleanup(wm, 1);
+    return EXIT_SUCCESS;
+}
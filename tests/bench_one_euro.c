@@ -0,0 +1,114 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* wiiuse internal headers for the smoothing filters */
+#include "wiiuse_internal.h"
+#include "dynamics.h"
+
+/*
+ * Cost per sample of the exponential smoothing and of the One Euro
+ * filter, on a noisy slow motion like a wiimote held in the hand.
+ *
+ * Not a test: prints nanoseconds per sample and always succeeds.
+ */
+
+#define SAMPLES 100000
+#define ROUNDS 20
+
+/* report interval of a wiimote, in seconds */
+#define DT 0.01f
+
+static float roll[SAMPLES];
+static float pitch[SAMPLES];
+static float gforce[SAMPLES][3];
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static float noise(void) { return (float)rand() / RAND_MAX - 0.5f; }
+
+int main(void)
+{
+    struct accel_t ac;
+    struct orient_t orient;
+    struct gforce_t gf;
+    struct one_euro_t axis;
+    double start, ema, euro, single;
+    float sink = 0.0f;
+    int i, r;
+
+    srand(1234);
+    for (i = 0; i < SAMPLES; ++i)
+    {
+        roll[i]      = 60.0f * sinf(i * 0.01f) + noise();
+        pitch[i]     = 30.0f * cosf(i * 0.013f) + noise();
+        gforce[i][0] = sinf(i * 0.01f) + 0.01f * noise();
+        gforce[i][1] = cosf(i * 0.01f) + 0.01f * noise();
+        gforce[i][2] = 0.5f + 0.01f * noise();
+    }
+
+    memset(&ac, 0, sizeof(ac));
+    memset(&orient, 0, sizeof(orient));
+    ac.st_alpha = WIIUSE_DEFAULT_SMOOTH_ALPHA;
+
+    /* exponential smoothing of roll and pitch */
+    start = now();
+    for (r = 0; r < ROUNDS; ++r)
+    {
+        for (i = 0; i < SAMPLES; ++i)
+        {
+            orient.roll    = roll[i];
+            orient.pitch   = pitch[i];
+            orient.a_roll  = roll[i];
+            orient.a_pitch = pitch[i];
+            apply_smoothing(&ac, &orient, SMOOTH_ROLL);
+            apply_smoothing(&ac, &orient, SMOOTH_PITCH);
+            sink += orient.roll;
+        }
+    }
+    ema = (now() - start) / ((double)ROUNDS * SAMPLES);
+
+    /* One Euro on roll, pitch and the three gforce axes */
+    start = now();
+    for (r = 0; r < ROUNDS; ++r)
+    {
+        for (i = 0; i < SAMPLES; ++i)
+        {
+            orient.a_roll  = roll[i];
+            orient.a_pitch = pitch[i];
+            gf.x           = gforce[i][0];
+            gf.y           = gforce[i][1];
+            gf.z           = gforce[i][2];
+            apply_one_euro(&ac, &orient, &gf, WIIUSE_DEFAULT_EURO_MIN_CUTOFF, WIIUSE_DEFAULT_EURO_BETA, DT);
+            sink += orient.roll + gf.x;
+        }
+    }
+    euro = (now() - start) / ((double)ROUNDS * SAMPLES);
+
+    /* One Euro on a single axis */
+    memset(&axis, 0, sizeof(axis));
+    start = now();
+    for (r = 0; r < ROUNDS; ++r)
+    {
+        for (i = 0; i < SAMPLES; ++i)
+        {
+            sink += one_euro_filter(&axis, roll[i], WIIUSE_DEFAULT_EURO_MIN_CUTOFF, WIIUSE_DEFAULT_EURO_BETA, DT);
+        }
+    }
+    single = (now() - start) / ((double)ROUNDS * SAMPLES);
+
+    printf("apply_smoothing, roll + pitch:         %6.1f ns/sample\n", ema);
+    printf("apply_one_euro, roll + pitch + gforce: %6.1f ns/sample\n", euro);
+    printf("one_euro_filter, one axis:             %6.1f ns/sample\n", single);
+
+    /* keep the loops from being optimized away */
+    return (sink == 12345.0f) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* wiiuse internal headers, built against the BlueZ backend with WIIUSE_IO_URING */
+#include "wiiuse_internal.h"
+
+/*
+ * Time wiiuse_poll_wait() on the epoll set against the same wait
+ * on an io_uring, for 16 and 128 wiimotes. A socket pair stands in
+ * for the L2CAP interrupt channel of each wiimote.
+ *
+ * "all" has every wiimote send a report before each wait, "one"
+ * has a single wiimote send one, which is closer to wiimotes that
+ * report at 100 Hz each and seldom at the same time. The CPU time
+ * of the process is measured: io_uring does part of its work when
+ * the report is written, so timing only the waits would flatter it.
+ * Writing the reports costs the same either way.
+ *
+ * Not a test: prints microseconds per report and always succeeds.
+ */
+
+#define REPORTS 20000
+
+enum
+{
+    BENCH_EPOLL,
+    BENCH_URING
+};
+
+static int peer[128];
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void fake_connect(struct wiimote_t *wm, int i)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0)
+    {
+        perror("socketpair()");
+        exit(EXIT_FAILURE);
+    }
+    wm->in_sock  = sv[0];
+    wm->out_sock = dup(sv[0]);
+    peer[i]      = sv[1];
+    fcntl(peer[i], F_SETFL, O_NONBLOCK);
+
+    WIIMOTE_ENABLE_STATE(wm, WIIMOTE_STATE_DEV_FOUND | WIIMOTE_STATE_CONNECTED | WIIMOTE_STATE_HANDSHAKE_COMPLETE);
+}
+
+static void send_buttons(int i, int k)
+{
+    byte report[4] = {0xA1, WM_RPT_BTN, 0x00, (k & 1) ? 0x08 : 0x04};
+
+    if (write(peer[i], report, sizeof(report)) != sizeof(report))
+    {
+        perror("write()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double bench(int mode, int wiimotes, int all)
+{
+    struct wiiuse_context_t *ctx = wiiuse_context_create();
+    struct wiimote_t **wm;
+    double start, took;
+    int reports = 0;
+    int rounds  = all ? REPORTS / wiimotes : REPORTS;
+    int evnt;
+    int i, k;
+
+    wiiuse_context_set_output(ctx, LOGLEVEL_INFO, NULL);
+    ctx->uring_unavailable = (mode == BENCH_EPOLL);
+
+    wm = wiiuse_context_init(ctx, wiimotes);
+    for (i = 0; i < wiimotes; ++i)
+    {
+        fake_connect(wm[i], i);
+    }
+
+    /* sets up the ring or the epoll set */
+    wiiuse_poll_wait(wm, wiimotes, 0);
+
+    start = now();
+    for (k = 0; k < rounds; ++k)
+    {
+        if (all)
+        {
+            for (i = 0; i < wiimotes; ++i)
+            {
+                send_buttons(i, k);
+            }
+        } else
+        {
+            send_buttons(k % wiimotes, k / wiimotes);
+        }
+
+        for (evnt = 0; evnt < (all ? wiimotes : 1);)
+        {
+            evnt += wiiuse_poll_wait(wm, wiimotes, 100);
+        }
+        reports += evnt;
+    }
+    took = now() - start;
+
+    if ((mode == BENCH_URING) && !ctx->uring)
+    {
+        printf("(no io_uring, the epoll set was used) ");
+    }
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        close(peer[i]);
+    }
+    wiiuse_cleanup(wm, wiimotes);
+    wiiuse_context_destroy(ctx);
+
+    return took / reports;
+}
+
+int main(void)
+{
+    static const int counts[] = {16, 128};
+    int all, c;
+
+    for (all = 1; all >= 0; --all)
+    {
+        for (c = 0; c < 2; ++c)
+        {
+            printf("%-3s %3i wiimotes, epoll:    %6.2f us/report\n", all ? "all" : "one", counts[c],
+                   bench(BENCH_EPOLL, counts[c], all));
+            printf("%-3s %3i wiimotes, io_uring: %6.2f us/report\n", all ? "all" : "one", counts[c],
+                   bench(BENCH_URING, counts[c], all));
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
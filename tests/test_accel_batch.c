@@ -0,0 +1,179 @@
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* wiiuse internal headers for the per-report accelerometer math */
+#include "wiiuse_internal.h"
+#include "dynamics.h"
+
+/*
+ * wiiuse_calculate_gforce_batch() and wiiuse_calculate_orientation_batch()
+ * must give the same results as calculate_gforce() and calculate_orientation()
+ * with WIIUSE_FAST_ORIENT, bit for bit. The sample count is not a multiple
+ * of 4 so both the 4 lane code and the tail get used.
+ *
+ * Build it once as is and once with -DWIIUSE_NO_SIMD for the library,
+ * to cover both the SSE2 lanes and the portable ones.
+ */
+
+#define SAMPLES 37
+
+static struct vec3b_t sample[SAMPLES];
+
+static void calibrate(struct accel_t *ac)
+{
+    memset(ac, 0, sizeof(*ac));
+    ac->cal_zero.x = 130;
+    ac->cal_zero.y = 128;
+    ac->cal_zero.z = 131;
+    ac->cal_g.x    = 26;
+    ac->cal_g.y    = 25;
+    ac->cal_g.z    = 27;
+    ac->st_alpha   = WIIUSE_DEFAULT_SMOOTH_ALPHA;
+    calculate_accel_gains(ac);
+}
+
+/* random readings, every fifth one over 1g on some axis */
+static void fill_samples(void)
+{
+    int n;
+
+    srand(1234);
+    for (n = 0; n < SAMPLES; ++n)
+    {
+        sample[n].x = (byte)(104 + rand() % 53);
+        sample[n].y = (byte)(103 + rand() % 51);
+        sample[n].z = (byte)(104 + rand() % 55);
+
+        if (!(n % 5))
+        {
+            sample[n].x = (byte)rand();
+            sample[n].y = (byte)rand();
+        }
+    }
+}
+
+static void check_orient(const struct orient_t *batch, const struct orient_t *single)
+{
+    ck_assert_float_eq(batch->roll, single->roll);
+    ck_assert_float_eq(batch->pitch, single->pitch);
+    ck_assert_float_eq(batch->a_roll, single->a_roll);
+    ck_assert_float_eq(batch->a_pitch, single->a_pitch);
+    ck_assert_float_eq(batch->yaw, single->yaw);
+}
+
+START_TEST(test_gforce_matches)
+{
+    struct gforce_t batch[SAMPLES], single;
+    struct accel_t ac;
+    int n;
+
+    calibrate(&ac);
+    fill_samples();
+
+    wiiuse_calculate_gforce_batch(&ac, sample, SAMPLES, batch);
+
+    for (n = 0; n < SAMPLES; ++n)
+    {
+        calculate_gforce(&ac, &sample[n], &single);
+        ck_assert(!memcmp(&batch[n], &single, sizeof(single)));
+    }
+}
+END_TEST
+
+#ifndef WIIUSE_FIXED_POINT
+
+static void orientation_matches(int smooth)
+{
+    struct orient_t batch[SAMPLES], single;
+    struct accel_t ac_batch, ac_single;
+    int flags = WIIUSE_FAST_ORIENT | (smooth ? WIIUSE_SMOOTHING : 0);
+    int n;
+
+    calibrate(&ac_batch);
+    calibrate(&ac_single);
+    fill_samples();
+
+    /* both start from the same angles for the held axes of the first sample */
+    memset(batch, 0, sizeof(batch));
+    memset(&single, 0, sizeof(single));
+
+    wiiuse_calculate_orientation_batch(&ac_batch, sample, SAMPLES, batch, smooth);
+
+    for (n = 0; n < SAMPLES; ++n)
+    {
+        calculate_orientation(&ac_single, &sample[n], &single, flags);
+        check_orient(&batch[n], &single);
+    }
+
+    /* the smoothing state carries on to the next report the same way */
+    ck_assert_float_eq(ac_batch.st_roll, ac_single.st_roll);
+    ck_assert_float_eq(ac_batch.st_pitch, ac_single.st_pitch);
+}
+
+START_TEST(test_orientation_matches) { orientation_matches(0); }
+END_TEST
+
+START_TEST(test_orientation_smoothed_matches) { orientation_matches(1); }
+END_TEST
+
+START_TEST(test_orientation_near_libm)
+{
+    struct orient_t batch[SAMPLES], libm;
+    struct accel_t ac;
+    int n;
+
+    calibrate(&ac);
+    fill_samples();
+    memset(batch, 0, sizeof(batch));
+    memset(&libm, 0, sizeof(libm));
+
+    wiiuse_calculate_orientation_batch(&ac, sample, SAMPLES, batch, 0);
+
+    for (n = 0; n < SAMPLES; ++n)
+    {
+        calculate_orientation(&ac, &sample[n], &libm, 0);
+        ck_assert_float_eq_tol(batch[n].roll, libm.roll, 0.001f);
+        ck_assert_float_eq_tol(batch[n].pitch, libm.pitch, 0.001f);
+    }
+}
+END_TEST
+
+#endif
+
+Suite *accel_batch_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("AccelBatch");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_gforce_matches);
+#ifndef WIIUSE_FIXED_POINT
+    /* fixed-point builds do not use the polynomial atan2 outside of the batch */
+    tcase_add_test(tc_core, test_orientation_matches);
+    tcase_add_test(tc_core, test_orientation_smoothed_matches);
+    tcase_add_test(tc_core, test_orientation_near_libm);
+#endif
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s  = accel_batch_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,180 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* wiiuse internal headers for the placement policy */
+#include "wiiuse_internal.h"
+#include "adapters.h"
+
+/*
+ * Placement only looks at the adapter list and the wiimotes bound to it,
+ * so a list of fake adapters stands in for the HCI devices.
+ */
+
+static void mock_adapters(struct wiiuse_adapter_t *adapter, int count, const int *links)
+{
+    int i;
+
+    memset(adapter, 0, count * sizeof(*adapter));
+    for (i = 0; i < count; ++i)
+    {
+        adapter[i].id    = 10 + i;
+        adapter[i].links = links ? links[i] : 0;
+    }
+}
+
+START_TEST(test_round_robin_cycles)
+{
+    struct wiiuse_adapter_t adapter[3];
+    int cursor = 0;
+    int i;
+
+    mock_adapters(adapter, 3, NULL);
+
+    for (i = 0; i < 7; ++i)
+    {
+        ck_assert_int_eq(adapter_place(adapter, 3, WIIUSE_PLACE_ROUND_ROBIN, &cursor), i % 3);
+    }
+}
+END_TEST
+
+START_TEST(test_round_robin_skips_full)
+{
+    static const int links[3] = {0, WIIUSE_ADAPTER_MAX_LINKS, 2};
+    struct wiiuse_adapter_t adapter[3];
+    int cursor = 1;
+
+    mock_adapters(adapter, 3, links);
+
+    ck_assert_int_eq(adapter_place(adapter, 3, WIIUSE_PLACE_ROUND_ROBIN, &cursor), 2);
+    ck_assert_int_eq(adapter_place(adapter, 3, WIIUSE_PLACE_ROUND_ROBIN, &cursor), 0);
+    ck_assert_int_eq(adapter_place(adapter, 3, WIIUSE_PLACE_ROUND_ROBIN, &cursor), 2);
+}
+END_TEST
+
+START_TEST(test_least_loaded)
+{
+    static const int links[4] = {3, 1, 2, 1};
+    struct wiiuse_adapter_t adapter[4];
+    int cursor = 0;
+    int a;
+
+    mock_adapters(adapter, 4, links);
+
+    /* fill up as the platform code does, one connection at a time */
+    a = adapter_place(adapter, 4, WIIUSE_PLACE_LEAST_LOADED, &cursor);
+    ck_assert_int_eq(a, 1);
+    ++adapter[a].links;
+
+    /* ties go round-robin */
+    a = adapter_place(adapter, 4, WIIUSE_PLACE_LEAST_LOADED, &cursor);
+    ck_assert_int_eq(a, 3);
+    ++adapter[a].links;
+
+    a = adapter_place(adapter, 4, WIIUSE_PLACE_LEAST_LOADED, &cursor);
+    ck_assert_int_eq(a, 1);
+    ++adapter[a].links;
+
+    a = adapter_place(adapter, 4, WIIUSE_PLACE_LEAST_LOADED, &cursor);
+    ck_assert_int_eq(a, 2);
+}
+END_TEST
+
+START_TEST(test_all_full)
+{
+    static const int links[2] = {WIIUSE_ADAPTER_MAX_LINKS, WIIUSE_ADAPTER_MAX_LINKS};
+    struct wiiuse_adapter_t adapter[2];
+    int cursor = 1;
+
+    mock_adapters(adapter, 2, links);
+
+    ck_assert_int_eq(adapter_place(adapter, 2, WIIUSE_PLACE_ROUND_ROBIN, &cursor), -1);
+    ck_assert_int_eq(adapter_place(adapter, 2, WIIUSE_PLACE_LEAST_LOADED, &cursor), -1);
+    ck_assert_int_eq(adapter_place(adapter, 0, WIIUSE_PLACE_ROUND_ROBIN, &cursor), -1);
+    ck_assert_int_eq(cursor, 1);
+}
+END_TEST
+
+START_TEST(test_count_links)
+{
+    static const int bound[6] = {10, 12, 12, -1, 10, 12};
+    struct wiiuse_adapter_t adapter[3];
+    struct wiimote_t wiimote[6];
+    struct wiimote_t *wm[6];
+    int i;
+
+    mock_adapters(adapter, 3, NULL);
+    adapter[1].links = 5;
+
+    for (i = 0; i < 6; ++i)
+    {
+        memset(&wiimote[i], 0, sizeof(wiimote[i]));
+        wiimote[i].adapter = bound[i];
+        wiimote[i].state   = WIIMOTE_STATE_CONNECTED;
+        wm[i]              = &wiimote[i];
+    }
+
+    /* no longer connected, must not count */
+    wiimote[5].state = 0;
+
+    adapter_count_links(adapter, 3, wm, 6);
+
+    ck_assert_int_eq(adapter[0].links, 2);
+    ck_assert_int_eq(adapter[1].links, 0);
+    ck_assert_int_eq(adapter[2].links, 2);
+}
+END_TEST
+
+START_TEST(test_add_limit)
+{
+    struct wiiuse_context_t *ctx = wiiuse_context_create();
+    int i;
+
+    ck_assert_ptr_ne(ctx, NULL);
+
+    for (i = 0; i < WIIUSE_MAX_ADAPTERS; ++i)
+    {
+        ck_assert_int_eq(adapter_add(ctx, i, "00:11:22:33:44:55"), 1);
+    }
+    ck_assert_int_eq(adapter_add(ctx, i, "00:11:22:33:44:55"), 0);
+    ck_assert_int_eq(ctx->adapters, WIIUSE_MAX_ADAPTERS);
+    ck_assert_str_eq(ctx->adapter[3].addr, "00:11:22:33:44:55");
+
+    wiiuse_context_destroy(ctx);
+}
+END_TEST
+
+Suite *adapter_placement_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("AdapterPlacement");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_round_robin_cycles);
+    tcase_add_test(tc_core, test_round_robin_skips_full);
+    tcase_add_test(tc_core, test_least_loaded);
+    tcase_add_test(tc_core, test_all_full);
+    tcase_add_test(tc_core, test_count_links);
+    tcase_add_test(tc_core, test_add_limit);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s  = adapter_placement_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,169 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+/* wiiuse internal headers for the balance board ring */
+#include "wiiuse_internal.h"
+#include "wiiboard.h"
+
+/*
+ * The balance board ring is pushed by the polling thread and read
+ * by another one without a lock. Every sample that comes out must
+ * be whole, in order, and each report must either come out or be
+ * counted as an overrun.
+ */
+
+#define PUSHES 20000000UL
+#define CAPACITY 1024
+
+static struct wiimote_t **wm;
+
+/* what the consumer saw */
+static unsigned long done;
+static unsigned long got;
+static unsigned long torn;
+static unsigned long reordered;
+
+static void setup(void) { wm = wiiuse_init(1); }
+
+static void teardown(void) { wiiuse_cleanup(wm, 1); }
+
+/* every field of a sample is derived from its report number */
+static void fill_board(struct wii_board_t *wb, unsigned long i)
+{
+    wb->tl  = (float)(i & 0xFFFF);
+    wb->br  = (float)((i >> 16) & 0xFFFF);
+    wb->rtl = (uint16_t)i;
+    wb->rbr = (uint16_t)(i >> 16);
+}
+
+static int sample_whole(const struct wii_board_sample_t *s)
+{
+    return (s->timestamp == s->seq) && (s->tl == (float)(s->seq & 0xFFFF))
+           && (s->br == (float)((s->seq >> 16) & 0xFFFF)) && (s->rtl == (uint16_t)s->seq)
+           && (s->rbr == (uint16_t)(s->seq >> 16));
+}
+
+static void *consume(void *arg)
+{
+    struct wii_board_sample_t buf[64];
+    unsigned long next = 0;
+    int finished;
+    int n, i;
+
+    (void)arg;
+
+    for (;;)
+    {
+        /* read the flag first, so nothing pushed before it is missed */
+        finished = (int)WIIUSE_LOAD_ACQUIRE(&done);
+
+        n = wiiuse_read_wii_board_ring(wm[0], buf, 64);
+        for (i = 0; i < n; ++i)
+        {
+            reordered += (buf[i].seq < next);
+            torn += !sample_whole(&buf[i]);
+            next = buf[i].seq + 1;
+        }
+        got += n;
+
+        if (!n && finished)
+        {
+            return NULL;
+        }
+    }
+}
+
+START_TEST(test_spsc_stress)
+{
+    struct wii_board_t wb;
+    pthread_t consumer;
+    unsigned long i;
+
+    ck_assert_int_eq(wiiuse_set_wii_board_ring(wm[0], CAPACITY), 1);
+    memset(&wb, 0, sizeof(wb));
+    done = got = torn = reordered = 0;
+
+    ck_assert_int_eq(pthread_create(&consumer, NULL, consume, NULL), 0);
+
+    for (i = 0; i < PUSHES; ++i)
+    {
+        fill_board(&wb, i);
+        wii_board_ring_push(wm[0]->board_ring, &wb, i);
+    }
+    WIIUSE_STORE_RELEASE(&done, 1);
+
+    pthread_join(consumer, NULL);
+
+    ck_assert_int_eq(torn, 0);
+    ck_assert_int_eq(reordered, 0);
+    ck_assert(got > 0);
+    ck_assert_uint_eq(got + wiiuse_wii_board_ring_overruns(wm[0]), PUSHES);
+}
+END_TEST
+
+START_TEST(test_full_ring_keeps_oldest)
+{
+    struct wii_board_sample_t buf[CAPACITY];
+    struct wii_board_t wb;
+    unsigned long i;
+    int n;
+
+    ck_assert_int_eq(wiiuse_set_wii_board_ring(wm[0], CAPACITY), 1);
+    memset(&wb, 0, sizeof(wb));
+
+    for (i = 0; i < CAPACITY + 10; ++i)
+    {
+        fill_board(&wb, i);
+        wii_board_ring_push(wm[0]->board_ring, &wb, i);
+    }
+
+    ck_assert_uint_eq(wiiuse_wii_board_ring_overruns(wm[0]), 10);
+
+    n = wiiuse_read_wii_board_ring(wm[0], buf, CAPACITY);
+    ck_assert_int_eq(n, CAPACITY);
+    ck_assert_uint_eq(buf[0].seq, 0);
+    ck_assert_uint_eq(buf[CAPACITY - 1].seq, CAPACITY - 1);
+    ck_assert(sample_whole(&buf[CAPACITY - 1]));
+
+    /* the next report after the gap */
+    wii_board_ring_push(wm[0]->board_ring, &wb, i);
+    ck_assert_int_eq(wiiuse_read_wii_board_ring(wm[0], buf, CAPACITY), 1);
+    ck_assert_uint_eq(buf[0].seq, CAPACITY + 10);
+}
+END_TEST
+
+Suite *board_ring_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("BoardRing");
+    tc_core = tcase_create("Core");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_set_timeout(tc_core, 60);
+    tcase_add_test(tc_core, test_spsc_stress);
+    tcase_add_test(tc_core, test_full_ring_keeps_oldest);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s  = board_ring_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,233 @@
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* wiiuse internal headers, built against the BlueZ backend */
+#include "wiiuse_internal.h"
+
+/*
+ * The descriptor from wiiuse_get_fd() must be ready exactly when
+ * wiiuse_poll() has something to do. A socket pair stands in for
+ * the L2CAP interrupt channel of each wiimote.
+ */
+
+#define WIIMOTES 2
+
+static struct wiimote_t **wm;
+static int peer[WIIMOTES];
+
+static void fake_connect(int i)
+{
+    int sv[2];
+
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), 0);
+    wm[i]->in_sock  = sv[0];
+    wm[i]->out_sock = dup(sv[0]);
+    peer[i]         = sv[1];
+    fcntl(peer[i], F_SETFL, O_NONBLOCK);
+
+    WIIMOTE_ENABLE_STATE(wm[i], WIIMOTE_STATE_DEV_FOUND | WIIMOTE_STATE_CONNECTED | WIIMOTE_STATE_HANDSHAKE_COMPLETE);
+}
+
+static void setup(void)
+{
+    int i;
+
+    wm = wiiuse_init(WIIMOTES);
+    for (i = 0; i < WIIMOTES; ++i)
+    {
+        fake_connect(i);
+    }
+}
+
+static void teardown(void)
+{
+    int i;
+
+    for (i = 0; i < WIIMOTES; ++i)
+    {
+        close(peer[i]);
+    }
+    wiiuse_cleanup(wm, WIIMOTES);
+}
+
+static void press(int i, byte buttons)
+{
+    const byte report[4] = {WM_SET_DATA | WM_BT_INPUT, WM_RPT_BTN, 0x00, buttons};
+
+    ck_assert_int_eq(write(peer[i], report, sizeof(report)), sizeof(report));
+}
+
+/* 1 if the descriptor gets ready within ms milliseconds */
+static int ready(int fd, int ms)
+{
+    struct epoll_event ev;
+    int r;
+
+    do
+    {
+        r = epoll_wait(fd, &ev, 1, ms);
+    } while ((r == -1) && (errno == EINTR));
+
+    ck_assert_int_ne(r, -1);
+    return r;
+}
+
+static void *wake_later(void *arg)
+{
+    usleep(20000);
+    wiiuse_wakeup((struct wiiuse_context_t *)arg);
+    return NULL;
+}
+
+START_TEST(test_quiet_when_idle)
+{
+    int fd = wiiuse_get_fd(wm, WIIMOTES);
+
+    ck_assert_int_ne(fd, -1);
+    ck_assert_int_eq(wiiuse_get_timeout(wm, WIIMOTES), -1);
+    ck_assert_int_eq(ready(fd, 20), 0);
+}
+END_TEST
+
+START_TEST(test_ready_until_read)
+{
+    int fd = wiiuse_get_fd(wm, WIIMOTES);
+
+    press(1, 0x04);
+    press(1, 0x08);
+    ck_assert_int_eq(ready(fd, 100), 1);
+
+    /* one report per poll, still ready for the second */
+    ck_assert_int_eq(wiiuse_poll(wm, WIIMOTES), 1);
+    ck_assert_int_eq(ready(fd, 0), 1);
+    ck_assert_int_eq(wiiuse_poll(wm, WIIMOTES), 1);
+    ck_assert(IS_PRESSED(wm[1], WIIMOTE_BUTTON_A));
+
+    ck_assert_int_eq(ready(fd, 20), 0);
+}
+END_TEST
+
+START_TEST(test_idle_smoothing_timer)
+{
+    int fd = wiiuse_get_fd(wm, WIIMOTES);
+    int timeout;
+    int i;
+
+    WIIMOTE_ENABLE_STATE(wm[0], WIIMOTE_STATE_ACC);
+    wiiuse_set_flags(wm[0], WIIUSE_SMOOTHING, WIIUSE_ONE_EURO);
+    wm[0]->orient.roll          = 10.0f;
+    wm[0]->orient.a_roll        = 40.0f;
+    wm[0]->accel_calib.st_roll  = 10.0f;
+    wm[0]->orient.pitch         = 0.0f;
+    wm[0]->orient.a_pitch       = 0.0f;
+    wm[0]->accel_calib.st_pitch = 0.0f;
+
+    wiiuse_poll(wm, WIIMOTES);
+    ck_assert(wm[0]->orient.roll > 10.0f);
+
+    timeout = wiiuse_get_timeout(wm, WIIMOTES);
+    ck_assert_int_ge(timeout, 0);
+    ck_assert_int_le(timeout, 10);
+
+    /* the timer wakes the loop until the angle caught up */
+    for (i = 0; (i < 1000) && (wiiuse_get_timeout(wm, WIIMOTES) != -1); ++i)
+    {
+        ck_assert_int_eq(ready(fd, 100), 1);
+        wiiuse_poll(wm, WIIMOTES);
+    }
+    ck_assert_int_eq(wiiuse_get_timeout(wm, WIIMOTES), -1);
+    ck_assert_float_eq_tol(wm[0]->orient.roll, 40.0f, 0.01f);
+    ck_assert_int_eq(ready(fd, 30), 0);
+}
+END_TEST
+
+START_TEST(test_dropped_wiimote_leaves_set)
+{
+    int fd = wiiuse_get_fd(wm, WIIMOTES);
+
+    close(peer[0]);
+    ck_assert_int_eq(ready(fd, 100), 1);
+    wiiuse_poll(wm, WIIMOTES);
+    ck_assert_int_eq(wm[0]->event, WIIUSE_DISCONNECT);
+
+    /* the closed channel would be ready forever */
+    ck_assert_int_eq(ready(fd, 20), 0);
+
+    /* back on a socket that likely has the same number */
+    wiiuse_disconnect(wm[0]);
+    fake_connect(0);
+    wiiuse_poll(wm, WIIMOTES);
+    press(0, 0x08);
+    ck_assert_int_eq(ready(fd, 100), 1);
+    ck_assert_int_eq(wiiuse_poll(wm, WIIMOTES), 1);
+}
+END_TEST
+
+START_TEST(test_poll_wait)
+{
+    /* nothing comes in, the whole timeout passes */
+    ck_assert_int_eq(wiiuse_poll_wait(wm, WIIMOTES, 20), 0);
+
+    press(0, 0x08);
+    ck_assert_int_eq(wiiuse_poll_wait(wm, WIIMOTES, -1), 1);
+    ck_assert(IS_PRESSED(wm[0], WIIMOTE_BUTTON_A));
+}
+END_TEST
+
+START_TEST(test_wakeup)
+{
+    pthread_t waker;
+
+    /* a wakeup before the wait is not lost */
+    wiiuse_wakeup(wm[0]->ctx);
+    ck_assert_int_eq(wiiuse_poll_wait(wm, WIIMOTES, -1), 0);
+
+    ck_assert_int_eq(pthread_create(&waker, NULL, wake_later, wm[0]->ctx), 0);
+    ck_assert_int_eq(wiiuse_poll_wait(wm, WIIMOTES, -1), 0);
+    pthread_join(waker, NULL);
+}
+END_TEST
+
+Suite *event_loop_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("EventLoop");
+    tc_core = tcase_create("Core");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_quiet_when_idle);
+    tcase_add_test(tc_core, test_ready_until_read);
+    tcase_add_test(tc_core, test_idle_smoothing_timer);
+    tcase_add_test(tc_core, test_dropped_wiimote_leaves_set);
+    tcase_add_test(tc_core, test_poll_wait);
+    tcase_add_test(tc_core, test_wakeup);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s  = event_loop_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,229 @@
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* wiiuse internal headers for the float and fixed-point kernels */
+#include "wiiuse_internal.h"
+#include "dynamics.h"
+#include "fixed.h"
+#include "wiiboard.h"
+
+/*
+ * The Q16.16 kernels selected by WIIUSE_FIXED_POINT must agree with the
+ * float code they replace. Build this test without WIIUSE_FIXED_POINT so
+ * the library functions below take the float path.
+ */
+
+/* largest angle difference accepted, in degrees */
+#define ANGLE_TOL 0.01f
+
+static float angle_diff(float a, float b)
+{
+    float d = fabsf(a - b);
+
+    return (d > 180.0f) ? 360.0f - d : d;
+}
+
+START_TEST(test_atan2_matches_float)
+{
+    int x, y;
+
+    for (y = -300; y <= 300; y += 7)
+    {
+        for (x = -300; x <= 300; x += 7)
+        {
+            float expected = RAD_TO_DEGREE(atan2f((float)y, (float)x));
+            float got      = FIXED_TO_FLOAT(fixed_atan2_deg(FIXED_FROM_INT(y), FIXED_FROM_INT(x)));
+
+            if (!x && !y)
+            {
+                continue;
+            }
+            ck_assert_float_le(angle_diff(got, expected), ANGLE_TOL);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_sincos_matches_float)
+{
+    float ang;
+
+    for (ang = -720.0f; ang <= 720.0f; ang += 0.37f)
+    {
+        fixed_t s, c;
+
+        fixed_sincos_deg(FIXED_FROM_FLOAT(ang), &s, &c);
+        ck_assert_float_eq_tol(FIXED_TO_FLOAT(s), sinf(DEGREE_TO_RAD(ang)), 2e-4f);
+        ck_assert_float_eq_tol(FIXED_TO_FLOAT(c), cosf(DEGREE_TO_RAD(ang)), 2e-4f);
+    }
+}
+END_TEST
+
+START_TEST(test_orientation_matches_float)
+{
+    struct accel_t ac;
+    struct vec3b_t accel;
+    int x, y, z;
+
+    memset(&ac, 0, sizeof(ac));
+    ac.cal_zero.x = ac.cal_zero.y = ac.cal_zero.z = 128;
+    ac.cal_g.x = ac.cal_g.y = ac.cal_g.z = 26;
+    calculate_accel_gains(&ac);
+
+    for (x = 100; x <= 156; x += 3)
+    {
+        for (y = 100; y <= 156; y += 3)
+        {
+            for (z = 100; z <= 156; z += 3)
+            {
+                struct orient_t expected, got;
+
+                memset(&expected, 0, sizeof(expected));
+                memset(&got, 0, sizeof(got));
+                accel.x = (byte)x;
+                accel.y = (byte)y;
+                accel.z = (byte)z;
+
+                calculate_orientation(&ac, &accel, &expected, 0);
+                fixed_orientation(&ac, &accel, &got);
+
+                ck_assert_float_le(angle_diff(got.roll, expected.roll), ANGLE_TOL);
+                ck_assert_float_le(angle_diff(got.pitch, expected.pitch), ANGLE_TOL);
+                ck_assert_float_eq(got.a_roll, got.roll);
+                ck_assert_float_eq(got.a_pitch, got.pitch);
+            }
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_joystick_matches_float)
+{
+    struct joystick_t expected, got;
+    int x, y;
+
+    memset(&expected, 0, sizeof(expected));
+    expected.min.x = expected.min.y = 30;
+    expected.center.x = expected.center.y = 128;
+    expected.max.x = expected.max.y = 225;
+    got = expected;
+
+    for (y = 0; y < 256; y += 5)
+    {
+        for (x = 0; x < 256; x += 5)
+        {
+            calc_joystick_state(&expected, (float)x, (float)y);
+            fixed_joystick_state(&got, x, y);
+
+            ck_assert_float_eq_tol(got.x, expected.x, 1e-4f);
+            ck_assert_float_eq_tol(got.y, expected.y, 1e-4f);
+            ck_assert_float_eq_tol(got.mag, expected.mag, 1e-4f);
+            if (expected.mag > 0.01f)
+            {
+                ck_assert_float_le(angle_diff(got.ang, expected.ang), ANGLE_TOL);
+            }
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_ir_rotation_matches_float)
+{
+    struct ir_dot_t dot[4];
+    float ang;
+    int i;
+
+    memset(dot, 0, sizeof(dot));
+    for (i = 0; i < 4; ++i)
+    {
+        dot[i].visible = 1;
+        dot[i].rx      = (int16_t)(100 + 250 * i);
+        dot[i].ry      = (int16_t)(700 - 200 * i);
+    }
+
+    for (ang = -179.5f; ang < 180.0f; ang += 1.5f)
+    {
+        float s = sinf(DEGREE_TO_RAD(ang));
+        float c = cosf(DEGREE_TO_RAD(ang));
+
+        fixed_rotate_ir_dots(dot, ang);
+
+        /* same formula as fix_rotated_ir_dots() in ir.c */
+        for (i = 0; i < 4; ++i)
+        {
+            int x = dot[i].rx - 512;
+            int y = dot[i].ry - 384;
+            int ex = (int)((c * x) + (-s * y)) + 512;
+            int ey = (int)((s * x) + (c * y)) + 384;
+
+            ck_assert_int_le(abs((int)dot[i].x - ex), 1);
+            ck_assert_int_le(abs((int)dot[i].y - ey), 1);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_board_matches_float)
+{
+    struct wii_board_t wb;
+    byte msg[8];
+    int raw;
+
+    memset(&wb, 0, sizeof(wb));
+    wb.ctr[0] = wb.cbr[0] = wb.ctl[0] = wb.cbl[0] = 4000;
+    wb.ctr[1] = wb.cbr[1] = wb.ctl[1] = wb.cbl[1] = 5700;
+    wb.ctr[2] = wb.cbr[2] = wb.ctl[2] = wb.cbl[2] = 7400;
+
+    for (raw = 0; raw < 9000; raw += 13)
+    {
+        int i;
+
+        for (i = 0; i < 4; ++i)
+        {
+            msg[2 * i]     = (byte)(raw >> 8);
+            msg[2 * i + 1] = (byte)(raw & 0xFF);
+        }
+        wii_board_event(&wb, msg);
+
+        ck_assert_float_eq_tol(FIXED_TO_FLOAT(fixed_interpolate_board((uint16_t)raw, wb.ctr)), wb.tr, 1e-3f);
+        ck_assert_float_eq_tol(FIXED_TO_FLOAT(fixed_interpolate_board((uint16_t)raw, wb.cbl)), wb.bl, 1e-3f);
+    }
+}
+END_TEST
+
+Suite *fixed_point_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("FixedPoint");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_atan2_matches_float);
+    tcase_add_test(tc_core, test_sincos_matches_float);
+    tcase_add_test(tc_core, test_orientation_matches_float);
+    tcase_add_test(tc_core, test_joystick_matches_float);
+    tcase_add_test(tc_core, test_ir_rotation_matches_float);
+    tcase_add_test(tc_core, test_board_matches_float);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s  = fixed_point_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
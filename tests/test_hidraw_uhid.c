@@ -0,0 +1,285 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <linux/uhid.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* build against the hidraw backend: -DWIIUSE_HIDRAW -DWIIUSE_PLATFORM */
+#include "wiiuse_internal.h"
+
+/*
+ * A virtual wiimote made with /dev/uhid. The kernel gives it a hidraw
+ * node and sysfs entries just like a real one paired over Bluetooth,
+ * and whatever wiiuse writes to the node comes back here as
+ * UHID_OUTPUT. A small responder thread answers the handshake.
+ *
+ * Needs write access to /dev/uhid, the test is skipped otherwise.
+ */
+
+#define UHID_PATH "/dev/uhid"
+#define FAKE_ADDR "00:1F:32:C0:FF:EE"
+
+/* vendor defined reports with the ids and sizes of a wiimote */
+#define REPORT(id, size, dir) 0x85, (id), 0x09, 0x01, 0x95, (size), (dir), 0x00
+#define IN  0x81
+#define OUT 0x91
+
+static const byte fake_rdesc[] = {
+    0x06, 0x00, 0xFF,       /* usage page (vendor defined) */
+    0x09, 0x01,             /* usage (vendor usage 1) */
+    0xA1, 0x01,             /* collection (application) */
+    0x15, 0x00,             /* logical minimum (0) */
+    0x26, 0xFF, 0x00,       /* logical maximum (255) */
+    0x75, 0x08,             /* report size (8) */
+    REPORT(0x11, 1, OUT),   REPORT(0x12, 2, OUT),  REPORT(0x13, 1, OUT),  REPORT(0x15, 1, OUT),
+    REPORT(0x16, 21, OUT),  REPORT(0x17, 6, OUT),  REPORT(0x1A, 1, OUT),  REPORT(0x20, 6, IN),
+    REPORT(0x21, 21, IN),   REPORT(0x22, 4, IN),   REPORT(0x30, 2, IN),   REPORT(0x31, 5, IN),
+    0xC0, /* end collection */
+};
+
+static int uhid = -1;
+static volatile int destroyed;
+static pthread_t responder;
+
+static int uhid_send(const struct uhid_event *ev)
+{
+    return write(uhid, ev, sizeof(*ev)) == sizeof(*ev);
+}
+
+static int uhid_input(const byte *data, int len)
+{
+    struct uhid_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type          = UHID_INPUT2;
+    ev.u.input2.size = len;
+    memcpy(ev.u.input2.data, data, len);
+    return uhid_send(&ev);
+}
+
+/* answer status requests, memory reads and writes like a bare wiimote */
+static void answer(const byte *out)
+{
+    /* factory calibration: zero at 0x80, 1g at 0x9A */
+    static const byte calibration[8] = {0x80, 0x80, 0x80, 0x00, 0x9A, 0x9A, 0x9A, 0x00};
+    byte in[22];
+
+    memset(in, 0, sizeof(in));
+    switch (out[0])
+    {
+    case WM_CMD_CTRL_STATUS:
+        in[0] = WM_RPT_CTRL_STATUS;
+        in[3] = 0x10; /* led 1 */
+        in[6] = 0xC0; /* battery */
+        uhid_input(in, 7);
+        break;
+
+    case WM_CMD_READ_DATA:
+        in[0] = WM_RPT_READ;
+        in[3] = (byte)((out[6] - 1) << 4);
+        in[4] = out[3];
+        in[5] = out[4];
+        if (!out[2] && !out[3] && (out[4] == WM_MEM_OFFSET_CALIBRATION) && (out[6] <= sizeof(calibration)))
+        {
+            memcpy(in + 6, calibration, out[6]);
+        }
+        uhid_input(in, 22);
+        break;
+
+    case WM_CMD_WRITE_DATA:
+        in[0] = WM_RPT_WRITE;
+        in[3] = WM_CMD_WRITE_DATA;
+        uhid_input(in, 5);
+        break;
+    }
+}
+
+static void *respond(void *arg)
+{
+    struct uhid_event ev;
+    (void)arg;
+
+    while (read(uhid, &ev, sizeof(ev)) > 0)
+    {
+        if (ev.type == UHID_OUTPUT)
+        {
+            answer(ev.u.output.data);
+        } else if ((ev.type == UHID_STOP) && destroyed)
+        {
+            /* a driver rebind stops it too, only the last stop counts */
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void create_fake(void)
+{
+    struct uhid_event ev;
+
+    destroyed = 0;
+    uhid      = open(UHID_PATH, O_RDWR | O_CLOEXEC);
+    ck_assert_int_ne(uhid, -1);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    strcpy((char *)ev.u.create2.name, "Nintendo RVL-CNT-01 (uhid)");
+    strcpy((char *)ev.u.create2.uniq, "00:1f:32:c0:ff:ee");
+    memcpy(ev.u.create2.rd_data, fake_rdesc, sizeof(fake_rdesc));
+    ev.u.create2.rd_size = sizeof(fake_rdesc);
+    ev.u.create2.bus     = 0x0005; /* BUS_BLUETOOTH */
+    ev.u.create2.vendor  = 0x057E;
+    ev.u.create2.product = 0x0306;
+    ck_assert(uhid_send(&ev));
+
+    ck_assert_int_eq(pthread_create(&responder, NULL, respond, NULL), 0);
+}
+
+static void destroy_fake(void)
+{
+    struct uhid_event ev;
+
+    destroyed = 1;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    uhid_send(&ev);
+
+    pthread_join(responder, NULL);
+    close(uhid);
+    uhid = -1;
+}
+
+/* the slot holding the fake, other wiimotes may be around */
+static struct wiimote_t *find_fake(struct wiimote_t **wm, int wiimotes)
+{
+    int i;
+
+    for (i = 0; i < wiimotes; ++i)
+    {
+        if (!strcmp(wm[i]->bdaddr_str, FAKE_ADDR))
+        {
+            return wm[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* poll until the fake gets an event */
+static int poll_fake(struct wiimote_t **wm, int wiimotes, struct wiimote_t *fake)
+{
+    int i;
+
+    for (i = 0; i < 1000; ++i)
+    {
+        wiiuse_poll(wm, wiimotes);
+        if (fake->event != WIIUSE_NONE)
+        {
+            return fake->event;
+        }
+    }
+
+    return WIIUSE_NONE;
+}
+
+START_TEST(test_find_fake)
+{
+    struct wiimote_t **wm = wiiuse_init(4);
+    struct wiimote_t *fake;
+
+    create_fake();
+
+    ck_assert_int_ge(wiiuse_find(wm, 4, 2), 1);
+    fake = find_fake(wm, 4);
+    ck_assert_ptr_nonnull(fake);
+    ck_assert_int_eq(fake->type, WIIUSE_WIIMOTE_REGULAR);
+    ck_assert(!strncmp(fake->devnode, "/dev/hidraw", 11));
+
+    destroy_fake();
+    wiiuse_cleanup(wm, 4);
+}
+END_TEST
+
+START_TEST(test_connect_and_read)
+{
+    static const byte button_a[3] = {WM_RPT_BTN, 0x00, 0x08};
+    struct wiimote_t **wm = wiiuse_init(4);
+    struct wiimote_t *fake;
+    int i;
+
+    create_fake();
+
+    wiiuse_find(wm, 4, 2);
+    fake = find_fake(wm, 4);
+    ck_assert_ptr_nonnull(fake);
+
+    /* only the fake, leave real wiimotes alone */
+    for (i = 0; i < 4; ++i)
+    {
+        if (wm[i] != fake)
+        {
+            WIIMOTE_DISABLE_STATE(wm[i], WIIMOTE_STATE_DEV_FOUND);
+        }
+    }
+
+    ck_assert_int_eq(wiiuse_connect(wm, 4), 1);
+    ck_assert(WIIMOTE_IS_SET(fake, WIIMOTE_STATE_HANDSHAKE_COMPLETE));
+    ck_assert_int_eq(fake->accel_calib.cal_zero.x, 0x80);
+    ck_assert_int_eq(fake->accel_calib.cal_g.x, 0x1A);
+
+    ck_assert(uhid_input(button_a, sizeof(button_a)));
+    ck_assert_int_eq(poll_fake(wm, 4, fake), WIIUSE_EVENT);
+    ck_assert(IS_PRESSED(fake, WIIMOTE_BUTTON_A));
+
+    /* unplugging shows up as a dropped connection */
+    destroy_fake();
+    ck_assert_int_eq(poll_fake(wm, 4, fake), WIIUSE_UNEXPECTED_DISCONNECT);
+    ck_assert(!WIIMOTE_IS_CONNECTED(fake));
+
+    wiiuse_cleanup(wm, 4);
+}
+END_TEST
+
+Suite *hidraw_uhid_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("HidrawUhid");
+    tc_core = tcase_create("Core");
+
+    /* the synchronous handshake takes a few seconds */
+    tcase_set_timeout(tc_core, 30);
+    tcase_add_test(tc_core, test_find_fake);
+    tcase_add_test(tc_core, test_connect_and_read);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    if (access(UHID_PATH, W_OK))
+    {
+        printf("%s not available, skipping.\n", UHID_PATH);
+        return 77;
+    }
+
+    s  = hidraw_uhid_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
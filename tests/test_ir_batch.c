@@ -0,0 +1,149 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* wiiuse internal headers for the per-report IR decoders */
+#include "wiiuse_internal.h"
+#include "ir.h"
+
+/*
+ * wiiuse_decode_ir_batch() must give the same raw dots as the
+ * per-report decoders. The report count is not a multiple of 4 so
+ * both the vector kernel and the scalar tail get used.
+ */
+
+#define REPORTS 37
+
+static byte payload[REPORTS][12];
+static const byte *payloads[REPORTS];
+
+static int16_t rx[REPORTS * 4];
+static int16_t ry[REPORTS * 4];
+static byte size[REPORTS * 4];
+static byte visible[REPORTS * 4];
+
+/* random payloads, every third dot out of range */
+static void fill_payloads(int extended)
+{
+    int n, d;
+
+    srand(1234);
+    for (n = 0; n < REPORTS; ++n)
+    {
+        for (d = 0; d < 12; ++d)
+        {
+            payload[n][d] = (byte)rand();
+        }
+
+        if (extended)
+        {
+            for (d = n % 3; d < 4; d += 3)
+            {
+                payload[n][3 * d + 1] = 0xFF;
+                payload[n][3 * d + 2] |= 0xC0;
+            }
+        } else if (n % 3)
+        {
+            /* second dot of each pair */
+            payload[n][4] = 0xFF;
+            payload[n][2] |= 0x0C;
+        }
+
+        payloads[n] = payload[n];
+    }
+}
+
+static void decode_batch(int extended)
+{
+    struct ir_dot_batch_t out;
+
+    out.rx      = rx;
+    out.ry      = ry;
+    out.size    = size;
+    out.visible = visible;
+    wiiuse_decode_ir_batch(payloads, REPORTS, extended, &out);
+}
+
+static void check_report(struct wiimote_t *wm, int n, int extended)
+{
+    int d, i;
+
+    for (d = 0; d < 4; ++d)
+    {
+        i = n * 4 + d;
+        ck_assert_int_eq(rx[i], wm->ir.dot[d].rx);
+        ck_assert_int_eq(ry[i], wm->ir.dot[d].ry);
+        ck_assert_int_eq(visible[i], wm->ir.dot[d].visible);
+        if (extended || visible[i])
+        {
+            ck_assert_int_eq(size[i], wm->ir.dot[d].size);
+        }
+    }
+}
+
+START_TEST(test_basic_matches)
+{
+    struct wiimote_t **wm = wiiuse_init(1);
+    int n;
+
+    fill_payloads(0);
+    decode_batch(0);
+
+    for (n = 0; n < REPORTS; ++n)
+    {
+        calculate_basic_ir(wm[0], payload[n]);
+        check_report(wm[0], n, 0);
+    }
+
+    wiiuse_cleanup(wm, 1);
+}
+END_TEST
+
+START_TEST(test_extended_matches)
+{
+    struct wiimote_t **wm = wiiuse_init(1);
+    int n;
+
+    fill_payloads(1);
+    decode_batch(1);
+
+    for (n = 0; n < REPORTS; ++n)
+    {
+        calculate_extended_ir(wm[0], payload[n]);
+        check_report(wm[0], n, 1);
+    }
+
+    wiiuse_cleanup(wm, 1);
+}
+END_TEST
+
+Suite *ir_batch_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("IrBatch");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_basic_matches);
+    tcase_add_test(tc_core, test_extended_matches);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s  = ir_batch_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
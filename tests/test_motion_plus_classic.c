@@ -0,0 +1,184 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* wiiuse internal headers for the expansion decoders */
+#include "wiiuse_internal.h"
+#include "classic.h"
+#include "motion_plus.h"
+
+/*
+ * Classic controller frames passed through a Motion Plus use a different
+ * bit layout: the lowest bit of both left stick axes carries d-pad up and
+ * left, and the lowest two bits of byte 5 tag the frame as expansion data.
+ * Decoding must give the same classic_ctrl_t state as the regular frame.
+ */
+
+/* idle controller: sticks centered, shoulders released, no buttons */
+static const byte idle_frame[6] = {0xA1, 0x21, 0x10, 0x00, 0xFF, 0xFC};
+
+/* same, with d-pad up, d-pad left and A held */
+static const byte up_left_a_frame[6] = {0xA0, 0x20, 0x10, 0x00, 0xFF, 0xEC};
+
+/* gyro frame with the extension bit set, as interleaved by the Motion Plus */
+static const byte gyro_frame[6] = {0x7A, 0x1F, 0x22, 0x7D, 0x7F, 0x7E};
+
+static void setup_mp(struct motion_plus_t *mp, struct classic_ctrl_t *cc)
+{
+    memset(mp, 0, sizeof(*mp));
+    memset(cc, 0, sizeof(*cc));
+    classic_ctrl_passthrough_calibration(cc);
+    mp->classic = cc;
+}
+
+/* build a regular and a pass-through frame for the same controller state */
+static void encode_frames(int lx, int ly, int rx, int ry, int lt, int rt, uint16_t btns, byte *native,
+                          byte *passthrough)
+{
+    uint16_t raw = ~btns;
+
+    native[0] = ((rx & 0x18) << 3) | lx;
+    native[1] = ((rx & 0x06) << 5) | ly;
+    native[2] = ((rx & 0x01) << 7) | ((lt & 0x18) << 2) | ry;
+    native[3] = ((lt & 0x07) << 5) | rt;
+    native[4] = raw >> 8;
+    native[5] = raw & 0xFF;
+
+    passthrough[0] = (native[0] & 0xFE) | (native[5] & 0x01);
+    passthrough[1] = (native[1] & 0xFE) | ((native[5] & 0x02) >> 1);
+    passthrough[2] = native[2];
+    passthrough[3] = native[3];
+    passthrough[4] = native[4] | 0x01;
+    passthrough[5] = native[5] & 0xFC;
+}
+
+START_TEST(test_passthrough_idle)
+{
+    struct motion_plus_t mp;
+    struct classic_ctrl_t cc;
+    byte msg[6];
+
+    setup_mp(&mp, &cc);
+    memcpy(msg, idle_frame, sizeof(msg));
+
+    ck_assert_int_eq(motion_plus_event(&mp, EXP_MOTION_PLUS_CLASSIC, msg), 0);
+    ck_assert_int_eq(mp.ext, 1);
+    ck_assert_int_eq(cc.btns, 0);
+    ck_assert_float_eq_tol(cc.ljs.x, 0.0f, 1e-6);
+    ck_assert_float_eq_tol(cc.ljs.y, 0.0f, 1e-6);
+    ck_assert_float_eq_tol(cc.rjs.x, 0.0f, 1e-6);
+    ck_assert_float_eq_tol(cc.rjs.y, 0.0f, 1e-6);
+    ck_assert_float_eq_tol(cc.l_shoulder, 0.0f, 1e-6);
+    ck_assert_float_eq_tol(cc.r_shoulder, 0.0f, 1e-6);
+}
+END_TEST
+
+START_TEST(test_passthrough_dpad_bits)
+{
+    struct motion_plus_t mp;
+    struct classic_ctrl_t cc;
+    byte msg[6];
+
+    setup_mp(&mp, &cc);
+    memcpy(msg, up_left_a_frame, sizeof(msg));
+
+    ck_assert_int_eq(motion_plus_event(&mp, EXP_MOTION_PLUS_CLASSIC, msg), 0);
+    ck_assert_int_eq(cc.btns, CLASSIC_CTRL_BUTTON_UP | CLASSIC_CTRL_BUTTON_LEFT | CLASSIC_CTRL_BUTTON_A);
+
+    /* the d-pad bits must not leak into the left stick */
+    ck_assert_float_eq_tol(cc.ljs.x, 0.0f, 1e-6);
+    ck_assert_float_eq_tol(cc.ljs.y, 0.0f, 1e-6);
+}
+END_TEST
+
+START_TEST(test_passthrough_matches_native)
+{
+    static const int sticks[][4] = {
+        {0, 0, 0, 0}, {62, 62, 31, 31}, {32, 32, 16, 16}, {10, 50, 3, 28}, {44, 6, 25, 9},
+    };
+    struct motion_plus_t mp;
+    struct classic_ctrl_t native_cc, mp_cc;
+    byte native[6], passthrough[6];
+    int i, bit;
+
+    for (i = 0; i < (int)(sizeof(sticks) / sizeof(sticks[0])); i++)
+    {
+        for (bit = -1; bit < 16; bit++)
+        {
+            uint16_t btns = (bit < 0) ? 0 : (uint16_t)(1 << bit);
+
+            if (btns & ~CLASSIC_CTRL_BUTTON_ALL)
+            {
+                continue;
+            }
+
+            encode_frames(sticks[i][0], sticks[i][1], sticks[i][2], sticks[i][3], (i * 7) & 0x1F, (i * 5) & 0x1F,
+                          btns, native, passthrough);
+
+            memset(&native_cc, 0, sizeof(native_cc));
+            classic_ctrl_passthrough_calibration(&native_cc);
+            classic_ctrl_event(&native_cc, native);
+
+            setup_mp(&mp, &mp_cc);
+            ck_assert_int_eq(motion_plus_event(&mp, EXP_MOTION_PLUS_CLASSIC, passthrough), 0);
+
+            ck_assert_int_eq(mp_cc.btns, native_cc.btns);
+            ck_assert_float_eq(mp_cc.ljs.x, native_cc.ljs.x);
+            ck_assert_float_eq(mp_cc.ljs.y, native_cc.ljs.y);
+            ck_assert_float_eq(mp_cc.rjs.x, native_cc.rjs.x);
+            ck_assert_float_eq(mp_cc.rjs.y, native_cc.rjs.y);
+            ck_assert_float_eq(mp_cc.l_shoulder, native_cc.l_shoulder);
+            ck_assert_float_eq(mp_cc.r_shoulder, native_cc.r_shoulder);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_gyro_frame_leaves_classic)
+{
+    struct motion_plus_t mp;
+    struct classic_ctrl_t cc;
+    byte msg[6];
+
+    setup_mp(&mp, &cc);
+    memcpy(msg, up_left_a_frame, sizeof(msg));
+    motion_plus_event(&mp, EXP_MOTION_PLUS_CLASSIC, msg);
+
+    memcpy(msg, gyro_frame, sizeof(msg));
+    ck_assert_int_eq(motion_plus_event(&mp, EXP_MOTION_PLUS_CLASSIC, msg), 1);
+    ck_assert_int_eq(cc.btns, CLASSIC_CTRL_BUTTON_UP | CLASSIC_CTRL_BUTTON_LEFT | CLASSIC_CTRL_BUTTON_A);
+}
+END_TEST
+
+Suite *motion_plus_classic_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("MotionPlusClassic");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_passthrough_idle);
+    tcase_add_test(tc_core, test_passthrough_dpad_bits);
+    tcase_add_test(tc_core, test_passthrough_matches_native);
+    tcase_add_test(tc_core, test_gyro_frame_leaves_classic);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s  = motion_plus_classic_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
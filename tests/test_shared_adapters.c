@@ -0,0 +1,269 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+/* wiiuse internal headers for the adapter list */
+#include "wiiuse_internal.h"
+#include "adapters.h"
+
+/*
+ * The workers of a poller place wiimotes on the adapter list of
+ * the context they were cloned from. Each one claims, gives back
+ * and recounts links on it at the same time: no adapter may ever
+ * go over its link limit, and at the end every adapter must hold
+ * exactly the links of the wiimotes bound to it.
+ *
+ * Worth running under -fsanitize=thread as well.
+ */
+
+#define ADAPTERS 4
+#define WORKERS 4
+#define WIIMOTES 16
+#define ROUNDS 200000
+
+struct worker_t
+{
+    struct wiiuse_context_t ctx;
+    struct wiimote_t wiimote[WIIMOTES];
+    struct wiimote_t *wm[WIIMOTES];
+    unsigned seed;
+    int full; /* claims refused because every adapter was full */
+    int over; /* times an adapter was seen over the limit */
+};
+
+static struct wiiuse_context_t *table;
+static struct worker_t worker[WORKERS];
+
+static void setup(void)
+{
+    struct wiiuse_adapter_t found[ADAPTERS];
+    int a;
+
+    table = wiiuse_context_create();
+    wiiuse_context_set_placement(table, WIIUSE_PLACE_LEAST_LOADED);
+
+    memset(found, 0, sizeof(found));
+    for (a = 0; a < ADAPTERS; ++a)
+    {
+        found[a].id = 10 + a;
+        strcpy(found[a].addr, "00:11:22:33:44:55");
+    }
+    adapter_update(table, found, ADAPTERS);
+}
+
+static void teardown(void) { wiiuse_context_destroy(table); }
+
+static void init_worker(struct worker_t *w, unsigned seed)
+{
+    int i;
+
+    memset(w, 0, sizeof(*w));
+    w->ctx.adapter_owner = table;
+    w->seed              = seed;
+
+    for (i = 0; i < WIIMOTES; ++i)
+    {
+        w->wiimote[i].adapter = -1;
+        w->wm[i]              = &w->wiimote[i];
+    }
+}
+
+static int over_limit(void)
+{
+    int over = 0;
+    int a;
+
+    adapter_lock(table);
+    for (a = 0; a < table->adapters; ++a)
+    {
+        over += (table->adapter[a].links > WIIUSE_ADAPTER_MAX_LINKS) || (table->adapter[a].links < 0);
+    }
+    adapter_unlock(table);
+
+    return over;
+}
+
+static void *work(void *arg)
+{
+    struct worker_t *w = (struct worker_t *)arg;
+    struct wiiuse_adapter_t adapter;
+    struct wiimote_t *wm;
+    int r;
+
+    for (r = 0; r < ROUNDS; ++r)
+    {
+        wm = w->wm[rand_r(&w->seed) % WIIMOTES];
+
+        if (wm->adapter < 0)
+        {
+            /* a connect */
+            if (adapter_claim(&w->ctx, &adapter) == 1)
+            {
+                wm->adapter = adapter.id;
+            } else
+            {
+                ++w->full;
+            }
+        } else
+        {
+            /* a link that went away */
+            adapter_release(&w->ctx, wm->adapter);
+            wm->adapter = -1;
+        }
+
+        if (!(r % 64))
+        {
+            adapter_sync_links(&w->ctx, w->wm, WIIMOTES);
+            w->over += over_limit();
+        }
+    }
+
+    return NULL;
+}
+
+/* links bound to adapter id, over all workers */
+static int bound(int id)
+{
+    int n = 0;
+    int k, i;
+
+    for (k = 0; k < WORKERS; ++k)
+    {
+        for (i = 0; i < WIIMOTES; ++i)
+        {
+            n += (worker[k].wiimote[i].adapter == id);
+        }
+    }
+
+    return n;
+}
+
+START_TEST(test_concurrent_placement)
+{
+    pthread_t thread[WORKERS];
+    int full = 0;
+    int k, a;
+
+    for (k = 0; k < WORKERS; ++k)
+    {
+        init_worker(&worker[k], 1234 + k);
+    }
+
+    for (k = 0; k < WORKERS; ++k)
+    {
+        ck_assert_int_eq(pthread_create(&thread[k], NULL, work, &worker[k]), 0);
+    }
+
+    for (k = 0; k < WORKERS; ++k)
+    {
+        pthread_join(thread[k], NULL);
+        ck_assert_int_eq(worker[k].over, 0);
+        full += worker[k].full;
+    }
+
+    /* 64 wiimotes on 28 links, some connects had to be refused */
+    ck_assert_int_gt(full, 0);
+
+    for (a = 0; a < ADAPTERS; ++a)
+    {
+        ck_assert_int_le(table->adapter[a].links, WIIUSE_ADAPTER_MAX_LINKS);
+        ck_assert_int_eq(table->adapter[a].links, bound(table->adapter[a].id));
+    }
+}
+END_TEST
+
+START_TEST(test_move_keeps_counts)
+{
+    struct wiiuse_context_t *owner = table;
+    struct wiiuse_adapter_t adapter;
+    struct worker_t *w = &worker[0];
+    int i;
+
+    init_worker(w, 1);
+
+    /* the original context connects three wiimotes, then hands two to a worker */
+    for (i = 0; i < 3; ++i)
+    {
+        ck_assert_int_eq(adapter_claim(owner, &adapter), 1);
+        w->wiimote[i].adapter = adapter.id;
+    }
+
+    adapter_move(owner, &w->ctx, w->wm[0]);
+    adapter_move(owner, &w->ctx, w->wm[1]);
+
+    ck_assert_int_eq(table->adapter[0].links + table->adapter[1].links + table->adapter[2].links, 3);
+
+    /* the worker recounts its two, the third stays with the original */
+    adapter_sync_links(&w->ctx, w->wm, 2);
+    adapter_sync_links(owner, &w->wm[2], 1);
+    ck_assert_int_eq(table->adapter[0].links + table->adapter[1].links + table->adapter[2].links, 3);
+
+    /* and gives them back when it stops */
+    adapter_move(&w->ctx, owner, w->wm[0]);
+    adapter_move(&w->ctx, owner, w->wm[1]);
+    adapter_sync_links(&w->ctx, NULL, 0);
+    adapter_sync_links(owner, w->wm, 3);
+    ck_assert_int_eq(table->adapter[0].links + table->adapter[1].links + table->adapter[2].links, 3);
+
+    for (i = 0; i < 3; ++i)
+    {
+        adapter_release(owner, w->wiimote[i].adapter);
+    }
+    ck_assert_int_eq(table->adapter[0].links + table->adapter[1].links + table->adapter[2].links, 0);
+}
+END_TEST
+
+START_TEST(test_update_keeps_links)
+{
+    struct wiiuse_adapter_t adapter, found[2];
+
+    ck_assert_int_eq(adapter_claim(table, &adapter), 1);
+    ck_assert_int_eq(adapter.id, 10);
+
+    /* hci11 went down, hci20 came up */
+    memset(found, 0, sizeof(found));
+    found[0].id = 20;
+    found[1].id = 10;
+    adapter_update(table, found, 2);
+
+    ck_assert_int_eq(table->adapters, 2);
+    ck_assert_int_eq(table->adapter[0].links, 0);
+    ck_assert_int_eq(table->adapter[1].links, 1);
+}
+END_TEST
+
+Suite *shared_adapters_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("SharedAdapters");
+    tc_core = tcase_create("Core");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_set_timeout(tc_core, 60);
+    tcase_add_test(tc_core, test_concurrent_placement);
+    tcase_add_test(tc_core, test_move_keeps_counts);
+    tcase_add_test(tc_core, test_update_keeps_links);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s  = shared_adapters_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,142 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* wiiuse internal headers for the balance board decoder */
+#include "wiiuse_internal.h"
+#include "wiiboard.h"
+
+/*
+ * With center of pressure tracking on, the corner weights come from
+ * gains precomputed out of the calibration instead of the divides of
+ * the regular path. Both must give the same weights.
+ */
+
+/* calibration of a real board: 0 kg, 17 kg and 34 kg per sensor */
+static const uint16_t calib[4][3] = {
+    {3520, 5208, 6902}, /* top left */
+    {4650, 6331, 8018}, /* top right */
+    {2873, 4551, 6235}, /* bottom left */
+    {5108, 6802, 8500}, /* bottom right */
+};
+
+static void setup_board(struct wii_board_t *wb, int cop)
+{
+    memset(wb, 0, sizeof(*wb));
+    memcpy(wb->ctl, calib[0], sizeof(wb->ctl));
+    memcpy(wb->ctr, calib[1], sizeof(wb->ctr));
+    memcpy(wb->cbl, calib[2], sizeof(wb->cbl));
+    memcpy(wb->cbr, calib[3], sizeof(wb->cbr));
+
+    if (cop)
+    {
+        wb->cop_enabled    = 1;
+        wb->cop_decimation = 1;
+        wb->cop_inv_n      = 1.0f;
+        wii_board_calc_gains(wb);
+    }
+}
+
+/* report payload, sensors in the order the board sends them */
+static void board_report(byte *msg, uint16_t tl, uint16_t tr, uint16_t bl, uint16_t br)
+{
+    to_big_endian_uint16_t(msg, tr);
+    to_big_endian_uint16_t(msg + 2, br);
+    to_big_endian_uint16_t(msg + 4, tl);
+    to_big_endian_uint16_t(msg + 6, bl);
+}
+
+START_TEST(test_gains_match_interpolation)
+{
+    struct wii_board_t slow, fast;
+    byte msg[8];
+    int raw;
+
+    setup_board(&slow, 0);
+    setup_board(&fast, 1);
+
+    /* below zero, both segments, the knees and above the top */
+    for (raw = 0; raw <= 10000; raw += 7)
+    {
+        board_report(msg, (uint16_t)raw, (uint16_t)(raw + 1), (uint16_t)(raw + 2), (uint16_t)(raw + 3));
+        wii_board_event(&slow, msg);
+        wii_board_event(&fast, msg);
+
+        ck_assert_float_eq_tol(fast.tl, slow.tl, 1e-3);
+        ck_assert_float_eq_tol(fast.tr, slow.tr, 1e-3);
+        ck_assert_float_eq_tol(fast.bl, slow.bl, 1e-3);
+        ck_assert_float_eq_tol(fast.br, slow.br, 1e-3);
+    }
+}
+END_TEST
+
+START_TEST(test_cop_of_corners)
+{
+    struct wii_board_t wb;
+    byte msg[8];
+
+    setup_board(&wb, 1);
+
+    /* 17 kg on every corner */
+    board_report(msg, calib[0][1], calib[1][1], calib[2][1], calib[3][1]);
+    wii_board_event(&wb, msg);
+    ck_assert(wb.cop_ready);
+    ck_assert_float_eq_tol(wb.total, 68.0f, 1e-3);
+    ck_assert_float_eq_tol(wb.cop_x, 0.0f, 1e-5);
+    ck_assert_float_eq_tol(wb.cop_y, 0.0f, 1e-5);
+
+    /* all of it on the right */
+    board_report(msg, calib[0][0], calib[1][1], calib[2][0], calib[3][1]);
+    wii_board_event(&wb, msg);
+    ck_assert_float_eq_tol(wb.cop_x, 1.0f, 1e-5);
+    ck_assert_float_eq_tol(wb.cop_y, 0.0f, 1e-5);
+}
+END_TEST
+
+START_TEST(test_calib_sets_gains_when_send_fails)
+{
+    struct wiimote_t **wm = wiiuse_init(1);
+    struct wii_board_t *wb = &wm[0]->exp.wb;
+
+    /* not connected, so writing the calibration to the board fails */
+    setup_board(wb, 0);
+    wiiuse_set_wii_board_calib(wm[0]);
+
+    ck_assert_int_eq(wb->gain[0].knee, calib[0][1]);
+    ck_assert_int_eq(wb->gain[3].top, calib[3][2]);
+
+    wiiuse_cleanup(wm, 1);
+}
+END_TEST
+
+Suite *wii_board_cop_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s       = suite_create("WiiBoardCop");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_gains_match_interpolation);
+    tcase_add_test(tc_core, test_cop_of_corners);
+    tcase_add_test(tc_core, test_calib_sets_gains_when_send_fails);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s  = wii_board_cop_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}